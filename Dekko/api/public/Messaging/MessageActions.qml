@@ -123,6 +123,13 @@ ActionCreator {
 
     signal setMessageListFilter(int filter)
 
+    /* Tell the message list which rows are on screen.
+
+       Call this as the list view scrolls, messages on screen and around it
+       are then fetched ahead of time so they open instantly.
+    */
+    signal setMessageListVisibleRange(int first, int last)
+
     signal rewindMessageListStack()
 
     signal startMultiSelection()
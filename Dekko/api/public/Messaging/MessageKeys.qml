@@ -45,6 +45,7 @@ KeyTable {
     property string setMessageCheck
     property string showMoreMessages
     property string setMessageListFilter
+    property string setMessageListVisibleRange
     property string rewindMessageListStack
     property string startMultiSelection
     property string endMultiSelection
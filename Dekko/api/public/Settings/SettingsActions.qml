@@ -33,6 +33,7 @@ ActionCreator {
     signal saveSelectedAccount()
     signal detectStandardFolders()
     signal createStandardFolders(int accountId)
+    signal clearCache(string name)
 
     signal saveCurrentGroup()
     signal saveCurrentGroupNow()
@@ -32,6 +32,7 @@ KeyTable {
     property string saveSelectedAccount
     property string detectStandardFolders
     property string createStandardFolders
+    property string clearCache
 
 
     property string saveCurrentGroup
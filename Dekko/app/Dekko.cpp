@@ -30,6 +30,9 @@
 #include <QDir>
 #include <SnapStandardPaths.h>
 #include <PluginRegistry.h>
+#include <LocalMailService.h>
+#include <Metrics.h>
+#include <Trace.h>
 
 #define SMALL_FF_WIDTH 350
 #define MEDIUM_FF_WDTH 800
@@ -85,6 +88,16 @@ Dekko::Dekko(int &argc, char **argv) :
         else
             qputenv("QT_LOGGING_RULES", "dekko.*=true");
 
+    // Always on, the snapshots are small and are what we get back from the field
+    Metrics::start(QStringLiteral("dekko"),
+                   SnapStandardPaths::writableLocation(SnapStandardPaths::AppCacheLocation) + QStringLiteral("/metrics"));
+
+    if (m_verboseLogging) {
+        // Has to happen before dekkod and the worker are started so they trace too
+        Trace::start(QStringLiteral("dekko"),
+                     SnapStandardPaths::writableLocation(SnapStandardPaths::AppCacheLocation) + QStringLiteral("/traces"));
+    }
+
 }
 
 Dekko::~Dekko(){
@@ -134,7 +147,10 @@ bool Dekko::setup()
 
     if (!isWorkerRunning()) {
         qCDebug(DEKKO_MAIN) << "[Dekko]" << "Message worker not running attempting to start";
-        if (!startWorker()) {
+        if (LocalMailService::enabled() && LocalMailService::start()) {
+            // Must happen before anything touches Client::instance()
+            qCDebug(DEKKO_MAIN) << "[Dekko]" << "Message worker running in process";
+        } else if (!startWorker()) {
             qCDebug(DEKKO_MAIN) << "[Dekko]" << "Message worker failed to start";
             return false;
         } else {
@@ -0,0 +1,219 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "AccountRegistry.h"
+#include <QPointer>
+#include <algorithm>
+#include <qmailaccountconfiguration.h>
+#include <qmailfolderkey.h>
+#include <qmailserviceconfiguration.h>
+#include <qmailstore.h>
+#include "Account.h"
+#include "AccountConfiguration.h"
+
+Q_LOGGING_CATEGORY(D_ACCOUNT_REGISTRY, "dekko.accounts.registry")
+
+AccountRegistry::AccountRegistry(QObject *parent) : QObject(parent)
+{
+    connect(QMailStore::instance(),
+            SIGNAL(accountsAdded(QMailAccountIdList)),
+            this,
+            SLOT(accountsAdded(QMailAccountIdList)));
+    connect(QMailStore::instance(),
+            SIGNAL(accountsRemoved(QMailAccountIdList)),
+            this,
+            SLOT(accountsRemoved(QMailAccountIdList)));
+    connect(QMailStore::instance(),
+            SIGNAL(accountsUpdated(QMailAccountIdList)),
+            this,
+            SLOT(accountsUpdated(QMailAccountIdList)));
+    connect(QMailStore::instance(),
+            SIGNAL(foldersRemoved(QMailFolderIdList)),
+            this,
+            SLOT(foldersRemoved(QMailFolderIdList)));
+    reload();
+}
+
+static QPointer<AccountRegistry> s_registry;
+AccountRegistry *AccountRegistry::instance()
+{
+    if (s_registry.isNull()) {
+        s_registry = new AccountRegistry();
+    }
+    return s_registry;
+}
+
+bool AccountRegistry::contains(const QMailAccountId &id) const
+{
+    return m_accounts.contains(id);
+}
+
+AccountInfo AccountRegistry::account(const QMailAccountId &id) const
+{
+    return m_accounts.value(id);
+}
+
+QMailAccountIdList AccountRegistry::accountIds(const quint64 &statusMask) const
+{
+    if (!statusMask) {
+        return m_ids;
+    }
+    QMailAccountIdList ids;
+    Q_FOREACH(const QMailAccountId &id, m_ids) {
+        if (testStatus(id, statusMask)) {
+            ids << id;
+        }
+    }
+    return ids;
+}
+
+QString AccountRegistry::name(const QMailAccountId &id) const
+{
+    return m_accounts.value(id).name;
+}
+
+quint64 AccountRegistry::status(const QMailAccountId &id) const
+{
+    return m_accounts.value(id).status;
+}
+
+bool AccountRegistry::testStatus(const QMailAccountId &id, const quint64 &mask) const
+{
+    return (status(id) & mask) == mask;
+}
+
+QMailFolderId AccountRegistry::standardFolder(const QMailAccountId &id, const QMailFolder::StandardFolder &folder) const
+{
+    QHash<QMailAccountId, AccountInfo>::const_iterator it = m_accounts.constFind(id);
+    if (it == m_accounts.constEnd()) {
+        return QMailFolderId();
+    }
+    return it->standardFolders.value(folder);
+}
+
+void AccountRegistry::reload()
+{
+    qCDebug(D_ACCOUNT_REGISTRY) << "Loading all accounts";
+    m_accounts.clear();
+    m_ids.clear();
+    Q_FOREACH(const QMailAccountId &id, QMailStore::instance()->queryAccounts()) {
+        load(id);
+    }
+    sortIds();
+    emit accountsChanged(m_ids);
+}
+
+void AccountRegistry::accountsAdded(const QMailAccountIdList &ids)
+{
+    Q_FOREACH(const QMailAccountId &id, ids) {
+        load(id);
+    }
+    sortIds();
+    emit accountsChanged(ids);
+}
+
+void AccountRegistry::accountsUpdated(const QMailAccountIdList &ids)
+{
+    // Updates can change the name so we need to resort as well
+    accountsAdded(ids);
+}
+
+void AccountRegistry::accountsRemoved(const QMailAccountIdList &ids)
+{
+    Q_FOREACH(const QMailAccountId &id, ids) {
+        m_accounts.remove(id);
+        m_ids.removeAll(id);
+    }
+    emit accountsChanged(ids);
+}
+
+void AccountRegistry::foldersRemoved(const QMailFolderIdList &ids)
+{
+    // We only need to care about this if a standard folder went away
+    QMailAccountIdList affected;
+    Q_FOREACH(const AccountInfo &info, m_accounts) {
+        Q_FOREACH(const QMailFolderId &folderId, info.standardFolders) {
+            if (ids.contains(folderId)) {
+                affected << info.id;
+                break;
+            }
+        }
+    }
+    if (!affected.isEmpty()) {
+        accountsUpdated(affected);
+    }
+}
+
+void AccountRegistry::load(const QMailAccountId &id)
+{
+    QMailAccount account(id);
+    if (!account.id().isValid()) {
+        m_accounts.remove(id);
+        m_ids.removeAll(id);
+        return;
+    }
+    AccountInfo info;
+    info.id = account.id();
+    info.name = account.name();
+    info.status = account.status();
+    info.fromAddress = account.fromAddress();
+    info.signature = account.signature();
+
+    QMailFolderIdList standardIds;
+    QMap<QMailFolder::StandardFolder, QMailFolderId> folders = account.standardFolders();
+    QMap<QMailFolder::StandardFolder, QMailFolderId>::const_iterator it = folders.constBegin();
+    for (; it != folders.constEnd(); ++it) {
+        if (it.value().isValid()) {
+            standardIds << it.value();
+        }
+    }
+    // One query to drop any standard folders that no longer exist
+    QMailFolderIdList existing;
+    if (!standardIds.isEmpty()) {
+        existing = QMailStore::instance()->queryFolders(QMailFolderKey::id(standardIds));
+    }
+    for (it = folders.constBegin(); it != folders.constEnd(); ++it) {
+        if (existing.contains(it.value())) {
+            info.standardFolders.insert(it.key(), it.value());
+        }
+    }
+
+    QMailAccountConfiguration config(id);
+    QString recvType;
+    if (config.services().contains(Account::imapServiceType)) {
+        recvType = Account::imapServiceType;
+    } else if (config.services().contains(Account::popServiceType)) {
+        recvType = Account::popServiceType;
+    }
+    if (!recvType.isEmpty()) {
+        QMailServiceConfiguration incoming(&config, recvType);
+        info.incomingName = incoming.value(AccountKeys::name);
+        info.incomingEmail = incoming.value(AccountKeys::email);
+    }
+
+    m_accounts.insert(id, info);
+    if (!m_ids.contains(id)) {
+        m_ids << id;
+    }
+}
+
+void AccountRegistry::sortIds()
+{
+    std::sort(m_ids.begin(), m_ids.end(), [this](const QMailAccountId &a, const QMailAccountId &b) {
+        return QString::localeAwareCompare(m_accounts.value(a).name, m_accounts.value(b).name) < 0;
+    });
+}
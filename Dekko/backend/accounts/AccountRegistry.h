@@ -0,0 +1,98 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ACCOUNTREGISTRY_H
+#define ACCOUNTREGISTRY_H
+
+#include <QLoggingCategory>
+#include <QObject>
+#include <QHash>
+#include <qmailaccount.h>
+#include <qmailaddress.h>
+#include <qmailfolder.h>
+
+Q_DECLARE_LOGGING_CATEGORY(D_ACCOUNT_REGISTRY)
+
+/** @ingroup group_accounts
+ *
+ * @short Snapshot of the account data that is read on hot paths
+ */
+struct AccountInfo {
+    AccountInfo() : status(0) {}
+    bool isValid() const { return id.isValid(); }
+
+    QMailAccountId id;
+    QString name;
+    quint64 status;
+    QMailAddress fromAddress;
+    QString signature;
+    // Name & email from the incoming service configuration
+    QString incomingName;
+    QString incomingEmail;
+    // Only contains standard folders that exist in the store
+    QHash<int, QMailFolderId> standardFolders;
+};
+
+/** @ingroup group_accounts
+ *
+ * @short In-process registry of all accounts in the mail store
+ *
+ * Every account is loaded once and then kept up to date from the
+ * QMailStore accountsAdded/Updated/Removed signals. Lookups are
+ * served from memory so callers on hot paths (list delegates, the composer,
+ * submission) no longer need to construct a QMailAccount each time.
+ */
+class AccountRegistry : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AccountRegistry(QObject *parent = 0);
+
+    static AccountRegistry *instance();
+
+    bool contains(const QMailAccountId &id) const;
+    AccountInfo account(const QMailAccountId &id) const;
+    /** @short Ids of all accounts matching \param statusMask, ordered by name */
+    QMailAccountIdList accountIds(const quint64 &statusMask = 0) const;
+
+    QString name(const QMailAccountId &id) const;
+    quint64 status(const QMailAccountId &id) const;
+    bool testStatus(const QMailAccountId &id, const quint64 &mask) const;
+    QMailFolderId standardFolder(const QMailAccountId &id, const QMailFolder::StandardFolder &folder) const;
+
+signals:
+    void accountsChanged(const QMailAccountIdList &ids);
+
+public slots:
+    void reload();
+
+private slots:
+    void accountsAdded(const QMailAccountIdList &ids);
+    void accountsUpdated(const QMailAccountIdList &ids);
+    void accountsRemoved(const QMailAccountIdList &ids);
+    void foldersRemoved(const QMailFolderIdList &ids);
+
+private:
+    void load(const QMailAccountId &id);
+    void sortIds();
+
+    QHash<QMailAccountId, AccountInfo> m_accounts;
+    // Kept sorted by name
+    QMailAccountIdList m_ids;
+};
+
+#endif // ACCOUNTREGISTRY_H
@@ -21,8 +21,11 @@
 Q_LOGGING_CATEGORY(D_ACCOUNTS_VALIDATOR, "dekko.accounts.validator")
 
 AccountValidator::AccountValidator(QObject *parent) : QObject(parent),
-    m_inProgress(false), m_state(None), m_timer(new QTimer(this))
+    m_inProgress(false), m_incomingValid(false), m_outgoingValid(false),
+    m_state(None), m_timer(new QTimer(this))
 {
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &AccountValidator::handleTimeout);
 }
 
 void AccountValidator::validateAccount(Account *account)
@@ -32,16 +35,29 @@ void AccountValidator::validateAccount(Account *account)
         emit failed(AccountConfiguration::IMAP, ValidationAlreadyInProgress);
         return;
     }
+    if (backgroundTasksRunning()) {
+        // A previous account is still syncing it's folders. That's not
+        // something we need to wait on so just let it go.
+        qCDebug(D_ACCOUNTS_VALIDATOR) << "Abandoning background tasks for previous account";
+        cleanUp();
+    }
     setInProgress(true);
     m_account = account;
     init();
     if (m_account->accountId().isValid()) {
         m_timer->start(60 * 1000);
-        qCDebug(D_ACCOUNTS_VALIDATOR) << "Retrieving folder list for account" << m_account->id();
-        m_retrievelAction->retrieveFolderList(m_account->accountId(), QMailFolderId(), true);
-        m_state = RetrieveFolderList;
+        m_totalTime.start();
+        m_stageTime.start();
+        setState(CheckConnections);
+        // Both services are independent so check them at the same time.
+        // A shallow folder list is enough to prove the IMAP login, the full
+        // list isn't needed until after the account is saved.
+        qCDebug(D_ACCOUNTS_VALIDATOR) << "Checking incoming & outgoing connections for account" << m_account->id();
+        m_retrievelAction->retrieveFolderList(m_account->accountId(), QMailFolderId(), false);
+        m_transmitAction->transmitMessages(m_account->accountId());
     } else {
         qCWarning(D_ACCOUNTS_VALIDATOR) << "Validation failed for account" << m_account->id();
+        setInProgress(false);
         emit validationFailed();
         emit failed(static_cast<AccountConfiguration *>(m_account->incoming())->serviceType(), AccountInvalid);
     }
@@ -49,75 +65,150 @@ void AccountValidator::validateAccount(Account *account)
 
 void AccountValidator::handleAccountActivity(QMailServiceAction::Activity activity)
 {
+    if (activity != QMailServiceAction::Successful && activity != QMailServiceAction::Failed) {
+        return;
+    }
     if (static_cast<QObject *>(m_retrievelAction) == sender()) {
-        if (activity == QMailServiceAction::Successful) {
-            switch(m_state) {
-            case RetrieveFolderList:
-            {
-                // Success retrieving folders so create the standard folders
-                m_state = CreateStandardFolders;
-                QTimer::singleShot(2000, this, &AccountValidator::createStandardFolders);
-                qCDebug(D_ACCOUNTS_VALIDATOR) << "Folder list retrieved";
-                break;
-            }
-            case CreateStandardFolders:
-            {
-                // Incomings good
-                m_state = TransmitMessage;
-                QTimer::singleShot(1000, this, &AccountValidator::testTransmission);
-                qCDebug(D_ACCOUNTS_VALIDATOR) << "Standard Folders created";
-                break;
-            }
-            case TransmitMessage:
-            {
-                break;
-            }
-            case None:
-                break;
-            }
-        } else if (activity == QMailServiceAction::Failed) {
-            qCDebug(D_ACCOUNTS_VALIDATOR) << __func__ << "FAILED";
+        if (activity == QMailServiceAction::Failed) {
+            qCWarning(D_ACCOUNTS_VALIDATOR) << "Retrieval failed:" << m_retrievelAction->status().text;
             AccountConfiguration *incoming = static_cast<AccountConfiguration *>(m_account->incoming());
             testFailed(incoming->serviceType(), m_retrievelAction->status());
+            return;
+        }
+        switch(m_state) {
+        case CheckConnections:
+            recordTiming(QStringLiteral("imapLogin"), m_totalTime);
+            qCDebug(D_ACCOUNTS_VALIDATOR) << "Incoming connection valid";
+            m_incomingValid = true;
+            checkConnectionsComplete();
+            break;
+        case RetrieveFolderList:
+            recordTiming(QStringLiteral("folderList"), m_stageTime);
+            qCDebug(D_ACCOUNTS_VALIDATOR) << "Folder list retrieved";
+            // The folder list is now in the store so we can go straight
+            // on to creating the standard folders
+            m_stageTime.restart();
+            setState(CreateStandardFolders);
+            qCDebug(D_ACCOUNTS_VALIDATOR) << "Creating standard folders for account: " << m_account->id();
+            m_retrievelAction->createStandardFolders(m_account->accountId());
+            break;
+        case CreateStandardFolders:
+            recordTiming(QStringLiteral("standardFolders"), m_stageTime);
+            recordTiming(QStringLiteral("total"), m_totalTime);
+            qCDebug(D_ACCOUNTS_VALIDATOR) << "Standard Folders created";
+            setState(None);
+            cleanUp();
+            emit backgroundTasksComplete();
+            break;
+        case None:
+            break;
         }
     } else if (static_cast<QObject *>(m_transmitAction) == sender()) {
+        if (m_state != CheckConnections) {
+            return;
+        }
         if (activity == QMailServiceAction::Successful) {
-            if (m_state == TransmitMessage) {
-                // Yay!!!
-                m_timer->stop();
-                emit success();
-                qCDebug(D_ACCOUNTS_VALIDATOR) << "Transmission completed";
-                setInProgress(false);
-                cleanUp();
-                return;
-            }
-        } else if (activity == QMailServiceAction::Failed) {
-            qCWarning(D_ACCOUNTS_VALIDATOR) << "Transmission failed:" << m_retrievelAction->status().text;
+            recordTiming(QStringLiteral("smtpAuth"), m_totalTime);
+            qCDebug(D_ACCOUNTS_VALIDATOR) << "Transmission completed";
+            m_outgoingValid = true;
+            checkConnectionsComplete();
+        } else {
+            qCWarning(D_ACCOUNTS_VALIDATOR) << "Transmission failed:" << m_transmitAction->status().text;
             AccountConfiguration *outgoing = static_cast<AccountConfiguration *>(m_account->outgoing());
-            testFailed(outgoing->serviceType(), m_retrievelAction->status());
+            testFailed(outgoing->serviceType(), m_transmitAction->status());
         }
     }
 }
 
-void AccountValidator::createStandardFolders()
+void AccountValidator::handleTimeout()
 {
-    qCDebug(D_ACCOUNTS_VALIDATOR) << "Creating standard folders for account: " << m_account->id();
-    m_retrievelAction->createStandardFolders(m_account->accountId());
+    if (!m_inProgress) {
+        return;
+    }
+    AccountConfiguration *conf = 0;
+    if (m_incomingValid && !m_outgoingValid) {
+        conf = static_cast<AccountConfiguration *>(m_account->outgoing());
+    } else {
+        conf = static_cast<AccountConfiguration *>(m_account->incoming());
+    }
+    qCWarning(D_ACCOUNTS_VALIDATOR) << "Validation timed out for account" << m_account->id();
+    setState(None);
+    setInProgress(false);
+    emit failed(conf->serviceType(), Timeout);
+    emit validationFailed();
+    cleanUp();
 }
 
-void AccountValidator::testTransmission()
+void AccountValidator::checkConnectionsComplete()
 {
-    qCDebug(D_ACCOUNTS_VALIDATOR) << "Tesing transmission for account: " << m_account->id();
-    m_transmitAction->transmitMessages(m_account->accountId());
+    if (!m_incomingValid || !m_outgoingValid) {
+        return;
+    }
+    // Yay!!!
+    m_timer->stop();
+    recordTiming(QStringLiteral("checkConnections"), m_stageTime);
+    setInProgress(false);
+    setState(None);
+    emit success();
+}
+
+void AccountValidator::startBackgroundTasks()
+{
+    if (!m_account || !m_retrievelAction || m_state != None) {
+        // Nothing validated to carry on with, don't hold up the caller
+        qCWarning(D_ACCOUNTS_VALIDATOR) << "No validated account to run background tasks for";
+        emit backgroundTasksComplete();
+        return;
+    }
+    qCDebug(D_ACCOUNTS_VALIDATOR) << "Retrieving full folder list for account" << m_account->id();
+    m_stageTime.restart();
+    setState(RetrieveFolderList);
+    m_retrievelAction->retrieveFolderList(m_account->accountId(), QMailFolderId(), true);
+}
+
+void AccountValidator::cancelBackgroundTasks()
+{
+    if (!backgroundTasksRunning()) {
+        return;
+    }
+    qCDebug(D_ACCOUNTS_VALIDATOR) << "Cancelling background tasks for account" << m_account->id();
+    setState(None);
+    cleanUp();
+}
+
+void AccountValidator::setState(const AccountValidator::State state)
+{
+    bool wasRunning = backgroundTasksRunning();
+    m_state = state;
+    if (wasRunning != backgroundTasksRunning()) {
+        emit backgroundTasksRunningChanged();
+    }
+}
+
+void AccountValidator::recordTiming(const QString &stage, const QElapsedTimer &timer)
+{
+    m_stageTimings.insert(stage, timer.elapsed());
+    qCDebug(D_ACCOUNTS_VALIDATOR) << "Stage" << stage << "took" << timer.elapsed() << "ms";
+    emit stageTimingsChanged();
 }
 
 void AccountValidator::testFailed(AccountConfiguration::ServiceType serviceType, QMailServiceAction::Status status)
 {
     Q_UNUSED(serviceType);
+    if (backgroundTasksRunning()) {
+        // The account has already been validated, the folder list will
+        // get another go on the next sync so don't fail the account for it.
+        qCWarning(D_ACCOUNTS_VALIDATOR) << "Background tasks failed for account" << m_account->id();
+        setState(None);
+        cleanUp();
+        emit backgroundTasksComplete();
+        return;
+    }
     qCDebug(D_ACCOUNTS_VALIDATOR) << "Test failed :-(";
     if (!m_inProgress) {
         return;
     }
+    setState(None);
     setInProgress(false);
     m_timer->stop();
     emit validationFailed();
@@ -128,34 +219,32 @@ void AccountValidator::testFailed(AccountConfiguration::ServiceType serviceType,
 void AccountValidator::init()
 {
     qCDebug(D_ACCOUNTS_VALIDATOR) << "Initialising validator";
+    m_incomingValid = false;
+    m_outgoingValid = false;
+    m_stageTimings.clear();
+    emit stageTimingsChanged();
     m_retrievelAction = new QMailRetrievalAction(this);
     connect(m_retrievelAction, &QMailRetrievalAction::activityChanged, this, &AccountValidator::handleAccountActivity);
     m_transmitAction = new QMailTransmitAction(this);
     connect(m_transmitAction, &QMailTransmitAction::activityChanged, this, &AccountValidator::handleAccountActivity);
-    connect(m_timer, &QTimer::timeout, [=]() {
-        m_timer->stop();
-          if (m_retrievelAction->isRunning()) {
-              m_retrievelAction->cancelOperation();
-          }
-          if (m_transmitAction->isRunning()) {
-              m_transmitAction->cancelOperation();
-          }
-          AccountConfiguration *conf = 0;
-          if (m_state == TransmitMessage) {
-                conf = static_cast<AccountConfiguration *>(m_account->outgoing());
-          } else {
-              conf = static_cast<AccountConfiguration *>(m_account->incoming());
-          }
-          emit failed(conf->serviceType(), Timeout);
-          setInProgress(false);
-          cleanUp();
-    });
 }
 
 void AccountValidator::cleanUp()
 {
     qCDebug(D_ACCOUNTS_VALIDATOR) << "Cleaning up...";
-    m_retrievelAction->deleteLater();
-    m_transmitAction->deleteLater();
+    // Fast fail, whatever is left running is of no use now.
+    if (m_retrievelAction) {
+        m_retrievelAction->disconnect(this);
+        if (m_retrievelAction->isRunning()) {
+            m_retrievelAction->cancelOperation();
+        }
+        m_retrievelAction->deleteLater();
+    }
+    if (m_transmitAction) {
+        m_transmitAction->disconnect(this);
+        if (m_transmitAction->isRunning()) {
+            m_transmitAction->cancelOperation();
+        }
+        m_transmitAction->deleteLater();
+    }
 }
-
@@ -22,16 +22,32 @@
 #include <QObject>
 #include <QPointer>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QVariantMap>
 #include <qmailserviceaction.h>
 #include "Account.h"
 
 Q_DECLARE_LOGGING_CATEGORY(D_ACCOUNTS_VALIDATOR)
 
-/** @ingroup group_accounts */
+/** @ingroup group_accounts
+ *
+ * @short Validates a new account's incoming & outgoing services
+ *
+ * The IMAP login check (a shallow folder list) and the SMTP auth check run
+ * concurrently and the first failure cancels the other. success() is emitted as
+ * soon as both have passed. The full folder list & standard folder creation are
+ * left until the account has been saved, call startBackgroundTasks() then and wait
+ * for backgroundTasksComplete() before the first sync. cancelBackgroundTasks()
+ * drops them if the account is removed instead.
+ *
+ * Each stage is timed and the results are available via the stageTimings property
+ */
 class AccountValidator: public QObject
 {
     Q_OBJECT
     Q_PROPERTY(bool inProgress READ inProgress NOTIFY inProgressChanged)
+    Q_PROPERTY(bool backgroundTasksRunning READ backgroundTasksRunning NOTIFY backgroundTasksRunningChanged)
+    Q_PROPERTY(QVariantMap stageTimings READ stageTimings NOTIFY stageTimingsChanged)
     Q_ENUMS(FailureReason)
     Q_ENUMS(State)
 public:
@@ -52,14 +68,20 @@ public:
 
     enum State {
         None,
+        CheckConnections,
         RetrieveFolderList,
-        CreateStandardFolders,
-        TransmitMessage
+        CreateStandardFolders
     };
     bool inProgress() const { return m_inProgress; }
+    bool backgroundTasksRunning() const { return m_state == RetrieveFolderList || m_state == CreateStandardFolders; }
+    // Elapsed milliseconds keyed on stage name
+    QVariantMap stageTimings() const { return m_stageTimings; }
 
 signals:
     void success();
+    void backgroundTasksComplete();
+    void backgroundTasksRunningChanged();
+    void stageTimingsChanged();
     void failed(AccountConfiguration::ServiceType service, FailureReason reason);
     void failedActionStatus(QMailServiceAction::Status status);
     void validationFailed(); // qml one
@@ -67,21 +89,29 @@ signals:
 
 public slots:
     void validateAccount(Account *account);
+    void startBackgroundTasks();
+    void cancelBackgroundTasks();
 
 private slots:
     void handleAccountActivity(QMailServiceAction::Activity activity);
-
-    void createStandardFolders();
-    void testTransmission();
+    void handleTimeout();
 
 private:
     QPointer<Account> m_account; // store it locally
     QPointer<QMailRetrievalAction> m_retrievelAction;
     QPointer<QMailTransmitAction> m_transmitAction;
     bool m_inProgress;
+    bool m_incomingValid;
+    bool m_outgoingValid;
     State m_state;
     QTimer *m_timer;
+    QElapsedTimer m_totalTime;
+    QElapsedTimer m_stageTime;
+    QVariantMap m_stageTimings;
 
+    void checkConnectionsComplete();
+    void setState(const State state);
+    void recordTiming(const QString &stage, const QElapsedTimer &timer);
     void testFailed(AccountConfiguration::ServiceType serviceType, QMailServiceAction::Status status);
     void init();
     void cleanUp();
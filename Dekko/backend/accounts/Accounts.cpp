@@ -18,6 +18,7 @@
 #include "Accounts.h"
 #include <QDebug>
 #include "qmailstore.h"
+#include "AccountRegistry.h"
 
 Q_LOGGING_CATEGORY(D_ACCOUNTS_LIST, "dekko.accounts.list")
 
@@ -26,34 +27,27 @@ Accounts::Accounts(QObject *parent) : QObject(parent),
 {
     m_model = new QQmlObjectListModel<Account>(this);
     emit modelChanged();
-    connect(QMailStore::instance(),
-            SIGNAL(accountsAdded(QMailAccountIdList)),
-            this,
-            SLOT(accountsAdded(QMailAccountIdList)));
-    connect(QMailStore::instance(),
-            SIGNAL(accountsRemoved(QMailAccountIdList)),
-            this,
-            SLOT(accountsRemoved(QMailAccountIdList)));
-    connect(QMailStore::instance(),
-            SIGNAL(accountsUpdated(QMailAccountIdList)),
-            this,
-            SLOT(accountsUpdated(QMailAccountIdList)));
+    // The registry tracks the QMailStore account signals for us and lets
+    // us check the filter without querying the store each time.
+    connect(AccountRegistry::instance(), &AccountRegistry::accountsChanged, this, &Accounts::accountsChanged);
     reset();
 }
 
 quint64 Accounts::maskForFilter(Accounts::Filters filter)
 {
+    // We need to ensure we only show enabled accounts
+    // This means we can do filters like CanReceive | Enabled
     switch(filter) {
     case Enabled:
         return QMailAccount::Enabled;
     case CanReceive:
-        return QMailAccount::MessageSource;
+        return QMailAccount::MessageSource | QMailAccount::Enabled;
     case CanSend:
-        return QMailAccount::MessageSink;
+        return QMailAccount::MessageSink | QMailAccount::Enabled;
     case Synchronized:
-        return QMailAccount::Synchronized;
+        return QMailAccount::Synchronized | QMailAccount::Enabled;
     case HasPersitentConnection:
-        return QMailAccount::HasPersistentConnection;
+        return QMailAccount::HasPersistentConnection | QMailAccount::Enabled;
     }
     Q_UNREACHABLE();
 }
@@ -98,61 +92,27 @@ void Accounts::setFilter(Accounts::Filters filter)
     emit filterChanged(filter);
 }
 
-void Accounts::accountsAdded(const QMailAccountIdList &ids)
+void Accounts::accountsChanged(const QMailAccountIdList &ids)
 {
-    qCDebug(D_ACCOUNTS_LIST) << "Adding accounts " << ids << "to list";
-    QMailAccountKey passKey;
-    if (filter() != Enabled)
-        // We need to ensure we only show enabled accounts
-        // This means we can do filters like CanReceive | Enabled
-        passKey = QMailAccountKey::status(maskForFilter(filter()) | QMailAccount::Enabled) & QMailAccountKey::id(ids);
-    else
-        passKey = QMailAccountKey::status(maskForFilter(filter())) & QMailAccountKey::id(ids);
-
-    QMailAccountIdList results = QMailStore::instance()->queryAccounts(passKey);
-    if(results.isEmpty())
-        return;
-
-    // TODO: once sortkey is implemented update the model with the sorted result
-    // for now we just append the new account
-    Q_FOREACH(const QMailAccountId &id, ids) {
-        if (!m_idList.contains(id)) {
-            Account *account = new Account();
-            account->setId(id.toULongLong());
-            m_model->append(account);
-            m_idList.append(id);
-        } else {
-            qCDebug(D_ACCOUNTS_LIST) << __func__ << "Account with same id already in model";
-        }
-    }
-}
-
-void Accounts::accountsUpdated(const QMailAccountIdList &ids)
-{
-    QMailAccountKey idKey(QMailAccountKey::id(ids));
-    QMailAccountIdList validIds = QMailStore::instance()->queryAccounts(idKey & QMailAccountKey::status(maskForFilter(filter())));
-    // We maybe here because a an account has been enabled/disabled or some other filter we use
-    // in this model and we now need to remove or add an account to the model
-
-    // remove any that shouldn't be in the model
+    // We maybe here because a an account has been added, removed, enabled/disabled
+    // or some other filter we use in this model and we now need to remove or add
+    // an account to the model
+    AccountRegistry *registry = AccountRegistry::instance();
     Q_FOREACH(const QMailAccountId &id, ids) {
-
-        if (!validIds.contains(id)) {
-            int index = m_idList.indexOf(id);
+        bool valid = registry->contains(id) && registry->testStatus(id, maskForFilter(filter()));
+        int index = m_idList.indexOf(id);
+        if (!valid) {
             if (index == -1) {
                 continue;
             }
+            qCDebug(D_ACCOUNTS_LIST) << "Removing account" << id << "from list";
+            // Remove both from model & idlist;
             m_model->remove(index);
             m_idList.removeAt(index);
-        }
-    }
-
-    // go over the valid ids and either insert any missing or update any existing
-    Q_FOREACH(const QMailAccountId &id, validIds) {
-        int index = m_idList.indexOf(id);
-        if (index == -1) {
-            // Not here so create.
-            Account *account = new Account();
+        } else if (index == -1) {
+            qCDebug(D_ACCOUNTS_LIST) << "Adding account" << id << "to list";
+            // Appended for now, it gets moved into place below
+            Account *account = new Account(this);
             account->setId(id.toULongLong());
             m_model->append(account);
             m_idList.append(id);
@@ -161,20 +121,15 @@ void Accounts::accountsUpdated(const QMailAccountIdList &ids)
             m_model->at(index)->emitAccountChanged();
         }
     }
-}
-
-void Accounts::accountsRemoved(const QMailAccountIdList &ids)
-{
-    qCDebug(D_ACCOUNTS_LIST) << "Removing accounts" << ids << "from list";
-    Q_FOREACH(const QMailAccountId &id, ids) {
-        int index = m_idList.indexOf(id);
-        if (index == -1) {
-            // This id#s not in this model
-            continue;
+    // Additions and renames change the order, keep it the same as the registry's.
+    // Everything before i is already in place so the account is always found at or after it.
+    const QMailAccountIdList sorted = registry->accountIds(maskForFilter(filter()));
+    for (int i = 0; i < sorted.size(); ++i) {
+        int from = m_idList.indexOf(sorted.at(i));
+        if (from > i) {
+            m_model->move(from, i);
+            m_idList.move(from, i);
         }
-        // Remove both from model & idlist;
-        m_model->remove(index);
-        m_idList.removeAt(index);
     }
 }
 
@@ -189,7 +144,7 @@ void Accounts::reset()
 void Accounts::init()
 {
     qCDebug(D_ACCOUNTS_LIST) << "Initialising accounts list";
-    auto idList = QMailStore::instance()->queryAccounts(QMailAccountKey::status(maskForFilter(filter())) ,QMailAccountSortKey::name());
+    auto idList = AccountRegistry::instance()->accountIds(maskForFilter(filter()));
     Q_FOREACH(const QMailAccountId &id, idList) {
         int index = m_idList.indexOf(id);
         if (index == -1) {
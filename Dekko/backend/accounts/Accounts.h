@@ -70,9 +70,7 @@ public slots:
     void reset();
 
 private slots:
-    void accountsAdded(const QMailAccountIdList &ids);
-    void accountsUpdated(const QMailAccountIdList &ids);
-    void accountsRemoved(const QMailAccountIdList &ids);
+    void accountsChanged(const QMailAccountIdList &ids);
 
 private:
     Filters m_filter;
@@ -9,7 +9,7 @@ namespace {
 }
 
 Identities::Identities(QObject *parent) : QObject(parent),
-    m_db(Q_NULLPTR), m_defaultIdentity(0)
+    m_db(Q_NULLPTR), m_defaultIdentity(0), m_loaded(false)
 {
     m_sourcePath = SnapStandardPaths::writableLocation(SnapStandardPaths::AppConfigLocation) + QStringLiteral("/mazdb/identities.db");
     emit sourcePathChanged(m_sourcePath);
@@ -47,8 +47,10 @@ bool Identities::add(const QVariantMap &map)
 
     batch->put(key(QString::number(count)), identity);
     bool result = batch->write();
-    if (result)
+    if (result) {
+        invalidate();
         emit identitiesChanged();
+    }
     return result;
 }
 
@@ -65,8 +67,10 @@ bool Identities::update(const QVariantMap &map)
         return false;
     }
     bool result = m_db->put(key(QString::number(map["id"].toInt())), map);
-    if (result)
+    if (result) {
+        invalidate();
         emit identitiesChanged();
+    }
     return result;
 }
 
@@ -77,8 +81,10 @@ bool Identities::remove(const int &id)
         return false;
     }
     bool result = m_db->del(k);
-    if (result)
+    if (result) {
+        invalidate();
         emit identitiesChanged();
+    }
     return result;
 }
 
@@ -99,32 +105,23 @@ bool Identities::removeAccount(const int &id)
     };
     m_db->readStream(func, prefix);
     bool result = batch->write();
-    if (result)
+    if (result) {
+        invalidate();
         emit identitiesChanged();
+    }
     return result;
 }
 
 QVariantMap Identities::get(const int &id)
 {
-    QString k = key(QString::number(id));
-    if (!m_db->get(k).isValid()) {
-        return QVariantMap();
-    }
-    return m_db->get(k).toMap();
+    ensureLoaded();
+    return m_byId.value(id);
 }
 
 IdentityList Identities::getAllForAccount(const int &id)
 {
-    QList<QVariantMap> identities;
-    MazValueCallBack func = [this, &identities, &id](QVariant val) {
-        const QVariantMap identity = val.toMap();
-        if (identity["parentId"].toInt() == id) {
-            identities.append(identity);
-        }
-        return true;
-    };
-    m_db->valueStream(func, prefix);
-    return identities;
+    ensureLoaded();
+    return m_byParent.value(id);
 }
 
 int Identities::defaultIdentity() const
@@ -167,6 +164,28 @@ void Identities::setDefaultIdentity(int defaultIdentity)
     emit defaultIdentityChanged(defaultIdentity);
 }
 
+void Identities::ensureLoaded()
+{
+    if (m_loaded) {
+        return;
+    }
+    m_byId.clear();
+    m_byParent.clear();
+    MazValueCallBack func = [this](QVariant val) {
+        const QVariantMap identity = val.toMap();
+        m_byId.insert(identity["id"].toInt(), identity);
+        m_byParent[identity["parentId"].toInt()].append(identity);
+        return true;
+    };
+    m_db->valueStream(func, prefix);
+    m_loaded = true;
+}
+
+void Identities::invalidate()
+{
+    m_loaded = false;
+}
+
 QString Identities::key(const QString &k)
 {
     QString result(prefix);
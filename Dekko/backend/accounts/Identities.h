@@ -2,6 +2,7 @@
 #define IDENTITIES_H
 
 #include <QObject>
+#include <QHash>
 #include <MazDB.h>
 #include <Helpers.h>
 #include <qmailmessage.h>
@@ -46,9 +47,16 @@ signals:
 
 private:
     QString key(const QString &k);
+    void ensureLoaded();
+    void invalidate();
     Q_DISABLE_COPY(Identities)
     MazDB *m_db;
     int m_defaultIdentity;
+    // In memory index of the db so lookups don't have to
+    // stream every identity from disk.
+    bool m_loaded;
+    QHash<int, QVariantMap> m_byId;
+    QHash<int, IdentityList> m_byParent;
 };
 
 #endif // IDENTITIES_H
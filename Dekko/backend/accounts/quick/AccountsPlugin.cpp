@@ -19,6 +19,7 @@
 #include <QtQml/QtQml>
 #include <QtQml/QQmlContext>
 #include <Accounts.h>
+#include <AccountRegistry.h>
 #include <AccountConfiguration.h>
 #include <AccountValidator.h>
 #include <Identities.h>
@@ -45,5 +46,7 @@ void AccountsPlugin::registerTypes(const char *uri)
 
 void AccountsPlugin::initializeEngine(QQmlEngine *engine, const char *uri)
 {
+    // Load all accounts up front so lookups from the delegates are served from memory
+    AccountRegistry::instance();
     QQmlExtensionPlugin::initializeEngine(engine, uri);
 }
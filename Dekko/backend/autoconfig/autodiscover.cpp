@@ -21,11 +21,9 @@ AutoDiscover::AutoDiscover(QObject *parent) :
 {
     m_serverConfig = new EmailProvider(this);
     m_autoConfig = new AutoConfig(this, m_serverConfig);
-    connect(m_autoConfig, &AutoConfig::failed, this, &AutoDiscover::handleRequestFailed);
-    connect(m_autoConfig, &AutoConfig::success, this, &AutoDiscover::handleRequestSucceeded);
-//    m_srvLookup = new SrvLookup(this, m_serverConfig);
-//    connect(m_srvLookup, &SrvLookup::failed, this, &AutoDiscover::handleRequestFailed);
-//    connect(m_srvLookup, &SrvLookup::success, this, &AutoDiscover::handleRequestSucceeded);
+    m_probeEngine = new ProbeEngine(this);
+    connect(m_probeEngine, &ProbeEngine::failed, this, &AutoDiscover::handleRequestFailed);
+    connect(m_probeEngine, &ProbeEngine::success, this, &AutoDiscover::handleRequestSucceeded);
     m_status = INVALID;
 }
 
@@ -66,116 +64,23 @@ void AutoDiscover::lookUp(const QString &mailAddress)
         return;
     }
     setStatus(NEW_REQUEST);
-    buildNextRequest();
-}
-
-void AutoDiscover::buildNextRequest()
-{
 
     if (!m_testMode && !m_autoConfig->networkAccessible()) {
+        setStatus(REQUEST_FAILED);
         emit noNetworkAvailable();
         emit failed();
         return;
     }
-
-    switch(m_status) {
-    case INVALID:
-        setStatus(REQUEST_FAILED);
-        emit failed(); // Nothing we can do from here now.
-        break;
-    case NEW_REQUEST:
-        qDebug() << "[AutoDiscover::NEW_REQUEST]" << "Requesting local first";
-        setStatus(REQUEST_LOCAL);
-        buildNextRequest();
-        break;
-    case REQUEST_LOCAL:
-        qDebug() << "[AutoDiscover::REQUEST_LOCAL]" << "Looking for local config";
-        m_autoConfig->findLocal(m_domain);
-        break;
-    case REQUEST_AUTOCONFIG_V12:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_V12]" << "Looking for autoconfig v1.2";
-        m_autoConfig->lookUp(QString("http://autoconfig.%1/mail/config-v1.2.xml").arg(m_domain));
-        break;
-    case REQUEST_AUTOCONFIG_WELLKNOWN_V12:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_WELLKNOWN_V12]" << "Looking for wellknow autocnfig v1.2";
-        m_autoConfig->lookUp(QString("http://%1/.well-known/autoconfig/mail/config-v1.2.xml").arg(m_domain));
-        break;
-    case REQUEST_AUTOCONFIG_V11:
-        qDebug() << "[AutoDiscover::NEW_REQUEST]" << "Looking for autoconfig v1.1";
-        m_autoConfig->lookUp(QString("http://autoconfig.%1/mail/config-v1.1.xml").arg(m_domain));
-        break;
-    case REQUEST_AUTOCONFIG_WELLKNOWN_V11:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_WELLKNOWN_V11]" << "Looking for wellknow autocnfig v1.1";
-        m_autoConfig->lookUp(QString("http://%1/.well-known/autoconfig/mail/config-v1.1.xml").arg(m_domain));
-        break;
-    case REQUEST_DEKKO_ISPDB:
-        qDebug() << "[AutoDiscover::REQUEST_DEKKO_ISPDB]" << "Querying dekko's ispdb";
-        m_autoConfig->lookUp(QString("http://autoconfig.dekkoproject.org/v1.2/%1").arg(m_domain));
-        break;
-    case REQUEST_AUTOCONFIG_ISPDB:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_ISPDB]" << "Last chance! trying thunderbirds ispdb...";
-        m_autoConfig->lookUp(QString("https://autoconfig.thunderbird.net/v1.1/%1").arg(m_domain));
-        break;
-    case REQUEST_FAILED:
-    case REQUEST_SUCCEEDED:
-    case BUILDING_RESULT:
-        setStatus(REQUEST_FAILED);
-        emit failed(); // Nothing we can do from here now.
-        break;
-    }
+    qDebug() << "[AutoDiscover::REQUEST_PROBING]" << "Probing all sources for" << m_domain;
+    setStatus(REQUEST_PROBING);
+    m_probeEngine->lookUp(m_domain);
 }
 
 void AutoDiscover::handleRequestFailed()
 {
-
-    switch(m_status) {
-    case INVALID:
-    case NEW_REQUEST:
-        setStatus(REQUEST_FAILED);
-        emit failed(); // Nothing we can do from here now.
-        break;
-    case REQUEST_LOCAL:
-        qDebug() << "[AutoDiscover::REQUEST_LOCAL]" << "No local configs";
-        setStatus(REQUEST_AUTOCONFIG_V12);
-        buildNextRequest();
-        break;
-    case REQUEST_AUTOCONFIG_V12:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_V12]" << "Failed lookup";
-        setStatus(REQUEST_AUTOCONFIG_WELLKNOWN_V12);
-        buildNextRequest();
-        break;
-    case REQUEST_AUTOCONFIG_WELLKNOWN_V12:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_WELLKNOWN_V12]" << "Failed lookup";
-        setStatus(REQUEST_AUTOCONFIG_V11);
-        buildNextRequest();
-        break;
-    case REQUEST_AUTOCONFIG_V11:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_V11]" << "Failed lookup";
-        setStatus(REQUEST_AUTOCONFIG_WELLKNOWN_V11);
-        buildNextRequest();
-        break;
-    case REQUEST_AUTOCONFIG_WELLKNOWN_V11:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_WELLKNOWN_V11]" << "Failed lookup";
-        setStatus(REQUEST_DEKKO_ISPDB);
-        buildNextRequest();
-        break;
-    case REQUEST_DEKKO_ISPDB:
-        qDebug() << "[AutoDiscover::REQUEST_DEKKO_ISPDB]" << "Failed lookup";
-        setStatus(REQUEST_AUTOCONFIG_ISPDB);
-        buildNextRequest();
-        break;
-    case REQUEST_AUTOCONFIG_ISPDB:
-        qDebug() << "[AutoDiscover::REQUEST_AUTOCONFIG_ISPDB]" << "Failed lookup";
-        setStatus(REQUEST_FAILED);
-        buildNextRequest();
-        break;
-    case REQUEST_FAILED:
-    case REQUEST_SUCCEEDED:
-    case BUILDING_RESULT:
-        setStatus(REQUEST_FAILED);
-        buildNextRequest();
-        break;
-    }
+    qDebug() << "[AutoDiscover::REQUEST_FAILED]" << "No server configuration found for" << m_domain;
+    setStatus(REQUEST_FAILED);
+    emit failed(); // Nothing we can do from here now.
 }
 
 void AutoDiscover::setStatus(AutoDiscover::Status status)
@@ -193,6 +98,9 @@ void AutoDiscover::setStatus(AutoDiscover::Status status)
 
 void AutoDiscover::handleRequestSucceeded(EmailProvider *config)
 {
+    if (config != NULL) {
+        config->setParent(this);
+    }
     qDebug() << "++++++++++++++++++++++++";
     qDebug() << "SUCCESS!";
     qDebug() << "VERSION: " << config->version();
@@ -21,7 +21,7 @@
 #include <QScopedPointer>
 #include "autoconfig.h"
 #include "emailvalidator.h"
-#include "srvlookup.h"
+#include "probeengine.h"
 #include "emailprovider.h"
 
 class AutoDiscover : public QObject
@@ -44,6 +44,7 @@ public:
         REQUEST_AUTOCONFIG_WELLKNOWN_V11, // tbird v1.1
         REQUEST_DEKKO_ISPDB, // autoconfig.dekkoproject.org
         REQUEST_AUTOCONFIG_ISPDB, // autoconfig.thunderbird.net
+        REQUEST_PROBING, // All of the above + SRV & MX concurrently
 //        REQUEST_SRV,
 //        REQUEST_WEBFINGER, // Is this possible?? it should be!
         REQUEST_FAILED,
@@ -67,17 +68,16 @@ public slots:
     void lookUp(const QString &mailAddress);
 
 private:
-    void buildNextRequest();
-    void handleRequestFailed();
     void setStatus(Status status);
 
 private slots:
+    void handleRequestFailed();
     void handleRequestSucceeded(EmailProvider *config);
 
 private:
     QPointer<EmailProvider> m_serverConfig;
     QPointer<AutoConfig> m_autoConfig;
-    QPointer<SrvLookup> m_srvLookup;
+    QPointer<ProbeEngine> m_probeEngine;
 
     QString m_domain;
     Status m_status;
@@ -0,0 +1,509 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "probeengine.h"
+#include <QDebug>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkRequest>
+#include <QXmlStreamWriter>
+#include <Paths.h>
+
+#define DEFAULT_PROBE_TIMEOUT 5000
+#define DEFAULT_CACHE_TTL (7 * 24 * 60 * 60)
+#define MAX_REDIRECTS 5
+// Rank offsets, lower is preferred
+#define RANK_AUTOCONFIG 0
+#define RANK_SRV 10
+#define RANK_ISPDB 20
+#define RANK_MX_GUESS 30
+
+ProbeEngine::ProbeEngine(QObject *parent) : QObject(parent),
+    m_nam(new QNetworkAccessManager(this)), m_nextId(0),
+    m_probeTimeout(DEFAULT_PROBE_TIMEOUT), m_cacheTtl(DEFAULT_CACHE_TTL),
+    m_fallbackSource(IspDb), m_fallbackRank(-1), m_running(false)
+{
+    // Ordered by preference
+    m_autoConfigUrls << QStringLiteral("http://autoconfig.%1/mail/config-v1.2.xml")
+                     << QStringLiteral("http://%1/.well-known/autoconfig/mail/config-v1.2.xml")
+                     << QStringLiteral("http://autoconfig.%1/mail/config-v1.1.xml")
+                     << QStringLiteral("http://%1/.well-known/autoconfig/mail/config-v1.1.xml");
+    m_ispDbUrls << QStringLiteral("http://autoconfig.dekkoproject.org/v1.2/%1")
+                << QStringLiteral("https://autoconfig.thunderbird.net/v1.1/%1");
+}
+
+ProbeEngine::~ProbeEngine()
+{
+    cancel();
+}
+
+int ProbeEngine::probeTimeout() const
+{
+    return m_probeTimeout;
+}
+
+void ProbeEngine::setProbeTimeout(const int &msecs)
+{
+    m_probeTimeout = msecs;
+}
+
+int ProbeEngine::cacheTtl() const
+{
+    return m_cacheTtl;
+}
+
+void ProbeEngine::setCacheTtl(const int &secs)
+{
+    m_cacheTtl = secs;
+}
+
+void ProbeEngine::setAutoConfigUrls(const QStringList &urls)
+{
+    m_autoConfigUrls = urls;
+}
+
+void ProbeEngine::setIspDbUrls(const QStringList &urls)
+{
+    m_ispDbUrls = urls;
+}
+
+void ProbeEngine::setNameserver(const QHostAddress &nameserver)
+{
+    m_nameserver = nameserver;
+}
+
+bool ProbeEngine::isRunning() const
+{
+    return m_running;
+}
+
+void ProbeEngine::lookUp(const QString &domain)
+{
+    cancel();
+    if (domain.isEmpty()) {
+        emit failed();
+        return;
+    }
+    m_domain = domain.toLower();
+    m_running = true;
+    // These are both just a file read so check them before
+    // hitting the network
+    if (findLocal(m_domain) || findCached(m_domain)) {
+        return;
+    }
+    int rank = RANK_AUTOCONFIG;
+    Q_FOREACH(const QString &url, m_autoConfigUrls) {
+        startHttpProbe(AutoConfigUrl, rank++, true, QUrl(url.arg(m_domain)));
+    }
+    startSrvProbe();
+    rank = RANK_ISPDB;
+    Q_FOREACH(const QString &url, m_ispDbUrls) {
+        startHttpProbe(IspDb, rank++, false, QUrl(url.arg(m_domain)));
+    }
+    startMxProbe();
+    qDebug() << "[ProbeEngine]" << "Started" << m_probes.size() << "probes for" << m_domain;
+}
+
+void ProbeEngine::cancel()
+{
+    Q_FOREACH(const int &id, m_probes.keys()) {
+        finishProbe(id);
+    }
+    m_probes.clear();
+    m_fallback.clear();
+    m_fallbackRank = -1;
+    m_running = false;
+}
+
+int ProbeEngine::startProbe(const ProbeEngine::Source &source, const int &rank, const bool &authoritative)
+{
+    Probe probe;
+    probe.source = source;
+    probe.rank = rank;
+    probe.authoritative = authoritative;
+    probe.redirects = 0;
+    probe.timer = new QTimer(this);
+    probe.timer->setSingleShot(true);
+    probe.timer->setInterval(m_probeTimeout);
+    connect(probe.timer, &QTimer::timeout, this, &ProbeEngine::handleProbeTimeout);
+    probe.timer->start();
+    int id = m_nextId++;
+    m_probes.insert(id, probe);
+    return id;
+}
+
+void ProbeEngine::startHttpProbe(const ProbeEngine::Source &source, const int &rank, const bool &authoritative, const QUrl &url)
+{
+    if (!url.isValid()) {
+        qDebug() << "[ProbeEngine] Invalid URL: " << url;
+        return;
+    }
+    int id = startProbe(source, rank, authoritative);
+    Probe &probe = m_probes[id];
+    probe.url = url;
+    QNetworkReply *reply = m_nam->get(QNetworkRequest(url));
+    connect(reply, &QNetworkReply::finished, this, &ProbeEngine::handleReplyFinished);
+    probe.job = reply;
+}
+
+void ProbeEngine::startSrvProbe()
+{
+    int id = startProbe(SrvRecord, RANK_SRV, true);
+    ServerConfiguration *config = new ServerConfiguration();
+    SrvLookup *srv = new SrvLookup(this, config);
+    // The config goes away with the lookup when the probe finishes
+    config->setParent(srv);
+    if (!m_nameserver.isNull()) {
+        srv->setNameserver(m_nameserver);
+    }
+    connect(srv, &SrvLookup::success, this, &ProbeEngine::handleSrvSuccess);
+    connect(srv, &SrvLookup::failed, this, &ProbeEngine::handleSrvFailed);
+    m_probes[id].job = srv;
+    srv->lookUp(m_domain);
+}
+
+void ProbeEngine::startMxProbe()
+{
+    int id = startProbe(MxGuess, RANK_MX_GUESS, false);
+    QDnsLookup *mx = new QDnsLookup(QDnsLookup::MX, m_domain, this);
+    if (!m_nameserver.isNull()) {
+        mx->setNameserver(m_nameserver);
+    }
+    connect(mx, &QDnsLookup::finished, this, &ProbeEngine::handleMxFinished);
+    m_probes[id].job = mx;
+    mx->lookup();
+}
+
+int ProbeEngine::probeIdForJob(QObject *job) const
+{
+    if (!job) {
+        return -1;
+    }
+    QHash<int, Probe>::const_iterator it = m_probes.constBegin();
+    for (; it != m_probes.constEnd(); ++it) {
+        if (it.value().job == job || it.value().timer == job) {
+            return it.key();
+        }
+    }
+    return -1;
+}
+
+void ProbeEngine::handleReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (!reply) {
+        return;
+    }
+    reply->deleteLater();
+    int id = probeIdForJob(reply);
+    if (id == -1) {
+        return;
+    }
+    // We should handle redirects so do that first.
+    QVariant redirect = reply->attribute(QNetworkRequest::RedirectionTargetAttribute);
+    if (redirect.isValid()) {
+        Probe &probe = m_probes[id];
+        QUrl target = probe.url.resolved(redirect.toUrl());
+        if (++probe.redirects > MAX_REDIRECTS || !target.isValid()) {
+            qDebug() << "[ProbeEngine] Too many redirects for: " << probe.url;
+            probeFailed(id);
+            return;
+        }
+        qDebug() << "[ProbeEngine] Redirecting to: " << target;
+        probe.url = target;
+        QNetworkReply *next = m_nam->get(QNetworkRequest(target));
+        connect(next, &QNetworkReply::finished, this, &ProbeEngine::handleReplyFinished);
+        probe.job = next;
+        return;
+    }
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "[ProbeEngine] Request failed: " << reply->url() << reply->errorString();
+        probeFailed(id);
+        return;
+    }
+    probeSucceeded(id, reply->readAll());
+}
+
+void ProbeEngine::handleProbeTimeout()
+{
+    int id = probeIdForJob(sender());
+    if (id == -1) {
+        return;
+    }
+    qDebug() << "[ProbeEngine] Probe timed out: " << m_probes.value(id).source << m_probes.value(id).url;
+    probeFailed(id);
+}
+
+void ProbeEngine::handleSrvSuccess(ServerConfiguration *config)
+{
+    int id = probeIdForJob(sender());
+    if (id == -1) {
+        return;
+    }
+    probeSucceeded(id, serverConfigurationToXml(m_domain, config));
+}
+
+void ProbeEngine::handleSrvFailed()
+{
+    int id = probeIdForJob(sender());
+    if (id == -1) {
+        return;
+    }
+    probeFailed(id);
+}
+
+void ProbeEngine::handleMxFinished()
+{
+    QDnsLookup *mx = qobject_cast<QDnsLookup *>(sender());
+    int id = probeIdForJob(mx);
+    if (id == -1) {
+        return;
+    }
+    if (mx->error() != QDnsLookup::NoError || mx->mailExchangeRecords().isEmpty()) {
+        probeFailed(id);
+        return;
+    }
+    QDnsMailExchangeRecord best = mx->mailExchangeRecords().first();
+    Q_FOREACH(const QDnsMailExchangeRecord &record, mx->mailExchangeRecords()) {
+        if (record.preference() < best.preference()) {
+            best = record;
+        }
+    }
+    // Hosted domains i.e aspmx.l.google.com are best guessed by asking
+    // the ISPDB's about the base domain of the exchange.
+    QStringList labels = best.exchange().toLower().split(QLatin1Char('.'), QString::SkipEmptyParts);
+    QString mxDomain = labels.mid(qMax(0, labels.size() - 2)).join(QLatin1Char('.'));
+    if (labels.size() >= 2 && mxDomain != m_domain) {
+        qDebug() << "[ProbeEngine] Guessing config from MX domain: " << mxDomain;
+        int rank = RANK_MX_GUESS + 1;
+        Q_FOREACH(const QString &url, m_ispDbUrls) {
+            startHttpProbe(MxGuess, rank++, false, QUrl(url.arg(mxDomain)));
+        }
+    }
+    // The guesses are now probes of their own
+    probeFailed(id);
+}
+
+void ProbeEngine::probeSucceeded(const int &id, const QByteArray &xml)
+{
+    EmailProvider *provider = EmailProvider::fromXml(xml);
+    bool valid = provider && provider->isValid();
+    if (provider) {
+        provider->deleteLater();
+    }
+    if (!valid) {
+        probeFailed(id);
+        return;
+    }
+    Probe probe = m_probes.value(id);
+    finishProbe(id);
+    m_probes.remove(id);
+    if (probe.authoritative) {
+        qDebug() << "[ProbeEngine] Authoritative result from: " << probe.source << probe.url;
+        accept(xml, probe.source, true);
+        return;
+    }
+    if (m_fallbackRank == -1 || probe.rank < m_fallbackRank) {
+        m_fallback = xml;
+        m_fallbackSource = probe.source;
+        m_fallbackRank = probe.rank;
+    }
+    checkFinished();
+}
+
+void ProbeEngine::probeFailed(const int &id)
+{
+    finishProbe(id);
+    m_probes.remove(id);
+    checkFinished();
+}
+
+void ProbeEngine::finishProbe(const int &id)
+{
+    if (!m_probes.contains(id)) {
+        return;
+    }
+    Probe probe = m_probes.value(id);
+    if (probe.timer) {
+        probe.timer->stop();
+        probe.timer->deleteLater();
+    }
+    if (probe.job) {
+        probe.job->disconnect(this);
+        if (QNetworkReply *reply = qobject_cast<QNetworkReply *>(probe.job)) {
+            reply->abort();
+        } else if (QDnsLookup *dns = qobject_cast<QDnsLookup *>(probe.job)) {
+            dns->abort();
+        } else if (SrvLookup *srv = qobject_cast<SrvLookup *>(probe.job)) {
+            srv->abort();
+        }
+        probe.job->deleteLater();
+    }
+}
+
+void ProbeEngine::checkFinished()
+{
+    if (!m_running) {
+        return;
+    }
+    // We can only settle for a fallback once nothing better can turn up
+    bool waiting = false;
+    Q_FOREACH(const Probe &probe, m_probes) {
+        if (probe.authoritative || m_fallbackRank == -1 || probe.rank < m_fallbackRank) {
+            waiting = true;
+            break;
+        }
+    }
+    if (waiting) {
+        return;
+    }
+    if (!m_fallback.isEmpty()) {
+        qDebug() << "[ProbeEngine] Using non authoritative result from: " << m_fallbackSource;
+        accept(m_fallback, m_fallbackSource, true);
+        return;
+    }
+    qDebug() << "[ProbeEngine] All probes failed for: " << m_domain;
+    cancel();
+    emit failed();
+}
+
+void ProbeEngine::accept(const QByteArray &xml, const ProbeEngine::Source &source, const bool &cache)
+{
+    QString domain = m_domain;
+    cancel();
+    if (cache) {
+        writeCache(domain, xml);
+    }
+    EmailProvider *provider = EmailProvider::fromXml(xml);
+    if (!provider || !provider->isValid()) {
+        emit failed();
+        return;
+    }
+    emit success(provider, source);
+}
+
+bool ProbeEngine::findLocal(const QString &domain)
+{
+    QString configPath = Paths::configLocationForFile(QStringLiteral("autoconfig/%1/config-v1.2.xml").arg(domain));
+    QFile config(configPath);
+    if (!config.exists() || !config.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    qDebug() << "[ProbeEngine] Using local config: " << configPath;
+    accept(config.readAll(), LocalFile, false);
+    return true;
+}
+
+bool ProbeEngine::findCached(const QString &domain)
+{
+    if (m_cacheTtl <= 0) {
+        return false;
+    }
+    QFileInfo info(cacheFile(domain));
+    if (!info.exists()) {
+        return false;
+    }
+    if (info.lastModified().secsTo(QDateTime::currentDateTime()) > m_cacheTtl) {
+        QFile::remove(info.absoluteFilePath());
+        return false;
+    }
+    QFile cached(info.absoluteFilePath());
+    if (!cached.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qDebug() << "[ProbeEngine] Using cached config for: " << domain;
+    accept(cached.readAll(), DiskCache, false);
+    return true;
+}
+
+QString ProbeEngine::cacheFile(const QString &domain) const
+{
+    return Paths::cacheLocationForFile(QStringLiteral("autoconfig/%1.xml").arg(domain));
+}
+
+void ProbeEngine::writeCache(const QString &domain, const QByteArray &xml)
+{
+    if (m_cacheTtl <= 0 || domain.isEmpty()) {
+        return;
+    }
+    QFileInfo info(cacheFile(domain));
+    if (!info.dir().exists() && !info.dir().mkpath(QStringLiteral("."))) {
+        qWarning() << "[ProbeEngine] Cannot create cache directory: " << info.dir().path();
+        return;
+    }
+    QFile cached(info.absoluteFilePath());
+    if (!cached.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "[ProbeEngine] Failed writing cache file: " << info.absoluteFilePath();
+        return;
+    }
+    cached.write(xml);
+}
+
+QByteArray ProbeEngine::serverConfigurationToXml(const QString &domain, ServerConfiguration *config)
+{
+    auto socketType = [](const ServerConfiguration::NetworkMethod &method) -> QString {
+        switch (method) {
+        case ServerConfiguration::SSL_TLS:
+            return QStringLiteral("SSL");
+        case ServerConfiguration::STARTTLS:
+            return QStringLiteral("STARTTLS");
+        default:
+            return QStringLiteral("plain");
+        }
+    };
+    // Only hand over the password as is when the SRV record gave us
+    // an encrypted transport, otherwise ask for a challenge response.
+    auto authentication = [](const ServerConfiguration::NetworkMethod &method) -> QString {
+        switch (method) {
+        case ServerConfiguration::SSL_TLS:
+        case ServerConfiguration::STARTTLS:
+            return QStringLiteral("password-cleartext");
+        default:
+            return QStringLiteral("password-encrypted");
+        }
+    };
+    auto writeServer = [&](QXmlStreamWriter &xml, const QString &element, const QString &type,
+            const QString &host, const int &port, const ServerConfiguration::NetworkMethod &method) {
+        xml.writeStartElement(element);
+        xml.writeAttribute(QStringLiteral("type"), type);
+        xml.writeTextElement(QStringLiteral("hostname"), host);
+        xml.writeTextElement(QStringLiteral("port"), QString::number(port));
+        xml.writeTextElement(QStringLiteral("socketType"), socketType(method));
+        xml.writeTextElement(QStringLiteral("authentication"), authentication(method));
+        xml.writeTextElement(QStringLiteral("username"), QStringLiteral("%EMAILADDRESS%"));
+        xml.writeEndElement();
+    };
+
+    QByteArray data;
+    QXmlStreamWriter xml(&data);
+    xml.writeStartDocument();
+    xml.writeStartElement(QStringLiteral("clientConfig"));
+    xml.writeAttribute(QStringLiteral("version"), QStringLiteral("1.1"));
+    xml.writeStartElement(QStringLiteral("emailProvider"));
+    xml.writeAttribute(QStringLiteral("id"), domain);
+    xml.writeTextElement(QStringLiteral("domain"), domain);
+    xml.writeTextElement(QStringLiteral("displayName"), domain);
+    xml.writeTextElement(QStringLiteral("displayShortName"), domain);
+    writeServer(xml, QStringLiteral("incomingServer"), QStringLiteral("imap"),
+                config->imapHost(), config->imapPort(), config->imapMethod());
+    writeServer(xml, QStringLiteral("outgoingServer"), QStringLiteral("smtp"),
+                config->smtpHost(), config->smtpPort(), config->smtpMethod());
+    xml.writeEndElement();
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    return data;
+}
@@ -0,0 +1,140 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROBEENGINE_H
+#define PROBEENGINE_H
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include <QUrl>
+#include <QStringList>
+#include <QHostAddress>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QDnsLookup>
+#include <QTimer>
+#include "emailprovider.h"
+#include "serverconfiguration.h"
+#include "srvlookup.h"
+
+/** @short Runs all autoconfig sources for a domain at the same time
+ *
+ * Previously each source was tried one after the other and every failing
+ * http request could cost us the full network timeout. Now the local config,
+ * the domains own autoconfig & well-known urls, SRV records, the ISPDB's
+ * and an MX based ISPDB guess are all requested together.
+ *
+ * Results from the domain itself (autoconfig urls & SRV) are authoritative and
+ * the first one to arrive wins, all other probes are then cancelled. Results
+ * from the ISPDB's are only used once every authoritative probe has failed
+ * or timed out, in which case the best ranked one is used.
+ *
+ * Successful lookups are cached on disk per domain as clientConfig xml.
+ */
+class ProbeEngine : public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(Source)
+public:
+    explicit ProbeEngine(QObject *parent = 0);
+    ~ProbeEngine();
+
+    enum Source {
+        LocalFile,
+        DiskCache,
+        AutoConfigUrl,
+        SrvRecord,
+        IspDb,
+        MxGuess
+    };
+
+    // How long a single probe is allowed to take before we give up on it.
+    int probeTimeout() const;
+    void setProbeTimeout(const int &msecs);
+    // How long a cached result is considered fresh, 0 disables the cache
+    int cacheTtl() const;
+    void setCacheTtl(const int &secs);
+    // %1 is replaced with the domain. These allow pointing the
+    // engine at a local http stand-in.
+    void setAutoConfigUrls(const QStringList &urls);
+    void setIspDbUrls(const QStringList &urls);
+    // Use a specific nameserver for SRV & MX lookups
+    void setNameserver(const QHostAddress &nameserver);
+
+    bool isRunning() const;
+
+    static QByteArray serverConfigurationToXml(const QString &domain, ServerConfiguration *config);
+
+signals:
+    void success(EmailProvider *provider, const ProbeEngine::Source source);
+    void failed();
+
+public slots:
+    void lookUp(const QString &domain);
+    void cancel();
+
+private slots:
+    void handleReplyFinished();
+    void handleProbeTimeout();
+    void handleSrvSuccess(ServerConfiguration *config);
+    void handleSrvFailed();
+    void handleMxFinished();
+
+private:
+    struct Probe {
+        Source source;
+        // Lower is better, used to pick between non authoritative results
+        int rank;
+        bool authoritative;
+        QUrl url;
+        int redirects;
+        QPointer<QObject> job;
+        QPointer<QTimer> timer;
+    };
+
+    int startProbe(const Source &source, const int &rank, const bool &authoritative);
+    void startHttpProbe(const Source &source, const int &rank, const bool &authoritative, const QUrl &url);
+    void startSrvProbe();
+    void startMxProbe();
+    int probeIdForJob(QObject *job) const;
+    void probeSucceeded(const int &id, const QByteArray &xml);
+    void probeFailed(const int &id);
+    void finishProbe(const int &id);
+    void checkFinished();
+    void accept(const QByteArray &xml, const Source &source, const bool &cache);
+
+    bool findLocal(const QString &domain);
+    bool findCached(const QString &domain);
+    QString cacheFile(const QString &domain) const;
+    void writeCache(const QString &domain, const QByteArray &xml);
+
+    QNetworkAccessManager *m_nam;
+    QHash<int, Probe> m_probes;
+    int m_nextId;
+    QString m_domain;
+    int m_probeTimeout;
+    int m_cacheTtl;
+    QStringList m_autoConfigUrls;
+    QStringList m_ispDbUrls;
+    QHostAddress m_nameserver;
+    // Best non authoritative result seen so far
+    QByteArray m_fallback;
+    Source m_fallbackSource;
+    int m_fallbackRank;
+    bool m_running;
+};
+
+#endif // PROBEENGINE_H
@@ -18,9 +18,13 @@
 #include <QDebug>
 
 SrvLookup::SrvLookup(QObject *parent, ServerConfiguration *config) :
-    QObject(parent), m_serverConfig(config), m_dns(new QDnsLookup), m_lookupType(INVALID)
+    QObject(parent), m_serverConfig(config)
 {
-    connect(m_dns, &QDnsLookup::finished, this, &SrvLookup::handleLookUpResult);
+}
+
+void SrvLookup::setNameserver(const QHostAddress &nameserver)
+{
+    m_nameserver = nameserver;
 }
 
 void SrvLookup::lookUp(const QString &domain)
@@ -29,129 +33,126 @@ void SrvLookup::lookUp(const QString &domain)
         emit failed();
         return;
     }
-    m_dns->setType(QDnsLookup::SRV);
+    abort();
     m_domain = domain;
-    // Ideally we always prefer IMAPS over IMAP even if it
-    // may get upgraded via STARTTLS. So start with this first.
-    m_lookupType = IMAPS;
-    buildNextRequest();
+    // Fire all of them at once, we only need to wait as long as
+    // the slowest record rather than the sum of all of them.
+    buildRequest(IMAPS);
+    buildRequest(IMAP);
+    buildRequest(SUBMISSIONS);
+    buildRequest(SUBMISSION);
 }
 
-void SrvLookup::buildNextRequest()
+void SrvLookup::abort()
 {
-    switch (m_lookupType) {
+    Q_FOREACH(QDnsLookup *dns, m_pending.keys()) {
+        dns->disconnect(this);
+        dns->abort();
+        dns->deleteLater();
+    }
+    m_pending.clear();
+    m_records.clear();
+}
+
+void SrvLookup::buildRequest(const LookupType &type)
+{
+    QString name;
+    switch (type) {
     case INVALID:
         // Shouldn't be here
-        emit failed();
         return;
     case IMAPS:
-        m_dns->setName(QString("_imaps._tcp." % m_domain));
-        m_dns->lookup();
+        name = QString("_imaps._tcp." % m_domain);
         break;
     case IMAP:
-        m_dns->setName(QString("_imap._tcp." % m_domain));
-        m_dns->lookup();
+        name = QString("_imap._tcp." % m_domain);
+        break;
+    case SUBMISSIONS:
+        name = QString("_submissions._tcp." % m_domain);
         break;
     case SUBMISSION:
-        m_dns->setName(QString("_submission._tcp." % m_domain));
-        m_dns->lookup();
+        name = QString("_submission._tcp." % m_domain);
         break;
     }
-    qDebug() << "Looking for SRV record at: " << m_dns->name();
+    QDnsLookup *dns = new QDnsLookup(QDnsLookup::SRV, name, this);
+    if (!m_nameserver.isNull()) {
+        dns->setNameserver(m_nameserver);
+    }
+    connect(dns, &QDnsLookup::finished, this, &SrvLookup::handleLookUpResult);
+    m_pending.insert(dns, type);
+    qDebug() << "Looking for SRV record at: " << name;
+    dns->lookup();
 }
 
 void SrvLookup::handleLookUpResult()
 {
-    if (m_dns->error() != QDnsLookup::NoError) {
-        qDebug() << "SRV lookup failed: " << m_dns->errorString();
-        switch (m_lookupType) {
-        case INVALID:
-            // Shouldn't be here
-            emit failed();
-            return;
-        case IMAPS:
-            m_lookupType = IMAP;
-            buildNextRequest();
-            return;
-        case IMAP:
-            // If we reached here then we failed to find any IMAP info
-            // So we need to just fail as we don't currently configure
-            // SMTP without IMAP info.
-        case SUBMISSION:
-            emit failed();
-            return;
-        }
-    }
-    // Now deal with the received records
-    handleReceivedRecords();
-
-    // Determine the next step.
-    switch(m_lookupType) {
-    case INVALID:
-        emit failed();
+    QDnsLookup *dns = qobject_cast<QDnsLookup *>(sender());
+    if (!dns || !m_pending.contains(dns)) {
         return;
-    case IMAPS:
-    case IMAP:
-        // We found details for IMAP so we want to jump to submission now
-        m_lookupType = SUBMISSION;
-        buildNextRequest();
-        break;
-    case SUBMISSION:
-        // Were complete now
-        if (m_serverConfig->isValid()) {
-            emit success(m_serverConfig);
+    }
+    LookupType type = m_pending.take(dns);
+    if (dns->error() != QDnsLookup::NoError) {
+        qDebug() << "SRV lookup failed: " << dns->name() << dns->errorString();
+    } else if (!dns->serviceRecords().isEmpty()) {
+        QDnsServiceRecord record = preferredRecord(dns->serviceRecords());
+        // rfc2782 & rfc6186 a target of "." means the service is
+        // deliberately not offered, so treat it the same as no record.
+        if (record.target().isEmpty() || record.target() == QStringLiteral(".")) {
+            qDebug() << "Service not offered at: " << dns->name();
         } else {
-            qWarning("Config isn't valid");
-            emit failed();
+            m_records.insert(type, record);
         }
-        break;
+    }
+    dns->deleteLater();
+
+    // The implicit TLS records are always preferred and we can't configure
+    // SMTP without IMAP info. So once both services are settled there's no
+    // need to wait for the remaining records. Likewise a service with no
+    // record at all means there is nothing left worth waiting for.
+    bool imapSettled = isSettled(IMAPS, IMAP);
+    bool smtpSettled = isSettled(SUBMISSIONS, SUBMISSION);
+    bool done = m_pending.isEmpty()
+            || (imapSettled && smtpSettled)
+            || (imapSettled && !m_records.contains(IMAPS) && !m_records.contains(IMAP))
+            || (smtpSettled && !m_records.contains(SUBMISSIONS) && !m_records.contains(SUBMISSION));
+    if (done) {
+        finish();
     }
 }
 
-void SrvLookup::handleReceivedRecords()
+bool SrvLookup::isSettled(const LookupType &secure, const LookupType &plain) const
 {
-    if (m_dns->serviceRecords().size() == 1) {
-        addRecordToConfig(m_dns->serviceRecords().at(0));
-    } else {
-        // rfc6186 section 3.4 states the record with the lowest priority value
-        // Is the one we should use.
-        int i = 0;
-        int idx = -1;
-        quint16 priority = -1;
-
-        auto updateInterestingRecord = [&](const int &index, const quint16 &recordPriority) {
-            idx = index;
-            priority = recordPriority;
-        };
+    if (m_records.contains(secure)) {
+        return true;
+    }
+    QList<LookupType> pending = m_pending.values();
+    return !pending.contains(secure) && !pending.contains(plain);
+}
 
-        Q_FOREACH (const QDnsServiceRecord &record, m_dns->serviceRecords()) {
-            if (priority == -1) {
-                //this is first in the list so is the potential candidate
-                updateInterestingRecord(i, record.priority());
-            } else {
-                if (record.priority() < priority) {
-                    updateInterestingRecord(i, record.priority());
-                }
-            }
-            ++i;
+QDnsServiceRecord SrvLookup::preferredRecord(const QList<QDnsServiceRecord> &records) const
+{
+    // rfc6186 section 3.4 states the record with the lowest priority value
+    // Is the one we should use.
+    int idx = 0;
+    for (int i = 1; i < records.size(); ++i) {
+        if (records.at(i).priority() < records.at(idx).priority()) {
+            idx = i;
         }
-        addRecordToConfig(m_dns->serviceRecords().at(idx));
     }
+    return records.at(idx);
 }
 
-
-void SrvLookup::addRecordToConfig(const QDnsServiceRecord &record)
+void SrvLookup::addRecordToConfig(const LookupType &type, const QDnsServiceRecord &record)
 {
     // Sort host & port first
-    switch (m_lookupType) {
+    switch (type) {
     case INVALID:
-        emit failed();
         return;
     case IMAPS:
     case IMAP:
         m_serverConfig->setImapHost(record.target());
         m_serverConfig->setImapPort(record.port());
-        if (m_lookupType == IMAPS) {
+        if (type == IMAPS) {
             m_serverConfig->setImapMethod(ServerConfiguration::SSL_TLS);
         } else {
             // We assume STARTLS as it's very uncommon that it would
@@ -159,13 +160,42 @@ void SrvLookup::addRecordToConfig(const QDnsServiceRecord &record)
             // capability being present
             m_serverConfig->setImapMethod(ServerConfiguration::STARTTLS);
         }
+        break;
+    case SUBMISSIONS:
     case SUBMISSION:
         m_serverConfig->setSmtpHost(record.target());
         m_serverConfig->setSmtpPort(record.port());
-        if (record.port() == 465) {
+        // rfc8314 _submissions is implicit TLS. Some domains still publish
+        // the legacy 465 port under _submission so treat that the same.
+        if (type == SUBMISSIONS || record.port() == 465) {
             m_serverConfig->setSmtpMethod(ServerConfiguration::SSL_TLS);
         } else {
             m_serverConfig->setSmtpMethod(ServerConfiguration::STARTTLS);
         }
+        break;
+    }
+}
+
+void SrvLookup::finish()
+{
+    LookupType imapType = m_records.contains(IMAPS) ? IMAPS : IMAP;
+    LookupType smtpType = m_records.contains(SUBMISSIONS) ? SUBMISSIONS : SUBMISSION;
+    if (!m_records.contains(imapType) || !m_records.contains(smtpType)) {
+        // If we reached here then we failed to find any IMAP info
+        // So we need to just fail as we don't currently configure
+        // SMTP without IMAP info.
+        abort();
+        emit failed();
+        return;
+    }
+    addRecordToConfig(imapType, m_records.value(imapType));
+    addRecordToConfig(smtpType, m_records.value(smtpType));
+    abort();
+    // Were complete now
+    if (m_serverConfig->isValid()) {
+        emit success(m_serverConfig);
+    } else {
+        qWarning("Config isn't valid");
+        emit failed();
     }
 }
@@ -20,6 +20,8 @@
 #include <QDnsLookup>
 #include <QDnsServiceRecord>
 #include <QPointer>
+#include <QHostAddress>
+#include <QHash>
 #include "serverconfiguration.h"
 
 class SrvLookup : public QObject
@@ -32,26 +34,41 @@ public:
         INVALID,
         IMAPS,
         IMAP,
+        SUBMISSIONS,
         SUBMISSION
     };
 
+    // Use a specific nameserver instead of the system resolver
+    // i.e a local stand-in when testing.
+    void setNameserver(const QHostAddress &nameserver);
+
 signals:
     void success(ServerConfiguration *serverConfig);
     void failed();
 
 public slots:
     void lookUp(const QString &domain);
+    void abort();
 
 private slots:
-    void buildNextRequest();
     void handleLookUpResult();
-    void handleReceivedRecords();
-    void addRecordToConfig(const QDnsServiceRecord &record);
 
 private:
-    QPointer<QDnsLookup> m_dns;
+    void buildRequest(const LookupType &type);
+    QDnsServiceRecord preferredRecord(const QList<QDnsServiceRecord> &records) const;
+    void addRecordToConfig(const LookupType &type, const QDnsServiceRecord &record);
+    // A service is settled once its preferred record is in or
+    // neither of its records can still turn up.
+    bool isSettled(const LookupType &secure, const LookupType &plain) const;
+    void finish();
+
+    // All lookups are in flight at the same time. We keep the
+    // results per type so IMAPS can still win over IMAP regardless
+    // of which one answers first.
+    QHash<QDnsLookup *, LookupType> m_pending;
+    QHash<int, QDnsServiceRecord> m_records;
     QPointer<ServerConfiguration> m_serverConfig;
-    LookupType m_lookupType;
+    QHostAddress m_nameserver;
     QString m_domain;
 };
 
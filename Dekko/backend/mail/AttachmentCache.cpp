@@ -0,0 +1,95 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "AttachmentCache.h"
+#include <QDir>
+#include <QFileInfo>
+#include <qmailstore.h>
+#include <CacheManager.h>
+#include <PolicyManager.h>
+#include <Paths.h>
+
+static QString cacheRoot()
+{
+    return Paths::cacheLocationForFile(AttachmentCache::cacheName());
+}
+
+// Paths look like <account>/<message id>-<part>/<name>
+static quint64 ownerFromPath(const QString &relativePath)
+{
+    const QString location = relativePath.section(QLatin1Char('/'), 1, 1);
+    return location.section(QLatin1Char('-'), 0, 0).toULongLong();
+}
+
+void AttachmentCache::init()
+{
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+    QDir().mkpath(cacheRoot());
+    // Make sure the budgets have been handed over
+    PolicyManager::instance()->storagePolicy();
+    CacheManager::instance()->registerCache(cacheName(), cacheRoot(), &ownerFromPath);
+    QObject::connect(QMailStore::instance(), &QMailStore::messagesRemoved, CacheManager::instance(), [](const QMailMessageIdList &ids) {
+        QList<quint64> owners;
+        owners.reserve(ids.size());
+        Q_FOREACH(const QMailMessageId &id, ids) {
+            owners << id.toULongLong();
+        }
+        CacheManager::instance()->removeOwners(owners);
+    });
+}
+
+QString AttachmentCache::directoryFor(const QMailMessageId &id, const QMailMessagePartContainer::Location &location)
+{
+    const QMailAccountId accountId = QMailMessageMetaData(id).parentAccountId();
+    return QStringLiteral("%1/%2/%3").arg(cacheRoot(),
+                                          QString::number(accountId.toULongLong()),
+                                          location.toString(true));
+}
+
+QString AttachmentCache::filePathFor(const QMailMessageId &id, const QMailMessagePartContainer::Location &location, const QString &name)
+{
+    QString fileName = name;
+    fileName.replace(QLatin1Char('/'), QLatin1Char('_'));
+    // Leading dots would hide it from the CacheManager
+    while (fileName.startsWith(QLatin1Char('.'))) {
+        fileName.remove(0, 1);
+    }
+    if (fileName.isEmpty()) {
+        fileName = QStringLiteral("attachment");
+    }
+    return directoryFor(id, location) + QLatin1Char('/') + fileName;
+}
+
+QString AttachmentCache::partialFilePathFor(const QString &filePath)
+{
+    const QFileInfo info(filePath);
+    return QStringLiteral("%1/.%2.part").arg(info.absolutePath(), info.fileName());
+}
+
+void AttachmentCache::inserted(const QMailMessageId &id, const QString &filePath)
+{
+    CacheManager::instance()->inserted(cacheName(), filePath, id.toULongLong());
+}
+
+void AttachmentCache::touch(const QString &filePath)
+{
+    CacheManager::instance()->accessed(filePath);
+}
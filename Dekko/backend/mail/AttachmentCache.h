@@ -0,0 +1,54 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ATTACHMENTCACHE_H
+#define ATTACHMENTCACHE_H
+
+#include <QString>
+#include <qmailmessage.h>
+
+/** @short Layout of the downloaded attachments cache
+ *
+ * Attachments are saved to cache/attachments/<account>/<location>/<name> and
+ * managed by the CacheManager as the "attachments" cache, so they're kept within
+ * StoragePolicy::attachmentCacheSize and removed along with their message.
+ */
+class AttachmentCache
+{
+public:
+    static QString cacheName() { return QStringLiteral("attachments"); }
+
+    /** @short Register the cache and start following message removals */
+    static void init();
+
+    /** @short Directory the part at \param location gets saved in */
+    static QString directoryFor(const QMailMessageId &id, const QMailMessagePartContainer::Location &location);
+    /** @short Full path of the saved part, \param name is made safe for use as a file name */
+    static QString filePathFor(const QMailMessageId &id, const QMailMessagePartContainer::Location &location, const QString &name);
+    /** @short Where \param filePath is written while it's still being downloaded
+     *
+     * Hidden so the CacheManager leaves it alone.
+     */
+    static QString partialFilePathFor(const QString &filePath);
+
+    /** @short \param filePath for message \param id has been written */
+    static void inserted(const QMailMessageId &id, const QString &filePath);
+    /** @short Mark \param filePath as just used */
+    static void touch(const QString &filePath);
+};
+
+#endif // ATTACHMENTCACHE_H
@@ -0,0 +1,413 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "AttachmentDownload.h"
+#include <climits>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <qmailstore.h>
+#include <MailServiceClient.h>
+#include "AttachmentCache.h"
+#include "MessageCache.h"
+
+// Smallest range requested at a time, parts under two ranges are fetched in one go (bytes)
+#define MINIMUM_RANGE (256 * 1024)
+#define STATE_MAGIC 0x64656b61u // "deka"
+
+static QString stateFileFor(const QString &partialFile)
+{
+    return partialFile + QStringLiteral(".state");
+}
+
+// Until a message is fully retrieved qmfstoragemanager keeps each part's encoded
+// body in a file of its own beside the message, named after the part's location
+static QString storedPartFile(const QMailMessageId &id, const QMailMessagePartContainer::Location &location)
+{
+    const QMailMessageMetaData meta = QMailStore::instance()->messageMetaData(id);
+    if (meta.contentScheme() != QLatin1String("qmfstoragemanager") || meta.contentIdentifier().isEmpty()) {
+        return QString();
+    }
+    return meta.contentIdentifier() + QStringLiteral("-parts/") + location.toString(false);
+}
+
+static int hexValue(const char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+PartDecoder::PartDecoder(const QMailMessageBody::TransferEncoding encoding) :
+    m_encoding(encoding)
+{
+}
+
+QByteArray PartDecoder::decode(const QByteArray &input)
+{
+    switch (m_encoding) {
+    case QMailMessageBody::Base64:
+        return decodeBase64(input);
+    case QMailMessageBody::QuotedPrintable:
+        return decodeQuotedPrintable(input, false);
+    default:
+        return input;
+    }
+}
+
+QByteArray PartDecoder::finish()
+{
+    QByteArray output;
+    if (m_encoding == QMailMessageBody::QuotedPrintable) {
+        output = decodeQuotedPrintable(QByteArray(), true);
+    } else if (m_encoding == QMailMessageBody::Base64 && !m_carry.isEmpty()) {
+        // Missing padding, decode what we can
+        output = QByteArray::fromBase64(m_carry);
+    }
+    m_carry.clear();
+    return output;
+}
+
+QByteArray PartDecoder::decodeBase64(const QByteArray &input)
+{
+    QByteArray encoded = m_carry;
+    encoded.reserve(m_carry.size() + input.size());
+    // Drop line breaks and anything else outside the alphabet
+    for (const char c : input) {
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+                || c == '+' || c == '/' || c == '=') {
+            encoded.append(c);
+        }
+    }
+    // Only whole quads can be decoded, the rest waits for the next piece
+    const int usable = encoded.size() - (encoded.size() % 4);
+    m_carry = encoded.mid(usable);
+    encoded.truncate(usable);
+    return QByteArray::fromBase64(encoded);
+}
+
+QByteArray PartDecoder::decodeQuotedPrintable(const QByteArray &input, const bool final)
+{
+    const QByteArray encoded = m_carry + input;
+    m_carry.clear();
+
+    QByteArray output;
+    output.reserve(encoded.size());
+    const int size = encoded.size();
+    int i = 0;
+    while (i < size) {
+        const char c = encoded.at(i);
+        if (c != '=') {
+            output.append(c);
+            ++i;
+            continue;
+        }
+        // An escape split across pieces is finished off next time
+        if (!final && i + 2 >= size) {
+            m_carry = encoded.mid(i);
+            break;
+        }
+        if (i + 1 < size && encoded.at(i + 1) == '\n') {
+            i += 2; // soft line break
+        } else if (i + 2 < size && encoded.at(i + 1) == '\r' && encoded.at(i + 2) == '\n') {
+            i += 3; // soft line break
+        } else if (i + 2 < size && hexValue(encoded.at(i + 1)) >= 0 && hexValue(encoded.at(i + 2)) >= 0) {
+            output.append(char((hexValue(encoded.at(i + 1)) << 4) | hexValue(encoded.at(i + 2))));
+            i += 3;
+        } else {
+            // Not a valid escape, leave it as is
+            output.append(c);
+            ++i;
+        }
+    }
+    return output;
+}
+
+AttachmentDownload::AttachmentDownload(const QMailMessageId &id, const QMailMessagePartContainer::Location &location,
+                                       const QString &filePath, QObject *parent) : QObject(parent),
+    m_id(id), m_location(location), m_filePath(filePath), m_consumed(0), m_written(0), m_total(0),
+    m_running(false), m_wholePart(false)
+{
+}
+
+void AttachmentDownload::start()
+{
+    if (m_running) {
+        return;
+    }
+    // Neither changes with what has been downloaded so any stored summary will do,
+    // only a message without one gets parsed
+    MessageStructure structure = MessageStructure::fromMetaData(QMailMessageMetaData(m_id));
+    if (!structure.isValid()) {
+        structure = MessageCache::instance()->structure(m_id);
+    }
+    const MessageStructure::Part *part = structure.part(m_location.toString(true));
+    if (!part) {
+        qWarning() << "[AttachmentDownload] No part" << m_location.toString(true) << "in message" << m_id;
+        emit failed();
+        return;
+    }
+    m_total = part->size;
+    m_decoder = PartDecoder(part->transferEncoding);
+    m_wholePart = m_total < 2 * MINIMUM_RANGE;
+
+    if (QFile::exists(m_filePath)) {
+        AttachmentCache::touch(m_filePath);
+        emit progress(m_total, m_total);
+        emit finished(m_filePath);
+        return;
+    }
+    if (!QDir().mkpath(QFileInfo(m_filePath).absolutePath()) || !openPartialFile()) {
+        qWarning() << "[AttachmentDownload] Unable to write to" << m_filePath;
+        emit failed();
+        return;
+    }
+
+    m_running = true;
+    connect(Client::instance(), &Client::messagePartNowAvailable, this, &AttachmentDownload::handlePartAvailable);
+    connect(Client::instance(), &Client::messagePartFetchFailed, this, &AttachmentDownload::handlePartFetchFailed);
+
+    // Whatever is already in the store can be written out straight away
+    switch (consume()) {
+    case Complete:
+        complete();
+        break;
+    case Error:
+        fail();
+        break;
+    case Incomplete:
+        requestNextRange();
+        break;
+    }
+}
+
+void AttachmentDownload::handlePartAvailable(const quint64 &id, const QString &location)
+{
+    if (id != m_id.toULongLong() || location != m_location.toString(true)) {
+        return;
+    }
+    // Only drops the cached copy, it's parsed again only if consume() needs it
+    MessageCache::instance()->invalidate(m_id);
+    const qint64 consumed = m_consumed;
+    switch (consume()) {
+    case Complete:
+        complete();
+        break;
+    case Error:
+        fail();
+        break;
+    case Incomplete:
+        if (m_consumed == consumed) {
+            if (m_wholePart) {
+                fail();
+                return;
+            }
+            // The service didn't give us a range so ask for the lot instead
+            qDebug() << "[AttachmentDownload] Range retrieval made no progress, fetching whole part";
+            m_wholePart = true;
+        }
+        requestNextRange();
+        break;
+    }
+}
+
+void AttachmentDownload::handlePartFetchFailed(const quint64 &id, const QString &location)
+{
+    if (id != m_id.toULongLong() || location != m_location.toString(true)) {
+        return;
+    }
+    fail();
+}
+
+bool AttachmentDownload::append(const QByteArray &arrived)
+{
+    const QByteArray decoded = m_decoder.decode(arrived);
+    if (m_file.write(decoded) != decoded.size()) {
+        qWarning() << "[AttachmentDownload] Write failed" << m_file.errorString();
+        return false;
+    }
+    m_written += decoded.size();
+    m_consumed += arrived.size();
+    return true;
+}
+
+AttachmentDownload::Result AttachmentDownload::incomplete()
+{
+    m_file.flush();
+    saveState();
+    emit progress(m_consumed, qMax(m_total, m_consumed));
+    return Incomplete;
+}
+
+bool AttachmentDownload::readStoredRange(QByteArray *arrived)
+{
+    QFile stored(storedPartFile(m_id, m_location));
+    if (stored.fileName().isEmpty() || !stored.open(QIODevice::ReadOnly) || stored.size() < m_consumed) {
+        return false;
+    }
+    if (!stored.seek(m_consumed)) {
+        return false;
+    }
+    *arrived = stored.readAll();
+    return true;
+}
+
+AttachmentDownload::Result AttachmentDownload::consume()
+{
+    // Read just the newly stored range while the part is still arriving, loading
+    // the message would read everything retrieved so far again after every range
+    QByteArray arrived;
+    if (m_consumed < m_total && readStoredRange(&arrived)) {
+        if (!append(arrived)) {
+            return Error;
+        }
+        if (m_consumed < m_total) {
+            return incomplete();
+        }
+    }
+
+    // Small parts, whole part fetches and confirming the part is complete go
+    // through the message
+    const ParsedMessagePtr parsed = MessageCache::instance()->message(m_id);
+    const QMailMessagePart &part = parsed->message().partAt(m_location);
+    if (!part.contentAvailable() && !part.partialContentAvailable()) {
+        return Incomplete;
+    }
+
+    const QByteArray encoded = part.body().data(QMailMessageBody::Encoded);
+    if (encoded.size() < m_consumed) {
+        // The store holds less than we already decoded, e.g the message was refetched
+        qDebug() << "[AttachmentDownload] Stored part shrank, restarting" << m_filePath;
+        resetPartialFile();
+    }
+    if (encoded.size() > m_consumed
+            && !append(QByteArray::fromRawData(encoded.constData() + m_consumed, encoded.size() - m_consumed))) {
+        return Error;
+    }
+
+    if (part.contentAvailable()) {
+        const QByteArray rest = m_decoder.finish();
+        if (m_file.write(rest) != rest.size()) {
+            qWarning() << "[AttachmentDownload] Write failed" << m_file.errorString();
+            return Error;
+        }
+        m_written += rest.size();
+        return Complete;
+    }
+    return incomplete();
+}
+
+void AttachmentDownload::requestNextRange()
+{
+    if (m_wholePart) {
+        Client::instance()->downloadMessagePart(m_location);
+        return;
+    }
+    // Each range is at least as big as what we already have, which keeps the
+    // number of round trips down to the log of the part size
+    const qint64 next = m_consumed + qMax<qint64>(MINIMUM_RANGE, m_consumed);
+    Client::instance()->downloadMessagePartRange(m_location, uint(qMin<qint64>(next, UINT_MAX)));
+}
+
+void AttachmentDownload::complete()
+{
+    disconnect(Client::instance(), 0, this, 0);
+    m_running = false;
+    m_file.close();
+    QFile::remove(m_filePath);
+    if (!QFile::rename(m_file.fileName(), m_filePath)) {
+        qWarning() << "[AttachmentDownload] Unable to move download into place" << m_filePath;
+        removePartialFiles();
+        emit failed();
+        return;
+    }
+    QFile::remove(stateFileFor(m_file.fileName()));
+    AttachmentCache::inserted(m_id, m_filePath);
+    emit progress(m_consumed, m_consumed);
+    emit finished(m_filePath);
+}
+
+void AttachmentDownload::fail()
+{
+    disconnect(Client::instance(), 0, this, 0);
+    m_running = false;
+    // The partial file and state are left behind so the next attempt can resume
+    m_file.close();
+    emit failed();
+}
+
+bool AttachmentDownload::openPartialFile()
+{
+    m_file.setFileName(AttachmentCache::partialFilePathFor(m_filePath));
+    QFile state(stateFileFor(m_file.fileName()));
+    if (m_file.exists() && state.open(QIODevice::ReadOnly)) {
+        QDataStream in(&state);
+        quint32 magic = 0;
+        qint64 consumed = 0;
+        qint64 written = 0;
+        QByteArray carry;
+        in >> magic >> consumed >> written >> carry;
+        // Anything written after the last saved state gets decoded again
+        if (in.status() == QDataStream::Ok && magic == STATE_MAGIC && m_file.size() >= written) {
+            if (m_file.open(QIODevice::ReadWrite) && m_file.resize(written) && m_file.seek(written)) {
+                qDebug() << "[AttachmentDownload] Resuming" << m_filePath << "from" << written;
+                m_consumed = consumed;
+                m_written = written;
+                m_decoder.setCarry(carry);
+                return true;
+            }
+            m_file.close();
+        }
+    }
+    m_consumed = 0;
+    m_written = 0;
+    m_decoder.setCarry(QByteArray());
+    return m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+}
+
+void AttachmentDownload::resetPartialFile()
+{
+    m_file.resize(0);
+    m_file.seek(0);
+    m_consumed = 0;
+    m_written = 0;
+    m_decoder.setCarry(QByteArray());
+}
+
+void AttachmentDownload::saveState()
+{
+    QSaveFile state(stateFileFor(m_file.fileName()));
+    if (!state.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream out(&state);
+    out << quint32(STATE_MAGIC) << m_consumed << m_written << m_decoder.carry();
+    state.commit();
+}
+
+void AttachmentDownload::removePartialFiles()
+{
+    QFile::remove(stateFileFor(m_file.fileName()));
+    QFile::remove(m_file.fileName());
+}
@@ -0,0 +1,121 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ATTACHMENTDOWNLOAD_H
+#define ATTACHMENTDOWNLOAD_H
+
+#include <QObject>
+#include <QFile>
+#include <qmailmessage.h>
+
+/** @short Incremental content transfer decoder
+ *
+ * Decodes base64 and quoted-printable input fed in arbitrary sized pieces, carrying
+ * any incomplete sequence at the end of a piece over to the next. Other encodings
+ * are passed straight through.
+ */
+class PartDecoder
+{
+public:
+    explicit PartDecoder(const QMailMessageBody::TransferEncoding encoding = QMailMessageBody::NoEncoding);
+
+    QByteArray decode(const QByteArray &input);
+    /** @short Decode whatever is left over once the input is complete */
+    QByteArray finish();
+
+    /** @short Undecoded input carried over from the last piece */
+    QByteArray carry() const { return m_carry; }
+    void setCarry(const QByteArray &carry) { m_carry = carry; }
+
+private:
+    QByteArray decodeBase64(const QByteArray &input);
+    QByteArray decodeQuotedPrintable(const QByteArray &input, const bool final);
+
+    QMailMessageBody::TransferEncoding m_encoding;
+    QByteArray m_carry;
+};
+
+/** @short Streams a message part to a file as it's retrieved
+ *
+ * Rather than waiting for the whole part to reach the store and then decoding it
+ * in one go, the part is requested in ranges. After each range is stored only the
+ * newly arrived encoded bytes are read back, decoded and appended to a hidden ".<file>.part".
+ * Once the part is complete the file is renamed into place.
+ *
+ * How far the download got is recorded next to the partial file after every range,
+ * so if the app goes away mid download the next attempt carries on from there
+ * rather than starting over.
+ */
+class AttachmentDownload : public QObject
+{
+    Q_OBJECT
+public:
+    AttachmentDownload(const QMailMessageId &id, const QMailMessagePartContainer::Location &location,
+                       const QString &filePath, QObject *parent = 0);
+
+    void start();
+
+    QString filePath() const { return m_filePath; }
+    // Progress is counted in encoded bytes, the same as the part size we know up front
+    qint64 received() const { return m_consumed; }
+    qint64 total() const { return m_total; }
+
+signals:
+    void progress(const qint64 &received, const qint64 &total);
+    void finished(const QString &filePath);
+    void failed();
+
+private slots:
+    void handlePartAvailable(const quint64 &id, const QString &location);
+    void handlePartFetchFailed(const quint64 &id, const QString &location);
+
+private:
+    enum Result {
+        Incomplete,
+        Complete,
+        Error
+    };
+    Result consume();
+    bool readStoredRange(QByteArray *arrived);
+    bool append(const QByteArray &arrived);
+    Result incomplete();
+    void requestNextRange();
+    void complete();
+    void fail();
+
+    bool openPartialFile();
+    void resetPartialFile();
+    void saveState();
+    void removePartialFiles();
+
+    QMailMessageId m_id;
+    QMailMessagePartContainer::Location m_location;
+    QString m_filePath;
+    QFile m_file;
+    PartDecoder m_decoder;
+    // Encoded bytes already decoded into m_file
+    qint64 m_consumed;
+    // Decoded bytes in m_file
+    qint64 m_written;
+    // Encoded size of the part
+    qint64 m_total;
+    bool m_running;
+    // Fetch the part in one go, it's either small or ranges aren't working
+    bool m_wholePart;
+};
+
+#endif // ATTACHMENTDOWNLOAD_H
@@ -19,15 +19,18 @@
 #include <QDebug>
 #include <QtQml>
 #include <QFile>
+#include <QDir>
 #include <QFileInfo>
 #include <QQmlEngine>
-#include <QUrlQuery>
-#include <QNetworkRequest>
+#include <QTemporaryFile>
 #include <QMimeDatabase>
 #include <qmailaccount.h>
 #include <qmailnamespace.h>
-#include <MailServiceClient.h>
 #include <Paths.h>
+#include "AttachmentCache.h"
+#include "AttachmentDownload.h"
+#include "MessageCache.h"
+#include "MimeWriter.h"
 
 Attachments::Attachments(QObject *parent) : QObject(parent),
     m_model(0)
@@ -39,11 +42,11 @@ Attachments::Attachments(QObject *parent) : QObject(parent),
 void Attachments::setMessageId(const QMailMessageId &id)
 {
     m_id = id;
-    QMailMessage msg(m_id);
+    const MessageStructure structure = MessageCache::instance()->structure(m_id);
 
-    Q_FOREACH(auto pLocation, msg.findAttachmentLocations()) {
+    Q_FOREACH(const MessageStructure::Part &part, structure.attachments()) {
         Attachment *a = new Attachment(0);
-        a->init(m_id, pLocation);
+        a->init(m_id, part);
         qDebug() << "Attachment name: " << a->displayName();
         qDebug() << "Attachment size: " << a->size();
         m_model->append(a);
@@ -51,12 +54,14 @@ void Attachments::setMessageId(const QMailMessageId &id)
 }
 
 Attachment::Attachment(QObject *parent) : QObject(parent),
-    m_type(Text), m_fetching(false), m_qnam(0), m_reply(0), m_hasRefs(false)
+    m_type(Text), m_fetching(false), m_progress(0), m_download(0), m_fromStructure(false), m_hasRefs(false),
+    m_spool(0)
 {
 }
 
 Attachment::Attachment(QObject *parent, const QString &attachment, const Attachment::PartType &partType, const Attachment::Disposition &disposition):
-    QObject(parent), m_partType(partType), m_disposition(disposition), m_hasRefs(false)
+    QObject(parent), m_type(Text), m_fetching(false), m_progress(0), m_download(0), m_fromStructure(false),
+    m_partType(partType), m_disposition(disposition), m_hasRefs(false), m_spool(0)
 {
     switch(partType) {
     case Message:
@@ -81,15 +86,21 @@ Attachment::Attachment(QObject *parent, const QString &attachment, const Attachm
             m_part = QMailMessagePart::fromMessageReference(msg.id(), d, cType, msg.transferEncoding());
             m_hasRefs = true;
         } else {
-            m_part = QMailMessagePart::fromData(msg.toRfc2822(), d, cType, msg.transferEncoding());
+            // Spool it to disk rather than holding the whole message in memory. The
+            // file goes with us, every draft save copies it into the store meanwhile
+            if (spool(msg)) {
+                m_part = QMailMessagePart::fromFile(m_spool->fileName(), d, cType, QMailMessageBody::NoEncoding, QMailMessageBody::AlreadyEncoded);
+            } else {
+                m_part = QMailMessagePart::fromData(msg.toRfc2822(), d, cType, msg.transferEncoding());
+            }
         }
         break;
     }
     case MessagePart:
     {
         QMailMessagePart::Location location(attachment);
-        const QMailMessage msg(location.containingMessageId());
-        const QMailMessagePart &existingPart(msg.partAt(location));
+        const ParsedMessagePtr parsed = MessageCache::instance()->message(location.containingMessageId());
+        const QMailMessagePart &existingPart(parsed->message().partAt(location));
         QMailMessageContentDisposition existingDisposition(existingPart.contentDisposition());
 
         QMailMessageContentDisposition d(disposition == Inline ? QMailMessageContentDisposition::Inline : QMailMessageContentDisposition::Attachment);
@@ -143,21 +154,30 @@ QString Attachment::displayName()
 
 ////        }
 //    }
+    if (m_fromStructure) {
+        return m_summary.displayName;
+    }
     return m_part.displayName();
 }
 
 QString Attachment::mimeType() const
 {
+    if (m_fromStructure) {
+        return m_summary.contentType;
+    }
     return QString::fromLatin1(m_part.contentType().content());
 }
 
 QString Attachment::size()
 {
-    return sizeToReadableString(m_part.contentDisposition().size());
+    return sizeToReadableString(sizeInBytes());
 }
 
 int Attachment::sizeInBytes() const
 {
+    if (m_fromStructure) {
+        return m_summary.size;
+    }
     return m_part.contentDisposition().size();
 }
 
@@ -168,11 +188,17 @@ Attachment::Type Attachment::type() const
 
 bool Attachment::contentAvailable() const
 {
+    if (m_fromStructure) {
+        return m_summary.available;
+    }
     return m_part.contentAvailable();
 }
 
 QString Attachment::location() const
 {
+    if (m_fromStructure) {
+        return m_summary.location;
+    }
     return m_part.location().toString(true);
 }
 
@@ -186,6 +212,11 @@ bool Attachment::fetchInProgress() const
     return m_fetching;
 }
 
+qreal Attachment::progress() const
+{
+    return m_progress;
+}
+
 QString Attachment::mimeTypeIcon() const
 {
     return QStringLiteral("%1-symbolic").arg(QMimeDatabase().mimeTypeForName(mimeType()).genericIconName());
@@ -203,14 +234,15 @@ static CTypes types()
     return t;
 }
 
-void Attachment::init(const QMailMessageId &id, const QMailMessagePartContainer::Location &location)
+void Attachment::init(const QMailMessageId &id, const MessageStructure::Part &part)
 {
     static const CTypes typeMap(types());
-    m_location = location;
     m_id = id;
-    m_part = QMailMessage(m_id).partAt(m_location);
+    m_location = QMailMessagePartContainer::Location(part.location);
+    m_summary = part;
+    m_fromStructure = true;
 
-    QString type = m_part.contentType().type().toLower();
+    QString type = part.contentType.section(QLatin1Char('/'), 0, 0).toLower();
     CTypes::const_iterator it = typeMap.find(type);
     if (it != typeMap.end()) {
         m_type = it.value();
@@ -220,6 +252,30 @@ void Attachment::init(const QMailMessageId &id, const QMailMessagePartContainer:
     emit attachmentChanged();
 }
 
+bool Attachment::spool(const QMailMessage &msg)
+{
+    const QString directory = Paths::cacheLocationForFile(QStringLiteral("outgoing"));
+    static bool swept = false;
+    if (!swept) {
+        // Left behind by a crash, nothing from a previous run can still be in use
+        swept = true;
+        Q_FOREACH(const QFileInfo &info, QDir(directory).entryInfoList(QStringList() << QStringLiteral("*.eml"), QDir::Files)) {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+    QDir().mkpath(directory);
+    m_spool = new QTemporaryFile(directory + QStringLiteral("/XXXXXX.eml"), this);
+    if (!m_spool->open() || MimeWriter::write(msg, m_spool) < 0 || !m_spool->flush()) {
+        qWarning() << "[Attachment] Unable to spool message" << msg.id() << m_spool->errorString();
+        delete m_spool;
+        m_spool = 0;
+        return false;
+    }
+    // The name stays reserved and the file is removed when we're destroyed
+    m_spool->close();
+    return true;
+}
+
 void Attachment::addToMessage(QMailMessage &msg)
 {
     switch(m_partType) {
@@ -245,91 +301,52 @@ void Attachment::addToMessage(QMailMessage &msg)
 
 void Attachment::open(QObject *qmlObject)
 {
+    Q_UNUSED(qmlObject);
+    if (m_download) {
+        return;
+    }
     m_fetching = true;
+    m_progress = 0;
     m_url = QString();
     emit progressChanged();
-    if (!contentAvailable()) {
-        QQmlEngine *engine = qmlEngine(qmlObject);
-        Q_ASSERT(engine);
-        m_qnam = engine->networkAccessManagerFactory()->create(this);
-        connect(m_qnam, SIGNAL(finished(QNetworkReply*)),
-                this, SLOT(handlePartFetched()));
-        fetch();
-    } else {
-        handlePartFetched();
-    }
+    m_download = new AttachmentDownload(m_id, m_location,
+                                        AttachmentCache::filePathFor(m_id, m_location, displayName()), this);
+    connect(m_download, &AttachmentDownload::progress, this, &Attachment::handleDownloadProgress);
+    connect(m_download, &AttachmentDownload::finished, this, &Attachment::handleDownloadFinished);
+    connect(m_download, &AttachmentDownload::failed, this, &Attachment::handleDownloadFailed);
+    m_download->start();
 }
 
-void Attachment::fetch()
+void Attachment::handleDownloadProgress(const qint64 &received, const qint64 &total)
 {
-    if (!m_qnam) {
-        // TODO emit some error
-        return;
-    }
-    if (m_reply) {
-        disconnect(m_reply, 0, this, 0);
-        delete m_reply;
-        m_reply = 0;
-    }
-    m_reply = m_qnam->get(QNetworkRequest(partFetchUrl()));
-    connect(m_reply, SIGNAL(finished()), this, SLOT(handlePartFetched()));
+    m_progress = total > 0 ? qMin<qreal>(1.0, qreal(received) / qreal(total)) : 0;
+    emit progressChanged();
 }
 
-void Attachment::handlePartFetched()
+void Attachment::handleDownloadFinished(const QString &filePath)
 {
-    m_part = QMailMessage(m_id).partAt(m_location);
-    if (contentAvailable()) {
-        QString filepath = writePartToFile();
-        if (!filepath.isEmpty()) {
-            if (!filepath.startsWith(QStringLiteral("file://"))) {
-                filepath.prepend(QStringLiteral("file://"));
-            }
-            m_url = filepath;
-            emit urlChanged();
-            emit readyToOpen(m_url);
-        }
-    } else {
-        qDebug() << "[Attachments::handlePartFetched] content still not available";
-    }
-    m_fetching = false;
-    emit progressChanged();
+    m_summary.available = true;
+    emit attachmentChanged();
+    m_url = QUrl::fromLocalFile(QFileInfo(filePath).absoluteFilePath()).toString();
+    emit urlChanged();
+    emit readyToOpen(m_url);
+    finishDownload();
 }
 
-QString Attachment::writePartToFile()
+void Attachment::handleDownloadFailed()
 {
-    QMailMessage msg(m_id);
-    QMailAccountId accountId = msg.parentAccountId();
-    QString attachmentPath = Paths::cacheLocationForFile(
-                QStringLiteral("attachments/%1/%2").arg(
-                    QString::number(accountId.toULongLong()), m_location.toString(true)));
-    QString attachmentFile = attachmentPath + "/" + displayName();
-    QFile file(attachmentFile);
-    QString path;
-    if (!file.exists()) {
-        // refresh the part
-        m_part = QMailMessage(m_id).partAt(m_location);
-        if (m_part.hasBody()) {
-            path = m_part.writeBodyTo(attachmentPath);
-        } else {
-            return QString();
-        }
-    } else {
-        path = attachmentFile;
-    }
-    qDebug() << "AttachmentPath" << path;
-    return QFileInfo(path).absoluteFilePath();
+    qDebug() << "[Attachment] Failed downloading" << m_location.toString(true);
+    finishDownload();
 }
 
-QUrl Attachment::partFetchUrl()
+void Attachment::finishDownload()
 {
-    QUrl url;
-    url.setScheme(QStringLiteral("dekko-part"));
-    url.setHost(QStringLiteral("msg"));
-    QUrlQuery query;
-    query.addQueryItem(QStringLiteral("messageId"), QString::number(m_id.toULongLong()));
-    query.addQueryItem(QStringLiteral("location"), m_location.toString(true));
-    url.setQuery(query);
-    return url;
+    if (m_download) {
+        m_download->deleteLater();
+        m_download = 0;
+    }
+    m_fetching = false;
+    emit progressChanged();
 }
 
 QString Attachment::sizeToReadableString(const int &size)
@@ -346,6 +363,9 @@ QString Attachment::sizeToReadableString(const int &size)
 
 bool Attachment::isRfc822()
 {
+    if (m_fromStructure) {
+        return m_summary.contentType.toLower() == QStringLiteral("message/rfc822");
+    }
     return (m_part.contentType().type().toLower() == "message") &&
             (m_part.contentType().subType().toLower() == "rfc822");
 }
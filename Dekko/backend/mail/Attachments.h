@@ -23,10 +23,11 @@
 #include <QMap>
 #include <QmlObjectListModel.h>
 #include <qmailmessage.h>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
+#include "MessageStructure.h"
 
 class Attachment;
+class AttachmentDownload;
+class QTemporaryFile;
 
 class Attachments : public QObject
 {
@@ -57,6 +58,7 @@ class Attachment : public QObject
     Q_PROPERTY(QString location READ location NOTIFY attachmentChanged)
     Q_PROPERTY(Type type READ type NOTIFY attachmentChanged)
     Q_PROPERTY(bool fetchInProgress READ fetchInProgress NOTIFY progressChanged)
+    Q_PROPERTY(qreal progress READ progress NOTIFY progressChanged)
     Q_PROPERTY(QString mimeTypeIcon READ mimeTypeIcon NOTIFY attachmentChanged)
 
     Q_ENUMS(Type)
@@ -93,11 +95,16 @@ public:
     QString location() const;
     QString url() const;
     bool fetchInProgress() const;
+    qreal progress() const;
     QString mimeTypeIcon() const;
     PartType partType() const { return m_partType; }
     Disposition contentDisposition() const { return m_disposition; }
 
-    void init(const QMailMessageId &id, const QMailMessagePartContainer::Location &location);
+    /** @short Describe the part of message \param id from it's structure summary
+     *
+     * Nothing is loaded from the store until the part is opened.
+     */
+    void init(const QMailMessageId &id, const MessageStructure::Part &part);
 
     void addToMessage(QMailMessage &msg);
 
@@ -108,34 +115,40 @@ signals:
     void urlChanged();
 
 public slots:
-    // This is a quick hack passing in a qml object to avoid a circular dependency.
-    // ideally we should split the Client* classes into another lib
-    // and avoid a circular dependency properly in the long term.
+    // The qml object is no longer used, the part is streamed to the
+    // attachments cache by AttachmentDownload rather than fetched through
+    // the qml engine's network access manager.
     void open(QObject *qmlObject);
 
 private slots:
-    void fetch();
-    void handlePartFetched();
+    void handleDownloadProgress(const qint64 &received, const qint64 &total);
+    void handleDownloadFinished(const QString &filePath);
+    void handleDownloadFailed();
 
 private:
-    QString writePartToFile();
-    QUrl partFetchUrl();
+    void finishDownload();
     QUrl saveToAccessibleFile();
     QString sizeToReadableString(const int &size);
     bool isRfc822();
+    bool spool(const QMailMessage &msg);
 
     QMailMessageId m_id;
     QMailMessagePartContainer::Location m_location;
     Type m_type;
     QMailMessagePart m_part;
+    // Set by init(), the accessors then use m_summary instead of m_part
+    MessageStructure::Part m_summary;
+    bool m_fromStructure;
     QString m_url;
     bool m_fetching;
-    QNetworkAccessManager *m_qnam;
-    QNetworkReply *m_reply;
+    qreal m_progress;
+    AttachmentDownload *m_download;
     PartType m_partType;
     Disposition m_disposition;
     QString m_filePath;
     bool m_hasRefs;
+    // A forwarded message written out as it's sent, removed along with us
+    QTemporaryFile *m_spool;
 };
 
 #endif // ATTACHMENTS_H
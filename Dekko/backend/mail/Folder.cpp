@@ -273,16 +273,10 @@ void Folder::handleContentsModified(const QMailFolderIdList &idList)
     }
 }
 
-void Folder::handleUnreadCount(QDBusPendingCallWatcher *call)
+void Folder::handleUnreadCount(const int &count)
 {
-    QDBusPendingReply<int> reply = *call;
-    if (reply.isError()) {
-        qDebug() << "[Folder::handleUnreadCount] >> Reply error";
-        return;
-    }
-    m_unreadCount = (int)reply.value();
+    m_unreadCount = count;
     qDebug() << "{Folder::handleUnreadCount} >> GOT UNREAD COUNT";
-    call->deleteLater();
     emit unreadCountChanged();
 }
 
@@ -339,10 +333,8 @@ void Folder::updateUnreadCount()
     }
     }
 
-    QDBusPendingReply<int> reply = Client::instance()->bus()->totalCount(msg_key_bytes(unreadKey));
-
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
-
-    connect(watcher, &QDBusPendingCallWatcher::finished, this, &Folder::handleUnreadCount);
+    Client::instance()->countMessages(unreadKey, this, [=](const int &count) {
+        handleUnreadCount(count);
+    });
 }
 
@@ -105,7 +105,7 @@ public slots:
 
 private slots:
     void updateUnreadCount();
-    void handleUnreadCount(QDBusPendingCallWatcher *call);
+    void handleUnreadCount(const int &count);
 
 private:
     QMailAccountId m_account;
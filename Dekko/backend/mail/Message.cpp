@@ -19,10 +19,11 @@
 #include <qmailfolder.h>
 #include <qmailmessagekey.h>
 #include <qmailstore.h>
-#include <Account.h>
+#include <AccountRegistry.h>
+#include "MessageCache.h"
 
 MinimalMessage::MinimalMessage(QObject *parent) : QObject(parent),
-    m_from(0), m_checked(Qt::Unchecked)
+    m_from(0), m_checked(Qt::Unchecked), m_threadCount(1), m_threadUnreadCount(0)
 {
 }
 
@@ -92,7 +93,7 @@ bool MinimalMessage::isDraft() const
 
 QString MinimalMessage::previousFolderName() const
 {
-    return QMailFolder(QMailMessage(m_id).restoreFolderId()).displayName();
+    return QMailFolder(QMailMessageMetaData(m_id).restoreFolderId()).displayName();
 }
 
 QDateTime MinimalMessage::date() const
@@ -148,6 +149,7 @@ void MinimalMessage::setMessageId(const QMailMessageId &id)
     }
     QMailMessageMetaData msg(m_id);
 //    qDebug() << "MSG ID: " << messageId();
+    m_parentAccountId = msg.parentAccountId();
     m_from = new MailAddress(this);
     m_from->setAddress(msg.from());
 
@@ -164,6 +166,16 @@ void MinimalMessage::setChecked(const Qt::CheckState &checked)
     emit checkedChanged();
 }
 
+void MinimalMessage::setThreadInfo(const int &count, const int &unread)
+{
+    if (count == m_threadCount && unread == m_threadUnreadCount) {
+        return;
+    }
+    m_threadCount = count;
+    m_threadUnreadCount = unread;
+    emit threadChanged();
+}
+
 void MinimalMessage::setIsTodo(const bool todo)
 {
     QMailMessageMetaData mmd(m_id);
@@ -186,24 +198,21 @@ Message::Message(QObject *parent) : MinimalMessage(parent),
 
 QString Message::toRecipientsString()
 {
-    QMailAccountId accId(QMailMessage(m_id).parentAccountId());
-    Account *account = new Account(this);
-    account->setId(accId.toULongLong());
-    AccountConfiguration *config = static_cast<AccountConfiguration *>(account->incoming());
+    const AccountInfo account = AccountRegistry::instance()->account(m_parentAccountId);
 
-    auto listContainsMe = [](AccountConfiguration *config, const QStringList &recips) -> int {
+    auto listContainsMe = [](const AccountInfo &account, const QStringList &recips) -> int {
         int idx = -1;
         for (int i = 0; i < recips.size(); ++i) {
             QString recip = recips.at(i);
-            if (config->name() == recip || config->email() == recip) {
+            if (account.incomingName == recip || account.incomingEmail == recip) {
                 return i;
             }
         }
         return idx;
     };
 
-    if (!config) {
-        qDebug() << "Failed to create account configuration";
+    if (!account.isValid()) {
+        qDebug() << "Failed to find account";
         return QString("Failed");
     }
     QStringList addr; // list of addresses to compare
@@ -211,7 +220,7 @@ QString Message::toRecipientsString()
     Q_FOREACH(auto a, m_to->toList()) {
         addr.append(a->address());
     }
-    int myIndex = listContainsMe(config, addr);
+    int myIndex = listContainsMe(account, addr);
     // we actually want the name here
     addr.clear();
     Q_FOREACH(auto n, m_to->toList()) {
@@ -237,35 +246,30 @@ QUrl Message::findInterestingBodyPart(const QMailMessageId &id, const bool prefe
     if (!id.isValid()) {
         return QUrl();
     }
-    QMailMessage msg(id);
+    // Decided from the summary stored with the metadata, the body isn't loaded
+    const MessageStructure structure = MessageCache::instance()->structure(id);
     bool isPlainText = false;
     QString msgIdString = QString::number(id.toULongLong());
     QString location;
     QUrl url;
 
-    if (msg.multipartType() == QMailMessage::MultipartNone && !msg.body().data().isEmpty()) {
-        isPlainText = (msg.body().contentType().content() == QByteArrayLiteral("text/plain"));
+    if (structure.hasSinglePartBody()) {
+        isPlainText = structure.singlePartIsPlainText();
         url.setScheme(QStringLiteral("dekko-msg"));
     } else {
-        QMailMessagePart *part = 0;
-        if (!preferPlainText && msg.hasHtmlBody()) {
-            QMailMessagePartContainer *html = msg.findHtmlContainer();
-            if (html) {
-                part = static_cast<QMailMessagePart *>(html);
-            }
+        if (!preferPlainText) {
+            location = structure.htmlLocation();
         }
-        if (!part || preferPlainText) {
-            QMailMessagePartContainer *ptext = msg.findPlainTextContainer();
-            if (ptext) {
-                part = static_cast<QMailMessagePart *>(ptext);
+        if (location.isEmpty() || preferPlainText) {
+            if (!structure.plainTextLocation().isEmpty()) {
+                location = structure.plainTextLocation();
                 isPlainText = true;
             }
         }
-        if (!part) {
+        if (location.isEmpty()) {
             qDebug() << __func__ << "Unable to find a displayable message part :-/";
             return QUrl();
         }
-        location = part->location().toString(true);
         url.setScheme(QStringLiteral("dekko-part"));
     }
     url.setHost(QStringLiteral("msg"));
@@ -312,10 +316,10 @@ void Message::initMessage()
             model->append(new MailAddress(0, address));
         }
     };
-    QMailMessage msg(m_id);
-    appendAddresses(m_to, msg.to());
-    appendAddresses(m_cc, msg.cc());
-    appendAddresses(m_bcc, msg.bcc());
+    const MessageStructure structure = MessageCache::instance()->structure(m_id);
+    appendAddresses(m_to, structure.to());
+    appendAddresses(m_cc, structure.cc());
+    appendAddresses(m_bcc, structure.bcc());
     m_attachments->setMessageId(m_id);
     emit messageChanged();
 }
@@ -56,11 +56,14 @@ class MinimalMessage : public QObject
     Q_PROPERTY(QString prettyLongDate READ prettyLongDate NOTIFY minMessageChanged)
     Q_PROPERTY(Qt::CheckState checked READ checked WRITE setChecked NOTIFY checkedChanged)
     Q_PROPERTY(QVariant senderMsgKey READ senderMsgKey NOTIFY minMessageChanged)
+    /** @short Messages in this message's conversation when the list is threaded, otherwise 1 */
+    Q_PROPERTY(int threadCount READ threadCount NOTIFY threadChanged)
+    Q_PROPERTY(int threadUnreadCount READ threadUnreadCount NOTIFY threadChanged)
 
 public:
     explicit MinimalMessage(QObject *parent = 0);
     int messageId() const { return m_id.toULongLong(); }
-    int parentAccountId() const { return QMailMessageMetaData(m_id).parentAccountId().toULongLong(); }
+    int parentAccountId() const { return m_parentAccountId.toULongLong(); }
     MailAddress *from() const;
     QString subject() const;
     QString preview() const;
@@ -79,11 +82,14 @@ public:
     QString prettyLongDate();
     Qt::CheckState checked() const;
     QVariant senderMsgKey() const;
+    int threadCount() const { return m_threadCount; }
+    int threadUnreadCount() const { return m_threadUnreadCount; }
 
 signals:
     void internalMessageChanged();
     void minMessageChanged();
     void checkedChanged();
+    void threadChanged();
 
 public slots:
     void setMessageId(const quint64 &id);
@@ -93,13 +99,18 @@ public slots:
     void selectionStarted() { setChecked(Qt::Unchecked); }
     void setChecked(const Qt::CheckState &checked);
     void setIsTodo(const bool todo);
+    void setThreadInfo(const int &count, const int &unread);
 
 protected:
     QMailMessageId m_id;
+    // Cached from the metadata we load in setMessageId
+    QMailAccountId m_parentAccountId;
 
 private:
     MailAddress *m_from;
     Qt::CheckState m_checked;
+    int m_threadCount;
+    int m_threadUnreadCount;
 };
 
 class Message : public MinimalMessage // Extend on what we already have above
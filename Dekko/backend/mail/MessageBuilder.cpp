@@ -27,6 +27,7 @@
 #include <Formatting.h>
 #include <PolicyManager.h>
 #include <SettingsPolicies.h>
+#include "MimeWriter.h"
 
 MessageBuilder::MessageBuilder(QObject *parent) : QObject(parent),
     m_to(Q_NULLPTR),m_cc(Q_NULLPTR), m_bcc(Q_NULLPTR), m_attachments(Q_NULLPTR), m_subject(Q_NULLPTR), m_internalSubject(Q_NULLPTR),
@@ -112,14 +113,17 @@ QMailMessage MessageBuilder::message()
     QString plainTextBody = m_internalBody->toPlainText();
     plainTextBody.append(QStringLiteral("\n\n-- \n%1").arg(identity->get_signature()));
     QMailMessageContentType type(QByteArrayLiteral("text/plain; charset=UTF-8"));
-    // TODO: Do we want to always encode as QuotedPrintable it's efficient for ASCII text but becomes inefficient
-    // for non-ascii chars i.e QChar::unicode() > 127. SHould we iterate over all chars and decide based on that as QString
-    // doesn't provide an isAscii??
+    // Pick the encoding from what's actually in the body, mostly ascii text
+    // goes out as 7bit or quoted printable and anything heavier as base64
+    const QByteArray bodyData = plainTextBody.toUtf8();
+    EncodingScanner scanner;
+    scanner.scan(bodyData);
+    const QMailMessageBody::TransferEncoding encoding = scanner.encoding();
     if (m_attachments->isEmpty()) {
-        mail.setBody(QMailMessageBody::fromData(plainTextBody, type, QMailMessageBody::QuotedPrintable));
+        mail.setBody(QMailMessageBody::fromData(bodyData, type, encoding));
     } else {
         QMailMessagePart bodyPart;
-        bodyPart.setBody(QMailMessageBody::fromData(plainTextBody, type, QMailMessageBody::QuotedPrintable));
+        bodyPart.setBody(QMailMessageBody::fromData(bodyData, type, encoding));
         mail.setMultipartType(QMailMessagePartContainer::MultipartMixed);
         mail.appendPart(bodyPart);
         foreach(Attachment *attachment, m_attachments->toList()) {
@@ -128,7 +132,8 @@ QMailMessage MessageBuilder::message()
     }
     mail.setMessageType(QMailMessage::Email);
 
-    mail.setSize(mail.indicativeSize() * 1024);
+    // File attachments are encoded a chunk at a time while measuring
+    mail.setSize(MimeWriter::measure(mail));
     mail.setStatus(QMailMessage::HasAttachments, false);
 
     if (m_sourceStatus & QMailMessage::LocalOnly) {
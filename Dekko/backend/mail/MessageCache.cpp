@@ -0,0 +1,291 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MessageCache.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QUrl>
+#include <qmailstore.h>
+#include <MailServiceClient.h>
+#include <Metrics.h>
+
+// Default budget in KiB
+#define MAX_CACHE_COST (16 * 1024)
+// Custom field holding "<content-id> <location>" lines
+#define CID_INDEX_FIELD "dekko-cid-index"
+
+struct PartIndexer {
+    QHash<QString, const QMailMessagePart *> *locations;
+    QHash<QString, const QMailMessagePart *> *contentIds;
+
+    bool operator()(const QMailMessagePart &part) {
+        locations->insert(part.location().toString(true), &part);
+        if (!part.contentID().isEmpty()) {
+            contentIds->insert(part.contentID(), &part);
+        }
+        return true; // visit every part
+    }
+};
+
+static QString normalizedContentId(const QString &cid)
+{
+    QString id = cid.startsWith(QStringLiteral("cid:"), Qt::CaseInsensitive) ? QUrl(cid).path() : cid;
+    if (id.startsWith(QLatin1Char('<')) && id.endsWith(QLatin1Char('>'))) {
+        id = id.mid(1, id.size() - 2);
+    }
+    return id;
+}
+
+ParsedMessage::ParsedMessage(const QMailMessageId &id) :
+    m_message(id.isValid() ? QMailMessage(id) : QMailMessage())
+{
+    PartIndexer indexer;
+    indexer.locations = &m_locations;
+    indexer.contentIds = &m_contentIds;
+    m_message.foreachPart<PartIndexer &>(indexer);
+}
+
+const QMailMessagePart *ParsedMessage::partAt(const QString &location) const
+{
+    return m_locations.value(location, 0);
+}
+
+const QMailMessagePart *ParsedMessage::partForContentId(const QString &cid) const
+{
+    return m_contentIds.value(normalizedContentId(cid), 0);
+}
+
+int ParsedMessage::cost() const
+{
+    return qMax(1, int(m_message.size() / 1024));
+}
+
+QString ParsedMessage::contentIdIndex() const
+{
+    QStringList lines;
+    QHash<QString, const QMailMessagePart *>::const_iterator it = m_contentIds.constBegin();
+    for (; it != m_contentIds.constEnd(); ++it) {
+        lines << QStringLiteral("%1 %2").arg(it.key(), it.value()->location().toString(true));
+    }
+    return lines.join(QLatin1Char('\n'));
+}
+
+QString ParsedMessage::locationFromIndex(const QString &index, const QString &cid)
+{
+    if (index.isEmpty()) {
+        return QString();
+    }
+    const QString key = normalizedContentId(cid) + QLatin1Char(' ');
+    Q_FOREACH(const QString &line, index.split(QLatin1Char('\n'), QString::SkipEmptyParts)) {
+        if (line.startsWith(key)) {
+            return line.mid(key.size());
+        }
+    }
+    return QString();
+}
+
+static QMutex s_instanceMutex;
+static MessageCache *s_cache = 0;
+MessageCache *MessageCache::instance()
+{
+    QMutexLocker lock(&s_instanceMutex);
+    if (!s_cache) {
+        s_cache = new MessageCache();
+        // Store & client signals need delivering on the main thread
+        // whichever thread happened to ask first.
+        if (QCoreApplication::instance()) {
+            s_cache->moveToThread(QCoreApplication::instance()->thread());
+        }
+    }
+    return s_cache;
+}
+
+MessageCache::MessageCache(QObject *parent) : QObject(parent),
+    m_generation(0)
+{
+    m_cache.setMaxCost(MAX_CACHE_COST);
+    connect(QMailStore::instance(), SIGNAL(messagesUpdated(QMailMessageIdList)),
+            this, SLOT(handleMessagesUpdated(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesRemoved(QMailMessageIdList)),
+            this, SLOT(invalidate(QMailMessageIdList)));
+    // The worker may report a fetch before the store tells us about the update
+    connect(Client::instance(), SIGNAL(messagesNowAvailable(QMailMessageIdList)),
+            this, SLOT(invalidate(QMailMessageIdList)));
+    connect(Client::instance(), SIGNAL(messagePartNowAvailable(quint64,QString)),
+            this, SLOT(handlePartAvailable(quint64,QString)));
+}
+
+ParsedMessagePtr MessageCache::message(const QMailMessageId &id)
+{
+    if (!id.isValid()) {
+        return ParsedMessagePtr(new ParsedMessage(id));
+    }
+    quint64 generation;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (ParsedMessagePtr *cached = m_cache.object(id)) {
+            METRIC_COUNT("cache.messages.hits");
+            return *cached;
+        }
+        generation = m_generation;
+    }
+    METRIC_COUNT("cache.messages.misses");
+    // Parse outside the lock so one large message doesn't block everyone else
+    ParsedMessagePtr parsed;
+    {
+        METRIC_LATENCY("messages.parse");
+        parsed = ParsedMessagePtr(new ParsedMessage(id));
+    }
+    QMutexLocker lock(&m_mutex);
+    if (generation == m_generation) {
+        if (ParsedMessagePtr *cached = m_cache.object(id)) {
+            return *cached; // someone else beat us to it
+        }
+        m_cache.insert(id, new ParsedMessagePtr(parsed), parsed->cost());
+    }
+    return parsed;
+}
+
+QString MessageCache::locationForContentId(const QMailMessageId &id, const QString &cid)
+{
+    if (!id.isValid()) {
+        return QString();
+    }
+    const QString index = QMailMessageMetaData(id).customField(QStringLiteral(CID_INDEX_FIELD));
+    QString location = ParsedMessage::locationFromIndex(index, cid);
+    if (!location.isEmpty()) {
+        return location;
+    }
+    const ParsedMessagePtr parsed = message(id);
+    if (const QMailMessagePart *part = parsed->partForContentId(cid)) {
+        location = part->location().toString(true);
+    }
+    if (index.isEmpty() && parsed->hasContentIds()) {
+        // The store is only touched from our own thread
+        QMetaObject::invokeMethod(this, "persistContentIdIndex", Qt::QueuedConnection,
+                                  Q_ARG(quint64, id.toULongLong()), Q_ARG(QString, parsed->contentIdIndex()));
+    }
+    return location;
+}
+
+MessageStructure MessageCache::structure(const QMailMessageId &id)
+{
+    if (!id.isValid()) {
+        return MessageStructure();
+    }
+    const QMailMessageMetaData meta(id);
+    const MessageStructure stored = MessageStructure::fromMetaData(meta);
+    if (stored.isCurrent(meta)) {
+        return stored;
+    }
+    const MessageStructure structure = MessageStructure::fromMessage(message(id)->message());
+    if (structure.isValid()) {
+        QMetaObject::invokeMethod(this, "persistStructure", Qt::QueuedConnection,
+                                  Q_ARG(quint64, id.toULongLong()), Q_ARG(QString, structure.toString()));
+    }
+    return structure;
+}
+
+void MessageCache::invalidate(const QMailMessageId &id)
+{
+    QMutexLocker lock(&m_mutex);
+    ++m_generation;
+    m_cache.remove(id);
+}
+
+int MessageCache::maxCost() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_cache.maxCost();
+}
+
+void MessageCache::setMaxCost(const int &cost)
+{
+    QMutexLocker lock(&m_mutex);
+    m_cache.setMaxCost(cost);
+}
+
+void MessageCache::invalidate(const QMailMessageIdList &ids)
+{
+    QMutexLocker lock(&m_mutex);
+    ++m_generation;
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        m_cache.remove(id);
+    }
+}
+
+void MessageCache::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    ++m_generation;
+    m_cache.clear();
+}
+
+void MessageCache::handlePartAvailable(const quint64 &id, const QString &location)
+{
+    Q_UNUSED(location);
+    invalidate(QMailMessageId(id));
+}
+
+void MessageCache::handleMessagesUpdated(const QMailMessageIdList &ids)
+{
+    QMailMessageIdList changed;
+    {
+        QMutexLocker lock(&m_mutex);
+        Q_FOREACH(const QMailMessageId &id, ids) {
+            if (!m_indexWrites.remove(id)) {
+                changed << id;
+            }
+        }
+    }
+    if (!changed.isEmpty()) {
+        invalidate(changed);
+    }
+}
+
+void MessageCache::persistContentIdIndex(const quint64 &id, const QString &index)
+{
+    persistField(QMailMessageId(id), QStringLiteral(CID_INDEX_FIELD), index);
+}
+
+void MessageCache::persistStructure(const quint64 &id, const QString &summary)
+{
+    persistField(QMailMessageId(id), MessageStructure::fieldName(), summary);
+}
+
+void MessageCache::persistField(const QMailMessageId &id, const QString &name, const QString &value)
+{
+    // Only the custom fields are written back, a flag or status change landing
+    // between our read and the write mustn't be overwritten with what we read.
+    const QMailMessageKey key = QMailMessageKey::id(id);
+    const QMailMessageMetaDataList current = QMailStore::instance()->messagesMetaData(key, QMailMessageKey::Custom);
+    if (current.isEmpty() || current.first().customField(name) == value) {
+        return;
+    }
+    QMailMessageMetaData meta;
+    meta.setCustomFields(current.first().customFields());
+    meta.setCustomField(name, value);
+    {
+        QMutexLocker lock(&m_mutex);
+        m_indexWrites.insert(id);
+    }
+    if (!QMailStore::instance()->updateMessagesMetaData(key, QMailMessageKey::Custom, meta)) {
+        QMutexLocker lock(&m_mutex);
+        m_indexWrites.remove(id);
+    }
+}
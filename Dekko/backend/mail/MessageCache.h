@@ -0,0 +1,129 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MESSAGECACHE_H
+#define MESSAGECACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <qmailmessage.h>
+#include "MessageStructure.h"
+
+/** @short A fully loaded QMailMessage along with an index of it's parts
+ *
+ * Instances are immutable once built so can be shared between threads,
+ * part pointers stay valid for as long as the ParsedMessage is held.
+ */
+class ParsedMessage
+{
+public:
+    explicit ParsedMessage(const QMailMessageId &id);
+
+    const QMailMessage &message() const { return m_message; }
+    /** @short Part at \param location as given by Location::toString(true), or 0 */
+    const QMailMessagePart *partAt(const QString &location) const;
+    /** @short Part with the given Content-ID, \param cid may be a cid: url or the bare id */
+    const QMailMessagePart *partForContentId(const QString &cid) const;
+    /** @short Approximate memory used in KiB */
+    int cost() const;
+    bool hasContentIds() const { return !m_contentIds.isEmpty(); }
+
+    /** @short Content-ID to location index in the form persisted with the metadata */
+    QString contentIdIndex() const;
+    /** @short Look up \param cid in a persisted \param index */
+    static QString locationFromIndex(const QString &index, const QString &cid);
+
+private:
+    QMailMessage m_message;
+    QHash<QString, const QMailMessagePart *> m_locations;
+    QHash<QString, const QMailMessagePart *> m_contentIds;
+};
+
+typedef QSharedPointer<const ParsedMessage> ParsedMessagePtr;
+
+/** @short Process wide cache of parsed messages
+ *
+ * Loading a QMailMessage builds the whole mime tree so callers that need
+ * parts of the same message (body lookup, each inline cid: image, attachments)
+ * should go through here rather than constructing their own.
+ *
+ * Entries are reference counted so eviction never pulls a message out from
+ * under someone using it, the cache itself is bounded by maxCost(). Anything
+ * updated or removed in the store, or fetched by the worker, is invalidated.
+ * All methods are safe to call from any thread.
+ */
+class MessageCache : public QObject
+{
+    Q_OBJECT
+public:
+    static MessageCache *instance();
+
+    /** @short Cached message for \param id, loaded from the store on a miss
+     *
+     * Never null, an invalid id gives an empty message.
+     */
+    ParsedMessagePtr message(const QMailMessageId &id);
+    void invalidate(const QMailMessageId &id);
+
+    /** @short Location of the part with the given Content-ID
+     *
+     * Uses the index stored in the message metadata when there is one so resolving
+     * a cid: url doesn't require parsing the message. Otherwise the message is parsed
+     * and the index persisted for next time.
+     */
+    QString locationForContentId(const QMailMessageId &id, const QString &cid);
+
+    /** @short Structure summary of \param id
+     *
+     * The message server stores one with each retrieved message so this is
+     * normally just a metadata read. Messages retrieved before that, or changed
+     * since, are parsed and the summary persisted for next time.
+     */
+    MessageStructure structure(const QMailMessageId &id);
+
+    int maxCost() const;
+    /** @short Set the memory budget in KiB */
+    void setMaxCost(const int &cost);
+
+public slots:
+    void invalidate(const QMailMessageIdList &ids);
+    void clear();
+
+private slots:
+    void handlePartAvailable(const quint64 &id, const QString &location);
+    void handleMessagesUpdated(const QMailMessageIdList &ids);
+    void persistContentIdIndex(const quint64 &id, const QString &index);
+    void persistStructure(const quint64 &id, const QString &summary);
+
+private:
+    explicit MessageCache(QObject *parent = 0);
+    void persistField(const QMailMessageId &id, const QString &name, const QString &value);
+
+    mutable QMutex m_mutex;
+    QCache<QMailMessageId, ParsedMessagePtr> m_cache;
+    // Bumped on every invalidation so a load racing one doesn't get cached
+    quint64 m_generation;
+    // Messages we just wrote an index or summary for, the update that
+    // follows doesn't change the structure so shouldn't evict them.
+    QSet<QMailMessageId> m_indexWrites;
+};
+
+#endif // MESSAGECACHE_H
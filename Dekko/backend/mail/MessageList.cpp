@@ -24,6 +24,7 @@
 #include <qmailstore.h>
 #include <qmaildisconnected.h>
 #include <QElapsedTimer>
+#include <Trace.h>
 #include <MailServiceClient.h>
 #include "serviceutils.h"
 
@@ -31,6 +32,7 @@ Q_LOGGING_CATEGORY(D_MSG_LIST, "dekko.mail.msglist")
 
 void MessageListWorker::updateMessages(const QMailMessageIdList &idList, const QMailMessageIdList &needsUpdate, const QMailMessageIdList &newIds, const QMap<QMailMessageId, int> &indexMap, const int &limit)
 {
+    TRACE_SPAN("MessageListWorker::updateMessages");
     QElapsedTimer timer;
     qCDebug(D_MSG_LIST) << "[MessageListWorker::updateMessages] >> Starting";
     timer.start();
@@ -138,6 +140,7 @@ void MessageListWorker::updateMessages(const QMailMessageIdList &idList, const Q
 
 void MessageListWorker::sortAndAppend(const QMailMessageIdList &idList, const QMailMessageIdList &idsToAppend, const QMailMessageIdList &newIdsList, const QMap<QMailMessageId, int> &indexMap, const int &limit)
 {
+    TRACE_SPAN("MessageListWorker::sortAndAppend");
     QElapsedTimer timer;
     qCDebug(D_MSG_LIST) << "[MessageListWorker::sortAndAppend] >> Starting";
     timer.start();
@@ -197,7 +200,8 @@ void MessageListWorker::sortAndAppend(const QMailMessageIdList &idList, const QM
 
 MessageList::MessageList(QObject *parent) : QObject(parent),
     m_model(0), m_initialized(false), m_selectionMode(false), m_currentIndex(-1), m_filter(FilterKey::All), m_disableUpdates(false),
-    m_needsRefresh(false), m_loading(false), m_disableRemovals(false)
+    m_needsRefresh(false), m_loading(false), m_disableRemovals(false), m_prefetcher(0), m_prefetchTimer(0),
+    m_firstVisible(-1), m_lastVisible(-1), m_threaded(false), m_threadTotal(0), m_threadTimer(0)
 {
 
     qRegisterMetaType<QMap<QMailMessageId, int>>("QMap<QMailMessageId, int>");
@@ -221,6 +225,17 @@ MessageList::MessageList(QObject *parent) : QObject(parent),
     connect(QMailStore::instance(), SIGNAL(messagesAdded(QMailMessageIdList)), this, SLOT(handleNewMessages(QMailMessageIdList)));
     connect(QMailStore::instance(), SIGNAL(messagesRemoved(QMailMessageIdList)), this, SLOT(handleMessagesRemoved(QMailMessageIdList)));
     connect(QMailStore::instance(), SIGNAL(messagesUpdated(QMailMessageIdList)), this, SLOT(handleUpdatedMessages(QMailMessageIdList)));
+
+    m_prefetcher = new MessagePrefetcher(this);
+    m_prefetchTimer = new QTimer(this);
+    m_prefetchTimer->setInterval(250);
+    m_prefetchTimer->setSingleShot(true);
+    connect(m_prefetchTimer, &QTimer::timeout, this, &MessageList::updatePrefetch);
+
+    m_threadTimer = new QTimer(this);
+    m_threadTimer->setInterval(100);
+    m_threadTimer->setSingleShot(true);
+    connect(m_threadTimer, &QTimer::timeout, this, &MessageList::refreshThreads);
 }
 
 MessageList::~MessageList()
@@ -246,6 +261,9 @@ Qt::SortOrder MessageList::sortOrder() const
 
 int MessageList::totalCount()
 {
+    if (m_threaded) {
+        return m_threadTotal;
+    }
     return QMailStore::instance()->countMessages(messageListKey());
 }
 
@@ -317,19 +335,48 @@ void MessageList::loadMore()
     }
 }
 
+void MessageList::setVisibleRange(const int &first, const int &last)
+{
+    if (m_firstVisible == first && m_lastVisible == last) {
+        return;
+    }
+    m_firstVisible = first;
+    m_lastVisible = last;
+    m_prefetchTimer->start();
+}
+
+void MessageList::updatePrefetch()
+{
+    m_prefetcher->update(m_idList, m_firstVisible, m_lastVisible, m_currentIndex);
+}
+
 void MessageList::refresh()
 {
+    TRACE_SPAN("MessageList::refresh");
     qCDebug(D_MSG_LIST) << "Refreshing Message List";
+    if (m_threaded) {
+        refreshThreads();
+        return;
+    }
     m_loading = true;
     emit loadingChanged();
-    QDBusPendingReply<QList<quint64> > reply = Client::instance()->bus()->queryMessages(
-                msg_key_bytes(messageListKey()),
-                msg_sort_key_bytes(m_sortKey),
-                m_limit);
-
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+    Client::instance()->queryMessages(messageListKey(), m_sortKey, m_limit, this, [=](const QMailMessageIdList &ids) {
+        refreshResponse(ids);
+    }, [=]() {
+        queryFailed();
+    });
+}
 
-    connect(watcher, &QDBusPendingCallWatcher::finished, this, &MessageList::refreshResponse);
+void MessageList::refreshThreads()
+{
+    m_loading = true;
+    emit loadingChanged();
+    Client::instance()->queryThreads(messageListKey(), m_sortKey, m_limit, this,
+                                     [=](const QMailMessageIdList &ids, const QList<int> &counts, const QList<int> &unread, const int &total) {
+        applyThreads(ids, counts, unread, total);
+    }, [=]() {
+        queryFailed();
+    });
 }
 
 int MessageList::currentSelectedIndex() const
@@ -454,18 +501,21 @@ void MessageList::setChecked(const int &index, const Qt::CheckState &checkState)
 
 void MessageList::markSelectedMessagesImportant()
 {
+    TRACE_SPAN("MessageList::markSelectedMessagesImportant");
     Client::instance()->markMessagesImportant(checkedIds(), canMarkSelectionImportant());
     unselectAll();
 }
 
 void MessageList::markSelectedMessagesRead()
 {
+    TRACE_SPAN("MessageList::markSelectedMessagesRead");
     Client::instance()->markMessagesRead(checkedIds(), canMarkSelectionAsRead());
     unselectAll();
 }
 
 void MessageList::deleteSelectedMessages()
 {
+    TRACE_SPAN("MessageList::deleteSelectedMessages");
     Client::instance()->deleteMessages(checkedIds());
     unselectAll();
 }
@@ -477,6 +527,7 @@ void MessageList::setCurrentSelectedIndex(int currentSelectedIndex)
         return;
 
     m_currentIndex = currentSelectedIndex;
+    m_prefetchTimer->start();
 
     if (currentSelectedIndex == -1) {
         emit currentSelectedIndexChanged();
@@ -533,8 +584,22 @@ void MessageList::setDisableRemovals(bool disableRemovals)
     emit disableRemovalsChanged(disableRemovals);
 }
 
+void MessageList::setThreaded(bool threaded)
+{
+    if (m_threaded == threaded)
+        return;
+
+    m_threaded = threaded;
+    m_threadTimer->stop();
+    if (m_initialized) {
+        reset();
+    }
+    emit threadedChanged(threaded);
+}
+
 void MessageList::handleNewMessages(const QMailMessageIdList &newList)
 {
+    TRACE_SPAN("MessageList::handleNewMessages");
     QElapsedTimer timer;
     qCDebug(D_MSG_LIST) << "[handleNewMessages] >> Starting";
 
@@ -551,6 +616,10 @@ void MessageList::handleNewMessages(const QMailMessageIdList &newList)
     if (m_msgKey.isNonMatching()) {
         return;
     }
+    if (m_threaded) {
+        m_threadTimer->start();
+        return;
+    }
     if (!m_initialized) {
         init();
     }
@@ -560,6 +629,7 @@ void MessageList::handleNewMessages(const QMailMessageIdList &newList)
 
 void MessageList::handleMessagesRemoved(const QMailMessageIdList &removedList)
 {
+    TRACE_SPAN("MessageList::handleMessagesRemoved");
     QElapsedTimer timer;
     qCDebug(D_MSG_LIST) << "[handleMessagesRemoved] >> Starting";
 
@@ -581,6 +651,10 @@ void MessageList::handleMessagesRemoved(const QMailMessageIdList &removedList)
     if (m_msgKey.isNonMatching()) {
         return;
     }
+    if (m_threaded) {
+        m_threadTimer->start();
+        return;
+    }
     if (!m_initialized) {
         init();
     }
@@ -590,6 +664,7 @@ void MessageList::handleMessagesRemoved(const QMailMessageIdList &removedList)
 
 void MessageList::handleUpdatedMessages(const QMailMessageIdList &updatedList)
 {
+    TRACE_SPAN("MessageList::handleUpdatedMessages");
     QElapsedTimer timer;
     qCDebug(D_MSG_LIST) << "[handleUpdatedMessages] >> Starting";
 
@@ -600,6 +675,20 @@ void MessageList::handleUpdatedMessages(const QMailMessageIdList &updatedList)
     }
     timer.start();
 
+    if (m_threaded) {
+        // A change anywhere in a conversation can move it or change it's counts
+        foreach (const QMailMessageId &id, updatedList) {
+            const int index = indexOf(id);
+            if (index != -1) {
+                updateMessageAt(index);
+            }
+        }
+        if (m_initialized && !m_msgKey.isNonMatching()) {
+            m_threadTimer->start();
+        }
+        return;
+    }
+
     QMailMessageIdList needsUpdate;
     foreach(const QMailMessageId &id, updatedList) {
         if (m_idList.contains(id)) {
@@ -613,22 +702,9 @@ void MessageList::handleUpdatedMessages(const QMailMessageIdList &updatedList)
     }
 
     // Find the updated positions for our messages
-    QMailMessageKey idKey(QMailMessageKey::id((m_idList.toSet() + needsUpdate.toSet()).toList()));
-    QMailMessageKey msgKey = messageListKey() & idKey;
-    QDBusPendingReply<QList<quint64> > reply = Client::instance()->bus()->queryMessages(msg_key_bytes(msgKey), msg_sort_key_bytes(m_sortKey), m_limit);
-
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
-
-    connect(watcher, &QDBusPendingCallWatcher::finished, [=](QDBusPendingCallWatcher *call){
-        QDBusPendingReply<QList<quint64> > reply = *call;
-        if (reply.isError()) {
-            qCDebug(D_MSG_LIST) << "[handleUpdatedMessages] >> Reply error";
-            return;
-        }
-        QMailMessageIdList newIds = from_dbus_msglist(reply.argumentAt<0>());
-
+    const QMailMessageIdList candidates = (m_idList.toSet() + needsUpdate.toSet()).toList();
+    Client::instance()->queryMessages(messageListKey(), m_sortKey, m_limit, candidates, this, [=](const QMailMessageIdList &newIds) {
         emit updateMessages(m_idList, needsUpdate, newIds, m_indexMap, m_limit);
-        call->deleteLater();
     });
     qCDebug(D_MSG_LIST) << "[handleUpdatedMessages] >> Finished in: " << timer.elapsed() << "milliseconds";
 }
@@ -648,6 +724,7 @@ void MessageList::insertMessageAt(const int &index, const QMailMessageId &id)
     for ( ; it != end; ++it) {
         m_indexMap[*it] += 1;
     }
+    m_prefetchTimer->start();
     emit totalCountChanged();
 }
 
@@ -656,6 +733,7 @@ void MessageList::removeMessageAt(const int &index)
     if (m_disableRemovals) {
         return;
     }
+    TRACE_SPAN("MessageList::removeMessageAt");
     QElapsedTimer timer;
     qCDebug(D_MSG_LIST) << "[removeMessageAt] >> Starting";
     timer.start();
@@ -670,12 +748,14 @@ void MessageList::removeMessageAt(const int &index)
     for ( ; it != end; ++it) {
         m_indexMap[*it] -= 1;
     }
+    m_prefetchTimer->start();
     emit totalCountChanged();
     qCDebug(D_MSG_LIST) << "[removeMessageAt] >> Finished in: " << timer.elapsed() << "milliseconds";
 }
 
 void MessageList::addNewMessages(const QMailMessageIdList &idList)
 {
+    TRACE_SPAN("MessageList::addNewMessages");
     QElapsedTimer timer;
     qCDebug(D_MSG_LIST) << "[addNewMessages] >> Starting";
     timer.start();
@@ -683,24 +763,8 @@ void MessageList::addNewMessages(const QMailMessageIdList &idList)
     // Note - we must only consider messages in the set given by (those we currently know +
     // those we have now been informed of) because the database content may have changed between
     // when this event was recorded and when we're processing the signal.
-
-    QMailMessageKey idKey(QMailMessageKey::id(m_idList + idList));
-    QMailMessageKey mIdKey = messageListKey() & idKey;
-
-    QDBusPendingReply<QList<quint64> > reply = Client::instance()->bus()->queryMessages(
-                msg_key_bytes(mIdKey), msg_sort_key_bytes(m_sortKey), m_limit);
-
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
-
-    connect(watcher, &QDBusPendingCallWatcher::finished, [=](QDBusPendingCallWatcher *call){
-        QDBusPendingReply<QList<quint64> > reply = *call;
-        if (reply.isError()) {
-            qCDebug(D_MSG_LIST) << "[addNewMessages] >> Reply error";
-            return;
-        }
-        QMailMessageIdList newIdsList = from_dbus_msglist(reply.argumentAt<0>());
+    Client::instance()->queryMessages(messageListKey(), m_sortKey, m_limit, m_idList + idList, this, [=](const QMailMessageIdList &newIdsList) {
         emit sortAndAppendNewMessages(m_idList, idList, newIdsList, m_indexMap, m_limit);
-        call->deleteLater();
     });
     qCDebug(D_MSG_LIST) << "[addNewMessages] >> Finished in: " << timer.elapsed() << "milliseconds";
 }
@@ -730,16 +794,9 @@ void MessageList::updateMessageAt(const int &index)
     m_model->at(index)->emitMinMessageChanged();
 }
 
-void MessageList::refreshResponse(QDBusPendingCallWatcher *call)
+void MessageList::refreshResponse(const QMailMessageIdList &newIdsList)
 {
     qCDebug(D_MSG_LIST) << "[MessageList::refreshResponse] >> Started";
-    QDBusPendingReply<QList<quint64> > reply = *call;
-    if (reply.isError()) {
-        qCDebug(D_MSG_LIST) << "Reply error for refresh response";
-        return;
-    }
-    QList<quint64> ids = reply.argumentAt<0>();
-    QMailMessageIdList newIdsList = from_dbus_msglist(ids);
 
     QMailMessageIdList idsToAppend;
     foreach (const QMailMessageId &id, newIdsList) {
@@ -748,7 +805,6 @@ void MessageList::refreshResponse(QDBusPendingCallWatcher *call)
         }
     }
     emit sortAndAppendNewMessages(m_idList, idsToAppend, newIdsList, m_indexMap, m_limit);
-    call->deleteLater();
 
     if (m_loading) {
         m_loading = false;
@@ -780,6 +836,7 @@ QMailMessageIdList MessageList::checkedIds()
 
 void MessageList::init()
 {
+    TRACE_SPAN("MessageList::init");
     if (!m_initialized) {
         m_model->clear();
         m_idList.clear();
@@ -788,18 +845,12 @@ void MessageList::init()
         m_loading = true;
         emit loadingChanged();
 
-        QDBusPendingReply<QList<quint64> > reply = Client::instance()->bus()->queryMessages(
-                    msg_key_bytes(messageListKey()), msg_sort_key_bytes(m_sortKey), m_limit);
-
-        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
-
-        connect(watcher, &QDBusPendingCallWatcher::finished, [=](QDBusPendingCallWatcher *call){
-            QDBusPendingReply<QList<quint64> > reply = *call;
-            if (reply.isError()) {
-                qCDebug(D_MSG_LIST) << "Reply error for init";
-                return;
-            }
-            QMailMessageIdList tmpList = from_dbus_msglist(reply.argumentAt<0>());
+        if (m_threaded) {
+            m_threadTotal = 0;
+            refreshThreads();
+            return;
+        }
+        Client::instance()->queryMessages(messageListKey(), m_sortKey, m_limit, this, [=](const QMailMessageIdList &tmpList) {
             int index = 0;
             Q_FOREACH(const auto &id, tmpList) {
                 insertMessageAt(index, id);
@@ -807,20 +858,82 @@ void MessageList::init()
             }
             m_initialized = true;
             emit canPossiblyLoadMore();
-            call->deleteLater();
 
             if (m_loading) {
                 m_loading = false;
                 emit loadingChanged();
             }
+        }, [=]() {
+            queryFailed();
         });
     }
 }
 
+void MessageList::queryFailed()
+{
+    qCDebug(D_MSG_LIST) << "[MessageList::queryFailed] >> Keeping current rows";
+    if (m_loading) {
+        m_loading = false;
+        emit loadingChanged();
+    }
+}
+
+void MessageList::applyThreads(const QMailMessageIdList &ids, const QList<int> &counts, const QList<int> &unread, const int &total)
+{
+    TRACE_SPAN("MessageList::applyThreads");
+    QElapsedTimer timer;
+    qCDebug(D_MSG_LIST) << "[MessageList::applyThreads] >> Started";
+    timer.start();
+    if (!m_threaded) {
+        // Switched off while the query was in flight
+        return;
+    }
+    // Drop conversations that went away, or whose newest message changed
+    const QSet<QMailMessageId> keep = ids.toSet();
+    for (int i = m_idList.count() - 1; i >= 0; --i) {
+        if (!keep.contains(m_idList.at(i))) {
+            removeMessageAt(i);
+        }
+    }
+    // Then walk the new order, everything before index is already in place
+    for (int index = 0; index < ids.count(); ++index) {
+        const QMailMessageId &id = ids.at(index);
+        int current = indexOf(id);
+        if (current == -1) {
+            current = qMin(index, m_idList.count());
+            insertMessageAt(current, id);
+        } else if (current > index) {
+            m_model->move(current, index);
+            m_idList.move(current, index);
+            for (int i = index; i <= current; ++i) {
+                m_indexMap[m_idList.at(i)] = i;
+            }
+            current = index;
+        }
+        m_model->at(current)->setThreadInfo(counts.value(index, 1), unread.value(index, 0));
+    }
+    m_initialized = true;
+    if (m_threadTotal != total) {
+        m_threadTotal = total;
+        emit totalCountChanged();
+    }
+    emit canPossiblyLoadMore();
+    m_prefetchTimer->start();
+
+    if (m_loading) {
+        m_loading = false;
+        emit loadingChanged();
+    }
+    qCDebug(D_MSG_LIST) << "[MessageList::applyThreads] >> Finished in: " << timer.elapsed() << "milliseconds";
+}
+
 void MessageList::reset()
 {
     m_initialized = false;
     m_limit = 50;
+    // New list so whatever was on screen no longer applies
+    m_firstVisible = -1;
+    m_lastVisible = -1;
     init();
 }
 
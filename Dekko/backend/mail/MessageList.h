@@ -24,11 +24,13 @@
 #include <QCache>
 #include <QmlObjectListModel.h>
 #include <QThread>
+#include <QTimer>
 #include <QDBusPendingCallWatcher>
 #include <qmailmessage.h>
 #include <qmailmessagekey.h>
 #include <qmailmessagesortkey.h>
 #include "Message.h"
+#include "MessagePrefetcher.h"
 
 #define INCREMENT_VALUE 50
 // Remember the selected message for each key using QCache
@@ -93,6 +95,10 @@ class MessageList : public QObject
 
     Q_PROPERTY(bool disableUpdates READ disableUpdates WRITE setDisableUpdates NOTIFY disableUpdatesChanged)
     Q_PROPERTY(bool disableRemovals READ disableRemovals WRITE setDisableRemovals NOTIFY disableRemovalsChanged)
+    /** @short MessagePrefetcher for this list, exposed so the ui can tune it's limits */
+    Q_PROPERTY(QObject *prefetcher READ prefetcher CONSTANT)
+    /** @short Show one row per conversation, the newest message in it, instead of every message */
+    Q_PROPERTY(bool threaded READ threaded WRITE setThreaded NOTIFY threadedChanged)
 
     Q_ENUMS(FilterKey)
 
@@ -129,6 +135,10 @@ public:
     int indexOf(const QMailMessageId &id);
     Q_INVOKABLE void loadMore();
     Q_INVOKABLE void refresh();
+    /** @short Rows currently visible in the view, drives the prefetcher */
+    Q_INVOKABLE void setVisibleRange(const int &first, const int &last);
+
+    QObject *prefetcher() const { return m_prefetcher; }
 
     int currentSelectedIndex() const;
 
@@ -138,6 +148,8 @@ public:
 
     bool disableRemovals() const;
 
+    bool threaded() const { return m_threaded; }
+
 signals:
     void loadingChanged();
     void totalCountChanged();
@@ -173,6 +185,8 @@ signals:
 
     void disableRemovalsChanged(bool disableRemovals);
 
+    void threadedChanged(bool threaded);
+
 public slots:
     void setLimit(int limit);
     void setKey(const QVariant &key);
@@ -203,6 +217,8 @@ public slots:
 
     void setDisableRemovals(bool disableRemovals);
 
+    void setThreaded(bool threaded);
+
 private slots:
     void handleNewMessages(const QMailMessageIdList &newList);
     void handleMessagesRemoved(const QMailMessageIdList &removedList);
@@ -214,12 +230,17 @@ private slots:
     void removeMessages(const QMailMessageIdList &idList);
     void updateMessageAt(const int &index);
 
-    void refreshResponse(QDBusPendingCallWatcher *call);
+    void refreshResponse(const QMailMessageIdList &newIdsList);
     void queryMessageResponse(QDBusPendingCallWatcher *call);
+    void updatePrefetch();
+    void refreshThreads();
 private:
     QMailMessageIdList checkedIds();
     void init();
     void reset();
+    void applyThreads(const QMailMessageIdList &ids, const QList<int> &counts, const QList<int> &unread, const int &total);
+    // The worker couldn't answer, keep the rows we have and stop loading
+    void queryFailed();
 
 private: //members
     typedef QMap<QMailMessageId, int> MessageIndexMap;
@@ -246,6 +267,15 @@ private: //members
     QThread m_workerThread;
     bool m_loading;
     bool m_disableRemovals;
+    MessagePrefetcher *m_prefetcher;
+    // Coalesces scrolling & model changes into one prefetch update
+    QTimer *m_prefetchTimer;
+    int m_firstVisible;
+    int m_lastVisible;
+    bool m_threaded;
+    int m_threadTotal;
+    // Store changes arrive in bursts, requery the conversations once they settle
+    QTimer *m_threadTimer;
 };
 
 #endif // MESSAGELIST_H
@@ -0,0 +1,209 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MessagePrefetcher.h"
+#include <QMap>
+#include <QNetworkConfiguration>
+#include <qmailstore.h>
+#include <MailServiceClient.h>
+
+Q_LOGGING_CATEGORY(D_PREFETCH, "dekko.mail.prefetch")
+
+MessagePrefetcher::MessagePrefetcher(QObject *parent) : QObject(parent),
+    m_first(-1), m_last(-1), m_current(-1), m_enabled(true), m_neighbourCount(5),
+    m_backgroundCount(20), m_maxMessageSize(512 * 1024), m_lowPower(false)
+{
+    connect(Client::instance(), &Client::messagesNowAvailable, this, &MessagePrefetcher::handleMessagesDone);
+    connect(Client::instance(), &Client::messageFetchFailed, this, &MessagePrefetcher::handleMessagesDone);
+    connect(&m_network, &QNetworkConfigurationManager::onlineStateChanged, this, &MessagePrefetcher::handleOnlineStateChanged);
+    connect(&m_network, &QNetworkConfigurationManager::configurationChanged, this, &MessagePrefetcher::limitsChanged);
+    connect(this, &MessagePrefetcher::limitsChanged, this, &MessagePrefetcher::refresh);
+}
+
+bool MessagePrefetcher::metered() const
+{
+    switch (m_network.defaultConfiguration().bearerType()) {
+    case QNetworkConfiguration::Bearer2G:
+    case QNetworkConfiguration::BearerCDMA2000:
+    case QNetworkConfiguration::BearerWCDMA:
+    case QNetworkConfiguration::BearerHSPA:
+    case QNetworkConfiguration::BearerEVDO:
+    case QNetworkConfiguration::BearerLTE:
+    case QNetworkConfiguration::Bearer3G:
+    case QNetworkConfiguration::Bearer4G:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void MessagePrefetcher::update(const QMailMessageIdList &ids, const int &first, const int &last, const int &current)
+{
+    m_ids = ids;
+    m_first = first;
+    m_last = last;
+    m_current = current;
+
+    if (!m_enabled || !m_network.isOnline() || m_ids.isEmpty()) {
+        cancelAll();
+        return;
+    }
+
+    const int count = m_ids.size();
+    // Until the view tells us otherwise assume it's showing the top of the list
+    const int firstVisible = m_first >= 0 ? m_first : 0;
+    const int lastVisible = m_last >= 0 ? qMin(m_last, count - 1) : qMin(m_neighbourCount, count - 1);
+
+    QHash<QMailMessageId, int> wanted;
+    auto want = [&](int from, int to, int priority) {
+        from = qMax(0, from);
+        to = qMin(count - 1, to);
+        for (int i = from; i <= to; ++i) {
+            const QMailMessageId &id = m_ids.at(i);
+            if (!wanted.contains(id) || wanted.value(id) > priority) {
+                wanted.insert(id, priority);
+            }
+        }
+    };
+
+    if (m_current >= 0 && m_current < count) {
+        want(m_current, m_current, ClientService::UserOpened);
+    }
+    want(firstVisible, lastVisible, ClientService::Visible);
+    if (!m_lowPower) {
+        want(firstVisible - m_neighbourCount, firstVisible - 1, ClientService::Neighbour);
+        want(lastVisible + 1, lastVisible + m_neighbourCount, ClientService::Neighbour);
+        if (m_current >= 0) {
+            want(m_current - m_neighbourCount, m_current + m_neighbourCount, ClientService::Neighbour);
+        }
+        if (!metered()) {
+            want(lastVisible + m_neighbourCount + 1, lastVisible + m_neighbourCount + m_backgroundCount,
+                 ClientService::Background);
+        }
+    }
+
+    // Only ask for what isn't already here, in one query.
+    QHash<QMailMessageId, int> needed;
+    const QMailMessageKey key = QMailMessageKey::id(wanted.keys())
+            & QMailMessageKey::status(QMailMessage::ContentAvailable, QMailDataComparator::Excludes);
+    const QMailMessageKey::Properties props(QMailMessageKey::Id | QMailMessageKey::Size);
+    Q_FOREACH(const QMailMessageMetaData &meta, QMailStore::instance()->messagesMetaData(key, props)) {
+        const int priority = wanted.value(meta.id());
+        if (priority != ClientService::UserOpened && m_maxMessageSize > 0 && meta.size() > (uint)m_maxMessageSize) {
+            continue;
+        }
+        needed.insert(meta.id(), priority);
+    }
+
+    QMailMessageIdList cancelled;
+    QMap<int, QMailMessageIdList> requests;
+    QHash<QMailMessageId, int>::const_iterator it = m_requested.constBegin();
+    for (; it != m_requested.constEnd(); ++it) {
+        if (!needed.contains(it.key())) {
+            cancelled << it.key();
+        }
+    }
+    QHash<QMailMessageId, int>::iterator n = needed.begin();
+    for (; n != needed.end(); ++n) {
+        const int previous = m_requested.value(n.key(), -1);
+        if (previous == -1 || n.value() < previous) {
+            requests[n.value()] << n.key();
+        } else {
+            // The worker never lowers a priority so keep track of what it actually has
+            n.value() = previous;
+        }
+    }
+    m_requested = needed;
+
+    if (!cancelled.isEmpty()) {
+        qCDebug(D_PREFETCH) << "Cancelling" << cancelled.size() << "prefetches";
+        Client::instance()->cancelPrefetch(cancelled);
+    }
+    QMap<int, QMailMessageIdList>::const_iterator req = requests.constBegin();
+    for (; req != requests.constEnd(); ++req) {
+        qCDebug(D_PREFETCH) << "Prefetching" << req.value().size() << "messages with priority" << req.key();
+        Client::instance()->prefetchMessages(req.value(), req.key());
+    }
+}
+
+void MessagePrefetcher::setEnabled(const bool enabled)
+{
+    if (m_enabled == enabled)
+        return;
+    m_enabled = enabled;
+    emit enabledChanged();
+    refresh();
+}
+
+void MessagePrefetcher::setNeighbourCount(const int &count)
+{
+    if (m_neighbourCount == count)
+        return;
+    m_neighbourCount = qMax(0, count);
+    emit limitsChanged();
+}
+
+void MessagePrefetcher::setBackgroundCount(const int &count)
+{
+    if (m_backgroundCount == count)
+        return;
+    m_backgroundCount = qMax(0, count);
+    emit limitsChanged();
+}
+
+void MessagePrefetcher::setMaxMessageSize(const int &bytes)
+{
+    if (m_maxMessageSize == bytes)
+        return;
+    m_maxMessageSize = qMax(0, bytes);
+    emit limitsChanged();
+}
+
+void MessagePrefetcher::setLowPower(const bool lowPower)
+{
+    if (m_lowPower == lowPower)
+        return;
+    m_lowPower = lowPower;
+    emit limitsChanged();
+}
+
+void MessagePrefetcher::refresh()
+{
+    update(m_ids, m_first, m_last, m_current);
+}
+
+void MessagePrefetcher::cancelAll()
+{
+    if (m_requested.isEmpty()) {
+        return;
+    }
+    Client::instance()->cancelPrefetch(m_requested.keys());
+    m_requested.clear();
+}
+
+void MessagePrefetcher::handleMessagesDone(const QMailMessageIdList &ids)
+{
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        m_requested.remove(id);
+    }
+}
+
+void MessagePrefetcher::handleOnlineStateChanged(bool online)
+{
+    qCDebug(D_PREFETCH) << "Online state changed:" << online;
+    refresh();
+}
@@ -0,0 +1,114 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MESSAGEPREFETCHER_H
+#define MESSAGEPREFETCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QNetworkConfigurationManager>
+#include <qmailmessage.h>
+
+Q_DECLARE_LOGGING_CATEGORY(D_PREFETCH)
+
+/** @short Fetches message bodies around the viewport before they are opened
+ *
+ * The MessageList reports which rows are on screen and which one is selected,
+ * from that each message is given a ClientService::PrefetchPriority:
+ *
+ * - the selected message is UserOpened
+ * - rows on screen are Visible
+ * - neighbourCount rows either side of the viewport and selection are Neighbour
+ * - the next backgroundCount rows after that are Background
+ *
+ * Anything previously requested that falls out of that window, i.e the user
+ * scrolled away, is cancelled in the worker.
+ *
+ * To go easy on data and battery, neighbours and background fetching are skipped
+ * when lowPower is set, background fetching is skipped on a cellular connection,
+ * messages over maxMessageSize are only fetched when opened and nothing is
+ * prefetched while offline.
+ */
+class MessagePrefetcher : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool enabled READ enabled WRITE setEnabled NOTIFY enabledChanged)
+    /** @short Rows either side of the viewport and selection to prefetch */
+    Q_PROPERTY(int neighbourCount READ neighbourCount WRITE setNeighbourCount NOTIFY limitsChanged)
+    /** @short Rows beyond the neighbours to prefetch when on an unmetered connection */
+    Q_PROPERTY(int backgroundCount READ backgroundCount WRITE setBackgroundCount NOTIFY limitsChanged)
+    /** @short Messages larger than this many bytes are only fetched when opened, 0 for no limit */
+    Q_PROPERTY(int maxMessageSize READ maxMessageSize WRITE setMaxMessageSize NOTIFY limitsChanged)
+    /** @short Should be set by the ui when running on a low battery */
+    Q_PROPERTY(bool lowPower READ lowPower WRITE setLowPower NOTIFY limitsChanged)
+    /** @short True when the default network connection is a cellular one */
+    Q_PROPERTY(bool metered READ metered NOTIFY limitsChanged)
+
+public:
+    explicit MessagePrefetcher(QObject *parent = 0);
+
+    bool enabled() const { return m_enabled; }
+    int neighbourCount() const { return m_neighbourCount; }
+    int backgroundCount() const { return m_backgroundCount; }
+    int maxMessageSize() const { return m_maxMessageSize; }
+    bool lowPower() const { return m_lowPower; }
+    bool metered() const;
+
+    /** @short Recalculate what should be prefetched
+     *
+     * \param ids are the message list ids in model order. \param first and \param last
+     * are the visible rows or -1 if the view hasn't told us yet, in which case the
+     * top of the list is assumed. \param current is the selected row or -1
+     */
+    void update(const QMailMessageIdList &ids, const int &first, const int &last, const int &current);
+
+signals:
+    void enabledChanged();
+    void limitsChanged();
+
+public slots:
+    void setEnabled(const bool enabled);
+    void setNeighbourCount(const int &count);
+    void setBackgroundCount(const int &count);
+    void setMaxMessageSize(const int &bytes);
+    void setLowPower(const bool lowPower);
+    /** @short Re-run the last update, e.g after a limit changed */
+    void refresh();
+    /** @short Cancel everything this prefetcher has requested */
+    void cancelAll();
+
+private slots:
+    void handleMessagesDone(const QMailMessageIdList &ids);
+    void handleOnlineStateChanged(bool online);
+
+private:
+    QMailMessageIdList m_ids;
+    int m_first;
+    int m_last;
+    int m_current;
+    // Everything requested from the worker that hasn't finished yet
+    QHash<QMailMessageId, int> m_requested;
+    QNetworkConfigurationManager m_network;
+    bool m_enabled;
+    int m_neighbourCount;
+    int m_backgroundCount;
+    int m_maxMessageSize;
+    bool m_lowPower;
+};
+
+#endif // MESSAGEPREFETCHER_H
@@ -73,10 +73,9 @@ void MessageSet::updateCounts()
         unreadKey = m_key & QMailMessageKey::status(QMailMessage::Read, QMailDataComparator::Excludes);
     }
 
-    QDBusPendingReply<int> unreadReply = Client::instance()->bus()->totalCount(msg_key_bytes(unreadKey));
-
-    QDBusPendingCallWatcher *unreadWatcher = new QDBusPendingCallWatcher(unreadReply, this);
-    connect(unreadWatcher, &QDBusPendingCallWatcher::finished, this, &MessageSet::updateUnreadCount);
+    Client::instance()->countMessages(unreadKey, this, [=](const int &count) {
+        updateUnreadCount(count);
+    });
 
     //total
     QMailMessageKey totalKey;
@@ -86,36 +85,21 @@ void MessageSet::updateCounts()
         totalKey = m_key;
     }
 
-    QDBusPendingReply<int> totalReply = Client::instance()->bus()->totalCount(msg_key_bytes(totalKey));
-
-    QDBusPendingCallWatcher *totalWatcher = new QDBusPendingCallWatcher(totalReply, this);
-    connect(totalWatcher, &QDBusPendingCallWatcher::finished, this, &MessageSet::updateTotalCount);
+    Client::instance()->countMessages(totalKey, this, [=](const int &count) {
+        updateTotalCount(count);
+    });
 }
 
-void MessageSet::updateUnreadCount(QDBusPendingCallWatcher *call)
+void MessageSet::updateUnreadCount(const int &count)
 {
-    QDBusPendingReply<int> reply = *call;
-    if (reply.isError()) {
-        qDebug() << "[MessageSet::updateUnreadCount] >> Reply error";
-        call->deleteLater();
-        return;
-    }
-    m_unreadCount = reply.value();
+    m_unreadCount = count;
     emit unreadCountChanged();
-    call->deleteLater();
 }
 
-void MessageSet::updateTotalCount(QDBusPendingCallWatcher *call)
+void MessageSet::updateTotalCount(const int &count)
 {
-    QDBusPendingReply<int> reply = *call;
-    if (reply.isError()) {
-        qDebug() << "[MessageSet::updateUnreadCount] >> Reply error";
-        call->deleteLater();
-        return;
-    }
-    m_totalCount = reply.value();
+    m_totalCount = count;
     emit totalCountChanged();
-    call->deleteLater();
 }
 
 
@@ -146,11 +130,7 @@ void StandardFolderSet::accountsAdded(const QMailAccountIdList &idList)
     }
     Q_FOREACH(auto &id, idList) {
         if (!m_inboxList.contains(id)) {
-            auto set = new StandardFolderSet();
-            set->setType(SpecialUseInboxFolder);
-            set->initNoDecendents(QMailAccount(id).name(), createAccountDescendentKey(id, QMailFolder::InboxFolder));
-            m_children->append(set);
-            m_inboxList.append(id);
+            appendInbox(id);
         } else {
             qDebug() << "[StandardFolderSet]" << __func__ << "Account with same id already a descendent";
         }
@@ -189,11 +169,10 @@ void StandardFolderSet::accountsChanged(const QMailAccountIdList &idList)
             // FIXME: We shouldn't need to do this here or in appendInboxDescendents
             // but it works around bug
             QMail::detectStandardFolders(enabledId);
-            auto set = new StandardFolderSet();
-            set->setType(SpecialUseInboxFolder);
-            set->initNoDecendents(QMailAccount(enabledId).name(), createAccountDescendentKey(enabledId, QMailFolder::InboxFolder));
-            m_children->append(set);
-            m_inboxList.append(enabledId);
+            appendInbox(enabledId);
+        } else {
+            // Picks up renames
+            m_children->at(index)->setDisplayName(QMailAccount(enabledId).name());
         }
     }
 }
@@ -202,18 +181,25 @@ void StandardFolderSet::appendInboxDescendents()
 {
     Q_FOREACH(const QMailAccountId &id, queryEnabledAccounts()) {
         QMail::detectStandardFolders(id);
-        auto set = new StandardFolderSet();
-        set->setType(SpecialUseInboxFolder);
-        set->initNoDecendents(QMailAccount(id).name(), createAccountDescendentKey(id, QMailFolder::InboxFolder));
-        m_children->append(set);
-        m_inboxList.append(id);
+        appendInbox(id);
     }
     updateCounts();
 }
 
-QMailMessageKey StandardFolderSet::createAccountDescendentKey(const QMailAccountId &id, const QMailFolder::StandardFolder &folderType)
+void StandardFolderSet::appendInbox(const QMailAccountId &id)
 {
+    // Read from the store, these run off the same QMailStore signals the
+    // AccountRegistry updates from so it may not have the new name yet.
     QMailAccount account(id);
+    auto set = new StandardFolderSet();
+    set->setType(SpecialUseInboxFolder);
+    set->initNoDecendents(account.name(), createAccountDescendentKey(account, QMailFolder::InboxFolder));
+    m_children->append(set);
+    m_inboxList.append(id);
+}
+
+QMailMessageKey StandardFolderSet::createAccountDescendentKey(const QMailAccount &account, const QMailFolder::StandardFolder &folderType)
+{
     QMailFolderId folderId = account.standardFolder(folderType);
     QMailFolderKey inboxKey = QMailFolderKey::id(folderId, QMailDataComparator::Equal);
     QMailMessageKey excludeRemovedKey = QMailMessageKey::status(QMailMessage::Removed,  QMailDataComparator::Excludes);
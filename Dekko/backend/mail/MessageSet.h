@@ -23,6 +23,7 @@
 #include <QFlags>
 #include <QmlObjectListModel.h>
 #include <qmailmessagekey.h>
+#include <qmailaccount.h>
 #include <qmailfolder.h>
 #include <QTimer>
 
@@ -83,8 +84,8 @@ public slots:
     void updateCounts();
 
 private slots:
-    void updateUnreadCount(QDBusPendingCallWatcher *call);
-    void updateTotalCount(QDBusPendingCallWatcher *call);
+    void updateUnreadCount(const int &count);
+    void updateTotalCount(const int &count);
 
 protected:
     QString m_name;
@@ -140,7 +141,8 @@ private:
     FolderType m_type;
     QMailAccountIdList m_inboxList;
     void appendInboxDescendents();
-    QMailMessageKey createAccountDescendentKey(const QMailAccountId &id, const QMailFolder::StandardFolder &folderType);
+    void appendInbox(const QMailAccountId &id);
+    QMailMessageKey createAccountDescendentKey(const QMailAccount &account, const QMailFolder::StandardFolder &folderType);
     QMailAccountIdList queryEnabledAccounts();
 };
 
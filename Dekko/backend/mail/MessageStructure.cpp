@@ -0,0 +1,247 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MessageStructure.h"
+#include <QSet>
+#include <QStringList>
+#include <QUrl>
+
+// Bump when the layout changes, older summaries are then just recomputed
+#define STRUCTURE_VERSION "2"
+
+enum SummaryFlags {
+    SinglePartBody = 0x1,
+    SinglePartPlainText = 0x2
+};
+
+enum PartFlags {
+    Attachment = 0x1,
+    InlineDisposition = 0x2,
+    Available = 0x4
+};
+
+static quint64 contentStatusOf(const QMailMessageMetaData &meta)
+{
+    return meta.status() & (QMailMessage::ContentAvailable | QMailMessage::PartialContentAvailable);
+}
+
+// Fields are tab separated and records newline separated, so encode anything that could clash
+static QString encode(const QString &value)
+{
+    return QString::fromLatin1(QUrl::toPercentEncoding(value));
+}
+
+static QString decode(const QString &value)
+{
+    return QString::fromUtf8(QByteArray::fromPercentEncoding(value.toLatin1()));
+}
+
+static QString encodeAddresses(const QMailAddressList &addresses)
+{
+    QStringList fields;
+    Q_FOREACH(const QString &address, QMailAddress::toStringList(addresses)) {
+        fields << encode(address);
+    }
+    return fields.join(QLatin1Char('\t'));
+}
+
+static QMailAddressList decodeAddresses(const QString &line)
+{
+    QStringList addresses;
+    Q_FOREACH(const QString &field, line.split(QLatin1Char('\t'), QString::SkipEmptyParts)) {
+        addresses << decode(field);
+    }
+    return QMailAddress::fromStringList(addresses);
+}
+
+static void collectParts(const QMailMessagePartContainer &container, const QSet<QString> &attachments,
+                         QList<MessageStructure::Part> &parts)
+{
+    for (uint i = 0; i < container.partCount(); ++i) {
+        const QMailMessagePart &mailPart = container.partAt(i);
+        MessageStructure::Part part;
+        part.location = mailPart.location().toString(true);
+        part.contentType = QString::fromLatin1(mailPart.contentType().content());
+        part.charset = QString::fromLatin1(mailPart.contentType().charset());
+        part.displayName = mailPart.displayName();
+        part.contentId = mailPart.contentID();
+        part.size = mailPart.contentDisposition().size();
+        part.transferEncoding = mailPart.transferEncoding();
+        part.attachment = attachments.contains(part.location);
+        part.inlineDisposition = mailPart.contentDisposition().type() == QMailMessageContentDisposition::Inline;
+        part.available = mailPart.contentAvailable();
+        parts << part;
+        collectParts(mailPart, attachments, parts);
+    }
+}
+
+MessageStructure::MessageStructure() :
+    m_valid(false), m_contentStatus(0), m_singlePartBody(false), m_singlePartPlainText(false)
+{
+}
+
+MessageStructure MessageStructure::fromMessage(const QMailMessage &msg)
+{
+    MessageStructure structure;
+    if (!msg.id().isValid()) {
+        return structure;
+    }
+    structure.m_valid = true;
+    structure.m_contentStatus = contentStatusOf(msg);
+    structure.m_to = msg.to();
+    structure.m_cc = msg.cc();
+    structure.m_bcc = msg.bcc();
+
+    QSet<QString> attachments;
+    Q_FOREACH(const QMailMessagePart::Location &location, msg.findAttachmentLocations()) {
+        attachments.insert(location.toString(true));
+    }
+    collectParts(msg, attachments, structure.m_parts);
+
+    if (msg.multipartType() == QMailMessage::MultipartNone && !msg.body().data().isEmpty()) {
+        structure.m_singlePartBody = true;
+        structure.m_singlePartPlainText = (msg.body().contentType().content() == QByteArrayLiteral("text/plain"));
+        return structure;
+    }
+    // The containers can be the message itself, which has no part location
+    if (msg.hasHtmlBody()) {
+        const QMailMessagePartContainer *html = msg.findHtmlContainer();
+        if (html && html != &msg) {
+            structure.m_htmlLocation = static_cast<const QMailMessagePart *>(html)->location().toString(true);
+        }
+    }
+    const QMailMessagePartContainer *plainText = msg.findPlainTextContainer();
+    if (plainText && plainText != &msg) {
+        structure.m_plainTextLocation = static_cast<const QMailMessagePart *>(plainText)->location().toString(true);
+    }
+    return structure;
+}
+
+MessageStructure MessageStructure::fromMetaData(const QMailMessageMetaData &meta)
+{
+    return fromString(meta.customField(fieldName()));
+}
+
+MessageStructure MessageStructure::fromString(const QString &summary)
+{
+    MessageStructure structure;
+    // header, to, cc and bcc come first
+    const QStringList lines = summary.split(QLatin1Char('\n'));
+    if (lines.size() < 4) {
+        return structure;
+    }
+    const QStringList header = lines.at(0).split(QLatin1Char('\t'));
+    if (header.size() != 5 || header.at(0) != QStringLiteral(STRUCTURE_VERSION)) {
+        return structure;
+    }
+    bool ok = false;
+    structure.m_contentStatus = header.at(1).toULongLong(&ok);
+    const int flags = header.at(2).toInt();
+    if (!ok) {
+        return structure;
+    }
+    structure.m_singlePartBody = flags & SinglePartBody;
+    structure.m_singlePartPlainText = flags & SinglePartPlainText;
+    structure.m_htmlLocation = decode(header.at(3));
+    structure.m_plainTextLocation = decode(header.at(4));
+    structure.m_to = decodeAddresses(lines.at(1));
+    structure.m_cc = decodeAddresses(lines.at(2));
+    structure.m_bcc = decodeAddresses(lines.at(3));
+
+    for (int i = 4; i < lines.size(); ++i) {
+        const QStringList fields = lines.at(i).split(QLatin1Char('\t'));
+        if (fields.size() != 8) {
+            return MessageStructure();
+        }
+        Part part;
+        part.location = decode(fields.at(0));
+        part.contentType = decode(fields.at(1));
+        part.charset = decode(fields.at(2));
+        part.displayName = decode(fields.at(3));
+        part.contentId = decode(fields.at(4));
+        part.size = fields.at(5).toInt();
+        part.transferEncoding = static_cast<QMailMessageBody::TransferEncoding>(fields.at(6).toInt());
+        const int partFlags = fields.at(7).toInt();
+        part.attachment = partFlags & Attachment;
+        part.inlineDisposition = partFlags & InlineDisposition;
+        part.available = partFlags & Available;
+        structure.m_parts << part;
+    }
+    structure.m_valid = true;
+    return structure;
+}
+
+QString MessageStructure::toString() const
+{
+    if (!m_valid) {
+        return QString();
+    }
+    int flags = 0;
+    if (m_singlePartBody) {
+        flags |= SinglePartBody;
+    }
+    if (m_singlePartPlainText) {
+        flags |= SinglePartPlainText;
+    }
+    QStringList lines;
+    lines << QStringList({QStringLiteral(STRUCTURE_VERSION), QString::number(m_contentStatus), QString::number(flags),
+                          encode(m_htmlLocation), encode(m_plainTextLocation)}).join(QLatin1Char('\t'));
+    lines << encodeAddresses(m_to) << encodeAddresses(m_cc) << encodeAddresses(m_bcc);
+    Q_FOREACH(const Part &part, m_parts) {
+        int partFlags = 0;
+        if (part.attachment) {
+            partFlags |= Attachment;
+        }
+        if (part.inlineDisposition) {
+            partFlags |= InlineDisposition;
+        }
+        if (part.available) {
+            partFlags |= Available;
+        }
+        lines << QStringList({encode(part.location), encode(part.contentType), encode(part.charset),
+                              encode(part.displayName), encode(part.contentId),
+                              QString::number(part.size), QString::number(part.transferEncoding),
+                              QString::number(partFlags)}).join(QLatin1Char('\t'));
+    }
+    return lines.join(QLatin1Char('\n'));
+}
+
+bool MessageStructure::isCurrent(const QMailMessageMetaData &meta) const
+{
+    return m_valid && m_contentStatus == contentStatusOf(meta);
+}
+
+QList<MessageStructure::Part> MessageStructure::attachments() const
+{
+    QList<Part> attachments;
+    Q_FOREACH(const Part &part, m_parts) {
+        if (part.attachment) {
+            attachments << part;
+        }
+    }
+    return attachments;
+}
+
+const MessageStructure::Part *MessageStructure::part(const QString &location) const
+{
+    for (int i = 0; i < m_parts.size(); ++i) {
+        if (m_parts.at(i).location == location) {
+            return &m_parts.at(i);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MESSAGESTRUCTURE_H
+#define MESSAGESTRUCTURE_H
+
+#include <QList>
+#include <QString>
+#include <qmailaddress.h>
+#include <qmailmessage.h>
+
+/** @short Compact summary of a message's mime structure
+ *
+ * Holds everything needed to decide how to show a message without loading it:
+ * the part tree, which parts are attachments, the parts to display as html and
+ * as plain text and the recipients. It's computed by the message server when a
+ * message is retrieved and persisted as a custom field of the metadata, so the
+ * client only has to read the metadata.
+ *
+ * This file is also built into the message server so must only depend on QMF.
+ */
+class MessageStructure
+{
+public:
+    struct Part {
+        Part() : size(-1), transferEncoding(QMailMessageBody::NoEncoding), attachment(false),
+            inlineDisposition(false), available(false) {}
+
+        QString location;      // Location::toString(true), the nesting is in there too
+        QString contentType;   // type/subtype
+        QString charset;
+        QString displayName;
+        QString contentId;
+        int size;
+        QMailMessageBody::TransferEncoding transferEncoding;
+        bool attachment;       // one of QMailMessage::findAttachmentLocations()
+        bool inlineDisposition;
+        bool available;
+    };
+
+    MessageStructure();
+
+    static MessageStructure fromMessage(const QMailMessage &msg);
+    /** @short The summary persisted with \param meta, invalid if there isn't one */
+    static MessageStructure fromMetaData(const QMailMessageMetaData &meta);
+    static MessageStructure fromString(const QString &summary);
+    QString toString() const;
+
+    /** @short Custom field the summary is stored under */
+    static QString fieldName() { return QStringLiteral("dekko-structure"); }
+
+    bool isValid() const { return m_valid; }
+    /** @short Whether the summary was computed from the content \param meta currently has */
+    bool isCurrent(const QMailMessageMetaData &meta) const;
+
+    QList<Part> parts() const { return m_parts; }
+    QList<Part> attachments() const;
+    /** @short Part at \param location, or 0 */
+    const Part *part(const QString &location) const;
+
+    /** @short The message isn't multipart and has a body of it's own to display */
+    bool hasSinglePartBody() const { return m_singlePartBody; }
+    bool singlePartIsPlainText() const { return m_singlePartPlainText; }
+    /** @short Location of the part to display as html, empty if there isn't one */
+    QString htmlLocation() const { return m_htmlLocation; }
+    /** @short Location of the part to display as plain text, empty if there isn't one */
+    QString plainTextLocation() const { return m_plainTextLocation; }
+
+    QMailAddressList to() const { return m_to; }
+    QMailAddressList cc() const { return m_cc; }
+    QMailAddressList bcc() const { return m_bcc; }
+
+private:
+    bool m_valid;
+    quint64 m_contentStatus;
+    bool m_singlePartBody;
+    bool m_singlePartPlainText;
+    QString m_htmlLocation;
+    QString m_plainTextLocation;
+    QMailAddressList m_to;
+    QMailAddressList m_cc;
+    QMailAddressList m_bcc;
+    QList<Part> m_parts;
+};
+
+#endif // MESSAGESTRUCTURE_H
@@ -0,0 +1,218 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MimeWriter.h"
+#include <cstring>
+#include <QDataStream>
+#include <QDebug>
+
+// RFC 5322 line limit, excluding the CRLF
+#define MAX_LINE_LENGTH 998
+// Quoted printable lines can be 76 characters including the soft break '='
+#define QP_LINE_LENGTH 75
+#define BASE64_LINE_LENGTH 76
+
+static const quint64 ONES = Q_UINT64_C(0x0101010101010101);
+static const quint64 HIGHS = Q_UINT64_C(0x8080808080808080);
+
+// Each is non zero when some byte of the word matches, only valid for words
+// without the high bit set in any byte
+static inline quint64 hasByteBelow(const quint64 word, const uchar n)
+{
+    return (word - ONES * n) & ~word & HIGHS;
+}
+
+static inline quint64 hasByte(const quint64 word, const uchar c)
+{
+    const quint64 x = word ^ (ONES * c);
+    return (x - ONES) & ~x & HIGHS;
+}
+
+// Printable ascii apart from '=', none of which need escaping or end a line
+static inline bool isPlainWord(const quint64 word)
+{
+    return !(word & HIGHS) && !hasByteBelow(word, 0x20) && !hasByte(word, '=') && !hasByte(word, 0x7f);
+}
+
+EncodingScanner::EncodingScanner() :
+    m_size(0), m_nonAscii(0), m_escapes(0), m_softBreaks(0), m_lineBreaks(0), m_binary(false),
+    m_lineLength(0), m_encodedLineLength(0), m_maxLineLength(0), m_lastWasCr(false)
+{
+}
+
+void EncodingScanner::scan(const char *data, const qint64 size)
+{
+    if (!data || size <= 0) {
+        return;
+    }
+    m_size += size;
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+    while (end - p >= 8) {
+        quint64 word;
+        std::memcpy(&word, p, sizeof(word));
+        if (!isPlainWord(word)) {
+            for (int i = 0; i < 8; ++i) {
+                scanByte(p[i]);
+            }
+        } else {
+            if (m_lastWasCr) {
+                m_binary = true;
+                m_lastWasCr = false;
+            }
+            m_lineLength += 8;
+            m_encodedLineLength += 8;
+            while (m_encodedLineLength > QP_LINE_LENGTH) {
+                ++m_softBreaks;
+                m_encodedLineLength -= QP_LINE_LENGTH;
+            }
+        }
+        p += 8;
+    }
+    while (p < end) {
+        scanByte(*p++);
+    }
+}
+
+void EncodingScanner::scanByte(const uchar c)
+{
+    if (m_lastWasCr && c != '\n') {
+        m_binary = true;
+    }
+    m_lastWasCr = false;
+    if (c == '\n') {
+        endLine();
+        return;
+    }
+    if (c == '\r') {
+        m_lastWasCr = true;
+        return;
+    }
+    if (c == 0) {
+        m_binary = true;
+    }
+    int width = 1;
+    if (c >= 0x80) {
+        ++m_nonAscii;
+        ++m_escapes;
+        width = 3;
+    } else if ((c < 0x20 && c != '\t') || c == '=' || c == 0x7f) {
+        ++m_escapes;
+        width = 3;
+    }
+    ++m_lineLength;
+    m_encodedLineLength += width;
+    if (m_encodedLineLength > QP_LINE_LENGTH) {
+        ++m_softBreaks;
+        m_encodedLineLength = width;
+    }
+}
+
+void EncodingScanner::endLine()
+{
+    m_maxLineLength = qMax(m_maxLineLength, m_lineLength);
+    ++m_lineBreaks;
+    m_lineLength = 0;
+    m_encodedLineLength = 0;
+}
+
+QMailMessageBody::TransferEncoding EncodingScanner::encoding(const bool allow8Bit) const
+{
+    const int longest = qMax(m_maxLineLength, m_lineLength);
+    if (!m_binary && longest <= MAX_LINE_LENGTH) {
+        if (m_nonAscii == 0) {
+            return QMailMessageBody::SevenBit;
+        }
+        if (allow8Bit) {
+            return QMailMessageBody::EightBit;
+        }
+    }
+    // Prefer quoted printable on a tie, it stays readable
+    if (encodedSize(QMailMessageBody::QuotedPrintable) <= encodedSize(QMailMessageBody::Base64)) {
+        return QMailMessageBody::QuotedPrintable;
+    }
+    return QMailMessageBody::Base64;
+}
+
+qint64 EncodingScanner::encodedSize(const QMailMessageBody::TransferEncoding encoding) const
+{
+    switch (encoding) {
+    case QMailMessageBody::QuotedPrintable:
+        // =XX for each escape and =CRLF for each soft break
+        return m_size + 2 * m_escapes + 3 * m_softBreaks;
+    case QMailMessageBody::Base64:
+    {
+        const qint64 encoded = ((m_size + 2) / 3) * 4;
+        return encoded + 2 * (encoded / BASE64_LINE_LENGTH);
+    }
+    default:
+        return m_size;
+    }
+}
+
+namespace {
+// Counts what gets written, passing it on to the target if there is one
+class CountingDevice : public QIODevice
+{
+public:
+    explicit CountingDevice(QIODevice *target) : m_target(target), m_count(0) {
+        open(QIODevice::WriteOnly);
+    }
+    qint64 count() const { return m_count; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) {
+        Q_UNUSED(data);
+        Q_UNUSED(maxSize);
+        return -1;
+    }
+    qint64 writeData(const char *data, qint64 size) {
+        const qint64 written = m_target ? m_target->write(data, size) : size;
+        if (written > 0) {
+            m_count += written;
+        }
+        return written;
+    }
+
+private:
+    QIODevice *m_target;
+    qint64 m_count;
+};
+}
+
+qint64 MimeWriter::write(const QMailMessage &msg, QIODevice *device)
+{
+    if (!device || !device->isWritable()) {
+        return -1;
+    }
+    CountingDevice counter(device);
+    QDataStream out(&counter);
+    msg.toRfc2822(out, QMailMessage::TransmissionFormat);
+    if (out.status() != QDataStream::Ok) {
+        qWarning() << "[MimeWriter] Failed writing message" << device->errorString();
+        return -1;
+    }
+    return counter.count();
+}
+
+qint64 MimeWriter::measure(const QMailMessage &msg)
+{
+    CountingDevice counter(0);
+    QDataStream out(&counter);
+    msg.toRfc2822(out, QMailMessage::TransmissionFormat);
+    return counter.count();
+}
@@ -0,0 +1,83 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MIMEWRITER_H
+#define MIMEWRITER_H
+
+#include <QIODevice>
+#include <qmailmessage.h>
+
+/** @short Picks the transfer encoding that keeps some content smallest
+ *
+ * Content is scanned once, in as many pieces as needed, counting what each
+ * encoding would have to escape: bytes over 127, '=' and control characters
+ * for quoted printable, NULs, bare CRs and overlong lines for 7bit and 8bit.
+ * Runs of plain printable ascii are checked eight bytes at a time.
+ */
+class EncodingScanner
+{
+public:
+    EncodingScanner();
+
+    void scan(const char *data, const qint64 size);
+    void scan(const QByteArray &data) { scan(data.constData(), data.size()); }
+
+    /** @short Cheapest encoding for what was scanned
+     *
+     * 8bit is only considered when \param allow8Bit is true, i.e the transport is
+     * known to announce 8BITMIME. Otherwise it's 7bit for short lined ascii and
+     * whichever of quoted printable and base64 comes out smaller for the rest.
+     */
+    QMailMessageBody::TransferEncoding encoding(const bool allow8Bit = false) const;
+
+    qint64 size() const { return m_size; }
+    /** @short Roughly how big \param encoding makes the content */
+    qint64 encodedSize(const QMailMessageBody::TransferEncoding encoding) const;
+
+private:
+    void scanByte(const uchar c);
+    void endLine();
+
+    qint64 m_size;
+    qint64 m_nonAscii;
+    // Bytes quoted printable has to write as =XX
+    qint64 m_escapes;
+    // Soft line breaks quoted printable needs to keep lines under 76
+    qint64 m_softBreaks;
+    qint64 m_lineBreaks;
+    bool m_binary; // NULs or bare CRs, neither survives 7bit or 8bit
+    int m_lineLength;
+    int m_encodedLineLength;
+    int m_maxLineLength;
+    bool m_lastWasCr;
+};
+
+/** @short Writes messages out the way they are transmitted
+ *
+ * Parts made with QMailMessagePart::fromFile() are read and encoded a chunk at
+ * a time as they're written, so the message never has to be held in memory.
+ */
+class MimeWriter
+{
+public:
+    /** @short Write \param msg to \param device, returns the bytes written or -1 */
+    static qint64 write(const QMailMessage &msg, QIODevice *device);
+    /** @short Exact size \param msg is transmitted as, nothing is kept */
+    static qint64 measure(const QMailMessage &msg);
+};
+
+#endif // MIMEWRITER_H
@@ -0,0 +1,64 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "RecipientCompleter.h"
+#include <MailServiceClient.h>
+
+RecipientCompleter::RecipientCompleter(QObject *parent) : QObject(parent),
+    m_limit(8), m_serial(0), m_model(0)
+{
+    m_model = new QQmlObjectListModel<MailAddress>(this);
+}
+
+void RecipientCompleter::setPrefix(const QString &prefix)
+{
+    if (m_prefix == prefix) {
+        return;
+    }
+    m_prefix = prefix;
+    emit prefixChanged();
+    update();
+}
+
+void RecipientCompleter::setLimit(const int &limit)
+{
+    if (m_limit == limit) {
+        return;
+    }
+    m_limit = limit;
+    emit limitChanged();
+    update();
+}
+
+void RecipientCompleter::update()
+{
+    const quint64 serial = ++m_serial;
+    if (m_prefix.trimmed().isEmpty()) {
+        m_model->clear();
+        return;
+    }
+    Client::instance()->completeRecipients(m_prefix, m_limit, this, [=](const QMailAddressList &addresses) {
+        if (serial != m_serial) {
+            // Superseded by a later prefix
+            return;
+        }
+        m_model->clear();
+        Q_FOREACH(const QMailAddress &address, addresses) {
+            m_model->append(new MailAddress(Q_NULLPTR, address));
+        }
+    });
+}
@@ -0,0 +1,62 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RECIPIENTCOMPLETER_H
+#define RECIPIENTCOMPLETER_H
+
+#include <QObject>
+#include <QmlObjectListModel.h>
+#include "MailAddress.h"
+
+/** @short Suggestions for the recipient field of the composer
+ *
+ * Set prefix to whatever has been typed so far and model fills with the best
+ * matching addresses from the worker's RecipientIndex. Replies for anything
+ * but the latest prefix are dropped.
+ */
+class RecipientCompleter : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString prefix READ prefix WRITE setPrefix NOTIFY prefixChanged)
+    /** @short Maximum number of suggestions */
+    Q_PROPERTY(int limit READ limit WRITE setLimit NOTIFY limitChanged)
+    Q_PROPERTY(QObject *model READ model CONSTANT)
+public:
+    explicit RecipientCompleter(QObject *parent = 0);
+
+    QString prefix() const { return m_prefix; }
+    int limit() const { return m_limit; }
+    QObject *model() const { return m_model; }
+
+signals:
+    void prefixChanged();
+    void limitChanged();
+
+public slots:
+    void setPrefix(const QString &prefix);
+    void setLimit(const int &limit);
+
+private:
+    void update();
+
+    QString m_prefix;
+    int m_limit;
+    quint64 m_serial;
+    QQmlObjectListModel<MailAddress> *m_model;
+};
+
+#endif // RECIPIENTCOMPLETER_H
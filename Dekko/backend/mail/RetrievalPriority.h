@@ -0,0 +1,54 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RETRIEVALPRIORITY_H
+#define RETRIEVALPRIORITY_H
+
+#include <qmailserviceaction.h>
+
+/** @short Marks retrievals that nobody is waiting on
+ *
+ * QMF gives clients no way to send a priority with a request, so speculative
+ * retrievals like prefetch set a flag above the RetrievalSpecification values.
+ * The message server dispatches them behind the interactive requests and clears
+ * the flag before the specification reaches the protocol plugin.
+ *
+ * This file is also built into the message server so must only depend on QMF.
+ */
+namespace RetrievalPriority {
+
+static const int BackgroundFlag = 0x100;
+
+inline QMailRetrievalAction::RetrievalSpecification background(QMailRetrievalAction::RetrievalSpecification spec)
+{
+    return QMailRetrievalAction::RetrievalSpecification(spec | BackgroundFlag);
+}
+
+inline bool isBackground(QMailRetrievalAction::RetrievalSpecification spec)
+{
+    return spec & BackgroundFlag;
+}
+
+/** @short \param spec without the priority, as QMF understands it */
+inline QMailRetrievalAction::RetrievalSpecification specification(QMailRetrievalAction::RetrievalSpecification spec)
+{
+    return QMailRetrievalAction::RetrievalSpecification(spec & ~BackgroundFlag);
+}
+
+}
+
+#endif // RETRIEVALPRIORITY_H
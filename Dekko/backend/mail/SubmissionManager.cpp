@@ -18,6 +18,7 @@
 #include "SubmissionManager.h"
 #include <qmailmessage.h>
 #include <qmailstore.h>
+#include <AccountRegistry.h>
 
 SubmissionManager::SubmissionManager(QObject *parent) : QObject(parent),
     m_builder(Q_NULLPTR)
@@ -76,11 +77,9 @@ void SubmissionManager::send()
     QMailMessage msg(m_builder->lastDraftId());
     qDebug() << "Msg valid> " << msg.id().isValid();
 //    qDebug() << msg.toRfc2822(QMailMessage::TransmissionFormat);
-    QMailAccount account(msg.parentAccountId());
-    if ((account.status() & QMailAccount::CanReferenceExternalData) &&
-            (account.status() & QMailAccount::CanTransmitViaReference) &&
-            account.standardFolder(QMailFolder::SentFolder).isValid() &&
-            QMailFolder(account.standardFolder(QMailFolder::SentFolder)).id().isValid()) {
+    AccountRegistry *registry = AccountRegistry::instance();
+    if (registry->testStatus(msg.parentAccountId(), QMailAccount::CanReferenceExternalData | QMailAccount::CanTransmitViaReference) &&
+            registry->standardFolder(msg.parentAccountId(), QMailFolder::SentFolder).isValid()) {
         qDebug() << "Enabling transmit from external";
         msg.setStatus(QMailMessage::TransmitFromExternal, true);
     }
@@ -29,7 +29,9 @@
 #include <MailAddress.h>
 #include <SenderIdentities.h>
 #include <MessageBuilder.h>
+#include <RecipientCompleter.h>
 #include <SubmissionManager.h>
+#include <AttachmentCache.h>
 #include "qmlenums.h"
 
 void MailPlugin::registerTypes(const char *uri)
@@ -46,6 +48,7 @@ void MailPlugin::registerTypes(const char *uri)
     qmlRegisterType<MailboxSearch>(uri, 1, 0, "MailboxSearch");
     qmlRegisterType<SenderIdentities>(uri, 1, 0, "SenderIdentities");
     qmlRegisterType<MessageBuilder>(uri, 1, 0, "MessageBuilder");
+    qmlRegisterType<RecipientCompleter>(uri, 1, 0, "RecipientCompleter");
     qmlRegisterType<SubmissionManager>(uri, 1, 0, "SubmissionManager");
 
     qmlRegisterUncreatableType<MessageSet>(uri, 1, 0, "MessageSet", "Cannot create MessageSet from QML, c++ only chap!");
@@ -59,5 +62,6 @@ void MailPlugin::registerTypes(const char *uri)
 void MailPlugin::initializeEngine(QQmlEngine *engine, const char *uri)
 {
     QQmlExtensionPlugin::initializeEngine(engine, uri);
+    AttachmentCache::init();
 }
 
@@ -17,10 +17,21 @@
 */
 #include "ClientService.h"
 #include <qmaildisconnected.h>
+#include <Metrics.h>
+#include <Trace.h>
+
+// Number of messages fetched per prefetch batch for each PrefetchPriority.
+// A user opened message is always fetched on it's own so we can report progress for it
+static const int s_prefetchBatchSize[] = { 1, 10, 10, 20 };
 
 ClientService::ClientService(QObject *parent) : QObject(parent),
-    m_undoQueue(0), m_undoTimer(0), m_exportAction(0)
+    m_undoQueue(0), m_undoTimer(0), m_exportAction(0), m_batcher(0), m_prefetchActionPriority(Background)
 {
+    m_batcher = new OperationBatcher(this);
+    connect(m_batcher, &OperationBatcher::flushed, this, &ClientService::handleBatchFlushed);
+    for (int i = UserOpened; i <= Background; ++i) {
+        m_prefetchQueues << QMailMessageIdList();
+    }
     m_undoTimer = new QTimer(this);
     m_undoTimer->setInterval(5000);
     m_undoTimer->setSingleShot(true);
@@ -90,7 +101,7 @@ void ClientService::deleteMessages(const QMailMessageIdList &ids)
     }
     qDebug() << "Deleting " << ids.count() << "messages";
     // these are undoable so add to the undo queue once processed
-    DeleteMessagesAction *action = new DeleteMessagesAction(this, ids);
+    DeleteMessagesAction *action = new DeleteMessagesAction(this, m_batcher, ids);
     action->process();
     m_undoQueue->append(action);
 }
@@ -98,6 +109,7 @@ void ClientService::deleteMessages(const QMailMessageIdList &ids)
 void ClientService::restoreMessage(const QMailMessageId &id)
 {
     if (id.isValid()) {
+        m_batcher->flush();
         QMailDisconnected::restoreToPreviousFolder(id);
         exportMailStoreUpdate(QMailMessage(id).parentAccountId());
     }
@@ -108,9 +120,8 @@ void ClientService::markMessagesImportant(const QMailMessageIdList &msgIds, cons
     if (msgIds.isEmpty()) {
         return;
     }
-    FlagsAction *flagAction = new FlagsAction(this, msgIds, FlagsAction::FlagStarred, important ? FlagsAction::Apply : FlagsAction::Remove);
+    FlagsAction *flagAction = new FlagsAction(this, m_batcher, msgIds, FlagsAction::FlagStarred, important ? FlagsAction::Apply : FlagsAction::Remove);
     flagAction->process();
-    exportMailStoreUpdate(flagAction->accountIds());
     flagAction->deleteLater();
 }
 
@@ -119,9 +130,8 @@ void ClientService::markMessagesRead(const QMailMessageIdList &msgIds, const boo
     if (msgIds.isEmpty()) {
         return;
     }
-    FlagsAction *flagAction = new FlagsAction(this, msgIds, FlagsAction::FlagRead, read ? FlagsAction::Apply : FlagsAction::Remove);
+    FlagsAction *flagAction = new FlagsAction(this, m_batcher, msgIds, FlagsAction::FlagRead, read ? FlagsAction::Apply : FlagsAction::Remove);
     flagAction->process();
-    exportMailStoreUpdate(flagAction->accountIds());
     flagAction->deleteLater();
 }
 
@@ -130,9 +140,8 @@ void ClientService::markMessagesTodo(const QMailMessageIdList &msgIds, const boo
     if (msgIds.isEmpty()) {
         return;
     }
-    FlagsAction *flagAction = new FlagsAction(this, msgIds, FlagsAction::FlagTodo, todo ? FlagsAction::Apply : FlagsAction::Remove);
+    FlagsAction *flagAction = new FlagsAction(this, m_batcher, msgIds, FlagsAction::FlagTodo, todo ? FlagsAction::Apply : FlagsAction::Remove);
     flagAction->process();
-    exportMailStoreUpdate(flagAction->accountIds());
     flagAction->deleteLater();
 }
 
@@ -167,7 +176,7 @@ void ClientService::markMessagesReplied(const QMailMessageIdList &idList, const
     } else {
         applyMask = QMailMessage::Replied;
     }
-    QMailDisconnected::flagMessages(idList, applyMask, removeMask, "Marking messages replied");
+    m_batcher->flagMessages(idList, applyMask, removeMask);
 }
 
 void ClientService::markMessageForwarded(const QMailMessageIdList &idList)
@@ -178,7 +187,7 @@ void ClientService::markMessageForwarded(const QMailMessageIdList &idList)
     quint64 applyMask = 0;
     quint64 removeMask = 0;
     applyMask = QMailMessage::Forwarded;
-    QMailDisconnected::flagMessages(idList, applyMask, removeMask, "Marking messages forwarded");
+    m_batcher->flagMessages(idList, applyMask, removeMask);
 }
 
 void ClientService::markFolderRead(const QMailFolderId &id)
@@ -193,12 +202,24 @@ void ClientService::markFolderRead(const QMailFolderId &id)
 }
 
 void ClientService::downloadMessagePart(const QMailMessageId &id, const QString &location)
+{
+    downloadMessagePartRange(id, location, 0);
+}
+
+void ClientService::downloadMessagePartRange(const QMailMessageId &id, const QString &location, const uint &minimum)
 {
     QMailMessagePart::Location part(location);
     if (!part.isValid(true)) {
         return;
     }
-    enqueue(new FetchMessagePartAction(this, id, location));
+    // Someone is waiting on this part so make room for it.
+    preemptPrefetch(UserOpened);
+    FetchMessagePartAction *action = new FetchMessagePartAction(this, id, location, minimum);
+    const quint64 msgId = id.toULongLong();
+    connect(action, &ClientServiceAction::progressChanged, this, [=](uint value, uint total) {
+        emit fetchProgress(msgId, location, value, total);
+    });
+    enqueueNext(action);
 }
 
 void ClientService::downloadMessages(const QMailMessageIdList &msgIds)
@@ -209,6 +230,54 @@ void ClientService::downloadMessages(const QMailMessageIdList &msgIds)
     enqueue(new FetchMessagesAction(this, msgIds));
 }
 
+void ClientService::prefetchMessages(const QMailMessageIdList &msgIds, const int priority)
+{
+    if (msgIds.isEmpty()) {
+        return;
+    }
+    const int p = qBound<int>(UserOpened, priority, Background);
+    const QMailMessageIdList running = m_prefetchAction ? m_prefetchAction->messageIds() : QMailMessageIdList();
+    Q_FOREACH(const QMailMessageId &id, msgIds) {
+        if (!id.isValid()) {
+            continue;
+        }
+        QHash<QMailMessageId, int>::iterator it = m_prefetchPriority.find(id);
+        if (it != m_prefetchPriority.end()) {
+            if (it.value() <= p) {
+                continue; // already wanted at least this much
+            }
+            m_prefetchQueues[it.value()].removeAll(id);
+        }
+        m_prefetchPriority.insert(id, p);
+        if (!running.contains(id)) {
+            m_prefetchQueues[p].append(id);
+        }
+    }
+    preemptPrefetch(p);
+    processPrefetchQueue();
+}
+
+void ClientService::cancelPrefetch(const QMailMessageIdList &msgIds)
+{
+    Q_FOREACH(const QMailMessageId &id, msgIds) {
+        QHash<QMailMessageId, int>::iterator it = m_prefetchPriority.find(id);
+        if (it == m_prefetchPriority.end()) {
+            continue;
+        }
+        m_prefetchQueues[it.value()].removeAll(id);
+        m_prefetchPriority.erase(it);
+    }
+    if (m_prefetchAction && m_prefetchAction->action()) {
+        Q_FOREACH(const QMailMessageId &id, m_prefetchAction->messageIds()) {
+            if (m_prefetchPriority.contains(id)) {
+                return; // still wanted by someone
+            }
+        }
+        qDebug() << "Cancelling running prefetch, no longer wanted";
+        m_prefetchAction->action()->cancelOperation();
+    }
+}
+
 void ClientService::sendMessage(const QMailMessage &msg)
 {
     // place it in outbox local storage. The service will pick up it's been stored
@@ -225,7 +294,7 @@ void ClientService::createStandardFolders(const QMailAccountId &id)
 
 void ClientService::moveToStandardFolder(const QMailMessageIdList &msgIds, const Folder::FolderType &folder, const bool userTriggered)
 {
-    MoveToStandardFolderAction *action = new MoveToStandardFolderAction(this, msgIds, Folder::folderFromType(folder));
+    MoveToStandardFolderAction *action = new MoveToStandardFolderAction(this, m_batcher, msgIds, Folder::folderFromType(folder));
     action->process();
     if (userTriggered) {
         m_undoQueue->append(action);
@@ -236,7 +305,7 @@ void ClientService::moveToStandardFolder(const QMailMessageIdList &msgIds, const
 
 void ClientService::moveToFolder(const QMailMessageIdList &msgIds, const QMailFolderId &folder)
 {
-    MoveToFolderAction *action = new MoveToFolderAction(this, msgIds, folder);
+    MoveToFolderAction *action = new MoveToFolderAction(this, m_batcher, msgIds, folder);
     action->process();
     m_undoQueue->append(action);
 }
@@ -322,6 +391,8 @@ void ClientService::sendAnyQueuedMail()
 void ClientService::undoActions()
 {
     m_undoTimer->stop();
+    // Anything still held in the batcher has to reach the store before it can be rolled back
+    m_batcher->flush();
     if (!m_undoQueue->isEmpty()) {
         // get list of accountids to rollback updates on
         // first get the total number of enabled accounts.
@@ -347,6 +418,7 @@ void ClientService::undoActions()
 
 void ClientService::exportMailStoreUpdate()
 {
+    m_batcher->flush();
     QMailAccountIdList accounts;
     foreach(ClientServiceAction *action, m_undoQueue->toList()) {
         Q_FOREACH(const QMailAccountId &id, qobject_cast<UndoableAction *>(action)->accountIds()) {
@@ -359,6 +431,13 @@ void ClientService::exportMailStoreUpdate()
     m_undoQueue->clear();
 }
 
+void ClientService::handleBatchFlushed(const QMailAccountIdList &accounts)
+{
+    // Undoable changes are exported by the undo timer, these are
+    // the accounts with changes that can go out now.
+    exportMailStoreUpdate(accounts);
+}
+
 void ClientService::exportMailStoreUpdate(const QMailAccountIdList &ids)
 {
     foreach(const QMailAccountId &id, ids) {
@@ -381,6 +460,7 @@ void ClientService::enqueue(ClientServiceAction *action)
     const bool queueWasEmpty = m_serviceQueue->isEmpty();
     qDebug() << "Enqueuing action";
     m_serviceQueue->enqueue(action);
+    updateQueueGauges();
     if (queueWasEmpty) {
         qDebug() << "Queue was empty processing next action";
         processNextServiceAction();
@@ -416,16 +496,126 @@ void ClientService::processNextAction()
 
 void ClientService::processNextServiceAction()
 {
+    TRACE_SPAN("ClientService::processNextServiceAction");
+    updateQueueGauges();
     if (m_serviceQueue->isEmpty()) {
         qDebug() << "Action queue empty nothing to do :-)";
+        // Idle, so anything waiting to be prefetched can go now
+        processPrefetchQueue();
         return;
     }
     qDebug() << "Processing next service action;";
     qDebug() << "Queue size is: " << m_serviceQueue->size();
     if (!m_serviceQueue->first()->isRunning()) {
         connect(m_serviceQueue->first(), &ClientServiceAction::activityChanged, m_serviceWatcher, &ClientServiceWatcher::activityChanged);
+        m_serviceQueue->first()->started();
         m_serviceQueue->first()->process();
     } else {
         qDebug() << "Action already running, cannot start another until it's done.";
     }
 }
+
+void ClientService::updateQueueGauges()
+{
+    static Metrics::Gauge *serviceQueue = Metrics::gauge("client.serviceQueue");
+    static Metrics::Gauge *prefetchQueue = Metrics::gauge("client.prefetchQueue");
+    serviceQueue->set(m_serviceQueue->size());
+    qint64 prefetching = 0;
+    Q_FOREACH(const QMailMessageIdList &queue, m_prefetchQueues) {
+        prefetching += queue.size();
+    }
+    prefetchQueue->set(prefetching);
+}
+
+void ClientService::enqueueNext(ClientServiceAction *action)
+{
+    if (m_serviceQueue->isEmpty()) {
+        enqueue(action);
+        return;
+    }
+    // Never displace the head as it's either running or just about to be.
+    int index = 1;
+    while (index < m_serviceQueue->size()
+           && m_serviceQueue->at(index)->serviceActionType() == ClientServiceAction::RetrievePartAction) {
+        ++index;
+    }
+    m_serviceQueue->insert(index, action);
+    updateQueueGauges();
+}
+
+void ClientService::preemptPrefetch(const int priority)
+{
+    if (m_prefetchAction && m_prefetchAction->action() && m_prefetchActionPriority > priority) {
+        qDebug() << "Preempting prefetch with priority" << m_prefetchActionPriority;
+        m_prefetchAction->action()->cancelOperation();
+    }
+}
+
+void ClientService::processPrefetchQueue()
+{
+    if (m_prefetchAction) {
+        return;
+    }
+    int priority = UserOpened;
+    while (priority <= Background && m_prefetchQueues.at(priority).isEmpty()) {
+        ++priority;
+    }
+    if (priority > Background) {
+        return;
+    }
+    // Speculative fetches should never hold up anything that was actually asked for.
+    if (priority >= Neighbour && !m_serviceQueue->isEmpty()) {
+        return;
+    }
+    QMailMessageIdList &queue = m_prefetchQueues[priority];
+    const int count = qMin(s_prefetchBatchSize[priority], queue.size());
+    const QMailMessageIdList batch = queue.mid(0, count);
+    queue.erase(queue.begin(), queue.begin() + count);
+
+    qDebug() << "Prefetching" << batch.size() << "messages with priority" << priority;
+    m_prefetchActionPriority = priority;
+    // Only the message the user opened is waiting to be read
+    m_prefetchAction = new FetchMessagesAction(this, batch, priority != UserOpened);
+    connect(m_prefetchAction, &ClientServiceAction::activityChanged, this, &ClientService::handlePrefetchActivity);
+    if (batch.size() == 1) {
+        const quint64 msgId = batch.first().toULongLong();
+        connect(m_prefetchAction, &ClientServiceAction::progressChanged, this, [=](uint value, uint total) {
+            emit fetchProgress(msgId, QString(), value, total);
+        });
+    }
+    updateQueueGauges();
+    m_prefetchAction->started();
+    m_prefetchAction->process();
+}
+
+void ClientService::handlePrefetchActivity(QMailServiceAction::Activity activity)
+{
+    if (!m_prefetchAction || (activity != QMailServiceAction::Successful && activity != QMailServiceAction::Failed)) {
+        return;
+    }
+    const QMailMessageIdList batch = m_prefetchAction->messageIds();
+    const QMailServiceAction::Status status = m_prefetchAction->action()->status();
+    m_prefetchAction->deleteLater();
+    m_prefetchAction.clear();
+
+    if (activity == QMailServiceAction::Failed && status.errorCode == QMailServiceAction::Status::ErrCancel) {
+        // Preempted or cancelled, put back whatever is still wanted at the front of it's queue.
+        for (int i = batch.size() - 1; i >= 0; --i) {
+            const QMailMessageId &id = batch.at(i);
+            if (m_prefetchPriority.contains(id)) {
+                m_prefetchQueues[m_prefetchPriority.value(id)].prepend(id);
+            }
+        }
+    } else {
+        Q_FOREACH(const QMailMessageId &id, batch) {
+            m_prefetchPriority.remove(id);
+        }
+        if (activity == QMailServiceAction::Successful) {
+            emit messagesFetched(batch);
+        } else {
+            qDebug() << "Prefetch failed: " << status.text;
+            emit messageFetchFailed(batch);
+        }
+    }
+    QTimer::singleShot(0, this, SLOT(processPrefetchQueue()));
+}
@@ -21,6 +21,7 @@
 #include <QObject>
 #include <QTimer>
 #include <QPointer>
+#include <QHash>
 #include <QmlObjectListModel.h>
 #include <PriorityQueue.h>
 #include <qmailstore.h>
@@ -52,6 +53,15 @@ class ClientService : public QObject
 
 public:
     explicit ClientService(QObject *parent = 0);
+
+    /** @short Priority classes for message prefetching, lower is more urgent */
+    enum PrefetchPriority {
+        UserOpened, /** @short The message the user has just opened */
+        Visible, /** @short Messages currently shown in the message list */
+        Neighbour, /** @short Messages just either side of the viewport or selection */
+        Background /** @short Anything else worth having available offline */
+    };
+
     QObject *undoQueue() { return m_undoQueue; }
     QObject *serviceQueue() { return m_serviceQueue; }
     bool hasUndoableAction();
@@ -66,7 +76,17 @@ public:
     void markMessageForwarded(const QMailMessageIdList &idList);
     void markFolderRead(const QMailFolderId &id);
     void downloadMessagePart(const QMailMessageId &id, const QString &location);
+    void downloadMessagePartRange(const QMailMessageId &id, const QString &location, const uint &minimum);
     void downloadMessages(const QMailMessageIdList &msgIds);
+    /** @short Queue message bodies to be fetched ahead of time
+     *
+     * Prefetches run outside of the service queue. Neighbour & Background
+     * priorities only run while the service queue is idle and get cancelled
+     * as soon as anything more urgent comes in.
+     */
+    void prefetchMessages(const QMailMessageIdList &msgIds, const int priority);
+    /** @short Drop any queued or running prefetch for msgIds */
+    void cancelPrefetch(const QMailMessageIdList &msgIds);
     void sendMessage(const QMailMessage &msg);
     void createStandardFolders(const QMailAccountId &id);
     void moveToStandardFolder(const QMailMessageIdList &msgIds, const Folder::FolderType &folder, const bool userTriggered);
@@ -84,6 +104,8 @@ signals:
     void queueChanged();
     void messagePartFetched(const quint64 &message, const QString &location);
     void messagePartFetchFailed(const quint64 &message, const QString &location);
+    /** @short Progress for a part fetch, or a whole message fetch when location is empty */
+    void fetchProgress(const quint64 &message, const QString &location, const uint &value, const uint &total);
     void messagesFetched(const QMailMessageIdList &ids);
     void messageFetchFailed(const QMailMessageIdList &ids);
     void messagesSent(const QMailMessageIdList &ids);
@@ -109,11 +131,20 @@ private slots:
     void undoableCountChanged();
     void rollBackMailStoreUpdates(const QMailAccountIdList &accounts);
     void markSentRead(const QMailMessageIdList &ids);
+    void handleBatchFlushed(const QMailAccountIdList &accounts);
+    /** @short Start the next prefetch batch if there is one and nothing is running */
+    void processPrefetchQueue();
+    void handlePrefetchActivity(QMailServiceAction::Activity activity);
 
 private:
     void connectServiceAction(QMailServiceAction* action);
     void enqueue(ClientServiceAction *action);
+    /** @short Place action directly behind the running action and any parts already waiting */
+    void enqueueNext(ClientServiceAction *action);
     bool exportQueuedForAccountId(const QMailAccountId &id);
+    /** @short Cancel the running prefetch if it's less urgent than priority */
+    void preemptPrefetch(const int priority);
+    void updateQueueGauges();
 
 private:
     QQmlObjectListModel<ClientServiceAction> *m_undoQueue;
@@ -124,6 +155,15 @@ private:
     QTimer *m_undoTimer;
 
     QMailRetrievalAction *m_exportAction;
+    // Flag & move operations waiting to be merged into the store
+    OperationBatcher *m_batcher;
+
+    // One FIFO per PrefetchPriority
+    QList<QMailMessageIdList> m_prefetchQueues;
+    // Priority of every message that is queued or in the running batch
+    QHash<QMailMessageId, int> m_prefetchPriority;
+    QPointer<FetchMessagesAction> m_prefetchAction;
+    int m_prefetchActionPriority;
 };
 
 /** @short ClientServiceWatcher watches the activity of a queues running action
@@ -22,10 +22,45 @@
 #include <qmailaccount.h>
 #include <qmailstore.h>
 #include <QDebug>
+#include <AccountRegistry.h>
+#include <Metrics.h>
+#include <RetrievalPriority.h>
 
-DeleteMessagesAction::DeleteMessagesAction(QObject *parent, const QMailMessageIdList &msgIds):
+void ClientServiceAction::started()
+{
+    const QByteArray type(metaObject()->className());
+    Metrics::histogram("client.queueWait." + type)->record(m_queued.nsecsElapsed() / 1000);
+    m_running.start();
+}
+
+void ClientServiceAction::recordRunTime(QMailServiceAction::Activity activity)
+{
+    if (!m_running.isValid() || (activity != QMailServiceAction::Successful && activity != QMailServiceAction::Failed)) {
+        return;
+    }
+    const QByteArray type(metaObject()->className());
+    Metrics::histogram("client.run." + type)->record(m_running.nsecsElapsed() / 1000);
+    if (activity == QMailServiceAction::Failed) {
+        Metrics::counter("client.failed." + type)->add();
+    }
+    m_running.invalidate();
+}
+
+QMailAccountIdList UndoableAction::accountsForMessages(const QMailMessageIdList &ids)
+{
+    QMailAccountIdList accounts;
+    const QMailMessageKey key = QMailMessageKey::id(ids);
+    Q_FOREACH(const QMailMessageMetaData &meta, QMailStore::instance()->messagesMetaData(
+                  key, QMailMessageKey::ParentAccountId, QMailStore::ReturnDistinct)) {
+        accounts << meta.parentAccountId();
+    }
+    return accounts;
+}
+
+DeleteMessagesAction::DeleteMessagesAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgIds):
     UndoableAction(parent), m_ids(msgIds)
 {
+    m_batcher = batcher;
     m_itemType = ItemType::Message;
     m_serviceActionType = ServiceAction::DeleteAction;
     m_description = QStringLiteral("Deleting %1 messages.").arg(m_ids.count());
@@ -34,11 +69,10 @@ DeleteMessagesAction::DeleteMessagesAction(QObject *parent, const QMailMessageId
 void DeleteMessagesAction::process()
 {
     qDebug() << "Moving to trash" << m_ids.at(0).toULongLong();
-    QMailDisconnected::moveToStandardFolder(m_ids,QMailFolder::TrashFolder);
-    QCoreApplication::processEvents();
+    m_batcher->moveToStandardFolder(m_ids, QMailFolder::TrashFolder);
     qDebug() << "Mark message deleted";
     const quint64 applyMask = QMailMessage::Trash | QMailMessage::Read;
-    QMailDisconnected::flagMessages(m_ids, applyMask, 0, "Marking messages as deleted");
+    m_batcher->flagMessages(m_ids, applyMask, 0, true);
 }
 
 int DeleteMessagesAction::itemCount()
@@ -48,19 +82,13 @@ int DeleteMessagesAction::itemCount()
 
 QMailAccountIdList DeleteMessagesAction::accountIds()
 {
-    QMailAccountIdList accounts;
-    Q_FOREACH(auto &id, m_ids) {
-        QMailAccountId accountId = QMailMessageMetaData(id).parentAccountId();
-        if (!accounts.contains(accountId)) {
-            accounts.append(accountId);
-        }
-    }
-    return accounts;
+    return accountsForMessages(m_ids);
 }
 
-MoveToFolderAction::MoveToFolderAction(QObject *parent, const QMailMessageIdList &msgIds, const QMailFolderId &destination):
+MoveToFolderAction::MoveToFolderAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgIds, const QMailFolderId &destination):
     UndoableAction(parent), m_ids(msgIds), m_destination(destination)
 {
+    m_batcher = batcher;
     m_itemType = ItemType::Message;
     m_serviceActionType = ServiceAction::MoveAction;
     m_description = QStringLiteral("Moving %1 messages to %2").arg(QString::number(m_ids.count()), QMailFolder(m_destination).displayName());
@@ -68,7 +96,7 @@ MoveToFolderAction::MoveToFolderAction(QObject *parent, const QMailMessageIdList
 
 void MoveToFolderAction::process()
 {
-    QMailDisconnected::moveToFolder(m_ids, m_destination);
+    m_batcher->moveToFolder(m_ids, m_destination);
 }
 
 int MoveToFolderAction::itemCount()
@@ -78,19 +106,13 @@ int MoveToFolderAction::itemCount()
 
 QMailAccountIdList MoveToFolderAction::accountIds()
 {
-    QMailAccountIdList accounts;
-    Q_FOREACH(auto &id, m_ids) {
-        QMailAccountId accountId = QMailMessageMetaData(id).parentAccountId();
-        if (!accounts.contains(accountId)) {
-            accounts.append(accountId);
-        }
-    }
-    return accounts;
+    return accountsForMessages(m_ids);
 }
 
-MoveToStandardFolderAction::MoveToStandardFolderAction(QObject *parent, const QMailMessageIdList &msgIds, const QMailFolder::StandardFolder &folder):
+MoveToStandardFolderAction::MoveToStandardFolderAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgIds, const QMailFolder::StandardFolder &folder):
     UndoableAction(parent), m_ids(msgIds), m_standard(folder)
 {
+    m_batcher = batcher;
     m_itemType = ItemType::Message;
     m_serviceActionType = ServiceAction::MoveAction;
     m_description = QStringLiteral("Moving %1 messages to standard folder").arg(QString::number(m_ids.count()));
@@ -98,20 +120,19 @@ MoveToStandardFolderAction::MoveToStandardFolderAction(QObject *parent, const QM
 
 void MoveToStandardFolderAction::process()
 {
-    QMailDisconnected::moveToStandardFolder(m_ids, m_standard);
-    QCoreApplication::processEvents();
+    m_batcher->moveToStandardFolder(m_ids, m_standard);
     switch (m_standard) {
     case QMailFolder::DraftsFolder:
-        QMailDisconnected::flagMessages(m_ids, QMailMessage::Draft, 0, "Flagging messages as draft");
+        m_batcher->flagMessages(m_ids, QMailMessage::Draft, 0, true);
         break;
     case QMailFolder::SentFolder:
-        QMailDisconnected::flagMessages(m_ids, QMailMessage::Sent, 0, "Flagging messages as sent");
+        m_batcher->flagMessages(m_ids, QMailMessage::Sent, 0, true);
         break;
     case QMailFolder::TrashFolder:
-        QMailDisconnected::flagMessages(m_ids, QMailMessage::Trash, 0, "Flagging messages as trash");
+        m_batcher->flagMessages(m_ids, QMailMessage::Trash, 0, true);
         break;
     case QMailFolder::JunkFolder:
-        QMailDisconnected::flagMessages(m_ids, QMailMessage::Junk, 0, "Flagging messages as Junk");
+        m_batcher->flagMessages(m_ids, QMailMessage::Junk, 0, true);
         break;
     case QMailFolder::InboxFolder:
     case QMailFolder::OutboxFolder:
@@ -126,14 +147,7 @@ int MoveToStandardFolderAction::itemCount()
 
 QMailAccountIdList MoveToStandardFolderAction::accountIds()
 {
-    QMailAccountIdList accounts;
-    Q_FOREACH(auto &id, m_ids) {
-        QMailAccountId accountId = QMailMessageMetaData(id).parentAccountId();
-        if (!accounts.contains(accountId)) {
-            accounts.append(accountId);
-        }
-    }
-    return accounts;
+    return accountsForMessages(m_ids);
 }
 
 ExportUpdatesAction::ExportUpdatesAction(QObject *parent, const QMailAccountId &id) :
@@ -141,18 +155,18 @@ ExportUpdatesAction::ExportUpdatesAction(QObject *parent, const QMailAccountId &
 {
     m_actionType = ActionType::Silent;
     m_serviceActionType = ServiceAction::ExportAction;
-    m_description = tr("Syncing changes for %1 account").arg(QMailAccount(m_accountId).name());
+    m_description = tr("Syncing changes for %1 account").arg(AccountRegistry::instance()->name(m_accountId));
 }
 
 void ExportUpdatesAction::process()
 {
-    qDebug() << "Exporting updates for account: " << QMailAccount(m_accountId).name();
+    qDebug() << "Exporting updates for account: " << AccountRegistry::instance()->name(m_accountId);
     createRetrievalAction()->exportUpdates(m_accountId);
 }
 
-FlagsAction::FlagsAction(QObject *parent, const QMailMessageIdList &msgs,
+FlagsAction::FlagsAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgs,
                          const FlagsAction::FlagType &flag, const FlagsAction::State &state) :
-    ClientServiceAction(parent), m_idList(msgs), m_flag(flag), m_state(state) {
+    ClientServiceAction(parent), m_batcher(batcher), m_idList(msgs), m_flag(flag), m_state(state) {
 
     m_actionType = ActionType::Immediate;
     m_serviceActionType = ServiceAction::FlagAction;
@@ -244,38 +258,39 @@ void FlagsAction::process()
         break;
     }
     }
-    QMailDisconnected::flagMessages(m_idList, applyMask, removeMask, m_description);
+    m_batcher->flagMessages(m_idList, applyMask, removeMask);
 }
 
 QMailAccountIdList FlagsAction::accountIds()
 {
-    QMailAccountIdList accounts;
-    Q_FOREACH(auto &id, m_idList) {
-        QMailAccountId accountId = QMailMessageMetaData(id).parentAccountId();
-        if (!accounts.contains(accountId)) {
-            accounts.append(accountId);
-        }
-    }
-    return accounts;
+    return UndoableAction::accountsForMessages(m_idList);
 }
 
-FetchMessagePartAction::FetchMessagePartAction(QObject *parent, const QMailMessageId &id, const QString &location):
-    ClientServiceAction(parent), m_id(id.toULongLong()), m_location(location)
+FetchMessagePartAction::FetchMessagePartAction(QObject *parent, const QMailMessageId &id, const QString &location, const uint &minimum):
+    ClientServiceAction(parent), m_id(id.toULongLong()), m_location(location), m_minimum(minimum)
 {
     m_actionType = ActionType::Immediate;
     m_serviceActionType = ServiceAction::RetrievePartAction;
-    m_description = QStringLiteral("Fetching message part: %1").arg(m_location);
+    if (m_minimum) {
+        m_description = QStringLiteral("Fetching %1 bytes of message part: %2").arg(m_minimum).arg(m_location);
+    } else {
+        m_description = QStringLiteral("Fetching message part: %1").arg(m_location);
+    }
 }
 
 void FetchMessagePartAction::process()
 {
 //    qDebug() << m_description;
     QMailMessagePart::Location part(m_location);
-    createRetrievalAction()->retrieveMessagePart(part);
+    if (m_minimum) {
+        createRetrievalAction()->retrieveMessagePartRange(part, m_minimum);
+    } else {
+        createRetrievalAction()->retrieveMessagePart(part);
+    }
 }
 
-FetchMessagesAction::FetchMessagesAction(QObject *parent, const QMailMessageIdList &list):
-    ClientServiceAction(parent), m_list(list)
+FetchMessagesAction::FetchMessagesAction(QObject *parent, const QMailMessageIdList &list, const bool &background):
+    ClientServiceAction(parent), m_list(list), m_background(background)
 {
     m_actionType = ActionType::Immediate;
     m_serviceActionType = ServiceAction::RetrieveAction;
@@ -284,7 +299,8 @@ FetchMessagesAction::FetchMessagesAction(QObject *parent, const QMailMessageIdLi
 
 void FetchMessagesAction::process()
 {
-    createRetrievalAction()->retrieveMessages(m_list, QMailRetrievalAction::RetrievalSpecification::Content);
+    const QMailRetrievalAction::RetrievalSpecification spec = QMailRetrievalAction::RetrievalSpecification::Content;
+    createRetrievalAction()->retrieveMessages(m_list, m_background ? RetrievalPriority::background(spec) : spec);
 }
 
 OutboxAction::OutboxAction(QObject *parent, const QMailMessage &msg) : ClientServiceAction(parent), m_msg(msg)
@@ -23,6 +23,8 @@
 #include <qmailserviceaction.h>
 #include <qmailmessage.h>
 #include <QUuid>
+#include <QElapsedTimer>
+#include "OperationBatcher.h"
 
 class ClientServiceAction : public QObject
 {
@@ -32,6 +34,8 @@ public:
     explicit ClientServiceAction(QObject *parent = 0) : QObject(parent)
     {
         m_uid = QUuid::createUuid().toByteArray();
+        m_queued.start();
+        connect(this, &ClientServiceAction::activityChanged, this, &ClientServiceAction::recordRunTime);
     }
 
     enum ActionType {
@@ -61,6 +65,8 @@ public:
     };
 
     virtual void process() = 0;
+    /** @short Call right before process(), records how long the action waited to run */
+    void started();
     QMailServiceAction *action() const { return m_serviceAction; }
     ActionType actionType() const { return m_actionType; }
     ServiceAction serviceActionType() const { return m_serviceActionType; }
@@ -99,6 +105,10 @@ public:
 
 signals:
     void activityChanged(QMailServiceAction::Activity activity);
+    void progressChanged(uint value, uint total);
+
+private slots:
+    void recordRunTime(QMailServiceAction::Activity activity);
 
 protected:
     ActionType m_actionType;
@@ -106,10 +116,13 @@ protected:
     QString m_description;
     QPointer<QMailServiceAction> m_serviceAction;
     QByteArray m_uid;
+    QElapsedTimer m_queued;
+    QElapsedTimer m_running;
 
     QMailRetrievalAction *createRetrievalAction() {
         m_serviceAction = new QMailRetrievalAction(this);
         connect(m_serviceAction, &QMailServiceAction::activityChanged, this, &ClientServiceAction::activityChanged);
+        connect(m_serviceAction, &QMailServiceAction::progressChanged, this, &ClientServiceAction::progressChanged);
         qDebug() << "Retrieval action created";
         return static_cast<QMailRetrievalAction *>(m_serviceAction.data());
     }
@@ -142,7 +155,11 @@ public:
     virtual QMailAccountIdList accountIds() = 0;
     ItemType itemType() const { return m_itemType; }
 
+    // Distinct parent accounts of \param ids in a single store query
+    static QMailAccountIdList accountsForMessages(const QMailMessageIdList &ids);
+
 protected:
+    QPointer<OperationBatcher> m_batcher;
     ItemType m_itemType;
 };
 
@@ -151,7 +168,7 @@ class DeleteMessagesAction : public UndoableAction
     Q_OBJECT
     QMailMessageIdList m_ids;
 public:
-    DeleteMessagesAction(QObject *parent, const QMailMessageIdList &msgIds);
+    DeleteMessagesAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgIds);
 
     void process();
     int itemCount();
@@ -164,7 +181,7 @@ class MoveToFolderAction : public UndoableAction
     QMailMessageIdList m_ids;
     QMailFolderId m_destination;
 public:
-    MoveToFolderAction(QObject *parent, const QMailMessageIdList &msgIds, const QMailFolderId &destination);
+    MoveToFolderAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgIds, const QMailFolderId &destination);
     void process();
     int itemCount();
     QMailAccountIdList accountIds();
@@ -176,7 +193,7 @@ class MoveToStandardFolderAction : public UndoableAction
     QMailMessageIdList m_ids;
     QMailFolder::StandardFolder m_standard;
 public:
-    MoveToStandardFolderAction(QObject *parent, const QMailMessageIdList &msgIds, const QMailFolder::StandardFolder &folder);
+    MoveToStandardFolderAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgIds, const QMailFolder::StandardFolder &folder);
     void process();
     int itemCount();
     QMailAccountIdList accountIds();
@@ -228,13 +245,14 @@ public:
         Remove
     };
 
-    FlagsAction(QObject *parent, const QMailMessageIdList &msgs,
+    FlagsAction(QObject *parent, OperationBatcher *batcher, const QMailMessageIdList &msgs,
                 const FlagsAction::FlagType &flag, const FlagsAction::State &state);
 
     void process();
     QMailAccountIdList accountIds();
 
 private:
+    QPointer<OperationBatcher> m_batcher;
     QMailMessageIdList m_idList;
     FlagType m_flag;
     State m_state;
@@ -244,7 +262,8 @@ class FetchMessagePartAction : public ClientServiceAction
 {
     Q_OBJECT
 public:
-    FetchMessagePartAction(QObject *parent, const QMailMessageId &id, const QString &location);
+    // A non zero minimum only retrieves that many bytes of the part, continuing from what's already stored
+    FetchMessagePartAction(QObject *parent, const QMailMessageId &id, const QString &location, const uint &minimum = 0);
     void process();
 public slots:
     QString location() { return m_location; }
@@ -252,18 +271,21 @@ public slots:
 private:
     quint64 m_id;
     QString m_location;
+    uint m_minimum;
 };
 
 class FetchMessagesAction : public ClientServiceAction
 {
     Q_OBJECT
 public:
-    FetchMessagesAction(QObject *parent, const QMailMessageIdList &list);
+    // Background fetches are queued by the server behind anything interactive
+    FetchMessagesAction(QObject *parent, const QMailMessageIdList &list, const bool &background = false);
     void process();
 public slots:
     QMailMessageIdList messageIds() { return m_list; }
 private:
     QMailMessageIdList m_list;
+    bool m_background;
 };
 
 class OutboxAction : public ClientServiceAction
@@ -0,0 +1,354 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "LocalMailService.h"
+#include <QDebug>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QSemaphore>
+#include <qmailnamespace.h>
+#include <qmailstore.h>
+#include "RecipientIndex.h"
+#include "ThreadIndex.h"
+#include <Metrics.h>
+#include <Trace.h>
+#include <service/AccountServiceWorker.h>
+#include <service/AccountServiceAdaptor.h>
+
+#define SERVICE "org.dekkoproject.Service"
+#define ACCOUNTS_PATH "/accounts"
+
+void LocalQueryRunner::queryMessages(const quint64 &ticket, const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit)
+{
+    TRACE_ACTION_SPAN("LocalQueryRunner::queryMessages", ticket);
+    METRIC_LATENCY("store.queryMessages");
+    emit messagesQueried(ticket, QMailStore::instance()->queryMessages(key, sortKey, limit));
+}
+
+void LocalQueryRunner::countMessages(const quint64 &ticket, const QMailMessageKey &key)
+{
+    TRACE_ACTION_SPAN("LocalQueryRunner::countMessages", ticket);
+    METRIC_LATENCY("store.countMessages");
+    emit messagesCounted(ticket, QMailStore::instance()->countMessages(key));
+}
+
+void LocalQueryRunner::queryThreads(const quint64 &ticket, const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit)
+{
+    TRACE_ACTION_SPAN("LocalQueryRunner::queryThreads", ticket);
+    METRIC_LATENCY("store.queryThreads");
+    const ThreadIndex::Conversations result = ThreadIndex::instance()->conversations(key, sortKey, limit);
+    emit threadsQueried(ticket, result.ids, result.counts, result.unread, result.total);
+}
+
+void LocalQueryRunner::completeRecipients(const quint64 &ticket, const QString &prefix, const int &limit)
+{
+    TRACE_ACTION_SPAN("LocalQueryRunner::completeRecipients", ticket);
+    METRIC_LATENCY("store.completeRecipients");
+    emit recipientsCompleted(ticket, QMailAddress::toStringList(RecipientIndex::instance()->complete(prefix, limit)));
+}
+
+static LocalMailService *s_local = 0;
+
+bool LocalMailService::enabled()
+{
+#ifdef WORKER_AS_QTHREAD
+    return qgetenv("DEKKO_WORKER_THREAD") != "0";
+#else
+    const QByteArray env = qgetenv("DEKKO_WORKER_THREAD");
+    return !env.isEmpty() && env != "0";
+#endif
+}
+
+LocalMailService *LocalMailService::instance()
+{
+    return s_local;
+}
+
+bool LocalMailService::start()
+{
+    if (s_local) {
+        return true;
+    }
+    s_local = new LocalMailService();
+    if (!s_local->startWorker()) {
+        delete s_local;
+        s_local = 0;
+        return false;
+    }
+    return true;
+}
+
+LocalMailService::LocalMailService(QObject *parent) : QObject(parent),
+    m_lockId(-1), m_nextTicket(0), m_hasUndoableAction(false)
+{
+    MailServiceWorker::registerTypes();
+    qRegisterMetaType<QMailMessageKey>();
+    qRegisterMetaType<QMailMessageSortKey>();
+    qRegisterMetaType<QMailMessageIdList>("QMailMessageIdList");
+    m_thread.setObjectName(QStringLiteral("MailServiceWorker"));
+}
+
+LocalMailService::~LocalMailService()
+{
+    if (m_thread.isRunning()) {
+        // Let the worker thread clean up it's own objects
+        connect(&m_thread, &QThread::finished, m_worker.data(), &QObject::deleteLater);
+        connect(&m_thread, &QThread::finished, m_accountsWorker.data(), &QObject::deleteLater);
+        connect(&m_thread, &QThread::finished, m_queryRunner.data(), &QObject::deleteLater);
+        m_thread.quit();
+        m_thread.wait();
+    }
+    delete m_worker;
+    delete m_accountsWorker;
+    delete m_queryRunner;
+    if (m_lockId != -1) {
+        QMail::fileUnlock(m_lockId);
+    }
+}
+
+bool LocalMailService::startWorker()
+{
+    // Same lock the dekko-worker process takes so we never run both
+    m_lockId = QMail::fileLock(QStringLiteral("dekko-worker.lock"));
+    if (m_lockId == -1) {
+        qWarning() << "[LocalMailService] dekko-worker is already running";
+        return false;
+    }
+
+    QDBusConnection connection = QDBusConnection::sessionBus();
+    if (connection.interface()->isServiceRegistered(SERVICE)) {
+        qWarning() << "[LocalMailService] Mail service already registered on the session bus";
+        return false;
+    }
+
+    // The worker talks to the store from its own thread so everything it owns has to be
+    // built there as well, rather than constructed here and moved across after the fact.
+    QSemaphore created;
+    QMetaObject::Connection setup = connect(&m_thread, &QThread::started, [this, &created]() {
+        createWorker();
+        created.release();
+    });
+    m_thread.start();
+    created.acquire();
+    disconnect(setup);
+
+    if (!connection.registerService(SERVICE)
+            || !connection.registerObject(ACCOUNTS_PATH, m_accountsWorker)) {
+        qWarning() << "[LocalMailService] Failed registering the account service";
+        return false;
+    }
+    qDebug() << "[LocalMailService] Mail service worker running in process";
+    return true;
+}
+
+void LocalMailService::createWorker()
+{
+    m_worker = new MailServiceWorker();
+    m_queryRunner = new LocalQueryRunner();
+    m_accountsWorker = new AccountServiceWorker();
+    new AccountServiceAdaptor(m_accountsWorker);
+    // Read the undo state where it lives and hand the values over
+    MailServiceWorker *worker = m_worker;
+    connect(worker, &MailServiceWorker::undoCountChanged, worker, [this, worker]() {
+        QMetaObject::invokeMethod(this, "setUndoState", Qt::QueuedConnection,
+                                  Q_ARG(bool, worker->hasUndoableAction()),
+                                  Q_ARG(QString, worker->undoDescription()));
+    });
+}
+
+void LocalMailService::setUndoState(const bool &hasUndoableAction, const QString &description)
+{
+    m_hasUndoableAction = hasUndoableAction;
+    m_undoDescription = description;
+    emit undoStateChanged();
+}
+
+void LocalMailService::deleteMessages(const QList<quint64> &ids)
+{
+    QMetaObject::invokeMethod(m_worker, "deleteMessages", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, ids));
+}
+
+void LocalMailService::restoreMessage(const quint64 &id)
+{
+    QMetaObject::invokeMethod(m_worker, "restoreMessage", Qt::QueuedConnection,
+                              Q_ARG(quint64, id));
+}
+
+void LocalMailService::markMessagesImportant(const QList<quint64> &msgIds, const bool important)
+{
+    QMetaObject::invokeMethod(m_worker, "markMessagesImportant", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(bool, important));
+}
+
+void LocalMailService::markMessagesRead(const QList<quint64> &msgIds, const bool read)
+{
+    QMetaObject::invokeMethod(m_worker, "markMessagesRead", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(bool, read));
+}
+
+void LocalMailService::markMessagesTodo(const QList<quint64> &msgIds, const bool todo)
+{
+    QMetaObject::invokeMethod(m_worker, "markMessagesTodo", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(bool, todo));
+}
+
+void LocalMailService::markMessagesDone(const QList<quint64> &msgIds, const bool done)
+{
+    QMetaObject::invokeMethod(m_worker, "markMessagesDone", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(bool, done));
+}
+
+void LocalMailService::markMessagesReplied(const QList<quint64> &msgIds, const bool all)
+{
+    QMetaObject::invokeMethod(m_worker, "markMessagesReplied", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(bool, all));
+}
+
+void LocalMailService::markMessageForwarded(const QList<quint64> &msgIds)
+{
+    QMetaObject::invokeMethod(m_worker, "markMessageForwarded", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds));
+}
+
+void LocalMailService::markFolderRead(const quint64 &folderId)
+{
+    QMetaObject::invokeMethod(m_worker, "markFolderRead", Qt::QueuedConnection,
+                              Q_ARG(quint64, folderId));
+}
+
+void LocalMailService::createStandardFolders(const quint64 &accountId)
+{
+    QMetaObject::invokeMethod(m_worker, "createStandardFolders", Qt::QueuedConnection,
+                              Q_ARG(quint64, accountId));
+}
+
+void LocalMailService::syncFolders(const quint64 &accountId, const QList<quint64> &folders)
+{
+    QMetaObject::invokeMethod(m_worker, "syncFolders", Qt::QueuedConnection,
+                              Q_ARG(quint64, accountId), Q_ARG(QList<quint64>, folders));
+}
+
+void LocalMailService::moveToFolder(const QList<quint64> &msgIds, const quint64 &folderId)
+{
+    QMetaObject::invokeMethod(m_worker, "moveToFolder", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(quint64, folderId));
+}
+
+void LocalMailService::moveToStandardFolder(const QList<quint64> &msgIds, const int &folder, const bool userTriggered)
+{
+    QMetaObject::invokeMethod(m_worker, "moveToStandardFolder", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(int, folder), Q_ARG(bool, userTriggered));
+}
+
+void LocalMailService::downloadMessagePart(const quint64 &msgId, const QString &partLocation)
+{
+    QMetaObject::invokeMethod(m_worker, "downloadMessagePart", Qt::QueuedConnection,
+                              Q_ARG(quint64, msgId), Q_ARG(QString, partLocation));
+}
+
+void LocalMailService::downloadMessagePartRange(const quint64 &msgId, const QString &partLocation, const uint &minimum)
+{
+    QMetaObject::invokeMethod(m_worker, "downloadMessagePartRange", Qt::QueuedConnection,
+                              Q_ARG(quint64, msgId), Q_ARG(QString, partLocation), Q_ARG(uint, minimum));
+}
+
+void LocalMailService::prefetchMessages(const QList<quint64> &msgIds, const int &priority)
+{
+    QMetaObject::invokeMethod(m_worker, "prefetchMessages", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds), Q_ARG(int, priority));
+}
+
+void LocalMailService::cancelPrefetch(const QList<quint64> &msgIds)
+{
+    QMetaObject::invokeMethod(m_worker, "cancelPrefetch", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds));
+}
+
+void LocalMailService::sendMessage(const quint64 &msgId)
+{
+    QMetaObject::invokeMethod(m_worker, "sendMessage", Qt::QueuedConnection,
+                              Q_ARG(quint64, msgId));
+}
+
+void LocalMailService::sendPendingMessages()
+{
+    QMetaObject::invokeMethod(m_worker, "sendPendingMessages", Qt::QueuedConnection);
+}
+
+void LocalMailService::synchronizeAccount(const quint64 &accountId)
+{
+    QMetaObject::invokeMethod(m_worker, "synchronizeAccount", Qt::QueuedConnection,
+                              Q_ARG(quint64, accountId));
+}
+
+void LocalMailService::undoActions()
+{
+    QMetaObject::invokeMethod(m_worker, "undoActions", Qt::QueuedConnection);
+}
+
+void LocalMailService::emptyTrash(const QList<quint64> &accountIds)
+{
+    QMetaObject::invokeMethod(m_worker, "emptyTrash", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, accountIds));
+}
+
+void LocalMailService::removeMessage(const quint64 &msgId, const int &option)
+{
+    QMetaObject::invokeMethod(m_worker, "removeMessage", Qt::QueuedConnection,
+                              Q_ARG(quint64, msgId), Q_ARG(int, option));
+}
+
+void LocalMailService::pruneCache(const QList<quint64> &msgIds)
+{
+    QMetaObject::invokeMethod(m_worker, "pruneCache", Qt::QueuedConnection,
+                              Q_ARG(QList<quint64>, msgIds));
+}
+
+quint64 LocalMailService::queryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit)
+{
+    const quint64 ticket = ++m_nextTicket;
+    QMetaObject::invokeMethod(m_queryRunner, "queryMessages", Qt::QueuedConnection,
+                              Q_ARG(quint64, ticket), Q_ARG(QMailMessageKey, key),
+                              Q_ARG(QMailMessageSortKey, sortKey), Q_ARG(int, limit));
+    return ticket;
+}
+
+quint64 LocalMailService::countMessages(const QMailMessageKey &key)
+{
+    const quint64 ticket = ++m_nextTicket;
+    QMetaObject::invokeMethod(m_queryRunner, "countMessages", Qt::QueuedConnection,
+                              Q_ARG(quint64, ticket), Q_ARG(QMailMessageKey, key));
+    return ticket;
+}
+
+quint64 LocalMailService::queryThreads(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit)
+{
+    const quint64 ticket = ++m_nextTicket;
+    QMetaObject::invokeMethod(m_queryRunner, "queryThreads", Qt::QueuedConnection,
+                              Q_ARG(quint64, ticket), Q_ARG(QMailMessageKey, key),
+                              Q_ARG(QMailMessageSortKey, sortKey), Q_ARG(int, limit));
+    return ticket;
+}
+
+quint64 LocalMailService::completeRecipients(const QString &prefix, const int &limit)
+{
+    const quint64 ticket = ++m_nextTicket;
+    QMetaObject::invokeMethod(m_queryRunner, "completeRecipients", Qt::QueuedConnection,
+                              Q_ARG(quint64, ticket), Q_ARG(QString, prefix), Q_ARG(int, limit));
+    return ticket;
+}
@@ -0,0 +1,141 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef LOCALMAILSERVICE_H
+#define LOCALMAILSERVICE_H
+
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+#include <qmailmessagekey.h>
+#include <qmailmessagesortkey.h>
+#include "MailServiceWorker.h"
+
+class AccountServiceWorker;
+
+/** @short Runs store queries on the worker thread without serializing the keys */
+class LocalQueryRunner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LocalQueryRunner(QObject *parent = 0) : QObject(parent) {}
+
+public slots:
+    void queryMessages(const quint64 &ticket, const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit);
+    void countMessages(const quint64 &ticket, const QMailMessageKey &key);
+    void queryThreads(const quint64 &ticket, const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit);
+    void completeRecipients(const quint64 &ticket, const QString &prefix, const int &limit);
+
+signals:
+    void messagesQueried(const quint64 &ticket, const QMailMessageIdList &ids);
+    void messagesCounted(const quint64 &ticket, const int &count);
+    void threadsQueried(const quint64 &ticket, const QMailMessageIdList &ids, const QList<int> &counts,
+                        const QList<int> &unread, const int &total);
+    void recipientsCompleted(const quint64 &ticket, const QStringList &addresses);
+};
+
+/** @short Hosts the mail service worker on a thread inside the app process
+ *
+ * Normally the MailServiceWorker lives in the dekko-worker process and every
+ * call from Client is marshalled over D-Bus. When enabled() this class runs
+ * the same worker on a dedicated thread instead and Client dispatches straight
+ * to it with queued calls, signals come back the same way. Store queries skip
+ * the QDataStream round trip of their keys altogether.
+ *
+ * The account service still registers on the session bus, from this process,
+ * so AccountServiceClient works unchanged.
+ *
+ * Enabled by building with the workerAsThread project option or at runtime
+ * by setting DEKKO_WORKER_THREAD=1
+ */
+class LocalMailService : public QObject
+{
+    Q_OBJECT
+public:
+    static bool enabled();
+    /** @short The running in process service or 0 if the worker is out of process */
+    static LocalMailService *instance();
+    /** @short Start the worker thread and register the account service */
+    static bool start();
+
+    ~LocalMailService();
+
+    MailServiceWorker *worker() const { return m_worker; }
+    LocalQueryRunner *queryRunner() const { return m_queryRunner; }
+
+    // These mirror MailServiceInterface so Client can call either.
+    // The undo state is cached from the worker so reading it never blocks on the worker thread.
+    bool hasUndoableAction() const { return m_hasUndoableAction; }
+    QString undoDescription() const { return m_undoDescription; }
+    void deleteMessages(const QList<quint64> &ids);
+    void restoreMessage(const quint64 &id);
+    void markMessagesImportant(const QList<quint64> &msgIds, const bool important);
+    void markMessagesRead(const QList<quint64> &msgIds, const bool read);
+    void markMessagesTodo(const QList<quint64> &msgIds, const bool todo);
+    void markMessagesDone(const QList<quint64> &msgIds, const bool done);
+    void markMessagesReplied(const QList<quint64> &msgIds, const bool all);
+    void markMessageForwarded(const QList<quint64> &msgIds);
+    void markFolderRead(const quint64 &folderId);
+    void createStandardFolders(const quint64 &accountId);
+    void syncFolders(const quint64 &accountId, const QList<quint64> &folders);
+    void moveToFolder(const QList<quint64> &msgIds, const quint64 &folderId);
+    void moveToStandardFolder(const QList<quint64> &msgIds, const int &folder, const bool userTriggered);
+    void downloadMessagePart(const quint64 &msgId, const QString &partLocation);
+    void downloadMessagePartRange(const quint64 &msgId, const QString &partLocation, const uint &minimum);
+    void prefetchMessages(const QList<quint64> &msgIds, const int &priority);
+    void cancelPrefetch(const QList<quint64> &msgIds);
+    void sendMessage(const quint64 &msgId);
+    void sendPendingMessages();
+    void synchronizeAccount(const quint64 &accountId);
+    void undoActions();
+    void emptyTrash(const QList<quint64> &accountIds);
+    void removeMessage(const quint64 &msgId, const int &option);
+    void pruneCache(const QList<quint64> &msgIds);
+
+    /** @short Returns a ticket matched by LocalQueryRunner::messagesQueried */
+    quint64 queryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit);
+    /** @short Returns a ticket matched by LocalQueryRunner::messagesCounted */
+    quint64 countMessages(const QMailMessageKey &key);
+    /** @short Returns a ticket matched by LocalQueryRunner::threadsQueried */
+    quint64 queryThreads(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit);
+    /** @short Returns a ticket matched by LocalQueryRunner::recipientsCompleted */
+    quint64 completeRecipients(const QString &prefix, const int &limit);
+
+signals:
+    /** @short The cached undo state caught up with the worker */
+    void undoStateChanged();
+
+private slots:
+    void setUndoState(const bool &hasUndoableAction, const QString &description);
+
+private:
+    explicit LocalMailService(QObject *parent = 0);
+    bool startWorker();
+    // Runs on m_thread
+    void createWorker();
+
+    QThread m_thread;
+    QPointer<MailServiceWorker> m_worker;
+    QPointer<AccountServiceWorker> m_accountsWorker;
+    QPointer<LocalQueryRunner> m_queryRunner;
+    int m_lockId;
+    quint64 m_nextTicket;
+    bool m_hasUndoableAction;
+    QString m_undoDescription;
+};
+
+#endif // LOCALMAILSERVICE_H
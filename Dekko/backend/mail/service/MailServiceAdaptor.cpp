@@ -45,6 +45,12 @@ QString MailServiceAdaptor::undoDescription() const
     return qvariant_cast< QString >(parent()->property("undoDescription"));
 }
 
+void MailServiceAdaptor::cancelPrefetch(const QList<quint64> &msgIds)
+{
+    // handle method call org.dekkoproject.MailService.cancelPrefetch
+    QMetaObject::invokeMethod(parent(), "cancelPrefetch", Q_ARG(QList<quint64>, msgIds));
+}
+
 void MailServiceAdaptor::createStandardFolders(qulonglong accountId)
 {
     // handle method call org.dekkoproject.MailService.createStandardFolders
@@ -63,6 +69,12 @@ void MailServiceAdaptor::downloadMessagePart(qulonglong msgId, const QString &pa
     QMetaObject::invokeMethod(parent(), "downloadMessagePart", Q_ARG(qulonglong, msgId), Q_ARG(QString, partLocation));
 }
 
+void MailServiceAdaptor::downloadMessagePartRange(qulonglong msgId, const QString &partLocation, uint minimum)
+{
+    // handle method call org.dekkoproject.MailService.downloadMessagePartRange
+    QMetaObject::invokeMethod(parent(), "downloadMessagePartRange", Q_ARG(qulonglong, msgId), Q_ARG(QString, partLocation), Q_ARG(uint, minimum));
+}
+
 void MailServiceAdaptor::downloadMessages(const QList<quint64> &msgIds)
 {
     // handle method call org.dekkoproject.MailService.downloadMessages
@@ -129,6 +141,12 @@ void MailServiceAdaptor::moveToStandardFolder(const QList<quint64> &msgIds, int
     QMetaObject::invokeMethod(parent(), "moveToStandardFolder", Q_ARG(QList<quint64>, msgIds), Q_ARG(int, folderType), Q_ARG(bool, userTriggered));
 }
 
+void MailServiceAdaptor::prefetchMessages(const QList<quint64> &msgIds, int priority)
+{
+    // handle method call org.dekkoproject.MailService.prefetchMessages
+    QMetaObject::invokeMethod(parent(), "prefetchMessages", Q_ARG(QList<quint64>, msgIds), Q_ARG(int, priority));
+}
+
 void MailServiceAdaptor::pruneCache(const QList<quint64> &msgIds)
 {
     // handle method call org.dekkoproject.MailService.pruneCache
@@ -143,6 +161,14 @@ QList<quint64> MailServiceAdaptor::queryFolders(const QByteArray &folderKey, con
     return folders;
 }
 
+QString MailServiceAdaptor::queryMessageSegment(const QByteArray &msgKey, const QByteArray &sortKey, int limit, const QString &restrictTo, QList<quint64> &messages)
+{
+    // handle method call org.dekkoproject.MailService.queryMessageSegment
+    QString segment;
+    QMetaObject::invokeMethod(parent(), "queryMessageSegment", Q_RETURN_ARG(QString, segment), Q_ARG(QByteArray, msgKey), Q_ARG(QByteArray, sortKey), Q_ARG(int, limit), Q_ARG(QString, restrictTo), Q_ARG(QList<quint64>&, messages));
+    return segment;
+}
+
 QList<quint64> MailServiceAdaptor::queryMessages(const QByteArray &msgKey, const QByteArray &sortKey, int limit)
 {
     // handle method call org.dekkoproject.MailService.queryMessages
@@ -151,6 +177,36 @@ QList<quint64> MailServiceAdaptor::queryMessages(const QByteArray &msgKey, const
     return messages;
 }
 
+QString MailServiceAdaptor::metrics()
+{
+    // handle method call org.dekkoproject.MailService.metrics
+    QString out0;
+    QMetaObject::invokeMethod(parent(), "metrics", Q_RETURN_ARG(QString, out0));
+    return out0;
+}
+
+QStringList MailServiceAdaptor::completeRecipients(const QString &prefix, int limit)
+{
+    // handle method call org.dekkoproject.MailService.completeRecipients
+    QStringList out0;
+    QMetaObject::invokeMethod(parent(), "completeRecipients", Q_RETURN_ARG(QStringList, out0), Q_ARG(QString, prefix), Q_ARG(int, limit));
+    return out0;
+}
+
+int MailServiceAdaptor::queryThreads(const QByteArray &msgKey, const QByteArray &sortKey, int limit, QList<quint64> &messages, QList<int> &counts, QList<int> &unread)
+{
+    // handle method call org.dekkoproject.MailService.queryThreads
+    int total;
+    QMetaObject::invokeMethod(parent(), "queryThreads", Q_RETURN_ARG(int, total), Q_ARG(QByteArray, msgKey), Q_ARG(QByteArray, sortKey), Q_ARG(int, limit), Q_ARG(QList<quint64>&, messages), Q_ARG(QList<int>&, counts), Q_ARG(QList<int>&, unread));
+    return total;
+}
+
+void MailServiceAdaptor::releaseSegment(const QString &segment)
+{
+    // handle method call org.dekkoproject.MailService.releaseSegment
+    QMetaObject::invokeMethod(parent(), "releaseSegment", Q_ARG(QString, segment));
+}
+
 void MailServiceAdaptor::removeMessage(qulonglong msgId, int option)
 {
     // handle method call org.dekkoproject.MailService.removeMessage
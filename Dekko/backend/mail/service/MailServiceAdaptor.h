@@ -48,6 +48,12 @@ class MailServiceAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"out\" type=\"t\" name=\"msgId\"/>\n"
 "      <arg direction=\"out\" type=\"s\" name=\"partLocation\"/>\n"
 "    </signal>\n"
+"    <signal name=\"fetchProgress\">\n"
+"      <arg direction=\"out\" type=\"t\" name=\"msgId\"/>\n"
+"      <arg direction=\"out\" type=\"s\" name=\"partLocation\"/>\n"
+"      <arg direction=\"out\" type=\"u\" name=\"value\"/>\n"
+"      <arg direction=\"out\" type=\"u\" name=\"total\"/>\n"
+"    </signal>\n"
 "    <signal name=\"messagesNowAvailable\">\n"
 "      <arg direction=\"out\" type=\"(iiii)\" name=\"msgIds\"/>\n"
 "      <annotation value=\"QList&lt;quint64&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.In0\"/>\n"
@@ -147,10 +153,24 @@ class MailServiceAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"in\" type=\"t\" name=\"msgId\"/>\n"
 "      <arg direction=\"in\" type=\"s\" name=\"partLocation\"/>\n"
 "    </method>\n"
+"    <method name=\"downloadMessagePartRange\">\n"
+"      <arg direction=\"in\" type=\"t\" name=\"msgId\"/>\n"
+"      <arg direction=\"in\" type=\"s\" name=\"partLocation\"/>\n"
+"      <arg direction=\"in\" type=\"u\" name=\"minimum\"/>\n"
+"    </method>\n"
 "    <method name=\"downloadMessages\">\n"
 "      <arg direction=\"in\" type=\"(iiii)\" name=\"msgIds\"/>\n"
 "      <annotation value=\"QList&lt;quint64&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.In0\"/>\n"
 "    </method>\n"
+"    <method name=\"prefetchMessages\">\n"
+"      <arg direction=\"in\" type=\"(iiii)\" name=\"msgIds\"/>\n"
+"      <arg direction=\"in\" type=\"i\" name=\"priority\"/>\n"
+"      <annotation value=\"QList&lt;quint64&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.In0\"/>\n"
+"    </method>\n"
+"    <method name=\"cancelPrefetch\">\n"
+"      <arg direction=\"in\" type=\"(iiii)\" name=\"msgIds\"/>\n"
+"      <annotation value=\"QList&lt;quint64&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.In0\"/>\n"
+"    </method>\n"
 "    <method name=\"sendMessage\">\n"
 "      <arg direction=\"in\" type=\"t\" name=\"msgId\"/>\n"
 "    </method>\n"
@@ -175,6 +195,36 @@ class MailServiceAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"out\" type=\"(iiii)\" name=\"messages\"/>\n"
 "      <annotation value=\"QList&lt;quint64&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.Out0\"/>\n"
 "    </method>\n"
+"    <method name=\"queryMessageSegment\">\n"
+"      <arg direction=\"in\" type=\"ay\" name=\"msgKey\"/>\n"
+"      <arg direction=\"in\" type=\"ay\" name=\"sortKey\"/>\n"
+"      <arg direction=\"in\" type=\"i\" name=\"limit\"/>\n"
+"      <arg direction=\"in\" type=\"s\" name=\"restrictTo\"/>\n"
+"      <arg direction=\"out\" type=\"s\" name=\"segment\"/>\n"
+"      <arg direction=\"out\" type=\"(iiii)\" name=\"messages\"/>\n"
+"      <annotation value=\"QList&lt;quint64&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.Out1\"/>\n"
+"    </method>\n"
+"    <method name=\"queryThreads\">\n"
+"      <arg direction=\"in\" type=\"ay\" name=\"msgKey\"/>\n"
+"      <arg direction=\"in\" type=\"ay\" name=\"sortKey\"/>\n"
+"      <arg direction=\"in\" type=\"i\" name=\"limit\"/>\n"
+"      <arg direction=\"out\" type=\"i\" name=\"total\"/>\n"
+"      <arg direction=\"out\" type=\"(iiii)\" name=\"messages\"/>\n"
+"      <annotation value=\"QList&lt;quint64&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.Out1\"/>\n"
+"      <arg direction=\"out\" type=\"ai\" name=\"counts\"/>\n"
+"      <arg direction=\"out\" type=\"ai\" name=\"unread\"/>\n"
+"    </method>\n"
+"    <method name=\"completeRecipients\">\n"
+"      <arg direction=\"in\" type=\"s\" name=\"prefix\"/>\n"
+"      <arg direction=\"in\" type=\"i\" name=\"limit\"/>\n"
+"      <arg direction=\"out\" type=\"as\"/>\n"
+"    </method>\n"
+"    <method name=\"metrics\">\n"
+"      <arg direction=\"out\" type=\"s\"/>\n"
+"    </method>\n"
+"    <method name=\"releaseSegment\">\n"
+"      <arg direction=\"in\" type=\"s\" name=\"segment\"/>\n"
+"    </method>\n"
 "    <method name=\"queryFolders\">\n"
 "      <arg direction=\"in\" type=\"ay\" name=\"folderKey\"/>\n"
 "      <arg direction=\"in\" type=\"ay\" name=\"sortKey\"/>\n"
@@ -204,9 +254,11 @@ public: // PROPERTIES
     QString undoDescription() const;
 
 public Q_SLOTS: // METHODS
+    void cancelPrefetch(const QList<quint64> &msgIds);
     void createStandardFolders(qulonglong accountId);
     void deleteMessages(const QList<quint64> &ids);
     void downloadMessagePart(qulonglong msgId, const QString &partLocation);
+    void downloadMessagePartRange(qulonglong msgId, const QString &partLocation, uint minimum);
     void downloadMessages(const QList<quint64> &msgIds);
     void emptyTrash(const QList<quint64> &accountIds);
     void markFolderRead(qulonglong folderId);
@@ -216,11 +268,17 @@ public Q_SLOTS: // METHODS
     void markMessagesRead(const QList<quint64> &msgIds, bool read);
     void markMessagesReplied(const QList<quint64> &msgIds, bool all);
     void markMessagesTodo(const QList<quint64> &msgIds, bool read);
+    QString metrics();
     void moveToFolder(const QList<quint64> &msgIds, qulonglong folderId);
     void moveToStandardFolder(const QList<quint64> &msgIds, int folderType, bool userTriggered);
+    void prefetchMessages(const QList<quint64> &msgIds, int priority);
     void pruneCache(const QList<quint64> &msgIds);
     QList<quint64> queryFolders(const QByteArray &folderKey, const QByteArray &sortKey, int limit);
+    QString queryMessageSegment(const QByteArray &msgKey, const QByteArray &sortKey, int limit, const QString &restrictTo, QList<quint64> &messages);
     QList<quint64> queryMessages(const QByteArray &msgKey, const QByteArray &sortKey, int limit);
+    QStringList completeRecipients(const QString &prefix, int limit);
+    int queryThreads(const QByteArray &msgKey, const QByteArray &sortKey, int limit, QList<quint64> &messages, QList<int> &counts, QList<int> &unread);
+    void releaseSegment(const QString &segment);
     void removeMessage(qulonglong msgId, int option);
     void restoreMessage(qulonglong id);
     void sendAnyQueuedMail();
@@ -234,6 +292,7 @@ Q_SIGNALS: // SIGNALS
     void accountSynced(qulonglong id);
     void actionFailed(qulonglong id, int statusCode, const QString &statusText);
     void clientError(qulonglong accountId, int error, const QString &errorString);
+    void fetchProgress(qulonglong msgId, const QString &partLocation, uint value, uint total);
     void messageFetchFailed(const QList<quint64> &msgIds);
     void messagePartFetchFailed(qulonglong msgId, const QString &partLocation);
     void messagePartNowAvailable(qulonglong msgId, const QString &partLocation);
@@ -20,13 +20,21 @@
 #include <QPointer>
 #include <qmailstore.h>
 #include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
 #include "MailServiceWorker.h"
+#include "LocalMailService.h"
+#include "SharedIdList.h"
 #include "serviceutils.h"
+#include <Trace.h>
 #include "qmailnamespace.h"
 
 #define SERVICE "org.dekkoproject.Service"
 #define SERVICE_PATH "/mail"
 
+// Dispatch to the in process worker when there is one, otherwise over the bus.
+#define CALL_WORKER(call) if (m_local) { m_local->call; } else { m_mService->call; }
+
 static QPointer<Client> s_client;
 Client *Client::instance()
 {
@@ -45,18 +53,43 @@ QObject *Client::factory(QQmlEngine *engine, QJSEngine *scriptEngine)
 
 Client::Client(QObject *parent) : QObject(parent),
     m_service(0),
-    m_mService(0)
+    m_mService(0),
+    m_local(0)
 {
 
     MailServiceWorker::registerTypes();
 
     m_mService = new MailServiceInterface(SERVICE, SERVICE_PATH, QDBusConnection::sessionBus());
+    m_local = LocalMailService::instance();
 
     m_service = new ClientService(this);
     emit serviceChanged();
 
+    if (m_local) {
+        // Same signals as the bus, just queued across the thread boundary instead
+        MailServiceWorker *worker = m_local->worker();
+        connect(worker, &MailServiceWorker::messagePartNowAvailable, this, &Client::messagePartNowAvailable);
+        connect(worker, &MailServiceWorker::messagePartFetchFailed, this, &Client::messagePartFetchFailed);
+        connect(worker, &MailServiceWorker::fetchProgress, this, &Client::fetchProgress);
+        connect(worker, &MailServiceWorker::messagesNowAvailable, this, &Client::handleMessagesNowAvailable);
+        connect(worker, &MailServiceWorker::messageFetchFailed, this, &Client::handleMessageFetchFailed);
+        connect(worker, &MailServiceWorker::messagesSent, this, &Client::handleMessagesSent);
+        connect(worker, &MailServiceWorker::messageSendingFailed, this, &Client::handleMessageSendingFailed);
+        connect(worker, &MailServiceWorker::accountSynced, this, &Client::accountSynced);
+        connect(worker, &MailServiceWorker::syncAccountFailed, this, &Client::syncAccountFailed);
+        connect(worker, &MailServiceWorker::standardFoldersCreated, this, &Client::standardFoldersCreated);
+        connect(worker, &MailServiceWorker::actionFailed, this, &Client::handleFailure);
+        connect(m_local, &LocalMailService::undoStateChanged, this, &Client::undoCountChanged);
+        connect(m_local->queryRunner(), &LocalQueryRunner::messagesQueried, this, &Client::handleLocalMessagesQueried);
+        connect(m_local->queryRunner(), &LocalQueryRunner::messagesCounted, this, &Client::handleLocalMessagesCounted);
+        connect(m_local->queryRunner(), &LocalQueryRunner::threadsQueried, this, &Client::handleLocalThreadsQueried);
+        connect(m_local->queryRunner(), &LocalQueryRunner::recipientsCompleted, this, &Client::handleLocalRecipientsCompleted);
+        return;
+    }
+
     connect(m_mService, &MailServiceInterface::messagePartNowAvailable, this, &Client::messagePartNowAvailable);
     connect(m_mService, &MailServiceInterface::messagePartFetchFailed, this, &Client::messagePartFetchFailed);
+    connect(m_mService, &MailServiceInterface::fetchProgress, this, &Client::fetchProgress);
     connect(m_mService, &MailServiceInterface::messagesNowAvailable, this, &Client::handleMessagesNowAvailable);
     connect(m_mService, &MailServiceInterface::messageFetchFailed, this, &Client::handleMessageFetchFailed);
     connect(m_mService, &MailServiceInterface::messagesSent, this, &Client::handleMessagesSent);
@@ -70,11 +103,17 @@ Client::Client(QObject *parent) : QObject(parent),
 
 bool Client::hasUndoableActions() const
 {
+    if (m_local) {
+        return m_local->hasUndoableAction();
+    }
     return m_mService->hasUndoableAction();
 }
 
 QString Client::undoDescription() const
 {
+    if (m_local) {
+        return m_local->undoDescription();
+    }
     return m_mService->undoDescription();
 }
 
@@ -91,12 +130,12 @@ void Client::deleteMessage(const int &msgId)
 
 void Client::deleteMessages(const QMailMessageIdList &idList)
 {
-    m_mService->deleteMessages(to_dbus_msglist(idList));
+    CALL_WORKER(deleteMessages(to_dbus_msglist(idList)))
 }
 
 void Client::restoreMessage(const int &msgId)
 {
-    m_mService->restoreMessage(QMailMessageId(msgId).toULongLong());
+    CALL_WORKER(restoreMessage(QMailMessageId(msgId).toULongLong()))
 }
 
 void Client::markMessageImportant(const int &msgId, const bool important)
@@ -178,22 +217,22 @@ void Client::emptyTrash(const int &accountId)
 
 void Client::markMessagesImportant(const QMailMessageIdList &idList, const bool important)
 {
-    m_mService->markMessagesImportant(to_dbus_msglist(idList), important);
+    CALL_WORKER(markMessagesImportant(to_dbus_msglist(idList), important))
 }
 
 void Client::markMessagesRead(const QMailMessageIdList &idList, const bool read)
 {
-    m_mService->markMessagesRead(to_dbus_msglist(idList), read);
+    CALL_WORKER(markMessagesRead(to_dbus_msglist(idList), read))
 }
 
 void Client::markMessagesTodo(const QMailMessageIdList &idList, const bool todo)
 {
-    m_mService->markMessagesTodo(to_dbus_msglist(idList), todo);
+    CALL_WORKER(markMessagesTodo(to_dbus_msglist(idList), todo))
 }
 
 void Client::markMessagesDone(const QMailMessageIdList &idList, const bool done)
 {
-    m_mService->markMessagesDone(to_dbus_msglist(idList), done);
+    CALL_WORKER(markMessagesDone(to_dbus_msglist(idList), done))
 }
 
 void Client::createStandardFolders(const quint64 &accountId)
@@ -203,40 +242,57 @@ void Client::createStandardFolders(const quint64 &accountId)
 
 void Client::createStandardFolders(const QMailAccountId &accountId)
 {
-    m_mService->createStandardFolders(accountId.toULongLong());
+    CALL_WORKER(createStandardFolders(accountId.toULongLong()))
 }
 
 void Client::markMessagesReplied(const QMailMessageIdList &idList, const bool all)
 {
-    m_mService->markMessagesReplied(to_dbus_msglist(idList), all);
+    CALL_WORKER(markMessagesReplied(to_dbus_msglist(idList), all))
 }
 
 void Client::markMessageForwarded(const QMailMessageIdList &idList)
 {
-    m_mService->markMessageForwarded(to_dbus_msglist(idList));
+    CALL_WORKER(markMessageForwarded(to_dbus_msglist(idList)))
 }
 
 void Client::markFolderRead(const QMailFolderId &id)
 {
-    m_mService->markFolderRead(id.toULongLong());
+    CALL_WORKER(markFolderRead(id.toULongLong()))
 }
 
 void Client::emptyTrash(const QMailAccountIdList &ids)
 {
-    m_mService->emptyTrash(to_dbus_accountlist(ids));
+    CALL_WORKER(emptyTrash(to_dbus_accountlist(ids)))
 }
 
 void Client::syncFolders(const QMailAccountId &accountId, const QMailFolderIdList &folders)
 {
-    m_mService->syncFolders(accountId.toULongLong(), to_dbus_folderlist(folders));
+    CALL_WORKER(syncFolders(accountId.toULongLong(), to_dbus_folderlist(folders)))
 }
 
 void Client::downloadMessagePart(const QMailMessagePart *msgPart)
 {
-    qDebug() << "[Client]" << "Downloading message part" << msgPart->location().toString(true);
-    quint64 id = msgPart->location().containingMessageId().toULongLong();
-    QString location = msgPart->location().toString(true);
-    m_mService->downloadMessagePart(id, location);
+    downloadMessagePart(msgPart->location());
+}
+
+void Client::downloadMessagePart(const QMailMessagePartContainer::Location &location)
+{
+    qDebug() << "[Client]" << "Downloading message part" << location.toString(true);
+    quint64 id = location.containingMessageId().toULongLong();
+    QString path = location.toString(true);
+    CALL_WORKER(downloadMessagePart(id, path))
+}
+
+void Client::downloadMessagePartRange(const QMailMessagePart *msgPart, const uint &minimum)
+{
+    downloadMessagePartRange(msgPart->location(), minimum);
+}
+
+void Client::downloadMessagePartRange(const QMailMessagePartContainer::Location &location, const uint &minimum)
+{
+    quint64 id = location.containingMessageId().toULongLong();
+    QString path = location.toString(true);
+    CALL_WORKER(downloadMessagePartRange(id, path, minimum))
 }
 
 void Client::downloadMessage(const QMailMessageId &msgId)
@@ -246,12 +302,29 @@ void Client::downloadMessage(const QMailMessageId &msgId)
 
 void Client::downloadMessages(const QMailMessageIdList &idList)
 {
-    Q_UNUSED(idList);
+    // Someone is waiting on these so they go ahead of any prefetching
+    prefetchMessages(idList, ClientService::UserOpened);
+}
+
+void Client::prefetchMessages(const QMailMessageIdList &idList, const int &priority)
+{
+    if (idList.isEmpty()) {
+        return;
+    }
+    CALL_WORKER(prefetchMessages(to_dbus_msglist(idList), priority))
+}
+
+void Client::cancelPrefetch(const QMailMessageIdList &idList)
+{
+    if (idList.isEmpty()) {
+        return;
+    }
+    CALL_WORKER(cancelPrefetch(to_dbus_msglist(idList)))
 }
 
 void Client::synchronizeAccount(const QMailAccountId &id)
 {
-    m_mService->synchronizeAccount(id.toULongLong());
+    CALL_WORKER(synchronizeAccount(id.toULongLong()))
 }
 
 bool Client::addMessage(QMailMessage *msg)
@@ -261,13 +334,13 @@ bool Client::addMessage(QMailMessage *msg)
 
 bool Client::removeMessage(const QMailMessageId &id, const QMailStore::MessageRemovalOption &option)
 {
-    m_mService->removeMessage(id.toULongLong(), static_cast<int>(option));
+    CALL_WORKER(removeMessage(id.toULongLong(), static_cast<int>(option)))
     return true;
 }
 
 void Client::moveToStandardFolder(const QMailMessageIdList &msgIds, const Folder::FolderType &folder, const bool userTriggered)
 {
-    m_mService->moveToStandardFolder(to_dbus_msglist(msgIds), static_cast<int>(folder), userTriggered);
+    CALL_WORKER(moveToStandardFolder(to_dbus_msglist(msgIds), static_cast<int>(folder), userTriggered))
 }
 
 void Client::moveToFolder(const quint64 &msgId, const quint64 &folderId)
@@ -283,7 +356,7 @@ void Client::moveToFolder(const quint64 &msgId, const quint64 &folderId)
 
 void Client::moveToFolder(const QMailMessageIdList &ids, const QMailFolderId &folderId)
 {
-    m_mService->moveToFolder(to_dbus_msglist(ids), folderId.toULongLong());
+    CALL_WORKER(moveToFolder(to_dbus_msglist(ids), folderId.toULongLong()))
 }
 
 bool Client::detectStandardFolders(const quint64 &id)
@@ -296,17 +369,17 @@ bool Client::detectStandardFolders(const quint64 &id)
 
 void Client::sendMessage(const QMailMessage &msg)
 {
-    m_mService->sendMessage(msg.id().toULongLong());
+    CALL_WORKER(sendMessage(msg.id().toULongLong()))
 }
 
 void Client::sendPendingMessages()
 {
-    m_mService->sendPendingMessages();
+    CALL_WORKER(sendPendingMessages())
 }
 
 void Client::undoActions()
 {
-    m_mService->undoActions();
+    CALL_WORKER(undoActions())
 }
 
 void Client::pruneCache(const QMailMessageIdList &msgIds)
@@ -314,7 +387,152 @@ void Client::pruneCache(const QMailMessageIdList &msgIds)
     if (msgIds.isEmpty()) {
         qDebug() << "[Client::pruneCache] >> No Messages to prune";
     }
-    m_mService->pruneCache(to_dbus_msglist(msgIds));
+    CALL_WORKER(pruneCache(to_dbus_msglist(msgIds)))
+}
+
+void Client::queryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit,
+                           QObject *context, MessageIdsCallback callback, FailedCallback failed)
+{
+    queryMessages(key, sortKey, limit, QMailMessageIdList(), context, callback, failed);
+}
+
+void Client::queryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit,
+                           const QMailMessageIdList &restrictTo, QObject *context, MessageIdsCallback callback,
+                           FailedCallback failed)
+{
+    QMailMessageKey msgKey = key;
+    QString restrictSegment;
+    if (!restrictTo.isEmpty()) {
+        if (!m_local && SharedIdList::worthSharing(restrictTo.size())) {
+            restrictSegment = SharedIdList::instance()->publish(restrictTo);
+        }
+        if (restrictSegment.isEmpty()) {
+            msgKey &= QMailMessageKey::id(restrictTo);
+        }
+    }
+
+    if (m_local) {
+        PendingQuery query;
+        query.context = context;
+        query.callback = callback;
+        const quint64 ticket = m_local->queryMessages(msgKey, sortKey, limit);
+        TRACE_ACTION_BEGIN("Client::queryMessages", ticket);
+        m_pendingQueries.insert(ticket, query);
+        return;
+    }
+    QDBusPendingReply<QString, QList<quint64> > reply = m_mService->queryMessageSegment(
+                msg_key_bytes(msgKey), msg_sort_key_bytes(sortKey), limit, restrictSegment);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, context);
+    // The watcher is alive until the reply is in so makes a good id
+    TRACE_ACTION_BEGIN("Client::queryMessages", quintptr(watcher));
+    connect(watcher, &QDBusPendingCallWatcher::finished, context, [=](QDBusPendingCallWatcher *call) {
+        QDBusPendingReply<QString, QList<quint64> > reply = *call;
+        call->deleteLater();
+        TRACE_ACTION_END("Client::queryMessages", quintptr(call));
+        if (!restrictSegment.isEmpty()) {
+            // The worker has read it by now
+            SharedIdList::instance()->release(restrictSegment);
+        }
+        if (reply.isError()) {
+            qDebug() << "[Client::queryMessages] >> Reply error" << reply.error().message();
+            if (failed) {
+                failed();
+            }
+            return;
+        }
+        const QString segment = reply.argumentAt<0>();
+        if (segment.isEmpty()) {
+            callback(from_dbus_msglist(reply.argumentAt<1>()));
+            return;
+        }
+        QMailMessageIdList ids;
+        const bool ok = SharedIdList::read(segment, ids);
+        m_mService->releaseSegment(segment);
+        if (ok) {
+            callback(ids);
+        } else {
+            qDebug() << "[Client::queryMessages] >> Unable to read segment" << segment;
+            if (failed) {
+                failed();
+            }
+        }
+    });
+}
+
+void Client::countMessages(const QMailMessageKey &key, QObject *context, CountCallback callback)
+{
+    if (m_local) {
+        PendingCount count;
+        count.context = context;
+        count.callback = callback;
+        m_pendingCounts.insert(m_local->countMessages(key), count);
+        return;
+    }
+    QDBusPendingReply<int> reply = m_mService->totalCount(msg_key_bytes(key));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, context);
+    connect(watcher, &QDBusPendingCallWatcher::finished, context, [=](QDBusPendingCallWatcher *call) {
+        QDBusPendingReply<int> reply = *call;
+        call->deleteLater();
+        if (reply.isError()) {
+            qDebug() << "[Client::countMessages] >> Reply error" << reply.error().message();
+            return;
+        }
+        callback(reply.argumentAt<0>());
+    });
+}
+
+void Client::queryThreads(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit,
+                          QObject *context, ThreadsCallback callback, FailedCallback failed)
+{
+    if (m_local) {
+        PendingThreads threads;
+        threads.context = context;
+        threads.callback = callback;
+        const quint64 ticket = m_local->queryThreads(key, sortKey, limit);
+        TRACE_ACTION_BEGIN("Client::queryThreads", ticket);
+        m_pendingThreads.insert(ticket, threads);
+        return;
+    }
+    QDBusPendingReply<int, QList<quint64>, QList<int>, QList<int> > reply = m_mService->queryThreads(
+                msg_key_bytes(key), msg_sort_key_bytes(sortKey), limit);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, context);
+    TRACE_ACTION_BEGIN("Client::queryThreads", quintptr(watcher));
+    connect(watcher, &QDBusPendingCallWatcher::finished, context, [=](QDBusPendingCallWatcher *call) {
+        QDBusPendingReply<int, QList<quint64>, QList<int>, QList<int> > reply = *call;
+        call->deleteLater();
+        TRACE_ACTION_END("Client::queryThreads", quintptr(call));
+        if (reply.isError()) {
+            qDebug() << "[Client::queryThreads] >> Reply error" << reply.error().message();
+            if (failed) {
+                failed();
+            }
+            return;
+        }
+        callback(from_dbus_msglist(reply.argumentAt<1>()), reply.argumentAt<2>(),
+                 reply.argumentAt<3>(), reply.argumentAt<0>());
+    });
+}
+
+void Client::completeRecipients(const QString &prefix, const int &limit, QObject *context, AddressesCallback callback)
+{
+    if (m_local) {
+        PendingAddresses addresses;
+        addresses.context = context;
+        addresses.callback = callback;
+        m_pendingAddresses.insert(m_local->completeRecipients(prefix, limit), addresses);
+        return;
+    }
+    QDBusPendingReply<QStringList> reply = m_mService->completeRecipients(prefix, limit);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, context);
+    connect(watcher, &QDBusPendingCallWatcher::finished, context, [=](QDBusPendingCallWatcher *call) {
+        QDBusPendingReply<QStringList> reply = *call;
+        call->deleteLater();
+        if (reply.isError()) {
+            qDebug() << "[Client::completeRecipients] >> Reply error" << reply.error().message();
+            return;
+        }
+        callback(QMailAddress::fromStringList(reply.argumentAt<0>()));
+    });
 }
 
 void Client::handleFailure(const quint64 &id, const int &statusCode, const QString &statusText)
@@ -416,6 +634,41 @@ void Client::handleMessageSendingFailed(const QList<quint64> &msgIds, const int
     emit messageSendingFailed(messages, err);
 }
 
+void Client::handleLocalMessagesQueried(const quint64 &ticket, const QMailMessageIdList &ids)
+{
+    TRACE_ACTION_END("Client::queryMessages", ticket);
+    PendingQuery query = m_pendingQueries.take(ticket);
+    if (query.context && query.callback) {
+        query.callback(ids);
+    }
+}
+
+void Client::handleLocalMessagesCounted(const quint64 &ticket, const int &count)
+{
+    PendingCount pending = m_pendingCounts.take(ticket);
+    if (pending.context && pending.callback) {
+        pending.callback(count);
+    }
+}
+
+void Client::handleLocalThreadsQueried(const quint64 &ticket, const QMailMessageIdList &ids, const QList<int> &counts,
+                                       const QList<int> &unread, const int &total)
+{
+    TRACE_ACTION_END("Client::queryThreads", ticket);
+    PendingThreads pending = m_pendingThreads.take(ticket);
+    if (pending.context && pending.callback) {
+        pending.callback(ids, counts, unread, total);
+    }
+}
+
+void Client::handleLocalRecipientsCompleted(const quint64 &ticket, const QStringList &addresses)
+{
+    PendingAddresses pending = m_pendingAddresses.take(ticket);
+    if (pending.context && pending.callback) {
+        pending.callback(QMailAddress::fromStringList(addresses));
+    }
+}
+
 QMailAccountIdList Client::getEnabledAccountIds() const
 {
     return QMailStore::instance()->queryAccounts(QMailAccountKey::messageType(QMailMessage::Email)
@@ -22,10 +22,15 @@
 #include <QQmlEngine>
 #include <QJSEngine>
 #include <QDBusConnection>
+#include <QHash>
+#include <QPointer>
 #include "ClientService.h"
 #include <qmailstore.h>
 #include "Folder.h"
 #include "MailServiceInterface.h"
+#include <functional>
+
+class LocalMailService;
 
 
 class Client : public QObject
@@ -116,8 +121,15 @@ public:
     void markMessageForwarded(const QMailMessageIdList &idList);
 
     void downloadMessagePart(const QMailMessagePart *msgPart);
+    void downloadMessagePart(const QMailMessagePartContainer::Location &location);
+    /** @short Retrieve at least \param minimum more bytes of the part, messagePartNowAvailable is emitted once stored */
+    void downloadMessagePartRange(const QMailMessagePart *msgPart, const uint &minimum);
+    void downloadMessagePartRange(const QMailMessagePartContainer::Location &location, const uint &minimum);
     void downloadMessage(const QMailMessageId &msgId);
     void downloadMessages(const QMailMessageIdList &idList);
+    /** @short Fetch message bodies ahead of time \see ClientService::PrefetchPriority */
+    void prefetchMessages(const QMailMessageIdList &idList, const int &priority);
+    void cancelPrefetch(const QMailMessageIdList &idList);
 
     bool addMessage(QMailMessage *msg);
     bool removeMessage(const QMailMessageId &id, const QMailStore::MessageRemovalOption &option);
@@ -132,6 +144,37 @@ public:
 
     MailServiceInterface *bus() { return m_mService; }
 
+    typedef std::function<void(const QMailMessageIdList &)> MessageIdsCallback;
+    typedef std::function<void(const int &)> CountCallback;
+    typedef std::function<void(const QMailMessageIdList &, const QList<int> &, const QList<int> &, const int &)> ThreadsCallback;
+    typedef std::function<void(const QMailAddressList &)> AddressesCallback;
+    // Called instead of the callback when the query failed, there is no result
+    // so callers should keep whatever they already have.
+    typedef std::function<void()> FailedCallback;
+    /** @short Query the store through the worker, \param callback is dropped if \param context is destroyed first
+     *
+     * Goes over D-Bus or straight to the worker thread depending on where the worker runs.
+     */
+    void queryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit,
+                       QObject *context, MessageIdsCallback callback, FailedCallback failed = FailedCallback());
+    /** @short Same as above with the query limited to \param restrictTo
+     *
+     * Large id sets are passed to the worker in shared memory instead of inside the serialized key.
+     */
+    void queryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit,
+                       const QMailMessageIdList &restrictTo, QObject *context, MessageIdsCallback callback,
+                       FailedCallback failed = FailedCallback());
+    void countMessages(const QMailMessageKey &key, QObject *context, CountCallback callback);
+    /** @short Conversations with a message matching \param key
+     *
+     * \param callback gets the newest message of each conversation, how many messages
+     * and unread messages match in each and the total number of conversations.
+     */
+    void queryThreads(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit,
+                      QObject *context, ThreadsCallback callback, FailedCallback failed = FailedCallback());
+    /** @short Known addresses for \param prefix, best match first */
+    void completeRecipients(const QString &prefix, const int &limit, QObject *context, AddressesCallback callback);
+
     void pruneCache(const QMailMessageIdList &msgIds);
 
 signals:
@@ -139,6 +182,8 @@ signals:
     void serviceChanged();
     void messagePartNowAvailable(const quint64 &msgId, const QString &partLocation);
     void messagePartFetchFailed(const quint64 &msgId, const QString &partLocation);
+    /** @short Progress of a part fetch, partLocation is empty when fetching a whole message */
+    void fetchProgress(const quint64 &msgId, const QString &partLocation, const uint &value, const uint &total);
     void messagesNowAvailable(const QMailMessageIdList &idList);
     void messageFetchFailed(const QMailMessageIdList &ids);
     void messagesSent(const QMailMessageIdList &ids);
@@ -156,6 +201,11 @@ private slots:
     void handleMessageFetchFailed(const QList<quint64> &msgIds);
     void handleMessagesSent(const QList<quint64> &msgIds);
     void handleMessageSendingFailed(const QList<quint64> &msgIds, const int &error);
+    void handleLocalMessagesQueried(const quint64 &ticket, const QMailMessageIdList &ids);
+    void handleLocalMessagesCounted(const quint64 &ticket, const int &count);
+    void handleLocalThreadsQueried(const quint64 &ticket, const QMailMessageIdList &ids, const QList<int> &counts,
+                                   const QList<int> &unread, const int &total);
+    void handleLocalRecipientsCompleted(const quint64 &ticket, const QStringList &addresses);
 
 protected:
     QMailAccountIdList getEnabledAccountIds() const;
@@ -164,6 +214,29 @@ private:
 
     ClientService *m_service;
     MailServiceInterface *m_mService;
+    // Set when the worker runs on a thread in this process
+    LocalMailService *m_local;
+
+    struct PendingQuery {
+        QPointer<QObject> context;
+        MessageIdsCallback callback;
+    };
+    struct PendingCount {
+        QPointer<QObject> context;
+        CountCallback callback;
+    };
+    QHash<quint64, PendingQuery> m_pendingQueries;
+    struct PendingThreads {
+        QPointer<QObject> context;
+        ThreadsCallback callback;
+    };
+    QHash<quint64, PendingCount> m_pendingCounts;
+    struct PendingAddresses {
+        QPointer<QObject> context;
+        AddressesCallback callback;
+    };
+    QHash<quint64, PendingThreads> m_pendingThreads;
+    QHash<quint64, PendingAddresses> m_pendingAddresses;
 
 };
 
@@ -44,6 +44,13 @@ public:
     { return qvariant_cast< QString >(property("undoDescription")); }
 
 public Q_SLOTS: // METHODS
+    inline QDBusPendingReply<> cancelPrefetch(const QList<quint64> &msgIds)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(msgIds);
+        return asyncCallWithArgumentList(QStringLiteral("cancelPrefetch"), argumentList);
+    }
+
     inline QDBusPendingReply<> createStandardFolders(qulonglong accountId)
     {
         QList<QVariant> argumentList;
@@ -65,6 +72,13 @@ public Q_SLOTS: // METHODS
         return asyncCallWithArgumentList(QStringLiteral("downloadMessagePart"), argumentList);
     }
 
+    inline QDBusPendingReply<> downloadMessagePartRange(qulonglong msgId, const QString &partLocation, uint minimum)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(msgId) << QVariant::fromValue(partLocation) << QVariant::fromValue(minimum);
+        return asyncCallWithArgumentList(QStringLiteral("downloadMessagePartRange"), argumentList);
+    }
+
     inline QDBusPendingReply<> downloadMessages(const QList<quint64> &msgIds)
     {
         QList<QVariant> argumentList;
@@ -142,6 +156,13 @@ public Q_SLOTS: // METHODS
         return asyncCallWithArgumentList(QStringLiteral("moveToStandardFolder"), argumentList);
     }
 
+    inline QDBusPendingReply<> prefetchMessages(const QList<quint64> &msgIds, int priority)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(msgIds) << QVariant::fromValue(priority);
+        return asyncCallWithArgumentList(QStringLiteral("prefetchMessages"), argumentList);
+    }
+
     inline QDBusPendingReply<> pruneCache(const QList<quint64> &msgIds)
     {
         QList<QVariant> argumentList;
@@ -163,6 +184,40 @@ public Q_SLOTS: // METHODS
         return asyncCallWithArgumentList(QStringLiteral("queryMessages"), argumentList);
     }
 
+    inline QDBusPendingReply<QString, QList<quint64> > queryMessageSegment(const QByteArray &msgKey, const QByteArray &sortKey, int limit, const QString &restrictTo)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(msgKey) << QVariant::fromValue(sortKey) << QVariant::fromValue(limit) << QVariant::fromValue(restrictTo);
+        return asyncCallWithArgumentList(QStringLiteral("queryMessageSegment"), argumentList);
+    }
+
+    inline QDBusPendingReply<QString> metrics()
+    {
+        QList<QVariant> argumentList;
+        return asyncCallWithArgumentList(QStringLiteral("metrics"), argumentList);
+    }
+
+    inline QDBusPendingReply<QStringList> completeRecipients(const QString &prefix, int limit)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(prefix) << QVariant::fromValue(limit);
+        return asyncCallWithArgumentList(QStringLiteral("completeRecipients"), argumentList);
+    }
+
+    inline QDBusPendingReply<int, QList<quint64>, QList<int>, QList<int> > queryThreads(const QByteArray &msgKey, const QByteArray &sortKey, int limit)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(msgKey) << QVariant::fromValue(sortKey) << QVariant::fromValue(limit);
+        return asyncCallWithArgumentList(QStringLiteral("queryThreads"), argumentList);
+    }
+
+    inline QDBusPendingReply<> releaseSegment(const QString &segment)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(segment);
+        return asyncCallWithArgumentList(QStringLiteral("releaseSegment"), argumentList);
+    }
+
     inline QDBusPendingReply<> removeMessage(qulonglong msgId, int option)
     {
         QList<QVariant> argumentList;
@@ -227,6 +282,7 @@ Q_SIGNALS: // SIGNALS
     void accountSynced(qulonglong id);
     void actionFailed(qulonglong id, int statusCode, const QString &statusText);
     void clientError(qulonglong accountId, int error, const QString &errorString);
+    void fetchProgress(qulonglong msgId, const QString &partLocation, uint value, uint total);
     void messageFetchFailed(const QList<quint64> &msgIds);
     void messagePartFetchFailed(qulonglong msgId, const QString &partLocation);
     void messagePartNowAvailable(qulonglong msgId, const QString &partLocation);
@@ -3,6 +3,14 @@
 #include <QByteArray>
 #include <qmailstore.h>
 #include "serviceutils.h"
+#include "SharedIdList.h"
+#include "RecipientIndex.h"
+#include "ThreadIndex.h"
+#include <Metrics.h>
+#include <Trace.h>
+
+// Every method is a D-Bus call, each gets a span and a latency histogram
+#define DBUS_METHOD(name) TRACE_SPAN("MailServiceWorker::" name); METRIC_LATENCY("dbus." name)
 
 
 MailServiceWorker::MailServiceWorker(QObject *parent) : QObject(parent),
@@ -16,49 +24,59 @@ MailServiceWorker::MailServiceWorker(QObject *parent) : QObject(parent),
     connect(m_service, &ClientService::messagePartFetchFailed, this, &MailServiceWorker::messagePartFetchFailed);
     connect(m_service, &ClientService::messagesFetched, this, &MailServiceWorker::handleMessagesFetched);
     connect(m_service, &ClientService::messageFetchFailed, this, &MailServiceWorker::handleMessageFetchFailed);
+    connect(m_service, &ClientService::fetchProgress, this, &MailServiceWorker::fetchProgress);
     connect(m_service, &ClientService::messagesSent, this, &MailServiceWorker::handleMessagesSent);
     connect(m_service, &ClientService::messageSendingFailed, this, &MailServiceWorker::handleMessageSendingFailed);
     connect(m_service, &ClientService::accountSynced, this, &MailServiceWorker::accountSynced);
     connect(m_service, &ClientService::syncAccountFailed, this, &MailServiceWorker::syncAccountFailed);
     connect(m_service, &ClientService::actionFailed, this, &MailServiceWorker::handleActionFailed);
     connect(m_service, &ClientService::standardFoldersCreated, this, &MailServiceWorker::standardFoldersCreated);
+    // Queued so the indexes are created on whichever thread we end up living on
+    QMetaObject::invokeMethod(this, "initIndexes", Qt::QueuedConnection);
 }
 
 void MailServiceWorker::registerTypes() {
     qRegisterMetaType<QList<quint64>>("QList<quint64>");
     qDBusRegisterMetaType<QList<quint64>>();
+    qRegisterMetaType<QList<int>>("QList<int>");
 }
 
 bool MailServiceWorker::hasUndoableAction()
 {
+    DBUS_METHOD("hasUndoableAction");
     return m_service->hasUndoableAction();
 }
 
 QString MailServiceWorker::undoDescription()
 {
+    DBUS_METHOD("undoDescription");
     return m_service->undoDescription();
 }
 
 void MailServiceWorker::deleteMessages(const QList<quint64> &ids)
 {
+    DBUS_METHOD("deleteMessages");
     QMailMessageIdList mIds = from_dbus_msglist(ids);
     m_service->deleteMessages(mIds);
 }
 
 void MailServiceWorker::restoreMessage(const quint64 &id)
 {
+    DBUS_METHOD("restoreMessage");
     QMailMessageId mid(id);
     m_service->restoreMessage(mid);
 }
 
 void MailServiceWorker::markMessagesImportant(const QList<quint64> &msgIds, const bool important)
 {
+    DBUS_METHOD("markMessagesImportant");
     QMailMessageIdList mIds = from_dbus_msglist(msgIds);
     m_service->markMessagesImportant(mIds, important);
 }
 
 void MailServiceWorker::markMessagesRead(const QList<quint64> &msgIds, const bool read)
 {
+    DBUS_METHOD("markMessagesRead");
     qDebug() << "Marking Message Read: " << msgIds;
     QMailMessageIdList mIds = from_dbus_msglist(msgIds);
     m_service->markMessagesRead(mIds, read);
@@ -66,30 +84,35 @@ void MailServiceWorker::markMessagesRead(const QList<quint64> &msgIds, const boo
 
 void MailServiceWorker::markMessagesTodo(const QList<quint64> &msgIds, const bool todo)
 {
+    DBUS_METHOD("markMessagesTodo");
     QMailMessageIdList mIds = from_dbus_msglist(msgIds);
     m_service->markMessagesTodo(mIds, todo);
 }
 
 void MailServiceWorker::markMessagesDone(const QList<quint64> &msgIds, const bool done)
 {
+    DBUS_METHOD("markMessagesDone");
     QMailMessageIdList mIds = from_dbus_msglist(msgIds);
     m_service->markMessagesDone(mIds, done);
 }
 
 void MailServiceWorker::markMessagesReplied(const QList<quint64> &msgIds, const bool all)
 {
+    DBUS_METHOD("markMessagesReplied");
     QMailMessageIdList list = from_dbus_msglist(msgIds);
     m_service->markMessagesReplied(list, all);
 }
 
 void MailServiceWorker::markMessageForwarded(const QList<quint64> &msgIds)
 {
+    DBUS_METHOD("markMessageForwarded");
     QMailMessageIdList list = from_dbus_msglist(msgIds);
     m_service->markMessageForwarded(list);
 }
 
 void MailServiceWorker::syncFolders(const quint64 &accountId, const QList<quint64> &folders)
 {
+    DBUS_METHOD("syncFolders");
     QMailAccountId id(accountId);
     QMailFolderIdList list = from_dbus_folderlist(folders);
     m_service->syncFolders(id, list);
@@ -97,12 +120,14 @@ void MailServiceWorker::syncFolders(const quint64 &accountId, const QList<quint6
 
 void MailServiceWorker::createStandardFolders(const quint64 &accountId)
 {
+    DBUS_METHOD("createStandardFolders");
     QMailAccountId id(accountId);
     m_service->createStandardFolders(id);
 }
 
 void MailServiceWorker::moveToFolder(const QList<quint64> &msgIds, const quint64 &folderId)
 {
+    DBUS_METHOD("moveToFolder");
     QMailMessageIdList list = from_dbus_msglist(msgIds);
     QMailFolderId id(folderId);
     m_service->moveToFolder(list, id);
@@ -110,6 +135,7 @@ void MailServiceWorker::moveToFolder(const QList<quint64> &msgIds, const quint64
 
 void MailServiceWorker::moveToStandardFolder(const QList<quint64> &msgIds, const int &folder, const bool userTriggered)
 {
+    DBUS_METHOD("moveToStandardFolder");
     QMailMessageIdList list = from_dbus_msglist(msgIds);
     Folder::FolderType type = static_cast<Folder::FolderType>(folder);
     m_service->moveToStandardFolder(list, type, userTriggered);
@@ -117,24 +143,49 @@ void MailServiceWorker::moveToStandardFolder(const QList<quint64> &msgIds, const
 
 void MailServiceWorker::markFolderRead(const quint64 &folderId)
 {
+    DBUS_METHOD("markFolderRead");
     QMailFolderId id(folderId);
     m_service->markFolderRead(id);
 }
 
 void MailServiceWorker::downloadMessagePart(const quint64 &msgId, const QString &partLocation)
 {
+    DBUS_METHOD("downloadMessagePart");
     QMailMessageId id(msgId);
     m_service->downloadMessagePart(id, partLocation);
 }
 
+void MailServiceWorker::downloadMessagePartRange(const quint64 &msgId, const QString &partLocation, const uint &minimum)
+{
+    DBUS_METHOD("downloadMessagePartRange");
+    QMailMessageId id(msgId);
+    m_service->downloadMessagePartRange(id, partLocation, minimum);
+}
+
 void MailServiceWorker::downloadMessages(const QList<quint64> &msgIds)
 {
+    DBUS_METHOD("downloadMessages");
     QMailMessageIdList list = from_dbus_msglist(msgIds);
     m_service->downloadMessages(list);
 }
 
+void MailServiceWorker::prefetchMessages(const QList<quint64> &msgIds, const int &priority)
+{
+    DBUS_METHOD("prefetchMessages");
+    QMailMessageIdList list = from_dbus_msglist(msgIds);
+    m_service->prefetchMessages(list, priority);
+}
+
+void MailServiceWorker::cancelPrefetch(const QList<quint64> &msgIds)
+{
+    DBUS_METHOD("cancelPrefetch");
+    QMailMessageIdList list = from_dbus_msglist(msgIds);
+    m_service->cancelPrefetch(list);
+}
+
 void MailServiceWorker::sendMessage(const quint64 &msgId)
 {
+    DBUS_METHOD("sendMessage");
     QMailMessageId id(msgId);
     QMailMessage message(id);
     m_service->sendMessage(message);
@@ -142,33 +193,39 @@ void MailServiceWorker::sendMessage(const quint64 &msgId)
 
 void MailServiceWorker::sendPendingMessages()
 {
+    DBUS_METHOD("sendPendingMessages");
     m_service->sendAnyQueuedMail();
 }
 
 void MailServiceWorker::synchronizeAccount(const quint64 &accountId)
 {
+    DBUS_METHOD("synchronizeAccount");
     QMailAccountId id(accountId);
     m_service->synchronizeAccount(id);
 }
 
 void MailServiceWorker::undoActions()
 {
+    DBUS_METHOD("undoActions");
     m_service->undoActions();
 }
 
 void MailServiceWorker::sendAnyQueuedMail()
 {
+    DBUS_METHOD("sendAnyQueuedMail");
     m_service->sendAnyQueuedMail();
 }
 
 void MailServiceWorker::emptyTrash(const QList<quint64> &accountIds)
 {
+    DBUS_METHOD("emptyTrash");
    QMailAccountIdList accounts = from_dbus_accountlist(accountIds);
    m_service->emptyTrash(accounts);
 }
 
 void MailServiceWorker::removeMessage(const quint64 &msgId, const int &option)
 {
+    DBUS_METHOD("removeMessage");
     QMailStore::MessageRemovalOption remOpt = static_cast<QMailStore::MessageRemovalOption>(option);
     QMailMessageId id(msgId);
     m_service->removeMessage(id, remOpt);
@@ -176,17 +233,82 @@ void MailServiceWorker::removeMessage(const quint64 &msgId, const int &option)
 
 int MailServiceWorker::totalCount(const QByteArray &msgKey)
 {
+    DBUS_METHOD("totalCount");
     return QMailStore::instance()->countMessages(to_msg_key(msgKey));
 }
 
 QList<quint64> MailServiceWorker::queryMessages(const QByteArray &msgKey, const QByteArray &sortKey, const int &limit)
 {
+    DBUS_METHOD("queryMessages");
     QMailMessageIdList result = QMailStore::instance()->queryMessages(to_msg_key(msgKey), to_msg_sort_key(sortKey), limit);
     return to_dbus_msglist(result);
 }
 
+QString MailServiceWorker::queryMessageSegment(const QByteArray &msgKey, const QByteArray &sortKey, const int &limit,
+                                               const QString &restrictTo, QList<quint64> &messages)
+{
+    DBUS_METHOD("queryMessageSegment");
+    QMailMessageKey key = to_msg_key(msgKey);
+    if (!restrictTo.isEmpty()) {
+        QMailMessageIdList restrictIds;
+        if (!SharedIdList::read(restrictTo, restrictIds)) {
+            // An empty reply reads as nothing matching and would wipe the caller's list
+            if (calledFromDBus()) {
+                sendErrorReply(QDBusError::Failed, QStringLiteral("Unable to read id segment: %1").arg(restrictTo));
+            }
+            return QString();
+        }
+        key &= QMailMessageKey::id(restrictIds);
+    }
+    QMailMessageIdList result = QMailStore::instance()->queryMessages(key, to_msg_sort_key(sortKey), limit);
+    if (SharedIdList::worthSharing(result.size())) {
+        const QString segment = SharedIdList::instance()->publish(result);
+        if (!segment.isEmpty()) {
+            return segment;
+        }
+    }
+    messages = to_dbus_msglist(result);
+    return QString();
+}
+
+void MailServiceWorker::releaseSegment(const QString &segment)
+{
+    DBUS_METHOD("releaseSegment");
+    SharedIdList::instance()->release(segment);
+}
+
+int MailServiceWorker::queryThreads(const QByteArray &msgKey, const QByteArray &sortKey, const int &limit,
+                                    QList<quint64> &messages, QList<int> &counts, QList<int> &unread)
+{
+    DBUS_METHOD("queryThreads");
+    const ThreadIndex::Conversations result = ThreadIndex::instance()->conversations(
+                to_msg_key(msgKey), to_msg_sort_key(sortKey), limit);
+    messages = to_dbus_msglist(result.ids);
+    counts = result.counts;
+    unread = result.unread;
+    return result.total;
+}
+
+QStringList MailServiceWorker::completeRecipients(const QString &prefix, const int &limit)
+{
+    DBUS_METHOD("completeRecipients");
+    return QMailAddress::toStringList(RecipientIndex::instance()->complete(prefix, limit));
+}
+
+QString MailServiceWorker::metrics()
+{
+    return QString::fromUtf8(Metrics::toJson());
+}
+
+void MailServiceWorker::initIndexes()
+{
+    ThreadIndex::instance();
+    RecipientIndex::instance();
+}
+
 QList<quint64> MailServiceWorker::queryFolders(const QByteArray &folderKey, const QByteArray &sortKey, const int &limit)
 {
+    DBUS_METHOD("queryFolders");
     QMailFolderIdList result = QMailStore::instance()->queryFolders(
                 to_folder_key(folderKey),
                 to_folder_sort_key(sortKey),
@@ -196,6 +318,7 @@ QList<quint64> MailServiceWorker::queryFolders(const QByteArray &folderKey, cons
 
 void MailServiceWorker::pruneCache(const QList<quint64> &msgIds)
 {
+    DBUS_METHOD("pruneCache");
     QMailMessageIdList msgs = from_dbus_msglist(msgIds);
     if (!msgs.isEmpty()) {
         QMailStore::instance()->removeMessages(QMailMessageKey::id(msgs), QMailStore::MessageRemovalOption::NoRemovalRecord);
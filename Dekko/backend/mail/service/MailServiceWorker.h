@@ -26,7 +26,7 @@
 #include <qmailmessagesortkey.h>
 
 
-class MailServiceWorker : public QObject
+class MailServiceWorker : public QObject, protected QDBusContext
 {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "org.dekkoproject.MailService")
@@ -37,9 +37,9 @@ public:
     static void registerTypes();
 
     Q_PROPERTY(bool hasUndoableAction READ hasUndoableAction)
-    bool hasUndoableAction();
+    Q_INVOKABLE bool hasUndoableAction();
     Q_PROPERTY(QString undoDescription READ undoDescription)
-    QString undoDescription();
+    Q_INVOKABLE QString undoDescription();
 
 public slots:
     /**
@@ -122,11 +122,34 @@ public slots:
      * @param partLocation
      */
     void downloadMessagePart(const quint64 &msgId, const QString &partLocation);
+    /**
+     * @brief downloadMessagePartRange
+     *
+     * Retrieves at least \param minimum bytes of the part, continuing on from
+     * whatever has already been stored. messagePartNowAvailable is emitted once
+     * the range is in the store even though the part may not be complete yet.
+     *
+     * @param msgId
+     * @param partLocation
+     * @param minimum
+     */
+    void downloadMessagePartRange(const quint64 &msgId, const QString &partLocation, const uint &minimum);
     /**
      * @brief downloadMessages
      * @param msgIds
      */
     void downloadMessages(const QList<quint64> &msgIds);
+    /**
+     * @brief prefetchMessages
+     * @param msgIds
+     * @param priority ClientService::PrefetchPriority
+     */
+    void prefetchMessages(const QList<quint64> &msgIds, const int &priority);
+    /**
+     * @brief cancelPrefetch
+     * @param msgIds
+     */
+    void cancelPrefetch(const QList<quint64> &msgIds);
     /**
      * @brief sendMessage
      * @param msgId
@@ -157,9 +180,34 @@ public slots:
     int totalCount(const QByteArray &msgKey);
 
     QList<quint64> queryMessages(const QByteArray &msgKey, const QByteArray &sortKey, const int &limit);
+    /**
+     * @brief queryMessageSegment
+     * Same as queryMessages but large results are returned in a SharedIdList segment
+     * rather than marshalled over the bus. The caller must releaseSegment() once read.
+     * @param restrictTo optional segment of ids the query is limited to
+     * @param messages the result when small enough to send inline
+     * @return segment key or an empty string if the result is in \param messages
+     */
+    QString queryMessageSegment(const QByteArray &msgKey, const QByteArray &sortKey, const int &limit,
+                                const QString &restrictTo, QList<quint64> &messages);
+    void releaseSegment(const QString &segment);
+    /** @short Best \param limit known addresses matching \param prefix, see RecipientIndex */
+    QStringList completeRecipients(const QString &prefix, const int &limit);
+    /**
+     * @brief queryThreads
+     * Conversations with a message matching \param msgKey, see ThreadIndex::conversations
+     * @param messages newest message of each conversation
+     * @param counts messages matching the key in each conversation
+     * @param unread unread messages matching the key in each conversation
+     * @return number of conversations returned, plus one if there are more past \param limit
+     */
+    int queryThreads(const QByteArray &msgKey, const QByteArray &sortKey, const int &limit,
+                     QList<quint64> &messages, QList<int> &counts, QList<int> &unread);
     QList<quint64> queryFolders(const QByteArray &folderKey, const QByteArray &sortKey = QByteArray(), const int &limit = 0);
 
     void pruneCache(const QList<quint64> &msgIds);
+    /** @short Snapshot of the worker's metrics as JSON, see Metrics */
+    QString metrics();
 signals:
     void undoCountChanged();
     void updatesRolledBack();
@@ -167,6 +215,7 @@ signals:
     void messageRestored(const quint64 &msgId);
     void messagePartNowAvailable(const quint64 &msgId, const QString &partLocation);
     void messagePartFetchFailed(const quint64 &msgId, const QString &partLocation);
+    void fetchProgress(const quint64 &msgId, const QString &partLocation, const uint &value, const uint &total);
     void messagesNowAvailable(const QList<quint64> &idList);
     void messageFetchFailed(const QList<quint64> &ids);
     void messagesSent(const QList<quint64> &ids);
@@ -179,6 +228,7 @@ signals:
 
 
 private slots:
+    void initIndexes();
     void handleMessagesFetched(const QMailMessageIdList &msgIds);
     void handleMessageFetchFailed(const QMailMessageIdList &msgIds);
     void handleMessagesSent(const QMailMessageIdList &msgIds);
@@ -0,0 +1,304 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "OperationBatcher.h"
+#include <algorithm>
+#include <QDebug>
+#include <QSet>
+#include <qmaildisconnected.h>
+#include <qmailstore.h>
+#include <AccountRegistry.h>
+
+// How long to hold operations so quick successive requests get merged
+#define BATCH_WINDOW 100
+
+OperationBatcher::OperationBatcher(QObject *parent) : QObject(parent),
+    m_timer(0), m_totalOperations(0), m_totalMessages(0), m_totalStoreUpdates(0),
+    m_totalCommands(0), m_totalCommandsSaved(0)
+{
+    m_timer = new QTimer(this);
+    m_timer->setInterval(BATCH_WINDOW);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &OperationBatcher::flush);
+}
+
+void OperationBatcher::flagMessages(const QMailMessageIdList &ids, const quint64 &applyMask, const quint64 &removeMask, const bool undoable)
+{
+    if (ids.isEmpty() || (!applyMask && !removeMask)) {
+        return;
+    }
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        Masks &masks = m_flags[id];
+        // Later requests win over earlier ones
+        masks.first = (masks.first & ~removeMask) | applyMask;
+        masks.second = (masks.second & ~applyMask) | removeMask;
+    }
+    int flagCount = 0;
+    for (quint64 bits = applyMask | removeMask; bits; bits &= bits - 1) {
+        ++flagCount;
+    }
+    addOperation(ids, flagCount, undoable);
+}
+
+void OperationBatcher::moveToFolder(const QMailMessageIdList &ids, const QMailFolderId &destination, const bool undoable)
+{
+    if (ids.isEmpty() || !destination.isValid()) {
+        return;
+    }
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        m_moves.insert(id, qMakePair(destination, -1));
+    }
+    addOperation(ids, 1, undoable);
+}
+
+void OperationBatcher::moveToStandardFolder(const QMailMessageIdList &ids, const QMailFolder::StandardFolder &folder, const bool undoable)
+{
+    if (ids.isEmpty()) {
+        return;
+    }
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        m_moves.insert(id, qMakePair(QMailFolderId(), static_cast<int>(folder)));
+    }
+    addOperation(ids, 1, undoable);
+}
+
+bool OperationBatcher::hasPendingOperations() const
+{
+    return !m_operations.isEmpty();
+}
+
+QVariantMap OperationBatcher::stats() const
+{
+    QVariantMap stats;
+    stats.insert(QStringLiteral("operations"), m_totalOperations);
+    stats.insert(QStringLiteral("messages"), m_totalMessages);
+    stats.insert(QStringLiteral("storeUpdates"), m_totalStoreUpdates);
+    stats.insert(QStringLiteral("commands"), m_totalCommands);
+    stats.insert(QStringLiteral("commandsSaved"), m_totalCommandsSaved);
+    return stats;
+}
+
+QStringList OperationBatcher::sequenceSets(QList<uint> uids, const int &maxLength)
+{
+    QStringList sets;
+    if (uids.isEmpty()) {
+        return sets;
+    }
+    std::sort(uids.begin(), uids.end());
+    uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+
+    QString current;
+    auto appendRange = [&](const uint &start, const uint &end) {
+        const QString range = (start == end) ? QString::number(start)
+                                             : QStringLiteral("%1:%2").arg(start).arg(end);
+        if (!current.isEmpty() && current.size() + range.size() + 1 > maxLength) {
+            sets << current;
+            current.clear();
+        }
+        if (!current.isEmpty()) {
+            current += QLatin1Char(',');
+        }
+        current += range;
+    };
+
+    uint start = uids.first();
+    uint end = start;
+    for (int i = 1; i < uids.size(); ++i) {
+        if (uids.at(i) == end + 1) {
+            end = uids.at(i);
+            continue;
+        }
+        appendRange(start, end);
+        start = end = uids.at(i);
+    }
+    appendRange(start, end);
+    sets << current;
+    return sets;
+}
+
+void OperationBatcher::flush()
+{
+    m_timer->stop();
+    if (!hasPendingOperations()) {
+        return;
+    }
+
+    QSet<QMailMessageId> idSet;
+    QSet<QMailMessageId> exportIds;
+    Q_FOREACH(const Operation &op, m_operations) {
+        idSet += op.ids.toSet();
+        if (!op.undoable) {
+            exportIds += op.ids.toSet();
+        }
+    }
+    // One query for everything we need to know about the whole batch
+    MetaDataMap metaData;
+    const QMailMessageKey::Properties props(QMailMessageKey::Id | QMailMessageKey::ParentAccountId
+                                            | QMailMessageKey::ParentFolderId | QMailMessageKey::ServerUid);
+    Q_FOREACH(const QMailMessageMetaData &meta, QMailStore::instance()->messagesMetaData(QMailMessageKey::id(idSet.toList()), props)) {
+        metaData.insert(meta.id(), meta);
+    }
+
+    const int unbatched = unbatchedCommands(metaData);
+    int storeUpdates = 0;
+    int commands = commitMoves(metaData, storeUpdates);
+    commands += commitFlags(metaData, storeUpdates);
+
+    QMailAccountIdList accounts;
+    Q_FOREACH(const QMailMessageId &id, exportIds) {
+        const QMailAccountId accountId = metaData.value(id).parentAccountId();
+        if (accountId.isValid() && !accounts.contains(accountId)) {
+            accounts << accountId;
+        }
+    }
+
+    const int saved = qMax(0, unbatched - commands);
+    m_totalOperations += m_operations.size();
+    m_totalMessages += metaData.size();
+    m_totalStoreUpdates += storeUpdates;
+    m_totalCommands += commands;
+    m_totalCommandsSaved += saved;
+    qDebug() << "[OperationBatcher] Flushed" << m_operations.size() << "operations on" << metaData.size()
+             << "messages with" << storeUpdates << "store updates." << "Commands:" << commands << "Saved:" << saved;
+
+    m_operations.clear();
+    m_flags.clear();
+    m_moves.clear();
+    emit flushed(accounts);
+}
+
+void OperationBatcher::addOperation(const QMailMessageIdList &ids, const int &commandsPerFolder, const bool undoable)
+{
+    Operation op;
+    op.ids = ids;
+    op.commandsPerFolder = commandsPerFolder;
+    op.undoable = undoable;
+    m_operations << op;
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+int OperationBatcher::unbatchedCommands(const MetaDataMap &metaData) const
+{
+    int commands = 0;
+    Q_FOREACH(const Operation &op, m_operations) {
+        QSet<QMailFolderId> folders;
+        Q_FOREACH(const QMailMessageId &id, op.ids) {
+            folders << metaData.value(id).parentFolderId();
+        }
+        commands += folders.size() * op.commandsPerFolder;
+    }
+    return commands;
+}
+
+int OperationBatcher::commitMoves(const MetaDataMap &metaData, int &storeUpdates)
+{
+    QMap<QMailFolderId, QMailMessageIdList> byDestination;
+    QHash<QMailMessageId, QPair<QMailFolderId, int> >::const_iterator it = m_moves.constBegin();
+    for (; it != m_moves.constEnd(); ++it) {
+        const QMailMessageMetaData meta = metaData.value(it.key());
+        if (!meta.id().isValid()) {
+            continue; // gone already
+        }
+        QMailFolderId destination = it.value().first;
+        if (!destination.isValid()) {
+            destination = AccountRegistry::instance()->standardFolder(meta.parentAccountId(),
+                                                                      static_cast<QMailFolder::StandardFolder>(it.value().second));
+        }
+        if (!destination.isValid()) {
+            qDebug() << "[OperationBatcher] No destination folder for" << it.key();
+            continue;
+        }
+        if (destination == meta.parentFolderId()) {
+            continue;
+        }
+        byDestination[destination] << it.key();
+    }
+
+    int commands = 0;
+    QMap<QMailFolderId, QMailMessageIdList>::const_iterator dest = byDestination.constBegin();
+    for (; dest != byDestination.constEnd(); ++dest) {
+        QMailDisconnected::moveToFolder(dest.value(), dest.key());
+        ++storeUpdates;
+        // One move per source folder & sequence set
+        QMap<QMailFolderId, QList<uint> > uidsByFolder;
+        Q_FOREACH(const QMailMessageId &id, dest.value()) {
+            const QMailMessageMetaData &meta = metaData[id];
+            if (uint uid = imapUid(meta)) {
+                uidsByFolder[meta.parentFolderId()] << uid;
+            } else {
+                ++commands;
+            }
+        }
+        Q_FOREACH(const QList<uint> &uids, uidsByFolder) {
+            commands += sequenceSets(uids).size();
+        }
+    }
+    return commands;
+}
+
+int OperationBatcher::commitFlags(const MetaDataMap &metaData, int &storeUpdates)
+{
+    QMap<Masks, QMailMessageIdList> byMasks;
+    // Keyed on folder and flag bit, removals use the bit negated
+    QMap<QPair<QMailFolderId, qint64>, QList<uint> > uidsByFlag;
+    int commands = 0;
+    QHash<QMailMessageId, Masks>::const_iterator it = m_flags.constBegin();
+    for (; it != m_flags.constEnd(); ++it) {
+        const QMailMessageMetaData meta = metaData.value(it.key());
+        if (!meta.id().isValid() || (!it.value().first && !it.value().second)) {
+            continue;
+        }
+        byMasks[it.value()] << it.key();
+
+        const uint uid = imapUid(meta);
+        for (int bit = 0; bit < 64; ++bit) {
+            const quint64 flag = Q_UINT64_C(1) << bit;
+            const bool apply = it.value().first & flag;
+            const bool remove = it.value().second & flag;
+            if (!apply && !remove) {
+                continue;
+            }
+            if (!uid) {
+                ++commands;
+                continue;
+            }
+            const qint64 key = apply ? qint64(bit + 1) : -qint64(bit + 1);
+            uidsByFlag[qMakePair(meta.parentFolderId(), key)] << uid;
+        }
+    }
+
+    QMap<Masks, QMailMessageIdList>::const_iterator group = byMasks.constBegin();
+    for (; group != byMasks.constEnd(); ++group) {
+        QMailDisconnected::flagMessages(group.value(), group.key().first, group.key().second,
+                                        QStringLiteral("Updating flags on %1 messages").arg(group.value().size()));
+        ++storeUpdates;
+    }
+    Q_FOREACH(const QList<uint> &uids, uidsByFlag) {
+        commands += sequenceSets(uids).size();
+    }
+    return commands;
+}
+
+uint OperationBatcher::imapUid(const QMailMessageMetaData &meta)
+{
+    // imap server uids are stored as "<folder>|<uid>"
+    bool ok = false;
+    const uint uid = meta.serverUid().section(QLatin1Char('|'), -1).toUInt(&ok);
+    return ok ? uid : 0;
+}
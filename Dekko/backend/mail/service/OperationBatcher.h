@@ -0,0 +1,111 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef OPERATIONBATCHER_H
+#define OPERATIONBATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QTimer>
+#include <QVariantMap>
+#include <qmailmessage.h>
+#include <qmailfolder.h>
+
+/** @short Merges flag & move operations before they hit the mail store
+ *
+ * Flag and move requests are held for a short window and merged per message,
+ * so marking a message read then unread in quick succession is a no-op and a
+ * list wide select + mark read is a single operation. On flush:
+ *
+ * - each message gets it's net apply/remove mask
+ * - messages sharing the same masks are updated in one store call
+ * - moves are grouped by destination and applied in one store call each
+ * - every affected account is reported once via flushed() so the caller can
+ *   export the changes in a single round
+ *
+ * Actually building IMAP commands happens in the qmf imap service on export,
+ * which issues one UID STORE/MOVE per folder & flag for everything pending. The
+ * uid sequence sets computed here estimate how many commands that is compared
+ * to running each request on it's own and are kept in stats().
+ */
+class OperationBatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit OperationBatcher(QObject *parent = 0);
+
+    /* Undoable operations are left for the undo queue to export, anything
+     * else has it's account reported in flushed() */
+    void flagMessages(const QMailMessageIdList &ids, const quint64 &applyMask, const quint64 &removeMask, const bool undoable = false);
+    void moveToFolder(const QMailMessageIdList &ids, const QMailFolderId &destination, const bool undoable = true);
+    /** @short The destination is resolved per account on flush */
+    void moveToStandardFolder(const QMailMessageIdList &ids, const QMailFolder::StandardFolder &folder, const bool undoable = true);
+
+    bool hasPendingOperations() const;
+    /** @short Cumulative counts since startup: operations, messages, storeUpdates, commands & commandsSaved */
+    QVariantMap stats() const;
+
+    /** @short Compress \param uids into imap sequence sets
+     *
+     * e.g 1,2,3,5,7,8 becomes "1:3,5,7:8". The result is split so no set is
+     * longer than \param maxLength characters.
+     */
+    static QStringList sequenceSets(QList<uint> uids, const int &maxLength = 1000);
+
+signals:
+    /** @short Emitted after a flush with the accounts that need exporting now */
+    void flushed(const QMailAccountIdList &accounts);
+
+public slots:
+    /** @short Apply everything pending now */
+    void flush();
+
+private:
+    typedef QPair<quint64, quint64> Masks; // apply, remove
+    typedef QHash<QMailMessageId, QMailMessageMetaData> MetaDataMap;
+    struct Operation {
+        QMailMessageIdList ids;
+        int commandsPerFolder;
+        bool undoable;
+    };
+
+    void addOperation(const QMailMessageIdList &ids, const int &commandsPerFolder, const bool undoable);
+    int unbatchedCommands(const MetaDataMap &metaData) const;
+    int commitMoves(const MetaDataMap &metaData, int &storeUpdates);
+    int commitFlags(const MetaDataMap &metaData, int &storeUpdates);
+    static uint imapUid(const QMailMessageMetaData &meta);
+
+    QTimer *m_timer;
+    // Net change per message
+    QHash<QMailMessageId, Masks> m_flags;
+    // Last destination per message, standard folders are stored as
+    // an invalid folder id + the QMailFolder::StandardFolder
+    QHash<QMailMessageId, QPair<QMailFolderId, int> > m_moves;
+    // Each request as it came in along with the commands it needs per folder,
+    // used to work out what sending them one by one would have cost.
+    QList<Operation> m_operations;
+
+    int m_totalOperations;
+    int m_totalMessages;
+    int m_totalStoreUpdates;
+    int m_totalCommands;
+    int m_totalCommandsSaved;
+};
+
+#endif // OPERATIONBATCHER_H
@@ -0,0 +1,249 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "RecipientIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <QDateTime>
+#include <QDebug>
+#include <QTimer>
+#include <qmailstore.h>
+#include <Trace.h>
+
+// Messages read from the store per pass of the event loop
+#define BATCH_SIZE 500
+// Seconds for an occurrence to be worth half as much, i.e 30 days
+#define HALF_LIFE 2592000.0
+// Relative weight of where an address was seen
+#define WEIGHT_SENT_TO 4.0
+#define WEIGHT_FROM 1.0
+#define WEIGHT_RECEIVED_WITH 0.5
+
+// Lower case with the accents stripped so "jose" finds "José"
+static QString normalized(const QString &text)
+{
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString result;
+    result.reserve(decomposed.size());
+    for (const QChar c : decomposed) {
+        if (c.category() != QChar::Mark_NonSpacing) {
+            result.append(c.toLower());
+        }
+    }
+    return result;
+}
+
+// log2(2^a + 2^b) without overflowing for large timestamps
+static double logAdd(const double a, const double b)
+{
+    const double high = qMax(a, b);
+    return high + std::log2(1.0 + std::exp2(-std::fabs(a - b)));
+}
+
+static RecipientIndex *s_index = 0;
+
+RecipientIndex *RecipientIndex::instance()
+{
+    if (!s_index) {
+        s_index = new RecipientIndex();
+    }
+    return s_index;
+}
+
+RecipientIndex::RecipientIndex(QObject *parent) : QObject(parent),
+    m_query(0), m_next(0), m_indexTimer(0)
+{
+    m_indexTimer = new QTimer(this);
+    m_indexTimer->setSingleShot(true);
+    m_indexTimer->setInterval(0);
+    connect(m_indexTimer, &QTimer::timeout, this, &RecipientIndex::indexPending);
+    connect(QMailStore::instance(), SIGNAL(messagesAdded(QMailMessageIdList)), this, SLOT(handleMessagesAdded(QMailMessageIdList)));
+
+    m_pending = QMailStore::instance()->queryMessages(QMailMessageKey::messageType(QMailMessage::Email));
+    if (!m_pending.isEmpty()) {
+        m_indexTimer->start();
+    }
+}
+
+QMailAddressList RecipientIndex::complete(const QString &prefix, const int &limit)
+{
+    QMailAddressList result;
+    const QString key = normalized(prefix.trimmed());
+    if (key.isEmpty() || limit <= 0) {
+        return result;
+    }
+    // Anything indexed so far this pass should be found too
+    mergeTokens();
+    if (++m_query == 0) {
+        // Wrapped around, forget what the old queries saw
+        m_seen.fill(0);
+        m_query = 1;
+    }
+    // Best first, never more than limit long
+    QVector<quint32> best;
+    best.reserve(limit + 1);
+    Token probe;
+    probe.key = key;
+    QVector<Token>::const_iterator it = std::lower_bound(m_tokens.constBegin(), m_tokens.constEnd(), probe);
+    for (; it != m_tokens.constEnd() && it->key.startsWith(key); ++it) {
+        const quint32 entry = it->entry;
+        if (m_seen.at(entry) == m_query) {
+            continue;
+        }
+        m_seen[entry] = m_query;
+        const double score = m_entries.at(entry).score;
+        if (best.size() == limit && score <= m_entries.at(best.last()).score) {
+            continue;
+        }
+        QVector<quint32>::iterator pos = std::upper_bound(best.begin(), best.end(), score,
+                                                          [this](const double s, const quint32 other) {
+            return s > m_entries.at(other).score;
+        });
+        best.insert(pos, entry);
+        if (best.size() > limit) {
+            best.removeLast();
+        }
+    }
+    result.reserve(best.size());
+    Q_FOREACH(const quint32 entry, best) {
+        result << m_entries.at(entry).address;
+    }
+    return result;
+}
+
+void RecipientIndex::handleMessagesAdded(const QMailMessageIdList &ids)
+{
+    m_pending << ids;
+    if (!m_pending.isEmpty()) {
+        m_indexTimer->start();
+    }
+}
+
+void RecipientIndex::indexPending()
+{
+    TRACE_SPAN("RecipientIndex::indexPending");
+    // Taken from the front in place, the list is only dropped once it's all done
+    QMailMessageIdList batch;
+    batch.reserve(BATCH_SIZE);
+    while (m_next < m_pending.size() && batch.size() < BATCH_SIZE) {
+        batch << m_pending.at(m_next++);
+    }
+    // Only the columns we need, no message has to be loaded
+    const QMailMessageKey::Properties props = QMailMessageKey::Id | QMailMessageKey::Sender | QMailMessageKey::Recipients
+            | QMailMessageKey::TimeStamp | QMailMessageKey::Status;
+    const QMailMessageMetaDataList metaData = QMailStore::instance()->messagesMetaData(QMailMessageKey::id(batch), props);
+    Q_FOREACH(const QMailMessageMetaData &meta, metaData) {
+        index(meta);
+    }
+    if (m_next < m_pending.size()) {
+        m_indexTimer->start();
+    } else {
+        m_pending.clear();
+        m_next = 0;
+        mergeTokens();
+        qDebug() << "[RecipientIndex] Indexed" << m_entries.size() << "addresses," << m_tokens.size() << "tokens";
+    }
+}
+
+void RecipientIndex::index(const QMailMessageMetaData &meta)
+{
+    const QDateTime seen = meta.date().toUTC();
+    if (meta.status() & (QMailMessage::Outgoing | QMailMessage::Sent)) {
+        Q_FOREACH(const QMailAddress &address, meta.recipients()) {
+            add(address, WEIGHT_SENT_TO, seen);
+        }
+        return;
+    }
+    add(meta.from(), WEIGHT_FROM, seen);
+    Q_FOREACH(const QMailAddress &address, meta.recipients()) {
+        add(address, WEIGHT_RECEIVED_WITH, seen);
+    }
+}
+
+void RecipientIndex::add(const QMailAddress &address, const double &weight, const QDateTime &seen)
+{
+    if (address.isNull() || address.isGroup() || !address.isEmailAddress()) {
+        return;
+    }
+    const double score = std::log2(weight) + (seen.isValid() ? seen.toMSecsSinceEpoch() / 1000.0 : 0.0) / HALF_LIFE;
+    const QString addressKey = address.address().toLower();
+    QHash<QString, quint32>::const_iterator it = m_byAddress.constFind(addressKey);
+    if (it == m_byAddress.constEnd()) {
+        const quint32 entry = m_entries.size();
+        Entry e;
+        e.address = address;
+        e.score = score;
+        m_entries.append(e);
+        m_seen.append(0);
+        m_byAddress.insert(addressKey, entry);
+        addTokens(entry, address);
+        return;
+    }
+    Entry &e = m_entries[it.value()];
+    e.score = logAdd(e.score, score);
+    if (e.address.name().isEmpty() && !address.name().isEmpty()) {
+        // First time we've seen a name for it
+        e.address = address;
+        addTokens(it.value(), address);
+    }
+}
+
+void RecipientIndex::addTokens(const quint32 entry, const QMailAddress &address)
+{
+    QStringList keys;
+    const QString addr = normalized(address.address());
+    keys << addr;
+    // Parts of the local part, so "smith" finds john.smith@example.org
+    const int at = addr.indexOf(QLatin1Char('@'));
+    for (int i = 0; i < at; ++i) {
+        const QChar c = addr.at(i);
+        if ((c == QLatin1Char('.') || c == QLatin1Char('_') || c == QLatin1Char('-') || c == QLatin1Char('+')) && i + 1 < at) {
+            keys << addr.mid(i + 1);
+        }
+    }
+    const QString name = normalized(address.name()).simplified();
+    if (!name.isEmpty()) {
+        // The whole name, so typing "john sm" still narrows it down, then each later word
+        keys << name;
+        int space = name.indexOf(QLatin1Char(' '));
+        while (space != -1) {
+            keys << name.mid(space + 1);
+            space = name.indexOf(QLatin1Char(' '), space + 1);
+        }
+    }
+    Q_FOREACH(const QString &key, keys) {
+        Token token;
+        token.key = key;
+        token.entry = entry;
+        m_newTokens << token;
+    }
+}
+
+void RecipientIndex::mergeTokens()
+{
+    if (m_newTokens.isEmpty()) {
+        return;
+    }
+    std::sort(m_newTokens.begin(), m_newTokens.end());
+    QVector<Token> merged;
+    merged.reserve(m_tokens.size() + m_newTokens.size());
+    std::merge(m_tokens.constBegin(), m_tokens.constEnd(), m_newTokens.constBegin(), m_newTokens.constEnd(),
+               std::back_inserter(merged));
+    m_tokens.swap(merged);
+    m_newTokens.clear();
+}
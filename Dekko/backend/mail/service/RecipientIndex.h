@@ -0,0 +1,87 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RECIPIENTINDEX_H
+#define RECIPIENTINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <qmailaddress.h>
+#include <qmailmessage.h>
+
+class QTimer;
+
+/** @short Completion source for recipient addresses, built from the mail store
+ *
+ * Every sender and recipient seen in the store gets an entry, scored by how
+ * often and how recently it turned up. Addresses we've sent to count for more
+ * than those we've only received from. The score is kept in log space with the
+ * recency folded in, so entries compare the same whatever the current time is
+ * and a query never has to rescore anything.
+ *
+ * Lookups go through a sorted array of normalized tokens, the address, the
+ * parts of it's local part and each word of the name, so a prefix is a binary
+ * search followed by a short scan.
+ *
+ * Lives in the worker, all methods must be called from the worker's thread.
+ */
+class RecipientIndex : public QObject
+{
+    Q_OBJECT
+public:
+    /** @short The worker's index, created on first use */
+    static RecipientIndex *instance();
+
+    /** @short Best \param limit addresses with a name or address part starting with \param prefix */
+    QMailAddressList complete(const QString &prefix, const int &limit);
+
+private slots:
+    void handleMessagesAdded(const QMailMessageIdList &ids);
+    void indexPending();
+
+private:
+    explicit RecipientIndex(QObject *parent = 0);
+
+    struct Entry {
+        QMailAddress address;
+        double score;
+    };
+    struct Token {
+        QString key;
+        quint32 entry;
+        bool operator<(const Token &other) const { return key < other.key; }
+    };
+
+    void index(const QMailMessageMetaData &meta);
+    void add(const QMailAddress &address, const double &weight, const QDateTime &seen);
+    void addTokens(const quint32 entry, const QMailAddress &address);
+    void mergeTokens();
+
+    QVector<Entry> m_entries;
+    QHash<QString, quint32> m_byAddress; // lower cased address -> entry
+    QVector<Token> m_tokens;             // sorted by key
+    QVector<Token> m_newTokens;          // since the last merge, at the end of a pass or by a query
+    QVector<quint32> m_seen;             // per entry, last query that returned it
+    quint32 m_query;
+
+    QMailMessageIdList m_pending;
+    int m_next;                          // first of m_pending not indexed yet
+    QTimer *m_indexTimer;
+};
+
+#endif // RECIPIENTINDEX_H
@@ -0,0 +1,129 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "SharedIdList.h"
+#include <QCoreApplication>
+#include <QDebug>
+
+// How long an unreleased segment is kept around (ms)
+#define SEGMENT_TTL 30000
+#define SEGMENT_MAGIC 0x64656b6bu // "dekk"
+
+// Segment layout: header followed by count quint64 ids
+struct SegmentHeader {
+    quint32 magic;
+    quint32 count;
+};
+
+static SharedIdList *s_instance = 0;
+SharedIdList *SharedIdList::instance()
+{
+    if (!s_instance) {
+        s_instance = new SharedIdList(QCoreApplication::instance());
+    }
+    return s_instance;
+}
+
+SharedIdList::SharedIdList(QObject *parent) : QObject(parent),
+    m_next(0)
+{
+    m_expiry.setInterval(SEGMENT_TTL / 3);
+    connect(&m_expiry, &QTimer::timeout, this, &SharedIdList::expire);
+}
+
+QString SharedIdList::publish(const QMailMessageIdList &ids)
+{
+    const QString key = QStringLiteral("dekko-ids-%1-%2").arg(QCoreApplication::applicationPid()).arg(++m_next);
+    QSharedMemory *memory = new QSharedMemory(key);
+    const int size = sizeof(SegmentHeader) + ids.size() * sizeof(quint64);
+    if (!memory->create(size)) {
+        qWarning() << "[SharedIdList] Failed creating segment" << key << memory->errorString();
+        delete memory;
+        return QString();
+    }
+    memory->lock();
+    SegmentHeader *header = static_cast<SegmentHeader *>(memory->data());
+    header->magic = SEGMENT_MAGIC;
+    header->count = ids.size();
+    quint64 *data = reinterpret_cast<quint64 *>(header + 1);
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        *data++ = id.toULongLong();
+    }
+    memory->unlock();
+
+    Segment segment;
+    segment.memory = memory;
+    segment.age.start();
+    m_segments.insert(key, segment);
+    if (!m_expiry.isActive()) {
+        m_expiry.start();
+    }
+    return key;
+}
+
+void SharedIdList::release(const QString &key)
+{
+    if (m_segments.contains(key)) {
+        delete m_segments.take(key).memory;
+    }
+    if (m_segments.isEmpty()) {
+        m_expiry.stop();
+    }
+}
+
+bool SharedIdList::read(const QString &key, QMailMessageIdList &ids)
+{
+    QSharedMemory memory(key);
+    if (!memory.attach(QSharedMemory::ReadOnly)) {
+        qWarning() << "[SharedIdList] Failed attaching to segment" << key << memory.errorString();
+        return false;
+    }
+    memory.lock();
+    const SegmentHeader *header = static_cast<const SegmentHeader *>(memory.constData());
+    const int available = (memory.size() - int(sizeof(SegmentHeader))) / int(sizeof(quint64));
+    if (header->magic != SEGMENT_MAGIC || int(header->count) > available) {
+        memory.unlock();
+        qWarning() << "[SharedIdList] Corrupt segment" << key;
+        return false;
+    }
+    // Build the id list straight from the mapping, no intermediate QList<quint64>
+    const quint64 *data = reinterpret_cast<const quint64 *>(header + 1);
+    ids.clear();
+    ids.reserve(header->count);
+    for (quint32 i = 0; i < header->count; ++i) {
+        ids.append(QMailMessageId(data[i]));
+    }
+    memory.unlock();
+    return true;
+}
+
+void SharedIdList::expire()
+{
+    QHash<QString, Segment>::iterator it = m_segments.begin();
+    while (it != m_segments.end()) {
+        if (it.value().age.hasExpired(SEGMENT_TTL)) {
+            qDebug() << "[SharedIdList] Segment never released, dropping" << it.key();
+            delete it.value().memory;
+            it = m_segments.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (m_segments.isEmpty()) {
+        m_expiry.stop();
+    }
+}
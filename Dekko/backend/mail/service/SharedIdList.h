@@ -0,0 +1,72 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SHAREDIDLIST_H
+#define SHAREDIDLIST_H
+
+#include <QObject>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QSharedMemory>
+#include <QTimer>
+#include <qmailid.h>
+
+/** @short Passes large message id lists between processes in shared memory
+ *
+ * Marshalling a QList<quint64> over D-Bus costs several copies per id, which for a
+ * 10k message list adds up to megabytes of bus traffic on every refresh. Instead the
+ * sender publish()es the ids into a segment and sends only it's key, the receiver
+ * read()s the ids straight out of the mapping and tells the sender to release() it.
+ *
+ * Segments are held until released, or for a short while if the other side never
+ * does so a crashed client can't leak them. Lists smaller than InlineLimit aren't
+ * worth the extra round trip and should be sent inline as before.
+ */
+class SharedIdList : public QObject
+{
+    Q_OBJECT
+public:
+    enum { InlineLimit = 2048 };
+
+    static SharedIdList *instance();
+
+    static bool worthSharing(const int &count) { return count >= InlineLimit; }
+
+    /** @short Copy \param ids into a new segment, returns it's key or an empty string on failure */
+    QString publish(const QMailMessageIdList &ids);
+    /** @short Drop our reference to the segment, it's freed once the reader detaches */
+    void release(const QString &key);
+
+    /** @short Read the ids held in segment \param key into \param ids */
+    static bool read(const QString &key, QMailMessageIdList &ids);
+
+private slots:
+    void expire();
+
+private:
+    explicit SharedIdList(QObject *parent = 0);
+
+    struct Segment {
+        QSharedMemory *memory;
+        QElapsedTimer age;
+    };
+    QHash<QString, Segment> m_segments;
+    QTimer m_expiry;
+    quint32 m_next;
+};
+
+#endif // SHAREDIDLIST_H
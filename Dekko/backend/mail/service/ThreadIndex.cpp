@@ -0,0 +1,635 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ThreadIndex.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSet>
+#include <QTimer>
+#include <qmailstore.h>
+#include <Formatting.h>
+#include <Paths.h>
+#include <Trace.h>
+
+#define NO_NODE 0xffffffffu
+#define INDEX_MAGIC 0x64746872u // "dthr"
+#define INDEX_VERSION 2
+// Messages indexed per pass of the event loop
+#define BATCH_SIZE 100
+#define SAVE_DELAY 5000
+// Messages of the list looked at first when looking for conversations
+#define PAGE_SIZE 200
+// Give up on a header block that hasn't ended by now
+#define MAX_HEADER_SIZE 65536
+
+static QString indexFile()
+{
+    return Paths::cacheLocationForFile(QStringLiteral("threads.index"));
+}
+
+// 64 bit FNV-1a, plenty to keep Message-IDs apart
+static quint64 hashOf(const QByteArray &data)
+{
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (const char c : data) {
+        hash ^= uchar(c);
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+static quint64 keyOf(const QString &messageId)
+{
+    QString id = messageId.trimmed();
+    if (id.startsWith(QLatin1Char('<')) && id.endsWith(QLatin1Char('>'))) {
+        id = id.mid(1, id.size() - 2);
+    }
+    return hashOf(id.toUtf8());
+}
+
+// Oldest first, with In-Reply-To last if References didn't already end with it
+static QStringList referencesOf(const QString &references, const QString &inReplyTo)
+{
+    static const QRegularExpression idMatcher(QStringLiteral("<([^<>\\s]+)>"));
+    QStringList refs;
+    QRegularExpressionMatchIterator it = idMatcher.globalMatch(references);
+    while (it.hasNext()) {
+        refs << it.next().captured(1);
+    }
+    const QRegularExpressionMatch parent = idMatcher.match(inReplyTo);
+    if (parent.hasMatch() && (refs.isEmpty() || refs.last() != parent.captured(1))) {
+        refs << parent.captured(1);
+    }
+    return refs;
+}
+
+// References and In-Reply-To straight from the stored header block, so
+// indexing never has to load and parse the whole message. Returns false if
+// the content isn't somewhere we can read it.
+static bool readThreadHeaders(const QMailMessageMetaData &meta, QString *references, QString *inReplyTo)
+{
+    if (meta.contentScheme() != QLatin1String("qmfstoragemanager") || meta.contentIdentifier().isEmpty()) {
+        return false;
+    }
+    QFile file(meta.contentIdentifier());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QString *field = 0;
+    qint64 remaining = MAX_HEADER_SIZE;
+    while (remaining > 0 && !file.atEnd()) {
+        const QByteArray line = file.readLine(remaining);
+        remaining -= line.size();
+        const QByteArray trimmed = line.trimmed();
+        if (trimmed.isEmpty()) {
+            break; // end of the header block
+        }
+        if (line.at(0) == ' ' || line.at(0) == '\t') {
+            // Folded continuation of the previous field
+            if (field) {
+                *field += QLatin1Char(' ') + QString::fromLatin1(trimmed);
+            }
+            continue;
+        }
+        const int colon = trimmed.indexOf(':');
+        const QByteArray name = trimmed.left(colon).trimmed().toLower();
+        field = 0;
+        if (name == "references") {
+            field = references;
+        } else if (name == "in-reply-to") {
+            field = inReplyTo;
+        }
+        if (field) {
+            *field = QString::fromLatin1(trimmed.mid(colon + 1));
+        }
+    }
+    return true;
+}
+
+// The subject without any "Re:" or mailing list prefixes
+static QString baseSubject(const QString &subject, bool *isReply)
+{
+    QString stripped = subject.simplified();
+    if (stripped.startsWith(QLatin1Char('['))) {
+        const int end = stripped.indexOf(QLatin1Char(']'));
+        if (end != -1) {
+            stripped = stripped.mid(end + 1).trimmed();
+        }
+    }
+    *isReply = stripped.startsWith(QLatin1String("re:"), Qt::CaseInsensitive);
+    // mangleReplySubject collapses the prefixes into a single "Re: " and keeps
+    // the list prefix after it
+    QString base = Formatting::mangleReplySubject(stripped).mid(4);
+    if (base.startsWith(QLatin1Char('['))) {
+        const int end = base.indexOf(QLatin1Char(']'));
+        if (end != -1) {
+            base = base.mid(end + 1);
+        }
+    }
+    return base.trimmed().toLower();
+}
+
+static ThreadIndex *s_index = 0;
+
+ThreadIndex *ThreadIndex::instance()
+{
+    if (!s_index) {
+        s_index = new ThreadIndex();
+    }
+    return s_index;
+}
+
+ThreadIndex::ThreadIndex(QObject *parent) : QObject(parent),
+    m_indexTimer(0), m_saveTimer(0), m_dirty(false)
+{
+    m_indexTimer = new QTimer(this);
+    m_indexTimer->setSingleShot(true);
+    m_indexTimer->setInterval(0);
+    connect(m_indexTimer, &QTimer::timeout, this, &ThreadIndex::indexPending);
+
+    m_saveTimer = new QTimer(this);
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(SAVE_DELAY);
+    connect(m_saveTimer, &QTimer::timeout, this, &ThreadIndex::save);
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &ThreadIndex::save);
+
+    connect(QMailStore::instance(), SIGNAL(messagesAdded(QMailMessageIdList)), this, SLOT(handleMessagesAdded(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesRemoved(QMailMessageIdList)), this, SLOT(handleMessagesRemoved(QMailMessageIdList)));
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!load()) {
+        qDebug() << "[ThreadIndex] No usable index, rebuilding";
+    }
+    reconcile();
+    qDebug() << "[ThreadIndex] Ready in" << timer.elapsed() << "ms," << m_pending.size() << "messages to index";
+}
+
+ThreadIndex::~ThreadIndex()
+{
+    save();
+}
+
+ThreadIndex::Conversations ThreadIndex::conversations(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit)
+{
+    // A handful of new messages are most likely what the caller is asking about
+    if (!m_pending.isEmpty() && m_pending.size() <= BATCH_SIZE) {
+        indexPending();
+    }
+    Conversations result;
+    QMailStore *store = QMailStore::instance();
+
+    // Walk the list until the newest message of limit conversations, and
+    // whether there's any more, is known. The first page nearly always has
+    // them, if not the whole list is taken in one query rather than paging
+    // through it with ever larger offsets.
+    QSet<quint64> threads;
+    const int pageSize = limit > 0 ? qMax(PAGE_SIZE, limit * 2) : 0;
+    QMailMessageIdList list = store->queryMessages(key, sortKey, pageSize);
+    int from = 0;
+    bool more = false;
+    forever {
+        for (int i = from; i < list.size(); ++i) {
+            const QMailMessageId &id = list.at(i);
+            const quint64 thread = threadOf(id);
+            if (threads.contains(thread)) {
+                continue;
+            }
+            if (limit > 0 && result.ids.size() == limit) {
+                more = true;
+                break;
+            }
+            threads.insert(thread);
+            result.ids << id;
+        }
+        if (more || pageSize == 0 || from > 0 || list.size() < pageSize) {
+            break;
+        }
+        from = list.size();
+        list = store->queryMessages(key, sortKey);
+    }
+    result.total = result.ids.size() + (more ? 1 : 0);
+    if (result.ids.isEmpty()) {
+        return result;
+    }
+
+    // The index knows every message in those conversations, so one query for
+    // just them gives the counts
+    QHash<quint64, int> rows;
+    rows.reserve(result.ids.size());
+    for (int row = 0; row < result.ids.size(); ++row) {
+        rows.insert(threadOf(result.ids.at(row)), row);
+        result.counts << 0;
+        result.unread << 0;
+    }
+    QMailMessageIdList members;
+    Q_FOREACH(const QMailMessageId &id, result.ids) {
+        const quint32 node = m_nodes.value(id.toULongLong(), NO_NODE);
+        if (node == NO_NODE) {
+            // Not indexed yet, so a conversation by itself
+            members << id;
+            continue;
+        }
+        quint32 member = node;
+        do {
+            if (m_messages.at(member)) {
+                members << QMailMessageId(m_messages.at(member));
+            }
+            member = m_next.at(member);
+        } while (member != node);
+    }
+    const QMailMessageKey::Properties props = QMailMessageKey::Id | QMailMessageKey::Status;
+    Q_FOREACH(const QMailMessageMetaData &meta, store->messagesMetaData(key & QMailMessageKey::id(members), props)) {
+        const int row = rows.value(threadOf(meta.id()), -1);
+        if (row < 0) {
+            continue;
+        }
+        ++result.counts[row];
+        if (!(meta.status() & (QMailMessage::Read | QMailMessage::ReadElsewhere))) {
+            ++result.unread[row];
+        }
+    }
+    return result;
+}
+
+quint64 ThreadIndex::threadOf(const QMailMessageId &id)
+{
+    QHash<quint64, quint32>::const_iterator it = m_nodes.constFind(id.toULongLong());
+    if (it == m_nodes.constEnd()) {
+        // Not indexed yet, so a conversation of it's own
+        return (Q_UINT64_C(1) << 63) | id.toULongLong();
+    }
+    return find(it.value());
+}
+
+QMailMessageId ThreadIndex::parentOf(const QMailMessageId &id) const
+{
+    const quint32 node = m_nodes.value(id.toULongLong(), NO_NODE);
+    if (node == NO_NODE) {
+        return QMailMessageId();
+    }
+    // Skip over anything we only know from references
+    quint32 parent = m_parents.at(node);
+    while (parent != NO_NODE && !m_messages.at(parent)) {
+        parent = m_parents.at(parent);
+    }
+    return parent == NO_NODE ? QMailMessageId() : QMailMessageId(m_messages.at(parent));
+}
+
+void ThreadIndex::save()
+{
+    m_saveTimer->stop();
+    if (!m_dirty) {
+        return;
+    }
+    QSaveFile file(indexFile());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[ThreadIndex] Unable to save" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(INDEX_MAGIC) << qint32(INDEX_VERSION)
+        << m_messages << m_parents << m_sets << m_keys << m_subjects;
+    if (out.status() == QDataStream::Ok && file.commit()) {
+        m_dirty = false;
+    }
+}
+
+void ThreadIndex::handleMessagesAdded(const QMailMessageIdList &ids)
+{
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        if (!m_nodes.contains(id.toULongLong())) {
+            m_pending.insert(id);
+        }
+    }
+    if (!m_pending.isEmpty()) {
+        m_indexTimer->start();
+    }
+}
+
+void ThreadIndex::handleMessagesRemoved(const QMailMessageIdList &ids)
+{
+    QList<quint32> emptied;
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        QHash<quint64, quint32>::iterator it = m_nodes.find(id.toULongLong());
+        if (it != m_nodes.end()) {
+            // The node stays as a placeholder so the rest of the conversation holds together
+            m_messages[it.value()] = 0;
+            emptied << it.value();
+            m_nodes.erase(it);
+            m_dirty = true;
+        } else {
+            m_pending.remove(id);
+        }
+    }
+    release(emptied);
+    scheduleSave();
+}
+
+void ThreadIndex::indexPending()
+{
+    TRACE_SPAN("ThreadIndex::indexPending");
+    QMailMessageIdList batch;
+    QSet<QMailMessageId>::iterator it = m_pending.begin();
+    while (it != m_pending.end() && batch.size() < BATCH_SIZE) {
+        batch << *it;
+        it = m_pending.erase(it);
+    }
+    const QMailMessageKey::Properties props = QMailMessageKey::Id | QMailMessageKey::Subject | QMailMessageKey::RfcId
+            | QMailMessageKey::ContentScheme | QMailMessageKey::ContentIdentifier;
+    Q_FOREACH(const QMailMessageMetaData &meta, QMailStore::instance()->messagesMetaData(QMailMessageKey::id(batch), props)) {
+        QString references;
+        QString inReplyTo;
+        if (!readThreadHeaders(meta, &references, &inReplyTo)) {
+            // Stored somewhere we can't peek at, so take the slow way
+            const QMailMessage msg(meta.id());
+            references = msg.headerFieldText(QStringLiteral("References"));
+            inReplyTo = msg.headerFieldText(QStringLiteral("In-Reply-To"));
+        }
+        index(meta, referencesOf(references, inReplyTo));
+    }
+    if (!m_pending.isEmpty()) {
+        m_indexTimer->start();
+    }
+    scheduleSave();
+}
+
+bool ThreadIndex::load()
+{
+    QFile file(indexFile());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0;
+    qint32 version = 0;
+    in >> magic >> version;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        return false;
+    }
+    in >> m_messages >> m_parents >> m_sets >> m_keys >> m_subjects;
+    if (in.status() != QDataStream::Ok || m_parents.size() != m_messages.size() || m_sets.size() != m_messages.size()) {
+        m_messages.clear();
+        m_parents.clear();
+        m_sets.clear();
+        m_keys.clear();
+        m_subjects.clear();
+        return false;
+    }
+    m_nodes.reserve(m_messages.size());
+    for (int node = 0; node < m_messages.size(); ++node) {
+        if (m_messages.at(node)) {
+            m_nodes.insert(m_messages.at(node), node);
+        }
+    }
+    // The rings aren't saved, every node rejoins the ring of its set
+    m_next.resize(m_messages.size());
+    QHash<quint32, quint32> last; // root -> node last added to its ring
+    for (int node = 0; node < m_sets.size(); ++node) {
+        if (m_sets.at(node) == NO_NODE) {
+            m_next[node] = NO_NODE;
+            m_free << node;
+            continue;
+        }
+        const quint32 root = find(node);
+        if (quint32(node) == root) {
+            m_next[node] = node;
+            last.insert(root, node);
+            continue;
+        }
+        // Roots are always the lowest node of their set, so already seen
+        const quint32 previous = last.value(root);
+        m_next[node] = m_next.at(previous);
+        m_next[previous] = node;
+        last.insert(root, node);
+    }
+    return true;
+}
+
+void ThreadIndex::reconcile()
+{
+    // Catch up with whatever happened to the store while we weren't running
+    const QMailMessageIdList ids = QMailStore::instance()->queryMessages(QMailMessageKey::messageType(QMailMessage::Email));
+    QSet<quint64> inStore;
+    inStore.reserve(ids.size());
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        inStore.insert(id.toULongLong());
+        if (!m_nodes.contains(id.toULongLong())) {
+            m_pending.insert(id);
+        }
+    }
+    QList<quint32> emptied;
+    QHash<quint64, quint32>::iterator it = m_nodes.begin();
+    while (it != m_nodes.end()) {
+        if (!inStore.contains(it.key())) {
+            m_messages[it.value()] = 0;
+            emptied << it.value();
+            it = m_nodes.erase(it);
+            m_dirty = true;
+        } else {
+            ++it;
+        }
+    }
+    release(emptied);
+    if (!m_pending.isEmpty()) {
+        m_indexTimer->start();
+    }
+}
+
+void ThreadIndex::index(const QMailMessageMetaData &meta, const QStringList &refs)
+{
+    const quint64 id = meta.id().toULongLong();
+    if (m_nodes.contains(id)) {
+        return;
+    }
+    const QString messageId = meta.rfcId();
+    quint32 node = messageId.isEmpty() ? newNode() : nodeFor(keyOf(messageId));
+    if (m_messages.at(node)) {
+        // Another copy of the same message, e.g. in sent and in the inbox
+        const quint32 copy = newNode();
+        m_parents[copy] = m_parents.at(node);
+        merge(copy, node);
+        node = copy;
+    }
+    m_messages[node] = id;
+    m_nodes.insert(id, node);
+
+    // Link the references into a chain of ancestors, without overriding what
+    // an earlier message already said about a node or creating a loop
+    quint32 previous = NO_NODE;
+    Q_FOREACH(const QString &ref, refs) {
+        const quint32 refNode = nodeFor(keyOf(ref));
+        if (refNode == node) {
+            continue;
+        }
+        if (previous != NO_NODE && m_parents.at(refNode) == NO_NODE && !isAncestor(refNode, previous)) {
+            m_parents[refNode] = previous;
+        }
+        merge(refNode, node);
+        previous = refNode;
+    }
+    if (previous != NO_NODE && !isAncestor(node, previous)) {
+        m_parents[node] = previous;
+    }
+
+    bool isReply = false;
+    const QString base = baseSubject(meta.subject(), &isReply);
+    if (!base.isEmpty()) {
+        const quint64 subjectKey = hashOf(base.toUtf8());
+        QHash<quint64, quint32>::const_iterator it = m_subjects.constFind(subjectKey);
+        if (it == m_subjects.constEnd()) {
+            m_subjects.insert(subjectKey, node);
+        } else if (refs.isEmpty() && isReply) {
+            merge(node, it.value());
+        }
+    }
+    m_dirty = true;
+}
+
+quint32 ThreadIndex::nodeFor(const quint64 &key)
+{
+    QHash<quint64, quint32>::const_iterator it = m_keys.constFind(key);
+    if (it != m_keys.constEnd()) {
+        return it.value();
+    }
+    const quint32 node = newNode();
+    m_keys.insert(key, node);
+    return node;
+}
+
+quint32 ThreadIndex::newNode()
+{
+    if (!m_free.isEmpty()) {
+        const quint32 node = m_free.takeLast();
+        m_sets[node] = node;
+        m_next[node] = node;
+        return node;
+    }
+    const quint32 node = m_messages.size();
+    m_messages.append(0);
+    m_parents.append(NO_NODE);
+    m_sets.append(node);
+    m_next.append(node);
+    return node;
+}
+
+void ThreadIndex::release(const QList<quint32> &emptied)
+{
+    // A conversation with none of its messages left in the store is only
+    // placeholders. Nothing reaches them but a later message's references,
+    // and those make new nodes as needed.
+    QSet<quint32> released;
+    Q_FOREACH(const quint32 &node, emptied) {
+        if (m_sets.at(node) == NO_NODE) {
+            continue; // went with an earlier one
+        }
+        bool empty = true;
+        quint32 member = node;
+        do {
+            if (m_messages.at(member)) {
+                empty = false;
+                break;
+            }
+            member = m_next.at(member);
+        } while (member != node);
+        if (!empty) {
+            continue;
+        }
+        member = node;
+        do {
+            const quint32 next = m_next.at(member);
+            m_parents[member] = NO_NODE;
+            m_sets[member] = NO_NODE;
+            m_next[member] = NO_NODE;
+            m_free << member;
+            released.insert(member);
+            member = next;
+        } while (member != node);
+    }
+    if (released.isEmpty()) {
+        return;
+    }
+    // Nodes don't know their keys, so one pass drops them all
+    QHash<quint64, quint32>::iterator it = m_keys.begin();
+    while (it != m_keys.end()) {
+        if (released.contains(it.value())) {
+            it = m_keys.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    it = m_subjects.begin();
+    while (it != m_subjects.end()) {
+        if (released.contains(it.value())) {
+            it = m_subjects.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_dirty = true;
+}
+
+quint32 ThreadIndex::find(quint32 node)
+{
+    quint32 root = node;
+    while (m_sets.at(root) != root) {
+        root = m_sets.at(root);
+    }
+    while (m_sets.at(node) != root) {
+        const quint32 next = m_sets.at(node);
+        m_sets[node] = root;
+        node = next;
+    }
+    return root;
+}
+
+void ThreadIndex::merge(const quint32 a, const quint32 b)
+{
+    const quint32 rootA = find(a);
+    const quint32 rootB = find(b);
+    if (rootA != rootB) {
+        // The lowest node names the conversation
+        m_sets[qMax(rootA, rootB)] = qMin(rootA, rootB);
+        // Swapping one link from each joins the two rings into one
+        qSwap(m_next[rootA], m_next[rootB]);
+    }
+}
+
+bool ThreadIndex::isAncestor(const quint32 ancestor, quint32 node) const
+{
+    while (node != NO_NODE) {
+        if (node == ancestor) {
+            return true;
+        }
+        node = m_parents.at(node);
+    }
+    return false;
+}
+
+void ThreadIndex::scheduleSave()
+{
+    if (m_dirty && !m_saveTimer->isActive()) {
+        m_saveTimer->start();
+    }
+}
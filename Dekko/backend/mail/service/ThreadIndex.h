@@ -0,0 +1,118 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef THREADINDEX_H
+#define THREADINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QVector>
+#include <qmailmessage.h>
+#include <qmailmessagekey.h>
+#include <qmailmessagesortkey.h>
+
+class QTimer;
+
+/** @short Groups the messages in the store into conversations
+ *
+ * Threads are built the JWZ way from the Message-ID, In-Reply-To and References
+ * headers. Every id seen gets a node, a message's references become it's chain
+ * of ancestors and everything linked ends up in the same conversation. Replies
+ * without any references fall back to joining the conversation started under
+ * the same subject, with reply and mailing list prefixes removed.
+ *
+ * Messages are indexed as they're added to the store, in small batches so the
+ * worker stays responsive, and the index is saved to the cache so headers only
+ * ever have to be read once per message. Message-IDs and subjects are kept as
+ * 64 bit hashes so even a 100k message store stays a few MB. Each conversation
+ * is also a ring of its nodes, so its members are found without looking at
+ * the rest, and its nodes are reused once none of its messages are left in
+ * the store.
+ *
+ * Lives in the worker, all methods must be called from the worker's thread.
+ */
+class ThreadIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Conversations {
+        Conversations() : total(0) {}
+        // Newest message of each conversation, in the order asked for
+        QMailMessageIdList ids;
+        // Messages and unread messages matching the key in each conversation
+        QList<int> counts;
+        QList<int> unread;
+        // Conversations returned, plus one if there are more past the limit
+        int total;
+    };
+
+    /** @short The worker's index, created on first use */
+    static ThreadIndex *instance();
+
+    /** @short Conversations with a message matching \param key
+     *
+     * Messages not yet indexed are returned as conversations of their own.
+     */
+    Conversations conversations(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, const int &limit);
+
+    /** @short Conversation the message belongs to, only meaningful for comparing */
+    quint64 threadOf(const QMailMessageId &id);
+    /** @short The message \param id is a reply to, invalid for the first message or if it isn't in the store */
+    QMailMessageId parentOf(const QMailMessageId &id) const;
+
+public slots:
+    void save();
+
+private slots:
+    void handleMessagesAdded(const QMailMessageIdList &ids);
+    void handleMessagesRemoved(const QMailMessageIdList &ids);
+    void indexPending();
+
+private:
+    explicit ThreadIndex(QObject *parent = 0);
+    ~ThreadIndex();
+
+    bool load();
+    void reconcile();
+    void index(const QMailMessageMetaData &meta, const QStringList &refs);
+    quint32 nodeFor(const quint64 &key);
+    quint32 newNode();
+    void release(const QList<quint32> &emptied);
+    quint32 find(quint32 node);
+    void merge(const quint32 a, const quint32 b);
+    bool isAncestor(const quint32 ancestor, quint32 node) const;
+    void scheduleSave();
+
+    // Per node, a node is either a message or a Message-ID only seen in references
+    QVector<quint64> m_messages; // 0 if no message in the store has it
+    QVector<quint32> m_parents;  // thread tree
+    QVector<quint32> m_sets;     // union-find, the set is the conversation, NO_NODE once freed
+    QVector<quint32> m_next;     // ring through every node of the set, rebuilt on load
+    QList<quint32> m_free;       // nodes released for reuse
+    QHash<quint64, quint32> m_keys;     // Message-ID hash -> node
+    QHash<quint64, quint32> m_subjects; // base subject hash -> first node seen with it
+    QHash<quint64, quint32> m_nodes;    // message id -> node
+
+    QSet<QMailMessageId> m_pending;
+    QTimer *m_indexTimer;
+    QTimer *m_saveTimer;
+    bool m_dirty;
+};
+
+#endif // THREADINDEX_H
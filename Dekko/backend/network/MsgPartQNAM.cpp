@@ -23,6 +23,7 @@
 #include "MsgPartReply.h"
 #include "MsgReply.h"
 #include "ForbiddenReply.h"
+#include <MessageCache.h>
 
 const QStringList Allowed::urlSchemes = QStringList() << QStringLiteral("dekko-msg")
                                                       << QStringLiteral("dekko-part")
@@ -73,8 +74,11 @@ QNetworkReply *MsgPartQNAM::createRequest(QNetworkAccessManager::Operation op, c
     }
 
     if (scheme == QStringLiteral("cid")) {
-        QString cidPath = request.url().path();
-        return new MsgPartReply(this, messageId, cidPath);
+        const QString location = MessageCache::instance()->locationForContentId(messageId, request.url().path());
+        if (location.isEmpty()) {
+            return new ForbiddenReply(this, QStringLiteral("Failed to find cid part"));
+        }
+        return new MsgPartReply(this, messageId, location, false, false);
     } else if (scheme == QStringLiteral("dekko-part")) { // implies we have a location qeury
         if (!query.hasQueryItem(QStringLiteral("location"))) {
             qDebug() << "dekko-part missing location query item";
@@ -19,25 +19,6 @@
 #include <Formatting.h>
 #include <QTimer>
 
-MsgPartReply::MsgPartReply(MsgPartQNAM *parent, const QMailMessageId &id, const QString &cidUrl):
-    QNetworkReply(parent), formattedBufferContent(0), m_msgId(id), m_ptext(false), m_format(false),
-    m_part(0)
-{
-    if (!cidToPart(QMailMessage(m_msgId), cidUrl)) {
-        failed(QStringLiteral("Failed to find cid part"));
-        return;
-    }
-    m_part = new Part(m_msgId, m_location);
-    if (m_part->partPtr()->contentID().isEmpty()) {
-        qDebug() << "MISSING CONTENT ID";
-        failed(QStringLiteral("Missing content id"));
-        return;
-    }
-    init();
-    buffer.setBuffer(formattedBufferContent);
-    buffer.open(QIODevice::ReadOnly);
-}
-
 MsgPartReply::MsgPartReply(MsgPartQNAM *parent, const QMailMessageId &id,
                            const QString &location, const bool plaintext,
                            const bool requiresFormatting) :
@@ -74,23 +55,14 @@ void MsgPartReply::init()
                     this, SLOT(handleMsgPartAvailable(quint64,QString)));
             connect(Client::instance(), SIGNAL(messagePartFetchFailed(quint64,QString)),
                     this, SLOT(handlePartFetchFailed(quint64,QString)));
+            connect(Client::instance(), SIGNAL(fetchProgress(quint64,QString,uint,uint)),
+                    this, SLOT(handleFetchProgress(quint64,QString,uint,uint)));
             // Request the download now
             // If it's already fetched then "Client" will emit the messagePartNowAvailable immediately
             Client::instance()->downloadMessagePart(m_part->partPtr());
-            // just fudge download progress for now
-            emit downloadProgress(1000, 2000);
         }
-    }
-}
-
-bool MsgPartReply::cidToPart(const QMailMessage &message, const QString &cidUrl) {
-
-    CidPartDetector d(cidUrl);
-    if (!message.foreachPart<CidPartDetector &>(d)) {
-        m_location = d.location;
-        return true;
     } else {
-        return false;
+        failed(QStringLiteral("No part at location: %1").arg(m_location));
     }
 }
 
@@ -127,9 +99,7 @@ void MsgPartReply::failed(const QString &reason)
 
 void MsgPartReply::handleMsgPartAvailable(const quint64 &id, const QString &location)
 {
-    QMailMessageId receivedId(id);
-    if (receivedId.toULongLong() != m_part->partPtr()->location().containingMessageId().toULongLong()
-            || location != m_part->partPtr()->location().toString(true)) {
+    if (id != m_msgId.toULongLong() || location != m_location) {
         qDebug() << "[MsgPartReply]" << __func__ << "Part not available... waiting";
         return;
     }
@@ -138,24 +108,32 @@ void MsgPartReply::handleMsgPartAvailable(const quint64 &id, const QString &loca
     delete m_part;
     m_part = 0;
     m_part = new Part(m_msgId, m_location);
+    if (!m_part->partPtr()) {
+        failed(QStringLiteral("Part missing after fetch: %1").arg(location));
+        return;
+    }
     messageReady();
 }
 
 void MsgPartReply::handlePartFetchFailed(const quint64 &id, const QString &location)
 {
-    QMailMessageId receivedId(id);
-    if (receivedId.toULongLong() != m_part->partPtr()->location().containingMessageId().toULongLong()
-            || location != m_part->partPtr()->location().toString(true)) {
+    if (id != m_msgId.toULongLong() || location != m_location) {
         qDebug() << "[MsgPartReply]" << __func__ << "Part not available... waiting";
         return;
     }
     failed(QStringLiteral("Failed fetching part: %1").arg(location));
 }
 
+void MsgPartReply::handleFetchProgress(const quint64 &id, const QString &location, const uint &value, const uint &total)
+{
+    if (id != m_msgId.toULongLong() || location != m_location) {
+        return;
+    }
+    emit downloadProgress(value, total);
+}
+
 void MsgPartReply::messageReady()
 {
-    // Woohoo
-    emit downloadProgress(2000, 2000);
     const QMailMessagePart *part = m_part->partPtr();
     QByteArray data;
     QMailMessageContentType ct = part->contentType();
@@ -177,6 +155,8 @@ void MsgPartReply::messageReady()
         setHeader(QNetworkRequest::ContentTypeHeader, ct.content());
     }
     formattedBufferContent = new QByteArray(data);
+    // Woohoo
+    emit downloadProgress(data.size(), data.size());
     buffer.close();
     secondBuffer = new QByteArray(data);
     buffer.setBuffer(secondBuffer);
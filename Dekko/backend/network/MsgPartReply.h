@@ -24,43 +24,13 @@
 #include <qmailstore.h>
 #include <qmailmessage.h>
 #include <MailServiceClient.h>
+#include <MessageCache.h>
 #include "MsgPartQNAM.h"
 
-struct PartFinder {
-    QString location;
-    const QMailMessagePart *part;
-    PartFinder() {}
-    PartFinder(const QString &location) : location(location) {}
-
-    bool operator()(const QMailMessagePart &p) {
-        const bool isPart = (p.location().toString(true) == location);
-        if (isPart) {
-            part = const_cast<QMailMessagePart *>(&p);
-        }
-        return !isPart; // Has to be false to exit the foreachPart
-    }
-};
-
-struct CidPartDetector {
-    QString cid;
-    QString location;
-
-    CidPartDetector(const QString &cid) : cid(cid) {}
-
-    bool operator()(const QMailMessagePart &part) {
-        const bool isPart = (part.contentID() == QUrl(cid).path());
-        if (isPart) {
-            location = part.location().toString(true);
-        }
-        return !isPart; // Has to be false to exit the foreachPart
-    }
-};
-
 class MsgPartReply : public QNetworkReply
 {
     Q_OBJECT
 public:
-    MsgPartReply(MsgPartQNAM *parent, const QMailMessageId &id, const QString &cidUrl);
     MsgPartReply(MsgPartQNAM *parent, const QMailMessageId &id, const QString &location,
                  const bool plaintext, const bool requiresFormatting);
     ~MsgPartReply();
@@ -81,29 +51,28 @@ public slots:
 
     void handleMsgPartAvailable(const quint64 &id, const QString &location);
     void handlePartFetchFailed(const quint64 &id, const QString &location);
+    void handleFetchProgress(const quint64 &id, const QString &location, const uint &value, const uint &total);
 
     void messageReady();
     void init();
-protected:
-    bool cidToPart(const QMailMessage &message, const QString &cidUrl);
 private:
     // Container to hold our msgpart pointer.
+    // The part lives in the shared parsed message so keep a reference on that.
     class Part {
     public:
-        Part(const QMailMessageId &id, const QString &location) : m_finder(0), m_msg(id) {
-            m_finder = PartFinder(location);
-            m_msg.foreachPart<PartFinder &>(m_finder);
-        }
+        Part(const QMailMessageId &id, const QString &location) :
+            m_msg(MessageCache::instance()->message(id)), m_part(m_msg->partAt(location)) {}
+
         const QMailMessage parentMessage() {
-            return m_msg;
+            return m_msg->message();
         }
 
         const QMailMessagePart *partPtr() {
-            return m_finder.part;
+            return m_part;
         }
     private:
-        PartFinder m_finder;
-        QMailMessage m_msg;
+        ParsedMessagePtr m_msg;
+        const QMailMessagePart *m_part;
     };
 
     QByteArray *formattedBufferContent;
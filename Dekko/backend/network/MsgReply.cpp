@@ -18,9 +18,10 @@
 #include "MsgReply.h"
 #include <QTimer>
 #include <Formatting.h>
+#include <MessageCache.h>
 
 MsgReply::MsgReply(MsgPartQNAM *parent, QMailMessageId &msgId):
-    QNetworkReply(parent), formattedBufferContent(0), m_id(msgId), m_msg(msgId), m_format(false)
+    QNetworkReply(parent), formattedBufferContent(0), m_id(msgId), m_msg(MessageCache::instance()->message(msgId)->message()), m_format(false)
 {
     init();
     buffer.setBuffer(formattedBufferContent);
@@ -28,7 +29,7 @@ MsgReply::MsgReply(MsgPartQNAM *parent, QMailMessageId &msgId):
 }
 
 MsgReply::MsgReply(MsgPartQNAM *parent, QMailMessageId &msgId, const bool requiresFormatting) :
-    QNetworkReply(parent), formattedBufferContent(0), m_id(msgId), m_msg(msgId), m_format(requiresFormatting)
+    QNetworkReply(parent), formattedBufferContent(0), m_id(msgId), m_msg(MessageCache::instance()->message(msgId)->message()), m_format(requiresFormatting)
 {
     init();
     buffer.setBuffer(formattedBufferContent);
@@ -74,6 +75,8 @@ void MsgReply::handleMsgsAvailable(const QMailMessageIdList &list)
     if (!list.contains(m_id)) {
         return;
     }
+    // Reload, we only had the metadata when this reply was created
+    m_msg = MessageCache::instance()->message(m_id)->message();
     messageReady();
 }
 
@@ -85,10 +88,16 @@ void MsgReply::handleFetchFailed(const QMailMessageIdList &list)
     failed(QStringLiteral("Failed downloading message"));
 }
 
+void MsgReply::handleFetchProgress(const quint64 &id, const QString &location, const uint &value, const uint &total)
+{
+    if (id != m_id.toULongLong() || !location.isEmpty()) {
+        return;
+    }
+    emit downloadProgress(value, total);
+}
+
 void MsgReply::messageReady()
 {
-    // Woohoo
-    emit downloadProgress(2000, 2000);
     QByteArray data = m_msg.body().data().toUtf8();
     QMailMessageContentType ct = m_msg.body().contentType();
     if (m_format) {
@@ -104,6 +113,8 @@ void MsgReply::messageReady()
         setHeader(QNetworkRequest::ContentTypeHeader, ct.content());
     }
     formattedBufferContent = new QByteArray(data.data());
+    // Woohoo
+    emit downloadProgress(data.size(), data.size());
     setFinished(true);
     QTimer::singleShot( 0, this, SIGNAL(readyRead()) );
     QTimer::singleShot( 0, this, SIGNAL(finished()) );
@@ -127,10 +138,11 @@ void MsgReply::init()
                 this, SLOT(handleMsgsAvailable(QMailMessageIdList)));
         connect(Client::instance(), SIGNAL(messageFetchFailed(QMailMessageIdList)),
                 this, SLOT(handleFetchFailed(QMailMessageIdList)));
+        connect(Client::instance(), SIGNAL(fetchProgress(quint64,QString,uint,uint)),
+                this, SLOT(handleFetchProgress(quint64,QString,uint,uint)));
         // Request the download now
         // If it's already fetched then "Client" will emit the messagePartNowAvailable immediately
         Client::instance()->downloadMessage(m_id);
-        emit downloadProgress(1000, 2000);
     }
 
 }
@@ -48,6 +48,7 @@ public slots:
 
     void handleMsgsAvailable(const QMailMessageIdList &list);
     void handleFetchFailed(const QMailMessageIdList &list);
+    void handleFetchProgress(const quint64 &id, const QString &location, const uint &value, const uint &total);
 
     void messageReady();
     void init();
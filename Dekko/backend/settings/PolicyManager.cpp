@@ -25,6 +25,7 @@ PolicyManager::PolicyManager(QObject *parent) : QObject(parent)
     // Maintain instances of global policies
     m_privacy = new PrivacyPolicy(this);
     m_view = new ViewPolicy(this);
+    m_storage = new StoragePolicy(this);
 }
 
 static QPointer<PolicyManager> s_mgr;
@@ -66,6 +67,11 @@ ViewPolicy *PolicyManager::viewPolicy()
     return m_view;
 }
 
+StoragePolicy *PolicyManager::storagePolicy()
+{
+    return m_storage;
+}
+
 void PolicyManager::setDefaultPolicies(const int &accountId) {
     setDefaultPolicies(QMailAccountId(accountId));
 }
@@ -32,6 +32,7 @@ class PolicyManager : public QObject
     Q_OBJECT
     Q_PROPERTY(PrivacyPolicy *privacy READ privacyPolicy CONSTANT)
     Q_PROPERTY(ViewPolicy *views READ viewPolicy CONSTANT)
+    Q_PROPERTY(StoragePolicy *storage READ storagePolicy CONSTANT)
 public:
     explicit PolicyManager(QObject *parent = 0);
 
@@ -73,6 +74,12 @@ public:
      */
     ViewPolicy *viewPolicy();
 
+    /**
+     * @brief Retrieve the StoragePolicy for this user
+     * @return StoragePolicy
+     */
+    StoragePolicy *storagePolicy();
+
     /**
      * @brief Set the default policies for \param accountId
      * @param QMailAccountId::toULongLong()
@@ -89,6 +96,7 @@ public:
 private:
     QPointer<PrivacyPolicy> m_privacy;
     QPointer<ViewPolicy> m_view;
+    QPointer<StoragePolicy> m_storage;
 };
 
 #endif // POLICYMANAGER_H
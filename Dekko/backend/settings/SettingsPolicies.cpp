@@ -17,6 +17,7 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 **************************************************************************/
 #include "SettingsPolicies.h"
+#include <CacheManager.h>
 
 int AccountPolicy::accountId() const { return m_accountId.toULongLong(); }
 
@@ -332,3 +333,51 @@ void ViewPolicy::setDefaults() {
     setPreviewLines(2);
     write("defaults_created", true);
 }
+
+StoragePolicy::StoragePolicy(QObject *parent) : GlobalPolicy(parent) {
+    connect(this, &StoragePolicy::dataChanged, this, &StoragePolicy::policyChanged);
+    connect(this, &StoragePolicy::policyChanged, this, &StoragePolicy::applyCacheBudgets);
+    setSettingsKey(QStringLiteral("storage"));
+    applyCacheBudgets();
+}
+
+int StoragePolicy::attachmentCacheSize()
+{
+    return readPolicy(QStringLiteral("cache.attachments.size")).toInt();
+}
+
+void StoragePolicy::setAttachmentCacheSize(const int &size)
+{
+    static int minSize = 10;
+
+    setPolicy(QStringLiteral("cache.attachments.size"), QString::number(qMax(minSize, size)));
+}
+
+int StoragePolicy::imageCacheSize()
+{
+    return readPolicy(QStringLiteral("cache.images.size")).toInt();
+}
+
+void StoragePolicy::setImageCacheSize(const int &size)
+{
+    static int minSize = 5;
+
+    setPolicy(QStringLiteral("cache.images.size"), QString::number(qMax(minSize, size)));
+}
+
+void StoragePolicy::applyCacheBudgets()
+{
+    static const qint64 mb = 1024 * 1024;
+
+    CacheManager::instance()->setBudget(QStringLiteral("attachments"), attachmentCacheSize() * mb);
+    CacheManager::instance()->setBudget(QStringLiteral("images"), imageCacheSize() * mb);
+}
+
+void StoragePolicy::setDefaults() {
+    if (read("defaults_created").toBool()) {
+        return;
+    }
+    setAttachmentCacheSize(250);
+    setImageCacheSize(50);
+    write("defaults_created", true);
+}
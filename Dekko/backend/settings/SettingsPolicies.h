@@ -209,6 +209,48 @@ protected:
     }
 };
 
+class StoragePolicy : public GlobalPolicy
+{
+    Q_OBJECT
+    /**
+     * @brief Maximum size in MB of the downloaded attachments cache
+     *
+     * The least recently opened attachments are removed once this is exceeded.
+     *
+     * @accessors %attachmentCacheSize(), setAttachmentCacheSize()
+     */
+    Q_PROPERTY(int attachmentCacheSize READ attachmentCacheSize WRITE setAttachmentCacheSize NOTIFY policyChanged)
+    /**
+     * @brief Maximum size in MB of the cached avatars and rendered icons
+     * @accessors %imageCacheSize(), setImageCacheSize()
+     */
+    Q_PROPERTY(int imageCacheSize READ imageCacheSize WRITE setImageCacheSize NOTIFY policyChanged)
+public:
+    explicit StoragePolicy(QObject *parent = 0);
+
+    int attachmentCacheSize();
+    void setAttachmentCacheSize(const int &size);
+
+    int imageCacheSize();
+    void setImageCacheSize(const int &size);
+
+signals:
+    void policyChanged();
+
+private slots:
+    // Hand the budgets to the CacheManager
+    void applyCacheBudgets();
+    // PolicyInterface interface
+public:
+    virtual void setDefaults() override;
+
+    // SettingsObjectBase interface
+protected:
+    virtual void createDefaultsIfNotExist() override {
+        setDefaults();
+    }
+};
+
 /**
  * @brief The AccountPolicy class
  */
@@ -20,15 +20,18 @@
 #include <QtQml/QQmlContext>
 #include <SettingsPolicies.h>
 #include <PolicyManager.h>
+#include <CacheManager.h>
 
 void SettingsPlugin::registerTypes(const char *uri)
 {
     Q_ASSERT(uri == QLatin1String("Dekko.Mail.Settings"));
     // @uri Dekko.Mail.Settings
     qmlRegisterSingletonType<PolicyManager>(uri, 1, 0, "PolicyManager", PolicyManager::factory);
+    qmlRegisterSingletonType<CacheManager>(uri, 1, 0, "CacheManager", CacheManager::factory);
     qmlRegisterType<MailPolicy>(uri, 1, 0, "MailPolicy");
     qmlRegisterType<PrivacyPolicy>(uri, 1, 0, "PrivacyPolicy");
     qmlRegisterType<ViewPolicy>(uri, 1, 0, "ViewPolicy");
+    qmlRegisterType<StoragePolicy>(uri, 1, 0, "StoragePolicy");
     qmlRegisterUncreatableType<AccountPolicy>(uri, 1, 0, "AccountPolicy", "Cannot be created in qml");
     qmlRegisterUncreatableType<GlobalPolicy>(uri, 1, 0, "GlobalPolicy", "Cannot be created in qml");
     qmlRegisterInterface<PolicyInterface>("PolicyInterface");
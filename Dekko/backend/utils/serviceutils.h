@@ -45,6 +45,7 @@ inline QByteArray msg_sort_key_bytes(const QMailMessageSortKey &key) {
 
 inline QMailMessageIdList from_dbus_msglist(const QList<quint64> &ids) {
     QMailMessageIdList list;
+    list.reserve(ids.size());
     foreach(const quint64 &id, ids) {
         QMailMessageId msgId(id);
         list << msgId;
@@ -33,6 +33,7 @@
 #include <QFuture>
 #include <QtQuick>
 #include <Paths.h>
+#include <CacheManager.h>
 
 
 QString ImageHelper::s_basePath;
@@ -51,6 +52,7 @@ ImageHelper::ImageHelper(QObject *parent) :
     }
     if (s_cachePath.isEmpty()) {
         ImageHelper::s_cachePath = (Paths::standardCacheLocation() % "/.ImageCache");
+        CacheManager::instance()->registerCache(QStringLiteral("images"), ImageHelper::s_cachePath);
     }
 
     connect(this, &ImageHelper::gravatarEmailChanged, [=]() {
@@ -147,11 +149,13 @@ void ImageHelper::setGravatarUrl(const QUrl &gravurl)
     }
     QString avatarCache(s_cachePath % "/" % m_gravatarEmail % QString::number(m_size) % ".png");
     if (QFile::exists(avatarCache)) {
+        CacheManager::instance()->accessed(avatarCache);
         if (m_property.isValid() && m_property.isWritable()) {
             m_property.write(QUrl::fromLocalFile(avatarCache));
         }
     } else {
         if (!m_requestSent) {
+            CacheManager::instance()->missed(QStringLiteral("images"));
             m_nam = new QNetworkAccessManager(this);
             connect(m_nam, SIGNAL(finished(QNetworkReply*)), this, SLOT(finished(QNetworkReply*)));
             QNetworkRequest request(m_gravatarUrl);
@@ -244,7 +248,9 @@ QUrl SvgToPngWorker::convertSvgToPng(const int &size, const qreal &h, const qrea
                         }
                     }
                     QDir().mkpath(m_cachePath);
-                    image.save(cachedPath, "PNG", 0);
+                    if (image.save(cachedPath, "PNG", 0)) {
+                        CacheManager::instance()->inserted(QStringLiteral("images"), cachedPath);
+                    }
                     url = QUrl::fromLocalFile(cachedPath);
                 }
             }
@@ -253,6 +259,7 @@ QUrl SvgToPngWorker::convertSvgToPng(const int &size, const qreal &h, const qrea
             }
         }
         else {
+            CacheManager::instance()->accessed(cachedPath);
             url = QUrl::fromLocalFile(cachedPath);
         }
     }
@@ -272,6 +279,7 @@ QUrl GravatarWorker::saveGravatar(const QByteArray &reply, const QString &path)
         return QUrl();
     }
     if (img->save(path, "PNG", 0)) {
+        CacheManager::instance()->inserted(QStringLiteral("images"), path);
         return QUrl::fromLocalFile(path);
     }
     return QUrl();
@@ -0,0 +1,120 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "folderfetcher.h"
+#include <QDebug>
+
+// Messages per FETCH, and FETCH commands in flight at once
+#define FETCH_BATCH 250
+#define FETCH_WINDOW 4
+
+FolderFetcher::FolderFetcher(const QMailAccountId &account, const Endpoint &endpoint, const QList<QPair<QMailFolderId, QString> > &folders,
+                             const int depth, QObject *parent)
+    : ImapConnection(account, endpoint, parent),
+      _folders(folders),
+      _depth(depth),
+      _exists(0),
+      _first(1),
+      _next(0),
+      _failed(false)
+{
+    // Headers are passed on untouched
+    setKeepLiterals(true);
+}
+
+void FolderFetcher::authenticated()
+{
+    nextFolder();
+}
+
+void FolderFetcher::nextFolder()
+{
+    if (_folders.isEmpty()) {
+        emit finished();
+        return;
+    }
+
+    const QPair<QMailFolderId, QString> folder = _folders.takeFirst();
+    _folder = folder.first;
+    _exists = 0;
+    _failed = false;
+    _examineTag = send("EXAMINE " + quoted(folder.second));
+}
+
+void FolderFetcher::untagged(const QByteArray &line)
+{
+    const int space = line.indexOf(' ');
+    if (space == -1)
+        return;
+
+    if (!_examineTag.isEmpty()) {
+        if (line.mid(space + 1).toUpper().startsWith("EXISTS"))
+            _exists = line.left(space).toInt();
+        return;
+    }
+
+    if (line.mid(space + 1, 6).toUpper() == "FETCH ") {
+        _responses.append(line);
+        _headers.append(literals().value(0));
+    }
+}
+
+void FolderFetcher::tagged(const QByteArray &tag, const bool ok, const QByteArray &line)
+{
+    if (tag == _examineTag) {
+        _examineTag.clear();
+        if (!ok || _exists == 0) {
+            nextFolder();
+            return;
+        }
+        _first = (_depth < 0) ? 1 : qMax(1, _exists - _depth + 1);
+        _next = _exists;
+        fetchMore();
+        return;
+    }
+
+    if (!_inFlight.remove(tag))
+        return;
+
+    if (!ok && !_failed) {
+        // Nothing more is asked for, what's still in flight is dropped
+        qWarning() << "FETCH in folder" << _folder.toULongLong() << "failed:" << line;
+        _failed = true;
+        _next = _first - 1;
+        emit incomplete(_folder);
+    }
+
+    // Responses come back in the order the commands went out, so all of
+    // this range has arrived
+    if (!_responses.isEmpty() && !_failed)
+        emit fetched(_folder, _responses, _headers);
+    _responses.clear();
+    _headers.clear();
+    fetchMore();
+    if (_inFlight.isEmpty())
+        nextFolder();
+}
+
+void FolderFetcher::fetchMore()
+{
+    while (_inFlight.size() < FETCH_WINDOW && _next >= _first) {
+        const int low = qMax(_first, _next - FETCH_BATCH + 1);
+        _inFlight.insert(send("FETCH " + QByteArray::number(low) + ':' + QByteArray::number(_next)
+                              + " (UID FLAGS INTERNALDATE RFC822.SIZE BODY.PEEK[HEADER])"));
+        _next = low - 1;
+    }
+}
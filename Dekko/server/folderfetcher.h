@@ -0,0 +1,77 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FOLDERFETCHER_H
+#define FOLDERFETCHER_H
+
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include "imapconnection.h"
+#include <qmailfolder.h>
+
+/*
+    Downloads the headers of the newest messages in a list of folders, one
+    folder after the other.
+
+    FETCH commands for consecutive ranges are pipelined, newest first, with
+    a few of them in flight so the server never waits on us. The raw
+    responses of each range are handed on through fetched() as soon as it
+    completes, parsing them is left to someone else. When a range fails
+    the rest of the folder is skipped and reported through incomplete().
+*/
+class FolderFetcher : public ImapConnection
+{
+    Q_OBJECT
+
+public:
+    FolderFetcher(const QMailAccountId &account, const Endpoint &endpoint, const QList<QPair<QMailFolderId, QString> > &folders,
+                  const int depth, QObject *parent = 0);
+
+    // The folder being fetched, invalid before the first one
+    QMailFolderId folder() const { return _folder; }
+
+signals:
+    // Each response line with the header it contains, in the same order
+    void fetched(const QMailFolderId &folder, const QList<QByteArray> &responses, const QList<QByteArray> &headers);
+    // Some of the folder's messages weren't fetched
+    void incomplete(const QMailFolderId &folder);
+    void finished();
+
+protected:
+    void authenticated();
+    void untagged(const QByteArray &line);
+    void tagged(const QByteArray &tag, const bool ok, const QByteArray &line);
+
+private:
+    void nextFolder();
+    void fetchMore();
+
+    QList<QPair<QMailFolderId, QString> > _folders;
+    int _depth; // newest messages wanted per folder, -1 for all
+    QMailFolderId _folder;
+    QByteArray _examineTag;
+    int _exists;
+    int _first; // lowest sequence number wanted
+    int _next;  // highest not yet asked for
+    bool _failed; // a range of the current folder failed
+    QSet<QByteArray> _inFlight;
+    QList<QByteArray> _responses;
+    QList<QByteArray> _headers;
+};
+
+#endif
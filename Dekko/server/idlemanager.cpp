@@ -0,0 +1,506 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "idlemanager.h"
+#include "servicehandler.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QNetworkConfigurationManager>
+#include <QTimer>
+#include <qmailserviceconfiguration.h>
+#include <qmailstore.h>
+#include <Metrics.h>
+#include <Trace.h>
+
+#define DEFAULT_BUDGET 4
+// Changes are collected this long before being retrieved
+#define BATCH_DELAY 2000
+// Folders sharing the budget get a turn this often, three times less often on battery
+#define ROTATE_INTERVAL (5 * 60 * 1000)
+#define BACKOFF_MIN (30 * 1000)
+#define BACKOFF_MAX (30 * 60 * 1000)
+#define POWER_CHECK_INTERVAL (60 * 1000)
+// Battery percentage below which only the inboxes are watched
+#define LOW_BATTERY 20
+
+namespace {
+
+QByteArray readSysFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll().trimmed();
+}
+
+}
+
+IdleManager::IdleManager(ServiceHandler *handler, QObject *parent)
+    : QObject(parent),
+      _handler(handler),
+      _budget(DEFAULT_BUDGET),
+      _rotation(0),
+      _actionCount(0),
+      _reloadTimer(new QTimer(this)),
+      _scheduleTimer(new QTimer(this)),
+      _rotateTimer(new QTimer(this)),
+      _retrieveTimer(new QTimer(this)),
+      _powerTimer(new QTimer(this)),
+      _network(0),
+      _online(true),
+      _onBattery(false),
+      _lowBattery(false)
+{
+    const QByteArray budget = qgetenv("DEKKO_IDLE_BUDGET");
+    if (!budget.isEmpty())
+        _budget = budget.toInt();
+    if (_budget <= 0) {
+        qDebug() << "IDLE sessions disabled";
+        return;
+    }
+
+    _clock.start();
+
+    // Account updates come in bursts while syncing
+    _reloadTimer->setSingleShot(true);
+    _reloadTimer->setInterval(1000);
+    connect(_reloadTimer, SIGNAL(timeout()), this, SLOT(reload()));
+    _scheduleTimer->setSingleShot(true);
+    connect(_scheduleTimer, SIGNAL(timeout()), this, SLOT(schedule()));
+    connect(_rotateTimer, SIGNAL(timeout()), this, SLOT(rotate()));
+    // Not restarted by later changes so a busy folder still gets retrieved
+    _retrieveTimer->setSingleShot(true);
+    _retrieveTimer->setInterval(BATCH_DELAY);
+    connect(_retrieveTimer, SIGNAL(timeout()), this, SLOT(retrieve()));
+    _powerTimer->setInterval(POWER_CHECK_INTERVAL);
+    connect(_powerTimer, SIGNAL(timeout()), this, SLOT(checkPower()));
+
+    QMailStore *store = QMailStore::instance();
+    connect(store, SIGNAL(accountsAdded(QMailAccountIdList)), this, SLOT(scheduleReload()));
+    connect(store, SIGNAL(accountsUpdated(QMailAccountIdList)), this, SLOT(scheduleReload()));
+    connect(store, SIGNAL(accountsRemoved(QMailAccountIdList)), this, SLOT(scheduleReload()));
+    connect(store, SIGNAL(foldersAdded(QMailFolderIdList)), this, SLOT(scheduleReload()));
+    connect(store, SIGNAL(foldersRemoved(QMailFolderIdList)), this, SLOT(scheduleReload()));
+    connect(_handler, SIGNAL(activityChanged(quint64, QMailServiceAction::Activity)),
+            this, SLOT(activityChanged(quint64, QMailServiceAction::Activity)));
+
+    _network = new QNetworkConfigurationManager(this);
+    // Without a bearer backend nothing is known about the network, assume it's there
+    _online = _network->isOnline() || _network->allConfigurations().isEmpty();
+    connect(_network, SIGNAL(onlineStateChanged(bool)), this, SLOT(onlineStateChanged(bool)));
+
+    checkPower();
+    _powerTimer->start();
+    _reloadTimer->start();
+}
+
+void IdleManager::scheduleReload()
+{
+    _reloadTimer->start();
+}
+
+void IdleManager::reload()
+{
+    TRACE_SPAN("IdleManager::reload");
+    QMailStore *store = QMailStore::instance();
+    QMap<QMailAccountId, Account> accounts;
+    const QMailAccountIdList ids = store->queryAccounts(QMailAccountKey::status(QMailAccount::Enabled, QMailDataComparator::Includes));
+    foreach (const QMailAccountId &id, ids) {
+        const QMailAccountConfiguration config(id);
+        if (!config.services().contains(QStringLiteral("imap4")))
+            continue;
+        const QMailServiceConfiguration imap(config, QStringLiteral("imap4"));
+        // The IMAP service keeps its own IDLE connections for these
+        if (imap.value(QStringLiteral("pushEnabled")).toInt() != 0)
+            continue;
+
+        Account account;
+        account.endpoint = ImapConnection::endpoint(config);
+        if (!account.endpoint.isValid())
+            continue;
+
+        const QMailFolderId inbox = QMailAccount(id).standardFolder(QMailFolder::InboxFolder);
+        if (inbox.isValid()) {
+            const QString path = QMailFolder(inbox).path();
+            account.paths << path;
+            account.folders.insert(path, inbox);
+        }
+        const QStringList pushFolders = imap.value(QStringLiteral("pushFolders")).split(QLatin1Char('\n'), QString::SkipEmptyParts);
+        foreach (const QString &path, pushFolders) {
+            if (account.folders.contains(path))
+                continue;
+            const QMailFolderIdList folders = store->queryFolders(QMailFolderKey::parentAccountId(id) & QMailFolderKey::path(path));
+            if (folders.isEmpty())
+                continue;
+            account.paths << path;
+            account.folders.insert(path, folders.first());
+        }
+        if (account.paths.isEmpty())
+            continue;
+
+        // Keep what we learnt about the server unless its settings changed
+        QMap<QMailAccountId, Account>::const_iterator it = _accounts.constFind(id);
+        if (it != _accounts.constEnd() && it->endpoint == account.endpoint) {
+            account.support = it->support;
+            account.failures = it->failures;
+            account.retryAt = it->retryAt;
+            account.authenticationFailed = it->authenticationFailed;
+        }
+        accounts.insert(id, account);
+    }
+    _accounts = accounts;
+
+    // Sessions on changed settings have to be reopened even if they're still wanted
+    foreach (const QString &key, _sessions.keys()) {
+        IdleSession *session = _sessions.value(key);
+        QMap<QMailAccountId, Account>::const_iterator it = _accounts.constFind(session->account());
+        if (it == _accounts.constEnd() || it->endpoint != session->endpoint())
+            close(_sessions.take(key));
+    }
+    schedule();
+}
+
+int IdleManager::allowance(const QMailAccountId &account) const
+{
+    // Our own sessions already hold some of the account's connections
+    int own = 0;
+    foreach (IdleSession *session, _sessions) {
+        if (session->account() == account)
+            ++own;
+    }
+    // One is left for the status probe and the initial sync
+    return qMin(ImapConnection::available(account) + own, ImapConnection::limit() - 1);
+}
+
+QList<IdleManager::Unit> IdleManager::wantedUnits(int &rotating, int &waiting) const
+{
+    const qint64 now = _clock.elapsed();
+    QList<Unit> pinned;
+    QList<Unit> shared;
+    QHash<QMailAccountId, int> allowed;
+    QMap<QMailAccountId, Account>::const_iterator it = _accounts.constBegin();
+    for ( ; it != _accounts.constEnd(); ++it) {
+        if (it->support == Unsupported || it->authenticationFailed || it->retryAt > now)
+            continue;
+        const int allowedConnections = allowance(it.key());
+        if (allowedConnections <= 0)
+            continue;
+        // The pinned unit takes one, the rest is for the folders taking turns
+        allowed.insert(it.key(), allowedConnections - 1);
+        if (it->support != IdleOnly) {
+            // One connection for everything, or finding out if it can be
+            Unit unit;
+            unit.account = it.key();
+            unit.paths = it->paths;
+            unit.pinned = true;
+            pinned << unit;
+            continue;
+        }
+        for (int i = 0; i < it->paths.size(); ++i) {
+            Unit unit;
+            unit.account = it.key();
+            unit.paths << it->paths.at(i);
+            unit.pinned = (i == 0);
+            (unit.pinned ? pinned : shared) << unit;
+        }
+    }
+
+    QList<Unit> wanted;
+    rotating = 0;
+    waiting = 0;
+    if (pinned.size() > _budget) {
+        // More accounts than connections, the inboxes take turns as well and
+        // get a catch up like any other folder
+        for (int i = 0; i < _budget; ++i) {
+            Unit unit = pinned.at((_rotation + i) % pinned.size());
+            unit.pinned = false;
+            wanted << unit;
+        }
+        rotating = _budget;
+        waiting = pinned.size() - _budget;
+        return wanted;
+    }
+
+    wanted = pinned;
+    if (!_lowBattery && !shared.isEmpty()) {
+        const int room = _budget - wanted.size();
+        for (int i = 0; i < shared.size() && rotating < room; ++i) {
+            const Unit &unit = shared.at((_rotation + i) % shared.size());
+            int &left = allowed[unit.account];
+            if (left <= 0)
+                continue;
+            --left;
+            wanted << unit;
+            ++rotating;
+        }
+        waiting = shared.size() - rotating;
+    }
+    return wanted;
+}
+
+void IdleManager::schedule()
+{
+    TRACE_SPAN("IdleManager::schedule");
+    if (!_online || _budget <= 0) {
+        closeAll();
+        return;
+    }
+
+    int rotating = 0;
+    int waiting = 0;
+    const QList<Unit> wanted = wantedUnits(rotating, waiting);
+    QSet<QString> keys;
+    foreach (const Unit &unit, wanted)
+        keys.insert(unit.key());
+
+    foreach (const QString &key, _sessions.keys()) {
+        if (!keys.contains(key))
+            close(_sessions.take(key));
+    }
+
+    foreach (const Unit &unit, wanted) {
+        const QString key = unit.key();
+        if (_sessions.contains(key))
+            continue;
+        IdleSession *session = new IdleSession(unit.account, _accounts.value(unit.account).endpoint, unit.paths, this);
+        session->setObjectName(key);
+        connect(session, SIGNAL(capabilities(bool, bool)), this, SLOT(sessionCapabilities(bool, bool)));
+        connect(session, SIGNAL(established()), this, SLOT(sessionEstablished()));
+        connect(session, SIGNAL(changed(QString)), this, SLOT(sessionChanged(QString)));
+        connect(session, SIGNAL(failed(QString)), this, SLOT(sessionFailed(QString)));
+        // Anything that arrived while it wasn't watched has to be fetched, the
+        // first time an inbox is watched the client is syncing it anyway
+        if (!unit.pinned || _watchedBefore.contains(key))
+            _catchUp.insert(session);
+        _sessions.insert(key, session);
+        session->open();
+    }
+    Metrics::gauge("idle.sessions")->set(_sessions.size());
+
+    if (waiting > 0) {
+        if (!_rotateTimer->isActive())
+            _rotateTimer->start(rotationInterval());
+    } else {
+        _rotateTimer->stop();
+    }
+
+    // Wake up for the first account coming out of its back off
+    const qint64 now = _clock.elapsed();
+    qint64 next = -1;
+    foreach (const Account &account, _accounts) {
+        if (account.retryAt > now && account.support != Unsupported && (next == -1 || account.retryAt < next))
+            next = account.retryAt;
+    }
+    if (next != -1)
+        _scheduleTimer->start(next - now);
+}
+
+void IdleManager::rotate()
+{
+    int rotating = 0;
+    int waiting = 0;
+    wantedUnits(rotating, waiting);
+    _rotation += qMax(rotating, 1);
+    Metrics::counter("idle.rotations")->add();
+    schedule();
+}
+
+int IdleManager::rotationInterval() const
+{
+    return _onBattery ? 3 * ROTATE_INTERVAL : ROTATE_INTERVAL;
+}
+
+void IdleManager::checkPower()
+{
+    bool onBattery = false;
+    bool lowBattery = false;
+    const QDir supplies(QStringLiteral("/sys/class/power_supply"));
+    foreach (const QString &name, supplies.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        const QString supply = supplies.filePath(name) + QLatin1Char('/');
+        if (readSysFile(supply + QStringLiteral("type")) != "Battery")
+            continue;
+        if (readSysFile(supply + QStringLiteral("status")) == "Discharging") {
+            onBattery = true;
+            bool ok = false;
+            const int capacity = readSysFile(supply + QStringLiteral("capacity")).toInt(&ok);
+            lowBattery = lowBattery || (ok && capacity < LOW_BATTERY);
+        }
+    }
+
+    if (onBattery == _onBattery && lowBattery == _lowBattery)
+        return;
+    _onBattery = onBattery;
+    _lowBattery = lowBattery;
+    _rotateTimer->stop();
+    if (!_accounts.isEmpty())
+        schedule();
+}
+
+void IdleManager::onlineStateChanged(bool online)
+{
+    if (online == _online)
+        return;
+    _online = online;
+    if (online) {
+        // Whatever was failing may well have been the network
+        for (QMap<QMailAccountId, Account>::iterator it = _accounts.begin(); it != _accounts.end(); ++it) {
+            it->failures = 0;
+            it->retryAt = 0;
+        }
+    }
+    schedule();
+}
+
+void IdleManager::sessionCapabilities(bool idle, bool notify)
+{
+    IdleSession *session = qobject_cast<IdleSession *>(sender());
+    if (!session || !_accounts.contains(session->account()))
+        return;
+    if (!idle && !notify) {
+        qDebug() << "Account" << session->account().toULongLong() << "can't be watched, leaving it to polling";
+        _accounts[session->account()].support = Unsupported;
+    }
+}
+
+void IdleManager::sessionEstablished()
+{
+    IdleSession *session = qobject_cast<IdleSession *>(sender());
+    if (!session || !_accounts.contains(session->account()))
+        return;
+
+    Account &account = _accounts[session->account()];
+    account.failures = 0;
+    const QStringList watching = session->watching();
+    if (session->paths().size() > 1) {
+        // Without NOTIFY only the inbox is being watched, the rest need their own
+        account.support = (watching.size() < session->paths().size()) ? IdleOnly : Notify;
+        if (account.support == IdleOnly)
+            _scheduleTimer->start(0);
+    }
+    _watchedBefore.insert(session->objectName());
+    if (_catchUp.remove(session)) {
+        foreach (const QString &path, watching)
+            queueRetrieval(session->account(), account.folders.value(path));
+    }
+}
+
+void IdleManager::sessionChanged(const QString &path)
+{
+    IdleSession *session = qobject_cast<IdleSession *>(sender());
+    if (!session || !_accounts.contains(session->account()))
+        return;
+
+    Metrics::counter("idle.changes")->add();
+    const Account &account = _accounts[session->account()];
+    QMailFolderId folder = account.folders.value(path);
+    if (!folder.isValid() && path.compare(QLatin1String("INBOX"), Qt::CaseInsensitive) == 0)
+        folder = QMailAccount(session->account()).standardFolder(QMailFolder::InboxFolder);
+    if (folder.isValid()) {
+        queueRetrieval(session->account(), folder);
+        return;
+    }
+    // Named differently than we asked for it, play safe
+    foreach (const QString &watched, session->watching())
+        queueRetrieval(session->account(), account.folders.value(watched));
+}
+
+void IdleManager::sessionFailed(const QString &reason)
+{
+    IdleSession *session = qobject_cast<IdleSession *>(sender());
+    if (!session)
+        return;
+
+    _sessions.remove(session->objectName());
+    close(session);
+    if (_accounts.contains(session->account())) {
+        Account &account = _accounts[session->account()];
+        if (session->authenticationFailed()) {
+            // Tried again once the account's settings change
+            qWarning() << "Not watching account" << session->account().toULongLong() << "until its login is fixed:" << reason;
+            account.authenticationFailed = true;
+        } else if (account.support != Unsupported) {
+            const qint64 backoff = qMin<qint64>(qint64(BACKOFF_MIN) << qMin(account.failures, 10), BACKOFF_MAX);
+            ++account.failures;
+            account.retryAt = _clock.elapsed() + backoff;
+            Metrics::counter("idle.failures")->add();
+        }
+    }
+    schedule();
+}
+
+void IdleManager::close(IdleSession *session)
+{
+    disconnect(session, 0, this, 0);
+    _catchUp.remove(session);
+    // Its connection is free for the ones opened next straight away
+    session->close();
+    session->deleteLater();
+}
+
+void IdleManager::closeAll()
+{
+    foreach (IdleSession *session, _sessions)
+        close(session);
+    _sessions.clear();
+    _rotateTimer->stop();
+    Metrics::gauge("idle.sessions")->set(0);
+}
+
+void IdleManager::queueRetrieval(const QMailAccountId &account, const QMailFolderId &folder)
+{
+    if (!folder.isValid())
+        return;
+    if (!_pendingSince.contains(account))
+        _pendingSince.insert(account, _clock.elapsed());
+    _pending[account].insert(folder);
+    if (!_retrieveTimer->isActive())
+        _retrieveTimer->start();
+}
+
+void IdleManager::retrieve()
+{
+    TRACE_SPAN("IdleManager::retrieve");
+    const QSet<QMailAccountId> busy = _inFlight.values().toSet();
+    foreach (const QMailAccountId &account, _pending.keys()) {
+        // Picked up again when the one in flight finishes
+        if (busy.contains(account))
+            continue;
+        const QMailFolderIdList folders = _pending.take(account).toList();
+        const quint64 action = (quint64(QCoreApplication::applicationPid()) << 32) | ++_actionCount;
+        _inFlight.insert(action, account);
+        _inFlightSince.insert(action, _pendingSince.take(account));
+        Metrics::counter("idle.retrievals")->add();
+        _handler->retrieveNewMessages(action, account, folders);
+    }
+}
+
+void IdleManager::activityChanged(quint64 action, QMailServiceAction::Activity activity)
+{
+    if (activity != QMailServiceAction::Successful && activity != QMailServiceAction::Failed)
+        return;
+    if (!_inFlight.contains(action))
+        return;
+
+    const QMailAccountId account = _inFlight.take(action);
+    const qint64 since = _inFlightSince.take(action);
+    if (activity == QMailServiceAction::Successful)
+        Metrics::histogram("idle.changeToStore")->record((_clock.elapsed() - since) * 1000);
+    if (_pending.contains(account) && !_retrieveTimer->isActive())
+        _retrieveTimer->start();
+}
@@ -0,0 +1,143 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IDLEMANAGER_H
+#define IDLEMANAGER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <qmailaccount.h>
+#include <qmailfolder.h>
+#include <qmailserviceaction.h>
+#include "idlesession.h"
+
+class QNetworkConfigurationManager;
+class QTimer;
+class ServiceHandler;
+
+/*
+    Keeps IDLE or NOTIFY sessions open for the inbox and push folders of the
+    IMAP accounts that don't have push email enabled, those are watched by
+    the IMAP service itself, and starts a retrieval of new messages when the
+    server reports a change.
+
+    The number of open connections is bounded by a budget, DEKKO_IDLE_BUDGET
+    in the environment, 0 turns it off. Each account's sessions also count
+    against the limit ImapConnection puts on all of dekkod's connections to
+    it, leaving one for the status probe and the initial sync. An account
+    whose server has NOTIFY needs a single connection for all of its
+    folders. Otherwise each folder needs its own, the inbox is always kept
+    open and the rest take turns on whatever is left of the budget, getting
+    a catch up retrieval whenever they're given a connection. With more
+    accounts than the budget allows the inboxes take turns the same way.
+
+    The folders watched besides the inbox are the imap4 service's
+    pushFolders, the same list the IMAP service uses for push accounts. It
+    is set through ImapAccountConfiguration::pushFolders, or from QML with
+    appendPushFolder() on the account's incoming configuration.
+
+    Changes are collected for a couple of seconds and retrieved with one
+    request per account, and only one request per account is ever in flight.
+    Failing sessions are retried with an exponential back off, except when
+    the login was refused, those accounts wait for their settings to change.
+    All sessions are closed while offline and only the inboxes are watched
+    when the battery runs low.
+*/
+class IdleManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    IdleManager(ServiceHandler *handler, QObject *parent = 0);
+
+private slots:
+    void scheduleReload();
+    void reload();
+    void schedule();
+    void rotate();
+    void checkPower();
+    void onlineStateChanged(bool online);
+
+    void sessionCapabilities(bool idle, bool notify);
+    void sessionEstablished();
+    void sessionChanged(const QString &path);
+    void sessionFailed(const QString &reason);
+
+    void retrieve();
+    void activityChanged(quint64 action, QMailServiceAction::Activity activity);
+
+private:
+    enum Support { Unknown, IdleOnly, Notify, Unsupported };
+
+    struct Account {
+        Account() : support(Unknown), failures(0), retryAt(0), authenticationFailed(false) {}
+        ImapConnection::Endpoint endpoint;
+        QStringList paths; // inbox first
+        QHash<QString, QMailFolderId> folders;
+        Support support;
+        int failures;
+        qint64 retryAt; // ms on _clock
+        bool authenticationFailed;
+    };
+
+    struct Unit {
+        Unit() : pinned(false) {}
+        QMailAccountId account;
+        QStringList paths;
+        bool pinned;
+        QString key() const { return QString::number(account.toULongLong()) + QLatin1Char('/') + paths.join(QLatin1Char('\n')); }
+    };
+
+    // Sessions the account's connection limit leaves room for
+    int allowance(const QMailAccountId &account) const;
+    QList<Unit> wantedUnits(int &rotating, int &waiting) const;
+    void close(IdleSession *session);
+    void closeAll();
+    void queueRetrieval(const QMailAccountId &account, const QMailFolderId &folder);
+    int rotationInterval() const;
+
+    ServiceHandler *_handler;
+    int _budget;
+    QMap<QMailAccountId, Account> _accounts;
+    QHash<QString, IdleSession *> _sessions; // by unit key
+    QSet<QString> _watchedBefore;
+    QSet<IdleSession *> _catchUp; // retrieve what was missed once established
+    int _rotation;
+
+    QMap<QMailAccountId, QSet<QMailFolderId> > _pending;
+    QMap<QMailAccountId, qint64> _pendingSince; // ms on _clock of the first change
+    QHash<quint64, QMailAccountId> _inFlight;
+    QHash<quint64, qint64> _inFlightSince;
+    quint32 _actionCount;
+
+    QElapsedTimer _clock;
+    QTimer *_reloadTimer;
+    QTimer *_scheduleTimer;
+    QTimer *_rotateTimer;
+    QTimer *_retrieveTimer;
+    QTimer *_powerTimer;
+    QNetworkConfigurationManager *_network;
+    bool _online;
+    bool _onBattery;
+    bool _lowBattery;
+};
+
+#endif
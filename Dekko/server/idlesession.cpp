@@ -0,0 +1,173 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "idlesession.h"
+#include <QTimer>
+
+// Servers may drop an idle connection after 30 minutes, RFC 2177
+#define KEEP_ALIVE_INTERVAL (25 * 60 * 1000)
+
+IdleSession::IdleSession(const QMailAccountId &account, const Endpoint &endpoint, const QStringList &paths, QObject *parent)
+    : ImapConnection(account, endpoint, parent),
+      _paths(paths),
+      _keepAlive(new QTimer(this)),
+      _state(Connecting),
+      _exists(-1)
+{
+    _keepAlive->setInterval(KEEP_ALIVE_INTERVAL);
+    connect(_keepAlive, SIGNAL(timeout()), this, SLOT(keepAlive()));
+    connect(this, SIGNAL(failed(QString)), _keepAlive, SLOT(stop()));
+}
+
+IdleSession::~IdleSession()
+{
+    // Let the LOGOUT through
+    if (isOpen() && _state == Idle)
+        write("DONE\r\n");
+}
+
+void IdleSession::authenticated()
+{
+    const bool idle = hasCapability("IDLE");
+    const bool notify = hasCapability("NOTIFY");
+    emit capabilities(idle, notify);
+
+    if (notify && _paths.size() > 1) {
+        QByteArray mailboxes;
+        foreach (const QString &path, _paths) {
+            if (!mailboxes.isEmpty())
+                mailboxes.append(' ');
+            mailboxes.append(quoted(path));
+        }
+        _state = Notify;
+        _tag = send("NOTIFY SET (mailboxes (" + mailboxes + ") (MessageNew MessageExpunge))");
+    } else if (idle) {
+        examine();
+    } else {
+        fail(QStringLiteral("Server supports neither IDLE nor NOTIFY"));
+    }
+}
+
+void IdleSession::untagged(const QByteArray &line)
+{
+    const QByteArray upper = line.toUpper();
+
+    if (upper.startsWith("STATUS ")) {
+        // Only sent for unselected mailboxes under NOTIFY
+        const int list = line.lastIndexOf(" (");
+        emit changed(unquoted(line.mid(7, list == -1 ? -1 : list - 7).trimmed()));
+        return;
+    }
+
+    if (upper.startsWith("VANISHED")) {
+        if (!_watching.isEmpty())
+            emit changed(_watching.first());
+        return;
+    }
+
+    // "<n> EXISTS", "<n> EXPUNGE" or "<n> FETCH (...)"
+    const int space = upper.indexOf(' ');
+    bool isNumber = false;
+    const int n = upper.left(space).toInt(&isNumber);
+    if (space == -1 || !isNumber)
+        return;
+    const QByteArray what = upper.mid(space + 1);
+
+    if (what.startsWith("EXISTS")) {
+        const bool grew = (_exists != -1 && n != _exists);
+        _exists = n;
+        if (!grew || _state == Examine)
+            return;
+    } else if (what.startsWith("EXPUNGE")) {
+        // Or the next EXISTS would look like nothing arrived
+        if (_exists > 0)
+            --_exists;
+    } else if (!what.startsWith("FETCH")) {
+        return;
+    }
+
+    if (!_watching.isEmpty())
+        emit changed(_watching.first());
+}
+
+void IdleSession::tagged(const QByteArray &tag, const bool ok, const QByteArray &line)
+{
+    if (tag != _tag)
+        return;
+
+    switch (_state) {
+    case Notify:
+        if (!ok) {
+            // Advertised but not usable for these mailboxes, watch the first one
+            examine();
+            return;
+        }
+        _watching = _paths;
+        _state = Waiting;
+        _keepAlive->start();
+        emit established();
+        break;
+    case Examine:
+        if (!ok) {
+            fail(QStringLiteral("Unable to examine ") + _paths.first());
+            return;
+        }
+        _state = Idle;
+        _tag = send("IDLE");
+        break;
+    case Done:
+        _state = Idle;
+        _tag = send("IDLE");
+        break;
+    case Noop:
+        _state = Waiting;
+        break;
+    case Idle:
+        // IDLE ended without us asking
+        fail(QStringLiteral("IDLE terminated by the server: ") + QString::fromUtf8(line));
+        break;
+    default:
+        break;
+    }
+}
+
+void IdleSession::continuation()
+{
+    if (_state == Idle && _watching.isEmpty()) {
+        _watching = QStringList() << _paths.first();
+        _keepAlive->start();
+        emit established();
+    }
+}
+
+void IdleSession::keepAlive()
+{
+    if (_state == Idle) {
+        _state = Done;
+        write("DONE\r\n");
+    } else if (_state == Waiting) {
+        _state = Noop;
+        _tag = send("NOOP");
+    }
+}
+
+void IdleSession::examine()
+{
+    _state = Examine;
+    _exists = -1;
+    _tag = send("EXAMINE " + quoted(_paths.first()));
+}
@@ -0,0 +1,87 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IDLESESSION_H
+#define IDLESESSION_H
+
+#include <QStringList>
+#include "imapconnection.h"
+
+class QTimer;
+
+/*
+    An IMAP connection that does nothing but wait for the server to tell
+    it about changes.
+
+    After logging in the session watches all of its paths with NOTIFY when
+    the server has it, otherwise it EXAMINEs the first path and sits in IDLE.
+    Anything that might mean new or removed messages is reported through
+    changed(), fetching them is left to the account's own retrieval service.
+    IDLE is restarted and NOTIFY sessions are sent a NOOP before the usual
+    30 minute server timeout.
+
+    A session never reconnects by itself, it reports failed() and the owner
+    decides when to try again.
+*/
+class IdleSession : public ImapConnection
+{
+    Q_OBJECT
+
+public:
+    IdleSession(const QMailAccountId &account, const Endpoint &endpoint, const QStringList &paths, QObject *parent = 0);
+    ~IdleSession();
+
+    QStringList paths() const { return _paths; }
+    // What the server is actually watching, valid once established
+    QStringList watching() const { return _watching; }
+
+signals:
+    void capabilities(bool idle, bool notify);
+    void established();
+    void changed(const QString &path);
+
+protected:
+    void authenticated();
+    void untagged(const QByteArray &line);
+    void tagged(const QByteArray &tag, const bool ok, const QByteArray &line);
+    void continuation();
+
+private slots:
+    void keepAlive();
+
+private:
+    enum State {
+        Connecting,
+        Notify,
+        Examine,
+        Idle,    // in IDLE, waiting for the continuation or for changes
+        Done,    // sent DONE, IDLE is restarted when it completes
+        Waiting, // NOTIFY is set, waiting for changes
+        Noop
+    };
+
+    void examine();
+
+    QStringList _paths;
+    QStringList _watching;
+    QTimer *_keepAlive;
+    State _state;
+    QByteArray _tag;
+    int _exists;
+};
+
+#endif
@@ -0,0 +1,466 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "imapconnection.h"
+#include <QDebug>
+#include <QHash>
+#include <QMessageAuthenticationCode>
+#include <QSslSocket>
+#include <qmailnamespace.h>
+#include <qmailserviceconfiguration.h>
+
+// Connections per account across all of dekkod's sessions. Servers
+// commonly allow 10 or more per user, Dovecot's default is 10, and the
+// IMAP service keeps a few of its own next to ours.
+#define MAX_CONNECTIONS 5
+
+namespace {
+
+QHash<QMailAccountId, int> openConnections;
+
+// decodeValue() is only available to subclasses
+class ImapConfiguration : public QMailServiceConfiguration
+{
+public:
+    explicit ImapConfiguration(const QMailAccountConfiguration &config)
+        : QMailServiceConfiguration(config, QStringLiteral("imap4")) {}
+
+    QString password() const { return decodeValue(value(QStringLiteral("password"))); }
+};
+
+// SASL PLAIN without an authorization identity, RFC 4616
+QByteArray plainCredentials(const ImapConnection::Endpoint &endpoint)
+{
+    return '\0' + endpoint.username.toUtf8() + '\0' + endpoint.password.toUtf8();
+}
+
+}
+
+bool ImapConnection::Endpoint::operator==(const Endpoint &other) const
+{
+    return server == other.server && port == other.port && encryption == other.encryption
+            && authentication == other.authentication && acceptUntrusted == other.acceptUntrusted && username == other.username && password == other.password;
+}
+
+ImapConnection::Endpoint ImapConnection::endpoint(const QMailAccountConfiguration &config)
+{
+    Endpoint endpoint;
+    if (!config.services().contains(QStringLiteral("imap4")))
+        return endpoint;
+
+    const ImapConfiguration imap(config);
+    endpoint.server = imap.value(QStringLiteral("server"));
+    endpoint.port = imap.value(QStringLiteral("port")).toInt();
+    endpoint.encryption = imap.value(QStringLiteral("encryption")).toInt();
+    endpoint.authentication = imap.value(QStringLiteral("authentication")).toInt();
+    endpoint.acceptUntrusted = imap.value(QStringLiteral("acceptUntrustedCertificates")).toInt() != 0;
+    endpoint.username = imap.value(QStringLiteral("username"));
+    endpoint.password = imap.password();
+    return endpoint;
+}
+
+ImapConnection::ImapConnection(const QMailAccountId &account, const Endpoint &endpoint, QObject *parent)
+    : QObject(parent),
+      _account(account),
+      _endpoint(endpoint),
+      _socket(new QSslSocket(this)),
+      _state(Greeting),
+      _literal(0),
+      _keepLiterals(false),
+      _tagCount(0),
+      _authStep(0),
+      _authenticationFailed(false),
+      _counted(false)
+{
+    connect(_socket, SIGNAL(encrypted()), this, SLOT(encrypted()));
+    connect(_socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(_socket, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrors(QList<QSslError>)));
+    connect(_socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketError()));
+    connect(_socket, SIGNAL(disconnected()), this, SLOT(socketError()));
+}
+
+ImapConnection::~ImapConnection()
+{
+    close();
+}
+
+int ImapConnection::limit()
+{
+    return MAX_CONNECTIONS;
+}
+
+int ImapConnection::available(const QMailAccountId &account)
+{
+    return qMax(0, MAX_CONNECTIONS - openConnections.value(account));
+}
+
+void ImapConnection::open()
+{
+    _state = Greeting;
+    _authenticationFailed = false;
+    if (!_counted) {
+        if (available(_account) == 0) {
+            // Reported once the caller is done setting up, like any other failure
+            _state = Closed;
+            qWarning() << metaObject()->className() << "for account" << _account.toULongLong() << "refused, too many connections";
+            QMetaObject::invokeMethod(this, "failed", Qt::QueuedConnection, Q_ARG(QString, QStringLiteral("Too many connections")));
+            return;
+        }
+        _counted = true;
+        ++openConnections[_account];
+    }
+    if (_endpoint.encryption == 1)
+        _socket->connectToHostEncrypted(_endpoint.server, _endpoint.port);
+    else
+        _socket->connectToHost(_endpoint.server, _endpoint.port);
+}
+
+void ImapConnection::encrypted()
+{
+    // With SSL the greeting is still to come, only STARTTLS continues from here
+    if (_state == StartTls) {
+        // Anything said before the handshake can't be trusted, RFC 3501 6.2.1
+        _capabilities.clear();
+        beginLogin();
+    }
+}
+
+void ImapConnection::sslErrors(const QList<QSslError> &errors)
+{
+    if (_endpoint.acceptUntrusted)
+        _socket->ignoreSslErrors(errors);
+}
+
+void ImapConnection::socketError()
+{
+    fail(_socket->errorString());
+}
+
+void ImapConnection::readyRead()
+{
+    _buffer.append(_socket->readAll());
+
+    // Consumed data is dropped once per read rather than once per line,
+    // a big FETCH response is thousands of lines
+    int pos = 0;
+    while (_state != Closed) {
+        if (_literal > 0) {
+            if (_buffer.size() - pos < _literal)
+                break;
+            if (_keepLiterals)
+                _literals.append(_buffer.mid(pos, _literal));
+            else
+                _line.append(quoted(QString::fromUtf8(_buffer.mid(pos, _literal))));
+            pos += _literal;
+            _literal = 0;
+        }
+
+        const int eol = _buffer.indexOf("\r\n", pos);
+        if (eol == -1)
+            break;
+        const QByteArray line = _buffer.mid(pos, eol - pos);
+        pos = eol + 2;
+
+        const int open = line.endsWith('}') ? line.lastIndexOf('{') : -1;
+        if (open != -1) {
+            bool ok = false;
+            const int size = line.mid(open + 1, line.size() - open - 2).replace('+', "").toInt(&ok);
+            if (ok) {
+                _line.append(_keepLiterals ? line : line.left(open));
+                _literal = size;
+                continue;
+            }
+        }
+
+        _line.append(line);
+        const QByteArray complete = _line;
+        _line.clear();
+        handleLine(complete);
+        _literals.clear();
+    }
+    _buffer.remove(0, pos);
+}
+
+void ImapConnection::handleLine(const QByteArray &line)
+{
+    if (_state == Authenticated) {
+        if (line.startsWith("* ")) {
+            if (line.mid(2, 4).toUpper() == "BYE ")
+                fail(QString::fromUtf8(line.mid(6)));
+            else
+                untagged(line.mid(2));
+        } else if (line.startsWith('+')) {
+            continuation();
+        } else {
+            const int space = line.indexOf(' ');
+            if (space != -1)
+                tagged(line.left(space), line.mid(space + 1, 2).toUpper() == "OK", line);
+        }
+        return;
+    }
+
+    const QByteArray upper = line.toUpper();
+    if (upper.startsWith("* BYE")) {
+        fail(QString::fromUtf8(line.mid(6)));
+        return;
+    }
+
+    switch (_state) {
+    case Greeting:
+        if (upper.startsWith("* PREAUTH")) {
+            _state = Capability;
+            _tag = send("CAPABILITY");
+        } else if (!upper.startsWith("* OK")) {
+            fail(QStringLiteral("Unexpected greeting"));
+        } else if (_endpoint.encryption == 2) {
+            _state = StartTls;
+            _tag = send("STARTTLS");
+        } else {
+            if (upper.contains("[CAPABILITY ")) {
+                const int start = upper.indexOf("[CAPABILITY ") + 12;
+                setCapabilities(upper.mid(start, upper.indexOf(']', start) - start));
+            }
+            beginLogin();
+        }
+        break;
+    case StartTls:
+        if (!line.startsWith(_tag + ' '))
+            break;
+        if (upper.mid(_tag.size() + 1, 2) != "OK") {
+            fail(QStringLiteral("STARTTLS refused"));
+            break;
+        }
+        _socket->startClientEncryption();
+        break;
+    case PreLogin:
+        if (upper.startsWith("* CAPABILITY ")) {
+            setCapabilities(upper.mid(13));
+        } else if (line.startsWith(_tag + ' ')) {
+            login();
+        }
+        break;
+    case Login:
+        if (line.startsWith('+')) {
+            authenticate(line.mid(1).trimmed());
+            break;
+        }
+        if (!line.startsWith(_tag + ' '))
+            break;
+        if (upper.mid(_tag.size() + 1, 2) != "OK") {
+            // Anything but a server that is temporarily unable to check, RFC 5530
+            _authenticationFailed = !upper.contains("[UNAVAILABLE]");
+            fail(QStringLiteral("Login failed: ") + QString::fromUtf8(line));
+            break;
+        }
+        // Most servers save us a round trip by sending them with the OK
+        if (upper.contains("[CAPABILITY ")) {
+            const int start = upper.indexOf("[CAPABILITY ") + 12;
+            setCapabilities(upper.mid(start, upper.indexOf(']', start) - start));
+            _state = Authenticated;
+            authenticated();
+        } else {
+            // Servers often only advertise their extensions once logged in
+            _state = Capability;
+            _tag = send("CAPABILITY");
+        }
+        break;
+    case Capability:
+        if (upper.startsWith("* CAPABILITY ")) {
+            setCapabilities(upper.mid(13));
+        } else if (line.startsWith(_tag + ' ')) {
+            _state = Authenticated;
+            authenticated();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void ImapConnection::beginLogin()
+{
+    // Most servers list them in the greeting, the rest have to be asked
+    if (!_capabilities.isEmpty()) {
+        login();
+        return;
+    }
+    _state = PreLogin;
+    _tag = send("CAPABILITY");
+}
+
+void ImapConnection::login()
+{
+    _state = Login;
+    _authStep = 0;
+
+    QByteArray mechanism;
+    switch (_endpoint.authentication) {
+    case QMail::NoMechanism:
+        // Set by servers that want encryption before any password goes out
+        if (hasCapability("LOGINDISABLED")) {
+            refuseLogin(QStringLiteral("Server has disabled LOGIN"));
+            return;
+        }
+        _tag = send("LOGIN " + quoted(_endpoint.username) + ' ' + quoted(_endpoint.password));
+        return;
+    case QMail::LoginMechanism:
+        mechanism = "LOGIN";
+        break;
+    case QMail::PlainMechanism:
+        mechanism = "PLAIN";
+        break;
+    case QMail::CramMd5Mechanism:
+        mechanism = "CRAM-MD5";
+        break;
+    default:
+        refuseLogin(QStringLiteral("Unknown authentication mechanism %1").arg(_endpoint.authentication));
+        return;
+    }
+
+    // Over a plain connection the server only offers what it is happy to take in the clear
+    if (!hasCapability("AUTH=" + mechanism)) {
+        refuseLogin(QStringLiteral("Server doesn't offer AUTH=") + QString::fromLatin1(mechanism));
+        return;
+    }
+    if (mechanism == "PLAIN" && hasCapability("SASL-IR")) {
+        _authStep = 1;
+        _tag = send("AUTHENTICATE PLAIN " + plainCredentials(_endpoint).toBase64());
+        return;
+    }
+    _tag = send("AUTHENTICATE " + mechanism);
+}
+
+void ImapConnection::authenticate(const QByteArray &challenge)
+{
+    QByteArray response;
+    switch (_endpoint.authentication) {
+    case QMail::LoginMechanism:
+        // Asked for the username and then the password
+        if (_authStep == 0)
+            response = _endpoint.username.toUtf8();
+        else if (_authStep == 1)
+            response = _endpoint.password.toUtf8();
+        break;
+    case QMail::PlainMechanism:
+        if (_authStep == 0)
+            response = plainCredentials(_endpoint);
+        break;
+    case QMail::CramMd5Mechanism:
+        if (_authStep == 0) {
+            const QByteArray digest = QMessageAuthenticationCode::hash(QByteArray::fromBase64(challenge),
+                                                                       _endpoint.password.toUtf8(), QCryptographicHash::Md5);
+            response = _endpoint.username.toUtf8() + ' ' + digest.toHex();
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (response.isEmpty()) {
+        // More than the mechanism needs, cancel and let the tagged NO fail the login
+        write("*\r\n");
+        return;
+    }
+    ++_authStep;
+    write(response.toBase64() + "\r\n");
+}
+
+void ImapConnection::refuseLogin(const QString &reason)
+{
+    // Retrying won't change the server's mind
+    _authenticationFailed = true;
+    fail(reason);
+}
+
+void ImapConnection::setCapabilities(const QByteArray &list)
+{
+    _capabilities.clear();
+    foreach (const QByteArray &capability, list.trimmed().split(' '))
+        _capabilities.insert(capability);
+}
+
+QByteArray ImapConnection::send(const QByteArray &command)
+{
+    const QByteArray tag = 'a' + QByteArray::number(++_tagCount);
+    _socket->write(tag + ' ' + command + "\r\n");
+    return tag;
+}
+
+void ImapConnection::write(const QByteArray &data)
+{
+    _socket->write(data);
+}
+
+void ImapConnection::close()
+{
+    release();
+    if (_state == Closed)
+        return;
+
+    _state = Closed;
+    _socket->blockSignals(true);
+    if (_socket->state() == QAbstractSocket::ConnectedState) {
+        // Best effort, nothing waits for the reply
+        _socket->write("z LOGOUT\r\n");
+        _socket->flush();
+    }
+    _socket->abort();
+}
+
+void ImapConnection::release()
+{
+    if (!_counted)
+        return;
+    _counted = false;
+    if (--openConnections[_account] <= 0)
+        openConnections.remove(_account);
+}
+
+void ImapConnection::fail(const QString &reason)
+{
+    release();
+    if (_state == Closed)
+        return;
+
+    _state = Closed;
+    _socket->blockSignals(true);
+    _socket->abort();
+    qWarning() << metaObject()->className() << "for account" << _account.toULongLong() << "failed:" << reason;
+    emit failed(reason);
+}
+
+QByteArray ImapConnection::quoted(const QString &string)
+{
+    QByteArray result = string.toUtf8();
+    result.replace('\\', "\\\\").replace('"', "\\\"");
+    return '"' + result + '"';
+}
+
+QString ImapConnection::unquoted(const QByteArray &string)
+{
+    if (string.size() < 2 || !string.startsWith('"') || !string.endsWith('"'))
+        return QString::fromUtf8(string);
+
+    QByteArray result;
+    result.reserve(string.size() - 2);
+    for (int i = 1; i < string.size() - 1; ++i) {
+        if (string.at(i) == '\\' && i + 1 < string.size() - 1)
+            ++i;
+        result.append(string.at(i));
+    }
+    return QString::fromUtf8(result);
+}
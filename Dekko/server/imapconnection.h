@@ -0,0 +1,159 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IMAPCONNECTION_H
+#define IMAPCONNECTION_H
+
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QSslError>
+#include <qmailaccount.h>
+
+class QMailAccountConfiguration;
+class QSslSocket;
+
+/*
+    The part of an IMAP connection shared by dekkod's own sessions, which
+    run alongside the ones the IMAP service keeps.
+
+    Connects with the account's encryption settings, logs in with the
+    account's SASL mechanism, or LOGIN when it has none, and reads the
+    capabilities, then hands every response to the subclass. LOGIN is never
+    sent once the server has said LOGINDISABLED, and a rejected login is
+    reported through authenticationFailed() so the owner doesn't keep
+    retrying the same credentials. Commands can be pipelined, each tagged
+    response is reported with its tag. Literals in responses are turned
+    into quoted strings so they can be parsed like the rest of the line,
+    unless the subclass asks to keep them as they are.
+
+    All of dekkod's connections to an account share one limit, whatever
+    they are for, as the server counts them together with the IMAP
+    service's own. A connection holds its place from open() until it
+    fails or is closed, owners check available() before making one and
+    open() refuses once the limit is reached.
+*/
+class ImapConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Endpoint {
+        Endpoint() : port(0), encryption(0), authentication(0), acceptUntrusted(false) {}
+        QString server;
+        int port;
+        int encryption; // 0 none, 1 SSL, 2 STARTTLS as in the imap4 service configuration
+        int authentication; // QMail::SaslMechanism, 0 for LOGIN
+        bool acceptUntrusted;
+        QString username;
+        QString password;
+
+        bool isValid() const { return !server.isEmpty() && port > 0; }
+        bool operator==(const Endpoint &other) const;
+        bool operator!=(const Endpoint &other) const { return !(*this == other); }
+    };
+
+    /** Invalid if the account has no IMAP service */
+    static Endpoint endpoint(const QMailAccountConfiguration &config);
+    /** Connections dekkod may have open to one account's server */
+    static int limit();
+    /** Connections dekkod may still open to the account's server */
+    static int available(const QMailAccountId &account);
+
+    ImapConnection(const QMailAccountId &account, const Endpoint &endpoint, QObject *parent = 0);
+    ~ImapConnection();
+
+    QMailAccountId account() const { return _account; }
+    Endpoint endpoint() const { return _endpoint; }
+
+    void open();
+    // Logs out without waiting and gives up the place in the account's limit
+    void close();
+
+    // The server refused the credentials, or they can't be sent the way it asks for
+    bool authenticationFailed() const { return _authenticationFailed; }
+
+signals:
+    void failed(const QString &reason);
+
+protected:
+    // Logged in and the capabilities are known
+    virtual void authenticated() = 0;
+    // Untagged responses without the leading "* "
+    virtual void untagged(const QByteArray &line) = 0;
+    virtual void tagged(const QByteArray &tag, const bool ok, const QByteArray &line) = 0;
+    virtual void continuation() {}
+
+    // Leave the {n} in the line and hand over the data through literals()
+    void setKeepLiterals(const bool keep) { _keepLiterals = keep; }
+    // Literals of the response being handled
+    const QList<QByteArray> &literals() const { return _literals; }
+
+    bool hasCapability(const QByteArray &capability) const { return _capabilities.contains(capability); }
+    bool isOpen() const { return _state == Authenticated; }
+
+    // Returns the tag the command was sent with
+    QByteArray send(const QByteArray &command);
+    void write(const QByteArray &data);
+    void fail(const QString &reason);
+
+    static QByteArray quoted(const QString &string);
+    static QString unquoted(const QByteArray &string);
+
+private slots:
+    void encrypted();
+    void readyRead();
+    void sslErrors(const QList<QSslError> &errors);
+    void socketError();
+
+private:
+    enum State {
+        Greeting,
+        StartTls,
+        PreLogin, // capabilities decide how to log in
+        Login,
+        Capability,
+        Authenticated,
+        Closed
+    };
+
+    void handleLine(const QByteArray &line);
+    void beginLogin();
+    void login();
+    void authenticate(const QByteArray &challenge);
+    void refuseLogin(const QString &reason);
+    void setCapabilities(const QByteArray &list);
+    void release();
+
+    QMailAccountId _account;
+    Endpoint _endpoint;
+    QSslSocket *_socket;
+    State _state;
+    QByteArray _buffer;
+    QByteArray _line;
+    int _literal; // bytes of a literal still to come in the current line
+    bool _keepLiterals;
+    QList<QByteArray> _literals;
+    QByteArray _tag; // of the login command in progress
+    int _tagCount;
+    int _authStep; // continuations answered for AUTHENTICATE
+    bool _authenticationFailed;
+    bool _counted; // holds a place in the account's limit
+    QSet<QByteArray> _capabilities;
+};
+
+#endif
@@ -0,0 +1,338 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "initialsync.h"
+#include "folderfetcher.h"
+#include <QDebug>
+#include <QSet>
+#include <QVector>
+#include <qmailaccountconfiguration.h>
+#include <qmailstore.h>
+#include <qmailtimestamp.h>
+#include <Metrics.h>
+#include <Trace.h>
+
+// Connections per account, each works through it's share of the folders
+#define MAX_FETCHERS 3
+// Messages added to the store per transaction
+#define STORE_BATCH 2000
+// Newest messages per folder a first sync fetches the headers of, unless
+// DEKKO_INITIAL_SYNC_DEPTH says otherwise
+#define DEFAULT_DEPTH 1000
+
+namespace {
+
+// The IMAP service's server uid format, so it recognises the messages
+QString serverUid(const QMailFolderId &folder, const QByteArray &uid)
+{
+    return QString::number(folder.toULongLong()) + QLatin1Char('|') + QString::fromLatin1(uid);
+}
+
+// Value following \a name in a FETCH response, up to the next space or
+// the matching close of a list or quoted string
+QByteArray fetchItem(const QByteArray &response, const QByteArray &upper, const QByteArray &name)
+{
+    int start = upper.indexOf(' ' + name + ' ');
+    if (start == -1)
+        start = upper.indexOf('(' + name + ' ');
+    if (start == -1)
+        return QByteArray();
+    start += name.size() + 2;
+    if (start >= response.size())
+        return QByteArray();
+
+    const char open = response.at(start);
+    if (open == '(' || open == '"') {
+        const int end = response.indexOf(open == '(' ? ')' : '"', start + 1);
+        return end == -1 ? QByteArray() : response.mid(start + 1, end - start - 1);
+    }
+    int end = start;
+    while (end < response.size() && response.at(end) != ' ' && response.at(end) != ')')
+        ++end;
+    return response.mid(start, end - start);
+}
+
+}
+
+void HeaderParser::parse(quint64 action, const QMailAccountId &account, const QMailFolderId &folder,
+                         const QList<QByteArray> &responses, const QList<QByteArray> &headers)
+{
+    TRACE_ACTION_SPAN("HeaderParser::parse", action);
+    QList<QMailMessage> messages;
+    messages.reserve(responses.size());
+    for (int i = 0; i < responses.size(); ++i) {
+        const QByteArray &response = responses.at(i);
+        const QByteArray upper = response.toUpper();
+        const QByteArray uid = fetchItem(response, upper, "UID");
+        const QByteArray flags = fetchItem(upper, upper, "FLAGS");
+        if (uid.isEmpty() || headers.value(i).isEmpty() || flags.contains("\\DELETED"))
+            continue;
+
+        QMailMessage message = QMailMessage::fromRfc2822(headers.at(i));
+        message.setMessageType(QMailMessage::Email);
+        message.setParentAccountId(account);
+        message.setParentFolderId(folder);
+        message.setServerUid(serverUid(folder, uid));
+        message.setSize(fetchItem(response, upper, "RFC822.SIZE").toUInt());
+
+        // "17-Jul-1996 02:44:25 -0700" is RFC 2822 once the dashes are gone
+        QByteArray internalDate = fetchItem(response, upper, "INTERNALDATE").trimmed();
+        const int time = internalDate.indexOf(' ');
+        if (time > 0) {
+            internalDate.replace(0, time, internalDate.left(time).replace('-', ' '));
+            message.setReceivedDate(QMailTimeStamp(QString::fromLatin1(internalDate)));
+        }
+
+        message.setStatus(QMailMessage::ContentAvailable | QMailMessage::PartialContentAvailable, false);
+        message.setStatus(QMailMessage::Incoming, true);
+        if (flags.contains("\\SEEN"))
+            message.setStatus(QMailMessage::Read | QMailMessage::ReadElsewhere, true);
+        if (flags.contains("\\FLAGGED"))
+            message.setStatus(QMailMessage::Important | QMailMessage::ImportantElsewhere, true);
+        if (flags.contains("\\ANSWERED"))
+            message.setStatus(QMailMessage::Replied, true);
+        if (flags.contains("\\DRAFT"))
+            message.setStatus(QMailMessage::Draft, true);
+        messages.append(message);
+    }
+    emit parsed(action, messages);
+}
+
+InitialSync::InitialSync(QObject *parent)
+    : QObject(parent),
+      _depth(DEFAULT_DEPTH),
+      _enabled(true)
+{
+    const QByteArray depth = qgetenv("DEKKO_INITIAL_SYNC_DEPTH").trimmed().toLower();
+    if (depth == "off")
+        _enabled = false;
+    else if (depth == "all")
+        _depth = -1;
+    else if (!depth.isEmpty())
+        _depth = qMax(0, depth.toInt());
+
+    qRegisterMetaType<QMailAccountId>("QMailAccountId");
+    qRegisterMetaType<QMailFolderId>("QMailFolderId");
+    qRegisterMetaType<QList<QByteArray> >("QList<QByteArray>");
+    qRegisterMetaType<QList<QMailMessage> >("QList<QMailMessage>");
+
+    HeaderParser *parser = new HeaderParser;
+    parser->moveToThread(&_thread);
+    connect(&_thread, SIGNAL(finished()), parser, SLOT(deleteLater()));
+    connect(this, SIGNAL(parse(quint64, QMailAccountId, QMailFolderId, QList<QByteArray>, QList<QByteArray>)),
+            parser, SLOT(parse(quint64, QMailAccountId, QMailFolderId, QList<QByteArray>, QList<QByteArray>)));
+    connect(parser, SIGNAL(parsed(quint64, QList<QMailMessage>)), this, SLOT(parsed(quint64, QList<QMailMessage>)));
+    _thread.start();
+}
+
+InitialSync::~InitialSync()
+{
+    _thread.quit();
+    _thread.wait();
+}
+
+bool InitialSync::sync(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds, uint minimum)
+{
+    TRACE_ACTION_SPAN("InitialSync::sync", action);
+    if (!_enabled)
+        return false;
+    // Only worth it when going deeper than the client asked for, the
+    // service's own retrieval fetches that many just as quickly
+    if (_depth >= 0 && _depth <= int(minimum))
+        return false;
+    const int depth = _depth;
+
+    const ImapConnection::Endpoint endpoint = ImapConnection::endpoint(QMailAccountConfiguration(accountId));
+    if (!endpoint.isValid())
+        return false;
+
+    QMailStore *store = QMailStore::instance();
+    QList<QPair<QMailFolderId, QString> > fresh;
+    foreach (const QMailFolderId &id, folderIds) {
+        const QMailFolder folder(id);
+        if (folder.parentAccountId() == accountId && store->countMessages(QMailMessageKey::parentFolderId(id)) == 0)
+            fresh << qMakePair(id, folder.path());
+    }
+    if (fresh.isEmpty())
+        return false;
+
+    // Share the folders out, biggest first isn't known so just take turns.
+    // The connections come out of the account's limit, without any the
+    // service does it the usual way.
+    const int count = qMin(qMin(MAX_FETCHERS, fresh.size()), ImapConnection::available(accountId));
+    if (count == 0)
+        return false;
+    QVector<QList<QPair<QMailFolderId, QString> > > shares(count);
+    for (int i = 0; i < fresh.size(); ++i)
+        shares[i % count] << fresh.at(i);
+
+    Job &job = _jobs[action];
+    job.account = accountId;
+    job.timer.start();
+    for (int i = 0; i < count; ++i) {
+        FolderFetcher *fetcher = new FolderFetcher(accountId, endpoint, shares.at(i), depth, this);
+        connect(fetcher, SIGNAL(fetched(QMailFolderId, QList<QByteArray>, QList<QByteArray>)),
+                this, SLOT(fetched(QMailFolderId, QList<QByteArray>, QList<QByteArray>)));
+        connect(fetcher, SIGNAL(incomplete(QMailFolderId)), this, SLOT(incomplete(QMailFolderId)));
+        connect(fetcher, SIGNAL(finished()), this, SLOT(fetcherFinished()));
+        connect(fetcher, SIGNAL(failed(QString)), this, SLOT(fetcherFailed()));
+        _fetchers.insert(fetcher, action);
+        ++job.fetchers;
+        fetcher->open();
+    }
+    return true;
+}
+
+void InitialSync::cancel(quint64 action)
+{
+    QHash<FolderFetcher *, quint64>::iterator it = _fetchers.begin();
+    while (it != _fetchers.end()) {
+        if (it.value() == action) {
+            disconnect(it.key(), 0, this, 0);
+            it.key()->close();
+            it.key()->deleteLater();
+            it = _fetchers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Anything still being parsed is dropped when it comes back
+    _jobs.remove(action);
+}
+
+void InitialSync::fetched(const QMailFolderId &folder, const QList<QByteArray> &responses, const QList<QByteArray> &headers)
+{
+    FolderFetcher *fetcher = qobject_cast<FolderFetcher *>(sender());
+    if (!fetcher || !_fetchers.contains(fetcher))
+        return;
+
+    const quint64 action = _fetchers.value(fetcher);
+    Job &job = _jobs[action];
+    ++job.parsing;
+    emit parse(action, job.account, folder, responses, headers);
+}
+
+void InitialSync::incomplete(const QMailFolderId &folder)
+{
+    FolderFetcher *fetcher = qobject_cast<FolderFetcher *>(sender());
+    if (!fetcher || !_fetchers.contains(fetcher))
+        return;
+
+    const quint64 action = _fetchers.value(fetcher);
+    if (_jobs.contains(action))
+        _jobs[action].incomplete.insert(folder);
+}
+
+void InitialSync::fetcherFailed()
+{
+    FolderFetcher *fetcher = qobject_cast<FolderFetcher *>(sender());
+    if (!fetcher || !_fetchers.contains(fetcher))
+        return;
+
+    // Whatever it was part way through is missing some messages
+    const quint64 action = _fetchers.value(fetcher);
+    if (_jobs.contains(action) && fetcher->folder().isValid())
+        _jobs[action].incomplete.insert(fetcher->folder());
+    fetcherFinished();
+}
+
+void InitialSync::fetcherFinished()
+{
+    FolderFetcher *fetcher = qobject_cast<FolderFetcher *>(sender());
+    if (!fetcher || !_fetchers.contains(fetcher))
+        return;
+
+    const quint64 action = _fetchers.take(fetcher);
+    disconnect(fetcher, 0, this, 0);
+    fetcher->close();
+    fetcher->deleteLater();
+    if (_jobs.contains(action)) {
+        --_jobs[action].fetchers;
+        finishIfDone(action);
+    }
+}
+
+void InitialSync::parsed(quint64 action, const QList<QMailMessage> &messages)
+{
+    if (!_jobs.contains(action))
+        return;
+
+    Job &job = _jobs[action];
+    --job.parsing;
+    job.unstored += messages;
+    if (job.unstored.size() >= STORE_BATCH)
+        store(job);
+    finishIfDone(action);
+}
+
+void InitialSync::store(Job &job)
+{
+    if (job.unstored.isEmpty())
+        return;
+
+    METRIC_LATENCY("initialSync.store");
+    QMailStore *store = QMailStore::instance();
+
+    // Something else may have retrieved some of them meanwhile
+    QStringList uids;
+    foreach (const QMailMessage &message, job.unstored)
+        uids << message.serverUid();
+    QSet<QString> existing;
+    const QMailMessageKey key(QMailMessageKey::serverUid(uids) & QMailMessageKey::parentAccountId(job.account));
+    foreach (const QMailMessageMetaData &meta, store->messagesMetaData(key, QMailMessageKey::ServerUid))
+        existing.insert(meta.serverUid());
+
+    QList<QMailMessage *> messages;
+    for (int i = 0; i < job.unstored.size(); ++i) {
+        const QMailMessage &message = job.unstored.at(i);
+        if (!existing.contains(message.serverUid()) && !job.incomplete.contains(message.parentFolderId()))
+            messages.append(&job.unstored[i]);
+    }
+    if (!messages.isEmpty() && !store->addMessages(messages))
+        qWarning() << "Unable to store" << messages.size() << "messages for the initial sync";
+    else
+        job.stored += messages.size();
+    job.unstored.clear();
+}
+
+void InitialSync::finishIfDone(quint64 action)
+{
+    Job &job = _jobs[action];
+    if (job.fetchers > 0 || job.parsing > 0)
+        return;
+
+    store(job);
+    // A folder with a gap goes back to being fresh, so the service fills it
+    // the usual way. No removal records, nothing is deleted on the server.
+    QMailStore *mailStore = QMailStore::instance();
+    foreach (const QMailFolderId &folder, job.incomplete) {
+        const QMailMessageKey key(QMailMessageKey::parentFolderId(folder));
+        const int count = mailStore->countMessages(key);
+        qWarning() << "Initial sync of folder" << folder.toULongLong() << "incomplete, leaving it to the service";
+        if (count > 0 && mailStore->removeMessages(key, QMailStore::NoRemovalRecord))
+            job.stored -= qMin(count, job.stored);
+    }
+    const qint64 elapsed = qMax<qint64>(job.timer.elapsed(), 1);
+    const qint64 rate = job.stored * 1000 / elapsed;
+    qDebug() << "Initial sync of account" << job.account.toULongLong() << "stored" << job.stored
+             << "messages in" << elapsed << "ms," << rate << "messages/s";
+    Metrics::counter("initialSync.messages")->add(job.stored);
+    if (job.stored > 0)
+        Metrics::histogram("initialSync.messagesPerSecond")->record(rate);
+    _jobs.remove(action);
+    emit finished(action);
+}
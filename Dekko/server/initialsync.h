@@ -0,0 +1,114 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef INITIALSYNC_H
+#define INITIALSYNC_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QThread>
+#include <qmailfolder.h>
+#include <qmailmessage.h>
+
+class FolderFetcher;
+
+// Turns raw FETCH responses into messages, lives on InitialSync's thread
+class HeaderParser : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void parse(quint64 action, const QMailAccountId &account, const QMailFolderId &folder,
+               const QList<QByteArray> &responses, const QList<QByteArray> &headers);
+
+signals:
+    void parsed(quint64 action, const QList<QMailMessage> &messages);
+};
+
+/*
+    Fills folders that have never been synced before the IMAP service gets
+    to them.
+
+    The service retrieves a message list one message at a time, storing
+    each as it arrives. For a folder with nothing in the store yet the
+    headers are downloaded here instead, with pipelined FETCHes over a few
+    connections so several folders come in at once. They're parsed on a
+    separate thread and stored a couple of thousand at a time. The request
+    then goes on to the service as usual, finding the messages already
+    there.
+
+    A first sync fetches the newest 1000 messages of each folder, or
+    DEKKO_INITIAL_SYNC_DEPTH in the environment, "all" for whole folders
+    and "off" to leave it to the service. Requests whose minimum is already
+    that deep are left to the service as well. The messages are stored
+    without any content, structure or New status, so the service only
+    updates their flags and fetches content as it's asked for.
+
+    When a FETCH fails or a connection drops part way through a folder,
+    what was stored for it is removed again and the service syncs it as if
+    the initial sync had never run.
+*/
+class InitialSync : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InitialSync(QObject *parent = 0);
+    ~InitialSync();
+
+    /** Starts filling the fresh folders, true if finished() will be emitted for the action */
+    bool sync(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds, uint minimum);
+    void cancel(quint64 action);
+
+signals:
+    void finished(quint64 action);
+    void parse(quint64 action, const QMailAccountId &account, const QMailFolderId &folder,
+               const QList<QByteArray> &responses, const QList<QByteArray> &headers);
+
+private slots:
+    void fetched(const QMailFolderId &folder, const QList<QByteArray> &responses, const QList<QByteArray> &headers);
+    void incomplete(const QMailFolderId &folder);
+    void fetcherFailed();
+    void fetcherFinished();
+    void parsed(quint64 action, const QList<QMailMessage> &messages);
+
+private:
+    struct Job {
+        Job() : fetchers(0), parsing(0), stored(0) {}
+        QMailAccountId account;
+        int fetchers;
+        int parsing; // batches handed to the parser
+        int stored;
+        QList<QMailMessage> unstored;
+        QSet<QMailFolderId> incomplete; // some of it couldn't be fetched
+        QElapsedTimer timer;
+    };
+
+    void store(Job &job);
+    void finishIfDone(quint64 action);
+
+    QHash<quint64, Job> _jobs;
+    QHash<FolderFetcher *, quint64> _fetchers;
+    QThread _thread;
+    int _depth;
+    bool _enabled;
+};
+
+#endif
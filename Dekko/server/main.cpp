@@ -44,6 +44,8 @@
 #include <qmailnamespace.h>
 #include <qmaillog.h>
 #include <qloggers.h>
+#include <Metrics.h>
+#include <Trace.h>
 #include <signal.h>
 #ifdef USE_HTML_PARSER
 #include <QtGui>
@@ -88,6 +90,8 @@ Q_DECL_EXPORT int main(int argc, char** argv)
 
     // This is ~/.config/dekko.dekkoproject/dekkod.conf
     qMailLoggersRecreate(APP_NAME, "dekkod", "Msgsrv");
+    Trace::startFromEnvironment(QStringLiteral("dekkod"));
+    Metrics::startFromEnvironment(QStringLiteral("dekkod"));
 
     if(QMail::fileLock("dekkod-instance.lock") == -1)
         qFatal("Could not get messageserver lock. Messageserver might already be running!");
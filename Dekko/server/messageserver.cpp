@@ -42,10 +42,14 @@
 #include "messageserver.h"
 #include "servicehandler.h"
 #include "mailmessageclient.h"
+#include "structureindexer.h"
+#include "idlemanager.h"
+#include "RetrievalPriority.h"
 #include <qmailfolder.h>
 #include <qmailmessage.h>
 #include <qmailstore.h>
 #include <QDataStream>
+#include <QDBusConnection>
 #include <QTimer>
 #include <QProcess>
 #include <qmaillog.h>
@@ -53,6 +57,7 @@
 #include <newcountnotifier.h>
 #include <qcopserver.h>
 #include <qmailmessageserverplugin.h>
+#include <Metrics.h>
 
 extern "C" {
 #ifndef Q_OS_WIN
@@ -70,10 +75,15 @@ int MessageServer::sighupFd[2];
 #define NO_NOTIFY_SEND
 #endif
 
+#define DBUS_SERVICE "org.dekkoproject.Server"
+#define DBUS_PATH "/server"
+
 MessageServer::MessageServer(QObject *parent)
     : QObject(parent),
       handler(0),
+      idleManager(0),
       client(new MailMessageClient(this)),
+      structureIndexer(new StructureIndexer(this)),
       messageCountUpdate("QPE/Messages/MessageCountUpdated"),
       newMessageTotal(0),
       completionAttempted(false),
@@ -111,6 +121,7 @@ MessageServer::MessageServer(QObject *parent)
         // Do not close, however, or QPE will start another instance.
     } else {
         handler = new ServiceHandler(this);
+        idleManager = new IdleManager(handler, this);
 
         connect(store, SIGNAL(messagesAdded(QMailMessageIdList)),
                 this, SLOT(messagesAdded(QMailMessageIdList)));
@@ -118,6 +129,8 @@ MessageServer::MessageServer(QObject *parent)
                 this, SLOT(notifyNewMessages(QMailMessageIdList)));
         connect(store, SIGNAL(messagesUpdated(QMailMessageIdList)),
                 this, SLOT(messagesUpdated(QMailMessageIdList)));
+        connect(store, SIGNAL(messageContentsModified(QMailMessageIdList)),
+                this, SLOT(messageContentsModified(QMailMessageIdList)));
         connect(store, SIGNAL(messagesRemoved(QMailMessageIdList)),
                 this, SLOT(messagesRemoved(QMailMessageIdList)));
 
@@ -263,6 +276,15 @@ MessageServer::MessageServer(QObject *parent)
         emit client->actionsListed(QMailActionDataList());
     }
 
+#ifndef SERVER_AS_QTHREAD
+    // In process the app's own metrics already cover the server
+    QDBusConnection connection = QDBusConnection::sessionBus();
+    if (!connection.registerService(DBUS_SERVICE)
+            || !connection.registerObject(DBUS_PATH, this, QDBusConnection::ExportScriptableSlots)) {
+        qWarning() << "Failed registering" << DBUS_SERVICE << "on the session bus";
+    }
+#endif
+
 #ifdef MESSAGESERVER_PLUGINS
     qDebug() << "Initiating messageserver plugins.";
     QStringList availablePlugins = QMailMessageServerPluginFactory::keys();
@@ -278,6 +300,11 @@ MessageServer::~MessageServer()
 {
 }
 
+QString MessageServer::metrics() const
+{
+    return QString::fromUtf8(Metrics::toJson());
+}
+
 void MessageServer::retrievalCompleted(quint64 action)
 {
     // Ensure the client receives any resulting events before a notification
@@ -287,7 +314,8 @@ void MessageServer::retrievalCompleted(quint64 action)
         if (!completionAttempted) {
             // Complete the messages that we selected for immediate completion
             completionAttempted = true;
-            handler->retrieveMessages(action, completionList.toList(), QMailRetrievalAction::Content);
+            // Nobody has asked for these yet, don't hold up those that have
+            handler->retrieveMessages(action, completionList.toList(), RetrievalPriority::background(QMailRetrievalAction::Content));
             return;
         } else {
             completionList.clear();
@@ -441,6 +469,8 @@ void MessageServer::messagesAdded(const QMailMessageIdList &ids)
 {
     if (!QMailStore::instance()->asynchronousEmission()) {
         // Added in our process - from retrieval
+        structureIndexer->messagesChanged(ids);
+
         foreach (const QMailMessageId &id, ids) {
             QMailMessageMetaData message(id);
 
@@ -465,6 +495,8 @@ void MessageServer::messagesUpdated(const QMailMessageIdList &ids)
         // Only need to check message counts if the update occurred in another process
         updateNewMessageCounts();
     } else {
+        structureIndexer->messagesChanged(ids);
+
         // If we're updating, check whether the messages have been marked as Removed
         foreach (const QMailMessageId &id, ids) {
             if (completionList.contains(id)) {
@@ -478,6 +510,14 @@ void MessageServer::messagesUpdated(const QMailMessageIdList &ids)
     }
 }
 
+void MessageServer::messageContentsModified(const QMailMessageIdList &ids)
+{
+    if (!QMailStore::instance()->asynchronousEmission()) {
+        // Parts retrieved in our process, the summary has to be remade
+        structureIndexer->contentsModified(ids);
+    }
+}
+
 void MessageServer::messagesRemoved(const QMailMessageIdList &ids)
 {
     foreach (const QMailMessageId &id, ids) {
@@ -54,7 +54,9 @@
 #endif
 
 class ServiceHandler;
+class IdleManager;
 class MailMessageClient;
+class StructureIndexer;
 class QDSData;
 class QMailMessageMetaData;
 class QNetworkState;
@@ -67,6 +69,7 @@ class MessageServer : public QObject
 #endif
 {
     Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.dekkoproject.Server")
 
 public:
     MessageServer(QObject *parent = 0);
@@ -78,6 +81,11 @@ public:
 
 signals:
     void messageCountUpdated();
+
+public slots:
+    // Same snapshot as the mail service's metrics(), for dekkod
+    Q_SCRIPTABLE QString metrics() const;
+
 #if defined(Q_OS_UNIX)
 public slots:
     void handleSigHup(); // Qt signal handler for UNIX SIGHUP signal.
@@ -93,6 +101,7 @@ private slots:
 
     void messagesAdded(const QMailMessageIdList &ids);
     void messagesUpdated(const QMailMessageIdList &ids);
+    void messageContentsModified(const QMailMessageIdList &ids);
     void messagesRemoved(const QMailMessageIdList &ids);
     void reportNewCounts();
     void acknowledgeNewMessages(const QMailMessageTypeList&);
@@ -107,7 +116,9 @@ private:
 
 
     ServiceHandler *handler;
+    IdleManager *idleManager;
     MailMessageClient *client;
+    StructureIndexer *structureIndexer;
     QMailMessageCountMap messageCounts;
 
     QCopAdaptor messageCountUpdate;
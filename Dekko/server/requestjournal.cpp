@@ -0,0 +1,191 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "requestjournal.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <QTimer>
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Compact once this many completions are in the file...
+const int CompactThreshold = 512;
+// ...and they outnumber the outstanding requests by this factor
+const int CompactRatio = 4;
+
+void syncToDisk(QFile &file)
+{
+    file.flush();
+#ifdef Q_OS_UNIX
+    ::fdatasync(file.handle());
+#endif
+}
+
+}
+
+RequestJournal::RequestJournal(const QString &fileName, QObject *parent)
+    : QObject(parent),
+      _file(fileName),
+      _completedRecords(0),
+      _commitScheduled(false)
+{
+}
+
+RequestJournal::~RequestJournal()
+{
+    commit();
+}
+
+QList<quint64> RequestJournal::recover()
+{
+    QSet<quint64> outstanding;
+    if (_file.exists()) {
+        if (!_file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Unable to open request journal for read!" << _file.fileName();
+        } else {
+            for (QByteArray line = _file.readLine(); !line.isEmpty(); line = _file.readLine()) {
+                // A torn final record from a crash mid write is ignored
+                if (!line.endsWith('\n'))
+                    break;
+
+                line = line.trimmed();
+                if (line.isEmpty())
+                    continue;
+
+                const char type = line.at(0);
+                if (type == '-') {
+                    outstanding.remove(line.mid(1).toULongLong());
+                } else if (type == '+') {
+                    if (quint64 action = line.mid(1).toULongLong())
+                        outstanding.insert(action);
+                } else if (quint64 action = line.toULongLong()) {
+                    // Bare action numbers as written by older versions
+                    outstanding.insert(action);
+                }
+            }
+            _file.close();
+        }
+    }
+
+    // Whatever was outstanding gets reported as failed, so start afresh
+    _outstanding.clear();
+    _pending.clear();
+    _completedRecords = 0;
+    if (open()) {
+        if (!_file.resize(0))
+            qWarning() << "Unable to truncate request journal!";
+        syncToDisk(_file);
+    }
+
+    return outstanding.toList();
+}
+
+void RequestJournal::enqueued(quint64 action)
+{
+    if (_outstanding.contains(action))
+        return;
+
+    _outstanding.insert(action);
+    _pending.append('+').append(QByteArray::number(action)).append('\n');
+    scheduleCommit();
+}
+
+void RequestJournal::completed(quint64 action)
+{
+    if (!_outstanding.remove(action))
+        return;
+
+    _pending.append('-').append(QByteArray::number(action)).append('\n');
+    ++_completedRecords;
+    scheduleCommit();
+}
+
+bool RequestJournal::isOutstanding(quint64 action) const
+{
+    return _outstanding.contains(action);
+}
+
+void RequestJournal::commit()
+{
+    _commitScheduled = false;
+    if (_pending.isEmpty())
+        return;
+
+    if (_completedRecords >= CompactThreshold
+        && _completedRecords >= _outstanding.count() * CompactRatio
+        && compact()) {
+        // Rewriting covered the pending records too
+        return;
+    }
+
+    if (!_file.isOpen() && !open())
+        return;
+
+    if (_file.write(_pending) != _pending.size())
+        qWarning() << "Unable to append to request journal!" << _file.errorString();
+    syncToDisk(_file);
+    _pending.clear();
+}
+
+bool RequestJournal::open()
+{
+    if (_file.isOpen())
+        return true;
+
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Unable to open request journal for write!" << _file.fileName();
+        return false;
+    }
+    return true;
+}
+
+void RequestJournal::scheduleCommit()
+{
+    if (!_commitScheduled) {
+        _commitScheduled = true;
+        QTimer::singleShot(0, this, SLOT(commit()));
+    }
+}
+
+bool RequestJournal::compact()
+{
+    QByteArray contents;
+    foreach (quint64 action, _outstanding)
+        contents.append('+').append(QByteArray::number(action)).append('\n');
+
+    // Written aside and renamed over the journal so a crash leaves either the old or new one
+    QSaveFile compacted(_file.fileName());
+    if (!compacted.open(QIODevice::WriteOnly)) {
+        qWarning() << "Unable to compact request journal!" << compacted.errorString();
+        return false;
+    }
+    compacted.write(contents);
+    if (!compacted.commit()) {
+        qWarning() << "Unable to compact request journal!" << compacted.errorString();
+        return false;
+    }
+
+    // Our handle still points at the replaced file
+    _file.close();
+    open();
+    _pending.clear();
+    _completedRecords = 0;
+    return true;
+}
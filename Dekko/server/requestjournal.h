@@ -0,0 +1,68 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef REQUESTJOURNAL_H
+#define REQUESTJOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QObject>
+#include <QSet>
+
+/*
+    Append only record of the requests the server has accepted but not yet
+    completed, so the ones lost to a crash can be failed back to the clients
+    on the next start.
+
+    Each record is a line "+<action>" when enqueued or "-<action>" when completed.
+    Records are buffered and written together, with a single sync, at the end of
+    the current event loop pass so a burst of requests costs one write instead of
+    one per request. Once enough completions pile up the file is compacted down
+    to just the outstanding actions.
+*/
+class RequestJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    RequestJournal(const QString &fileName, QObject *parent = 0);
+    ~RequestJournal();
+
+    // Returns the actions left outstanding by the previous run and starts a new journal
+    QList<quint64> recover();
+
+    void enqueued(quint64 action);
+    void completed(quint64 action);
+    bool isOutstanding(quint64 action) const;
+
+public slots:
+    void commit();
+
+private:
+    bool open();
+    void scheduleCommit();
+    bool compact();
+
+    QFile _file;
+    QByteArray _pending;
+    QSet<quint64> _outstanding;
+    int _completedRecords;
+    bool _commitScheduled;
+};
+
+#endif
@@ -0,0 +1,197 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "resyncfilter.h"
+#include "servicehandler.h"
+#include "statusprobe.h"
+#include <QDebug>
+#include <QTimer>
+#include <qmailaccountconfiguration.h>
+#include <qmailserviceconfiguration.h>
+#include <qmailstore.h>
+#include <Metrics.h>
+#include <Trace.h>
+
+// Past this the request goes through unfiltered
+#define CHECK_TIMEOUT (10 * 1000)
+
+static const QString stateField()
+{
+    return QStringLiteral("dekko-resync-state");
+}
+
+ResyncFilter::ResyncFilter(ServiceHandler *handler)
+    : QObject(handler)
+{
+    connect(handler, SIGNAL(activityChanged(quint64, QMailServiceAction::Activity)),
+            this, SLOT(activityChanged(quint64, QMailServiceAction::Activity)));
+}
+
+bool ResyncFilter::check(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds, uint minimum)
+{
+    TRACE_ACTION_SPAN("ResyncFilter::check", action);
+    // The probe is a connection of its own, for a single folder that costs
+    // about as much as letting the service resync it
+    if (folderIds.size() < 2)
+        return false;
+
+    const QMailAccountConfiguration config(accountId);
+    const ImapConnection::Endpoint endpoint = ImapConnection::endpoint(config);
+    if (!endpoint.isValid())
+        return false;
+    // The IMAP service keeps these up to date over its own IDLE connections
+    if (QMailServiceConfiguration(config, QStringLiteral("imap4")).value(QStringLiteral("pushEnabled")).toInt() != 0)
+        return false;
+    QHash<QMailAccountId, ImapConnection::Endpoint>::const_iterator it = _unsupported.constFind(accountId);
+    if (it != _unsupported.constEnd() && *it == endpoint)
+        return false;
+    it = _refused.constFind(accountId);
+    if (it != _refused.constEnd() && *it == endpoint)
+        return false;
+
+    QMailStore *store = QMailStore::instance();
+    Check check;
+    check.action = action;
+    check.folders = folderIds;
+    QStringList paths;
+    foreach (const QMailFolderId &id, folderIds) {
+        const QMailFolder folder(id);
+        if (folder.parentAccountId() != accountId)
+            return false;
+        const bool stored = !folder.customField(stateField()).isEmpty();
+        const uint count = (stored && minimum == 0) ? 0 : uint(store->countMessages(QMailMessageKey::parentFolderId(id)));
+        // Never synced, or asked for more than we have
+        if (!stored || (minimum > 0 && count < minimum))
+            check.needed.insert(id);
+        check.paths.insert(id, folder.path());
+        // Nothing to compare a folder that was never synced against, it's
+        // probed once it has messages so its state can be stored
+        if (stored || count > 0)
+            paths << folder.path();
+    }
+    // Not worth waiting for a connection, the service resyncs as usual
+    if (paths.isEmpty() || ImapConnection::available(accountId) == 0)
+        return false;
+
+    StatusProbe *probe = new StatusProbe(accountId, endpoint, paths, this);
+    connect(probe, SIGNAL(finished()), this, SLOT(probeFinished()));
+    connect(probe, SIGNAL(failed(QString)), this, SLOT(probeFailed()));
+    QTimer *timeout = new QTimer(probe);
+    timeout->setSingleShot(true);
+    connect(timeout, SIGNAL(timeout()), this, SLOT(probeFailed()));
+    timeout->start(CHECK_TIMEOUT);
+    _checks.insert(probe, check);
+    probe->open();
+    return true;
+}
+
+void ResyncFilter::cancel(quint64 action)
+{
+    _unconfirmed.remove(action);
+    QHash<StatusProbe *, Check>::iterator it = _checks.begin();
+    while (it != _checks.end()) {
+        if (it->action == action) {
+            it.key()->close();
+            it.key()->deleteLater();
+            it = _checks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ResyncFilter::probeFinished()
+{
+    StatusProbe *probe = qobject_cast<StatusProbe *>(sender());
+    if (!probe || !_checks.contains(probe))
+        return;
+
+    const Check check = _checks.value(probe);
+    if (!probe->hasCondStore()) {
+        qDebug() << "Account" << probe->account().toULongLong() << "has no CONDSTORE, folders are always resynced";
+        _unsupported.insert(probe->account(), probe->endpoint());
+        finish(probe, check.folders);
+        return;
+    }
+
+    QMailFolderIdList changed;
+    QList<QPair<QMailFolderId, QByteArray> > states;
+    foreach (const QMailFolderId &id, check.folders) {
+        const QByteArray state = probe->state(check.paths.value(id));
+        if (state.isEmpty() || check.needed.contains(id)
+                || QMailFolder(id).customField(stateField()) != QString::fromLatin1(state)) {
+            changed << id;
+            states << qMakePair(id, state);
+        }
+    }
+    Metrics::counter("resync.folders.checked")->add(check.folders.size());
+    Metrics::counter("resync.folders.skipped")->add(check.folders.size() - changed.size());
+    if (!states.isEmpty())
+        _unconfirmed.insert(check.action, states);
+    finish(probe, changed);
+}
+
+void ResyncFilter::probeFailed()
+{
+    StatusProbe *probe = qobject_cast<StatusProbe *>(sender());
+    if (!probe && sender())
+        probe = qobject_cast<StatusProbe *>(sender()->parent());
+    if (!probe || !_checks.contains(probe))
+        return;
+
+    Metrics::counter("resync.probeFailures")->add();
+    if (probe->authenticationFailed()) {
+        // Probed again once the account's settings change
+        qDebug() << "Account" << probe->account().toULongLong() << "refused the login, folders are always resynced";
+        _refused.insert(probe->account(), probe->endpoint());
+    }
+    finish(probe, _checks.value(probe).folders);
+}
+
+void ResyncFilter::finish(StatusProbe *probe, const QMailFolderIdList &changed)
+{
+    const quint64 action = _checks.take(probe).action;
+    disconnect(probe, 0, this, 0);
+    probe->close();
+    probe->deleteLater();
+    emit checked(action, changed);
+}
+
+void ResyncFilter::activityChanged(quint64 action, QMailServiceAction::Activity activity)
+{
+    if (activity != QMailServiceAction::Successful && activity != QMailServiceAction::Failed)
+        return;
+    if (!_unconfirmed.contains(action))
+        return;
+
+    const QList<QPair<QMailFolderId, QByteArray> > states = _unconfirmed.take(action);
+    if (activity != QMailServiceAction::Successful)
+        return;
+
+    typedef QPair<QMailFolderId, QByteArray> FolderState;
+    foreach (const FolderState &state, states) {
+        QMailFolder folder(state.first);
+        if (!folder.id().isValid())
+            continue;
+        if (state.second.isEmpty())
+            folder.removeCustomField(stateField());
+        else
+            folder.setCustomField(stateField(), QString::fromLatin1(state.second));
+        if (!QMailStore::instance()->updateFolder(&folder))
+            qWarning() << "Unable to store the resync state of folder" << folder.path();
+    }
+}
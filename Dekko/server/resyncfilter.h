@@ -0,0 +1,90 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RESYNCFILTER_H
+#define RESYNCFILTER_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <qmailfolder.h>
+#include <qmailserviceaction.h>
+#include "imapconnection.h"
+
+class StatusProbe;
+class ServiceHandler;
+
+/*
+    Leaves folders the server says haven't changed out of message list
+    retrievals.
+
+    The IMAP service re-reads the flags of every message it has in a folder
+    on each sync. Before a retrieveMessageLists request is queued its folders
+    are checked with a StatusProbe and only those whose CONDSTORE state
+    differs from the one stored on the folder after the last successful sync
+    are passed on. If none changed the request completes without the service
+    ever connecting.
+
+    The state is only stored once the retrieval succeeded, and it's the one
+    read before it started, so a change made while syncing is picked up next
+    time. Servers without CONDSTORE, and accounts whose login the server
+    refused, are remembered until their settings change and their requests
+    go straight through, as do all of them if the probe fails or is slow.
+
+    Requests for a single folder, for accounts with push email, which the
+    IMAP service keeps current itself, and for folders that were never
+    synced aren't probed at all.
+*/
+class ResyncFilter : public QObject
+{
+    Q_OBJECT
+
+public:
+    ResyncFilter(ServiceHandler *handler);
+
+    /** Starts checking the folders, true if checked() will be emitted for the action */
+    bool check(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds, uint minimum);
+    void cancel(quint64 action);
+
+signals:
+    void checked(quint64 action, const QMailFolderIdList &changed);
+
+private slots:
+    void probeFinished();
+    void probeFailed();
+    void activityChanged(quint64 action, QMailServiceAction::Activity activity);
+
+private:
+    struct Check {
+        quint64 action;
+        QMailFolderIdList folders;
+        QHash<QMailFolderId, QString> paths;
+        QSet<QMailFolderId> needed; // retrieved whatever their state, e.g to get more messages
+    };
+
+    void finish(StatusProbe *probe, const QMailFolderIdList &changed);
+
+    QHash<StatusProbe *, Check> _checks;
+    // Folder states to store once the action succeeds
+    QHash<quint64, QList<QPair<QMailFolderId, QByteArray> > > _unconfirmed;
+    QHash<QMailAccountId, ImapConnection::Endpoint> _unsupported;
+    QHash<QMailAccountId, ImapConnection::Endpoint> _refused; // login failed
+};
+
+#endif
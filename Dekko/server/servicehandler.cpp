@@ -41,6 +41,9 @@
 
 
 #include "servicehandler.h"
+#include "initialsync.h"
+#include "resyncfilter.h"
+#include "RetrievalPriority.h"
 #include <longstream_p.h>
 #include <QDataStream>
 #include <QIODevice>
@@ -56,12 +59,26 @@
 #include <QDir>
 #include <QDateTime>
 #include <QTimer>
+#include <Metrics.h>
+#include <Trace.h>
 
 // Account preparation is handled by an external function
 extern void prepareAccounts();
 
 namespace {
 
+Metrics::Gauge *queuedRequestsGauge()
+{
+    static Metrics::Gauge *gauge = Metrics::gauge("server.queuedRequests");
+    return gauge;
+}
+
+Metrics::Gauge *activeActionsGauge()
+{
+    static Metrics::Gauge *gauge = Metrics::gauge("server.activeActions");
+    return gauge;
+}
+
 template <typename T1>
 QByteArray serialize(const T1& v1)
 {
@@ -540,10 +557,19 @@ QMailMessageIdList ServiceHandler::MessageSearch::takeBatch()
 
 ServiceHandler::ServiceHandler(QObject* parent)
     : QObject(parent),
-      _requestsFile(requestsFileName())
+      mDispatchScheduled(false),
+      mInteractiveQueued(0),
+      _requestJournal(requestsFileName()),
+      _resyncFilter(new ResyncFilter(this)),
+      _initialSync(new InitialSync(this))
 {
     LongStream::cleanupTempFiles();
 
+    connect(_resyncFilter, SIGNAL(checked(quint64, QMailFolderIdList)),
+            this, SLOT(resyncChecked(quint64, QMailFolderIdList)));
+    connect(_initialSync, SIGNAL(finished(quint64)),
+            this, SLOT(initialSyncFinished(quint64)));
+
     ::prepareAccounts();
 
     if (QMailStore *store = QMailStore::instance()) {
@@ -555,31 +581,9 @@ ServiceHandler::ServiceHandler(QObject* parent)
         registerAccountServices(store->queryAccounts());
     }
 
-    // See if there are any requests remaining from our previous run
-    if (_requestsFile.exists()) {
-        if (!_requestsFile.open(QIODevice::ReadOnly)) {
-            qWarning() << "Unable to open requests file for read!";
-        } else {
-            // Every request still in the file failed to complete
-            for (QByteArray line = _requestsFile.readLine(); !line.isEmpty(); line = _requestsFile.readLine()) {
-                if (quint64 action = line.trimmed().toULongLong()) {
-                    _failedRequests.append(action);
-                }
-            }
-
-            _requestsFile.close();
-        }
-    }
-
-    if (!_requestsFile.open(QIODevice::WriteOnly)) {
-        qWarning() << "Unable to open requests file for write!" << _requestsFile.fileName();
-    } else {
-        if (!_requestsFile.resize(0)) {
-            qWarning() << "Unable to truncate requests file!";
-        } else {
-            _requestsFile.flush();
-        }
-    }
+    // See if there are any requests remaining from our previous run,
+    // every request still outstanding in the journal failed to complete
+    _failedRequests = _requestJournal.recover();
 
     if (!_failedRequests.isEmpty()) {
         // Allow the clients some time to reconnect, then report our failures
@@ -643,7 +647,8 @@ void ServiceHandler::removeServiceFromActions(QMailMessageService *removeService
         if (it->services.contains(removeService) || it->preconditions.contains(removeService))
         {
             reportFailure(it->action, QMailServiceAction::Status::ErrFrameworkFault, tr("Service became unavailable, couldn't dispatch"));
-            it = mRequests.erase(it);
+            TRACE_ACTION_END("Queued", it->action);
+            it = eraseRequest(it);
             continue;
         }
         ++it;
@@ -832,6 +837,7 @@ void ServiceHandler::accountsRemoved(const QMailAccountIdList &ids)
 {
     deregisterAccountServices(ids, QMailServiceAction::Status::ErrInternalStateReset, tr("Account removed"));
     foreach (const QMailAccountId &id, ids) {
+        mAccountSlots.remove(id);
         // remove messages from this account
         QMailMessageKey messageKey(QMailMessageKey::parentAccountId(id));
         QMailStore::instance()->removeMessages(messageKey);
@@ -1068,7 +1074,7 @@ quint64 ServiceHandler::serviceAction(QMailMessageService *service) const
     return 0;
 }
 
-void ServiceHandler::enqueueRequest(quint64 action, const QByteArray &data, const QSet<QMailMessageService*> &services, RequestServicer servicer, CompletionSignal completion, QMailServerRequestType description, const QSet<QMailMessageService*> &preconditions)
+void ServiceHandler::enqueueRequest(quint64 action, const QByteArray &data, const QSet<QMailMessageService*> &services, RequestServicer servicer, CompletionSignal completion, QMailServerRequestType description, const QSet<QMailMessageService*> &preconditions, bool interactive)
 {
     QSet<QPointer<QMailMessageService> > safeServices;
     QSet<QPointer<QMailMessageService> > safePreconditions;
@@ -1084,19 +1090,17 @@ void ServiceHandler::enqueueRequest(quint64 action, const QByteArray &data, cons
     req.servicer = servicer;
     req.completion = completion;
     req.description = description;
+    req.interactive = interactive || isInteractive(description);
+    req.accounts = requestAccounts(req.services);
+    req.queued.start();
 
-    mRequests.append(req);
+    appendRequest(req);
 
     // Add this request to the outstanding list
-    if (!_outstandingRequests.contains(action)) {
-        _outstandingRequests.insert(action);
-
-        QByteArray requestNumber(QByteArray::number(action));
-        _requestsFile.write(requestNumber.append('\n'));
-        _requestsFile.flush();
-    }
+    _requestJournal.enqueued(action);
+    TRACE_ACTION_BEGIN("Queued", action);
 
-    QTimer::singleShot(0, this, SLOT(dispatchRequest()));
+    scheduleDispatch();
 }
 
 namespace {
@@ -1129,31 +1133,181 @@ const char* requestTypeNames[] =
 };
 }
 
+void ServiceHandler::scheduleDispatch()
+{
+    // Any number of completions within one event loop pass only need a single scan
+    if (!mDispatchScheduled) {
+        mDispatchScheduled = true;
+        QTimer::singleShot(0, this, SLOT(dispatchRequest()));
+    }
+}
+
+void ServiceHandler::insertActiveAction(quint64 action, const ActionData &data)
+{
+    QMap<quint64, ActionData>::iterator it = mActiveActions.insert(action, data);
+    it->started.start();
+    activeActionsGauge()->set(mActiveActions.size());
+    ++mProcessActionCount[action >> 32];
+    foreach (const QMailAccountId &accountId, data.accounts)
+        ++mAccountSlots[accountId].active;
+}
+
+QMap<quint64, ServiceHandler::ActionData>::iterator ServiceHandler::eraseActiveAction(QMap<quint64, ActionData>::iterator it, ActionOutcome outcome)
+{
+    QHash<quint64, int>::iterator count = mProcessActionCount.find(it.key() >> 32);
+    if (count != mProcessActionCount.end() && --count.value() <= 0)
+        mProcessActionCount.erase(count);
+    TRACE_ACTION_END(::requestTypeNames[it->description], it.key());
+
+    const qint64 elapsed = it->started.elapsed();
+    const QByteArray type(::requestTypeNames[it->description]);
+    Metrics::histogram("server.run." + type)->record(it->started.nsecsElapsed() / 1000);
+    if (outcome == ActionFailed) {
+        Metrics::counter("server.failed." + type)->add();
+    } else if (outcome == ActionCancelled) {
+        Metrics::counter("server.cancelled." + type)->add();
+    }
+    const int maxAccountActions = QMail::maximumConcurrentServiceActions();
+    foreach (const QMailAccountId &accountId, it->accounts) {
+        QHash<QMailAccountId, AccountSlots>::iterator slots = mAccountSlots.find(accountId);
+        if (slots == mAccountSlots.end())
+            continue;
+        slots->active = qMax(0, slots->active - 1);
+        // Additive increase while the server keeps up, multiplicative decrease when it doesn't
+        if (outcome == ActionFailed) {
+            slots->limit = qMax(1, slots->limit / 2);
+        } else if (outcome == ActionSucceeded && elapsed < SlowActionMs) {
+            slots->limit = qMin(maxAccountActions, slots->limit + 1);
+        }
+    }
+    QMap<quint64, ActionData>::iterator next = mActiveActions.erase(it);
+    activeActionsGauge()->set(mActiveActions.size());
+    return next;
+}
+
+QSet<QMailAccountId> ServiceHandler::requestAccounts(const QSet<QPointer<QMailMessageService> > &services) const
+{
+    QSet<QMailAccountId> accounts;
+    foreach (QMailMessageService *service, services) {
+        if (service && service->accountId().isValid())
+            accounts.insert(service->accountId());
+    }
+    return accounts;
+}
+
+bool ServiceHandler::accountSlotsAvailable(const QSet<QMailAccountId> &accounts, int fairShare) const
+{
+    foreach (const QMailAccountId &accountId, accounts) {
+        const AccountSlots slots = mAccountSlots.value(accountId);
+        if (slots.active >= qMin(slots.limit, fairShare))
+            return false;
+    }
+    return true;
+}
+
+void ServiceHandler::appendRequest(const Request &request)
+{
+    mRequests.append(request);
+    queuedRequestsGauge()->set(mRequests.size());
+    if (request.interactive)
+        ++mInteractiveQueued;
+    foreach (const QMailAccountId &accountId, request.accounts)
+        ++mAccountSlots[accountId].queued;
+}
+
+QList<ServiceHandler::Request>::iterator ServiceHandler::eraseRequest(QList<Request>::iterator it)
+{
+    if (it->interactive)
+        --mInteractiveQueued;
+    foreach (const QMailAccountId &accountId, it->accounts) {
+        QHash<QMailAccountId, AccountSlots>::iterator slots = mAccountSlots.find(accountId);
+        if (slots != mAccountSlots.end())
+            slots->queued = qMax(0, slots->queued - 1);
+    }
+    QList<Request>::iterator next = mRequests.erase(it);
+    queuedRequestsGauge()->set(mRequests.size());
+    return next;
+}
+
+bool ServiceHandler::isInteractive(QMailServerRequestType description)
+{
+    // Someone is looking at the result of these
+    switch (description) {
+    case RetrieveMessagePartRequestType:
+    case RetrieveMessagePartRangeRequestType:
+    case RetrieveMessageRangeRequestType:
+    case TransmitMessagesRequestType:
+    case SearchMessagesRequestType:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ServiceHandler::appendActionExpiry(quint64 action)
+{
+    mActionExpiryIndex.insert(action, mActionExpiry.insert(mActionExpiry.end(), action));
+}
+
+QLinkedList<quint64>::iterator ServiceHandler::eraseActionExpiry(QLinkedList<quint64>::iterator it)
+{
+    QHash<quint64, QLinkedList<quint64>::iterator>::iterator index = mActionExpiryIndex.find(*it);
+    if (index != mActionExpiryIndex.end() && index.value() == it)
+        mActionExpiryIndex.erase(index);
+    return mActionExpiry.erase(it);
+}
+
 void ServiceHandler::dispatchRequest()
 {
+    TRACE_SPAN("ServiceHandler::dispatchRequest");
+    mDispatchScheduled = false;
+
+    const int maxActions = QMail::maximumConcurrentServiceActions();
+
+    // Nothing can start until something finishes
+    if (mActiveActions.count() >= maxActions + ReservedInteractiveActions)
+        return;
+
+    // Share the device limit between every account with work to do so one slow
+    // server can't hold all the slots while other accounts wait
+    int busyAccounts = 0;
+    for (QHash<QMailAccountId, AccountSlots>::const_iterator it = mAccountSlots.constBegin(); it != mAccountSlots.constEnd(); ++it) {
+        if (it->active > 0 || it->queued > 0)
+            ++busyAccounts;
+    }
+    const int fairShare = qMax(1, maxActions / qMax(1, busyAccounts));
+
+    // Interactive requests go first, then everything else in the order queued
+    if (mInteractiveQueued > 0)
+        dispatchRequests(true, fairShare);
+    dispatchRequests(false, fairShare);
+}
+
+void ServiceHandler::dispatchRequests(bool interactivePass, int fairShare)
+{
+    const int maxActions = QMail::maximumConcurrentServiceActions();
+
     QList<Request>::iterator request(mRequests.begin());
     while(request != mRequests.end())
     {
-        if (!servicesAvailable(*request)) {
+        if (request->interactive != interactivePass || !servicesAvailable(*request)) {
             ++request;
             continue;
         }
 
-        // Limit number of concurrent actions serviced on the device 
-        if (mActiveActions.count() >= QMail::maximumConcurrentServiceActions())
-            return;
+        // Limit number of concurrent actions serviced on the device, user visible
+        // requests get a reserved slot so they aren't stuck behind background syncs
+        if (mActiveActions.count() >= maxActions + (interactivePass ? ReservedInteractiveActions : 0))
+            break;
 
-        // Limit number of concurrent actions serviced per process
-        const quint64 requestProcess = request->action >> 32;
-        int requestProcessCount = 1; // including the request
-        foreach(quint64 actionId, mActiveActions.keys()) {
-            if ((actionId >> 32) == requestProcess) {
-                if (++requestProcessCount > QMail::maximumConcurrentServiceActionsPerProcess()) {
-                    break;
-                }
-            }
+        // Limit number of concurrent actions serviced per account
+        if (!interactivePass && !accountSlotsAvailable(request->accounts, fairShare)) {
+            ++request;
+            continue;
         }
 
+        // Limit number of concurrent actions serviced per process
+        const int requestProcessCount = mProcessActionCount.value(request->action >> 32) + 1; // including the request
         if (requestProcessCount > QMail::maximumConcurrentServiceActionsPerProcess()) {
             ++request;
             continue;
@@ -1173,9 +1327,13 @@ void ServiceHandler::dispatchRequest()
         data.progressTotal = 0;
         data.progressCurrent = 0;
         data.status = QMailServiceAction::Status(QMailServiceAction::Status::ErrNoError, QString(), QMailAccountId(), QMailFolderId(), QMailMessageId());
+        data.accounts = request->accounts;
 
-        mActiveActions.insert(request->action, data);
+        insertActiveAction(request->action, data);
         qDebug() << "Running action" << ::requestTypeNames[data.description] << request->action;
+        TRACE_ACTION_END("Queued", request->action);
+        Metrics::histogram("server.queueWait." + QByteArray(::requestTypeNames[data.description]))->record(request->queued.nsecsElapsed() / 1000);
+        TRACE_ACTION_BEGIN(::requestTypeNames[data.description], request->action);
         emit actionStarted(QMailActionData(request->action, request->description, 0, 0, 
                                            data.status.errorCode, data.status.text, 
                                            data.status.accountId, data.status.folderId, data.status.messageId));
@@ -1189,9 +1347,11 @@ void ServiceHandler::dispatchRequest()
                 const int expiryMs = ExpirySeconds * 1000;
                 QTimer::singleShot(expiryMs + 50, this, SLOT(expireAction()));
             }
-            mActionExpiry.append(request->action);
+            appendActionExpiry(request->action);
         } else {
-            mActiveActions.remove(request->action);
+            QMap<quint64, ActionData>::iterator it = mActiveActions.find(request->action);
+            if (it != mActiveActions.end())
+                eraseActiveAction(it, ActionFailed);
 
             qWarning() << "Unable to dispatch request:" << request->action << "to services:" << request->services;
             emit activityChanged(request->action, QMailServiceAction::Failed);
@@ -1200,17 +1360,18 @@ void ServiceHandler::dispatchRequest()
                 mServiceAction.remove(service);
         }
 
-        request = mRequests.erase(request);
+        request = eraseRequest(request);
     }
 }
 
 void ServiceHandler::updateAction(quint64 action)
 {
-    QLinkedList<quint64>::iterator it = qFind(mActionExpiry.begin(), mActionExpiry.end(), action);
-    if (it != mActionExpiry.end()) {
-        // Move this action to the end of the list
-        mActionExpiry.erase(it);
-        mActionExpiry.append(action);
+    QHash<quint64, QLinkedList<quint64>::iterator>::iterator index = mActionExpiryIndex.find(action);
+    if (index != mActionExpiryIndex.end()) {
+        // Move this action to the end of the list, expiry times are all now + ExpirySeconds
+        // so the list stays ordered
+        mActionExpiry.erase(index.value());
+        index.value() = mActionExpiry.insert(mActionExpiry.end(), action);
 
         // Update the expiry time for this action
         mActiveActions[action].unixTimeExpiry = QDateTime::currentDateTime().toTime_t() + ExpirySeconds;
@@ -1231,6 +1392,7 @@ void ServiceHandler::expireAction()
             // Is the oldest action expired?
             if (data.unixTimeExpiry <= now) {
                 qWarning() << "Expired request:" << action;
+                Metrics::counter("server.expired." + QByteArray(::requestTypeNames[data.description]))->add();
                 reportFailure(action, QMailServiceAction::Status::ErrTimeout, tr("Request is not progressing"));
                 emit activityChanged(action, QMailServiceAction::Failed);
 
@@ -1273,10 +1435,10 @@ void ServiceHandler::expireAction()
                         QMailStore::instance()->setTransmissionInProgress(_transmissionAccountIds.toList());
                     }
 
-                    mActiveActions.erase(it);
+                    eraseActiveAction(it, ActionFailed);
                 }
 
-                mActionExpiry.removeFirst();
+                eraseActionExpiry(mActionExpiry.begin());
 
                 // Restart the service(s) for each of these accounts
                 QMailAccountIdList ids(serviceAccounts.toList());
@@ -1299,7 +1461,7 @@ void ServiceHandler::expireAction()
             QTimer::singleShot(nextShot, this, SLOT(expireAction()));
             return;
         } else {
-            expiryIt = mActionExpiry.erase(expiryIt); // Just remove this non-existent action
+            expiryIt = eraseActionExpiry(expiryIt); // Just remove this non-existent action
         }
     }
 }
@@ -1307,6 +1469,7 @@ void ServiceHandler::expireAction()
 // Cancelled by user
 void ServiceHandler::cancelTransfer(quint64 action)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::cancelTransfer", action);
     cancelLocalSearch(action);
     QMap<quint64, ActionData>::iterator it = mActiveActions.find(action);
     if (it != mActiveActions.end()) {
@@ -1352,20 +1515,27 @@ void ServiceHandler::cancelTransfer(quint64 action)
 
         //The ActionData might have already been deleted by actionCompleted, triggered by cancelOperation
         it = mActiveActions.find(action);
-        if (it != mActiveActions.end()) mActiveActions.erase(it);
+        if (it != mActiveActions.end()) eraseActiveAction(it, ActionCancelled);
 
         // See if there are more actions 
-        QTimer::singleShot(0, this, SLOT(dispatchRequest()));
+        scheduleDispatch();
     } else {
         // See if this is a pending request that we can abort
         QList<Request>::iterator it = mRequests.begin(), end = mRequests.end();
         for ( ; it != end; ++it) {
             if ((*it).action == action) {
-                mRequests.erase(it);
+                TRACE_ACTION_END("Queued", action);
+                eraseRequest(it);
                 break;
             }
         }
 
+        if (_awaitingResync.remove(action))
+            _resyncFilter->cancel(action);
+        if (_awaitingInitialSync.remove(action))
+            _initialSync->cancel(action);
+        _requestJournal.completed(action);
+
         // Report this action as failed
         reportFailure(action, QMailServiceAction::Status::ErrCancel, tr("Cancelled by user"));
     }
@@ -1373,6 +1543,7 @@ void ServiceHandler::cancelTransfer(quint64 action)
 
 void ServiceHandler::transmitMessages(quint64 action, const QMailAccountId &accountId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::transmitMessages", action);
     // Ensure that this account has a sink configured
     QSet<QMailMessageService*> sinks(sinkServiceSet(accountId));
     if (sinks.isEmpty()) {
@@ -1408,6 +1579,7 @@ void ServiceHandler::transmitMessages(quint64 action, const QMailAccountId &acco
 
 void ServiceHandler::transmitMessage(quint64 action, const QMailMessageId &messageId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::transmitMessage", action);
     QMailAccountId accountId(QMailMessageMetaData(messageId).parentAccountId());
     // Ensure that this account has a sink configured
     QSet<QMailMessageService*> sinks(sinkServiceSet(accountId));
@@ -1542,6 +1714,7 @@ bool ServiceHandler::dispatchTransmitMessage(quint64 action, const QByteArray &d
 
 void ServiceHandler::retrieveFolderList(quint64 action, const QMailAccountId &accountId, const QMailFolderId &folderId, bool descending)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveFolderList", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve folder list for unconfigured account"));
@@ -1580,9 +1753,14 @@ bool ServiceHandler::dispatchRetrieveFolderListAccount(quint64 action, const QBy
 
 void ServiceHandler::retrieveMessageList(quint64 action, const QMailAccountId &accountId, const QMailFolderId &folderId, uint minimum, const QMailMessageSortKey &sort)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveMessageList", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve message list for unconfigured account"));
+    } else if (_initialSync->sync(action, accountId, QMailFolderIdList() << folderId, minimum)) {
+        // Carries on as a request for a list of one folder, which the services treat the same
+        _awaitingInitialSync.insert(action, serialize(accountId, QMailFolderIdList() << folderId, minimum, sort));
+        _requestJournal.enqueued(action);
     } else {
         enqueueRequest(action, serialize(accountId, folderId, minimum, sort), sources, &ServiceHandler::dispatchRetrieveMessageList, &ServiceHandler::retrievalCompleted, RetrieveMessageListRequestType);
     }
@@ -1618,11 +1796,76 @@ bool ServiceHandler::dispatchRetrieveMessageList(quint64 action, const QByteArra
 
 void ServiceHandler::retrieveMessageLists(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds, uint minimum, const QMailMessageSortKey &sort)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveMessageLists", action);
+    QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
+    if (sources.isEmpty()) {
+        reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve message list for unconfigured account"));
+    } else if (_initialSync->sync(action, accountId, folderIds, minimum)) {
+        _awaitingInitialSync.insert(action, serialize(accountId, folderIds, minimum, sort));
+        _requestJournal.enqueued(action);
+    } else {
+        queueMessageLists(action, accountId, folderIds, minimum, sort);
+    }
+}
+
+void ServiceHandler::initialSyncFinished(quint64 action)
+{
+    TRACE_ACTION_SPAN("ServiceHandler::initialSyncFinished", action);
+    if (!_awaitingInitialSync.contains(action))
+        return;
+
+    QMailAccountId accountId;
+    QMailFolderIdList folderIds;
+    uint minimum;
+    QMailMessageSortKey sort;
+
+    deserialize(_awaitingInitialSync.take(action), accountId, folderIds, minimum, sort);
+
+    if (sourceServiceSet(accountId).isEmpty()) {
+        _requestJournal.completed(action);
+        reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve message list for unconfigured account"));
+    } else {
+        queueMessageLists(action, accountId, folderIds, minimum, sort);
+    }
+}
+
+void ServiceHandler::queueMessageLists(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds, uint minimum, const QMailMessageSortKey &sort)
+{
+    if (_resyncFilter->check(action, accountId, folderIds, minimum)) {
+        _awaitingResync.insert(action, serialize(accountId, folderIds, minimum, sort));
+        _requestJournal.enqueued(action);
+    } else {
+        enqueueRequest(action, serialize(accountId, folderIds, minimum, sort), sourceServiceSet(accountId), &ServiceHandler::dispatchRetrieveMessageLists, &ServiceHandler::retrievalCompleted, RetrieveMessageListRequestType);
+    }
+}
+
+void ServiceHandler::resyncChecked(quint64 action, const QMailFolderIdList &changed)
+{
+    TRACE_ACTION_SPAN("ServiceHandler::resyncChecked", action);
+    if (!_awaitingResync.contains(action))
+        return;
+
+    QMailAccountId accountId;
+    QMailFolderIdList folderIds;
+    uint minimum;
+    QMailMessageSortKey sort;
+
+    deserialize(_awaitingResync.take(action), accountId, folderIds, minimum, sort);
+
+    if (changed.isEmpty()) {
+        // Nothing changed on the server since the last sync
+        _requestJournal.completed(action);
+        emit retrievalCompleted(action);
+        emit activityChanged(action, QMailServiceAction::Successful);
+        return;
+    }
+
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
+        _requestJournal.completed(action);
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve message list for unconfigured account"));
     } else {
-        enqueueRequest(action, serialize(accountId, folderIds, minimum, sort), sources, &ServiceHandler::dispatchRetrieveMessageLists, &ServiceHandler::retrievalCompleted, RetrieveMessageListRequestType);
+        enqueueRequest(action, serialize(accountId, changed, minimum, sort), sources, &ServiceHandler::dispatchRetrieveMessageLists, &ServiceHandler::retrievalCompleted, RetrieveMessageListRequestType);
     }
 }
 
@@ -1656,6 +1899,7 @@ bool ServiceHandler::dispatchRetrieveMessageLists(quint64 action, const QByteArr
 
 void ServiceHandler::retrieveNewMessages(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveNewMessages", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve new messages for unconfigured account"));
@@ -1692,6 +1936,7 @@ bool ServiceHandler::dispatchRetrieveNewMessages(quint64 action, const QByteArra
 
 void ServiceHandler::createStandardFolders(quint64 action, const QMailAccountId &accountId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::createStandardFolders", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve standard folders for unconfigured account"));
@@ -1726,13 +1971,16 @@ bool ServiceHandler::dispatchCreateStandardFolders(quint64 action, const QByteAr
 
 void ServiceHandler::retrieveMessages(quint64 action, const QMailMessageIdList &messageIds, QMailRetrievalAction::RetrievalSpecification spec)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveMessages", action);
     QMap<QMailAccountId, QMailMessageIdList> messageLists(accountMessages(messageIds));
 
     QSet<QMailMessageService*> sources(sourceServiceSet(messageLists.keys().toSet()));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve messages for unconfigured account"));
     } else {
-        enqueueRequest(action, serialize(messageLists, spec), sources, &ServiceHandler::dispatchRetrieveMessages, &ServiceHandler::retrievalCompleted, RetrieveMessagesRequestType);
+        // Prefetch marks itself as background, anything else is someone opening a message
+        const bool interactive = !RetrievalPriority::isBackground(spec);
+        enqueueRequest(action, serialize(messageLists, RetrievalPriority::specification(spec)), sources, &ServiceHandler::dispatchRetrieveMessages, &ServiceHandler::retrievalCompleted, RetrieveMessagesRequestType, QSet<QMailMessageService*>(), interactive);
     }
 }
 
@@ -1771,6 +2019,7 @@ bool ServiceHandler::dispatchRetrieveMessages(quint64 action, const QByteArray &
 
 void ServiceHandler::retrieveMessagePart(quint64 action, const QMailMessagePart::Location &partLocation)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveMessagePart", action);
     QSet<QMailAccountId> accountIds(messageAccount(partLocation.containingMessageId()));
     QSet<QMailMessageService*> sources(sourceServiceSet(accountIds));
     if (sources.isEmpty()) {
@@ -1809,6 +2058,7 @@ bool ServiceHandler::dispatchRetrieveMessagePart(quint64 action, const QByteArra
 
 void ServiceHandler::retrieveMessageRange(quint64 action, const QMailMessageId &messageId, uint minimum)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveMessageRange", action);
     QSet<QMailAccountId> accountIds(messageAccount(messageId));
     QSet<QMailMessageService*> sources(sourceServiceSet(accountIds));
     if (sources.isEmpty()) {
@@ -1848,6 +2098,7 @@ bool ServiceHandler::dispatchRetrieveMessageRange(quint64 action, const QByteArr
 
 void ServiceHandler::retrieveMessagePartRange(quint64 action, const QMailMessagePart::Location &partLocation, uint minimum)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveMessagePartRange", action);
     QSet<QMailAccountId> accountIds(messageAccount(partLocation.containingMessageId()));
     QSet<QMailMessageService*> sources(sourceServiceSet(accountIds));
     if (sources.isEmpty()) {
@@ -1888,6 +2139,7 @@ bool ServiceHandler::dispatchRetrieveMessagePartRange(quint64 action, const QByt
 
 void ServiceHandler::retrieveAll(quint64 action, const QMailAccountId &accountId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::retrieveAll", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to retrieve all messages for unconfigured account"));
@@ -1924,6 +2176,7 @@ bool ServiceHandler::dispatchRetrieveAll(quint64 action, const QByteArray &data)
 
 void ServiceHandler::exportUpdates(quint64 action, const QMailAccountId &accountId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::exportUpdates", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to export updates for unconfigured account"));
@@ -1957,6 +2210,7 @@ bool ServiceHandler::dispatchExportUpdates(quint64 action, const QByteArray &dat
 
 void ServiceHandler::synchronize(quint64 action, const QMailAccountId &accountId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::synchronize", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to synchronize unconfigured account"));
@@ -1994,6 +2248,7 @@ bool ServiceHandler::dispatchSynchronize(quint64 action, const QByteArray &data)
 
 void ServiceHandler::onlineDeleteMessages(quint64 action, const QMailMessageIdList& messageIds, QMailStore::MessageRemovalOption option)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::onlineDeleteMessages", action);
     QSet<QMailMessageService*> sources;
 
     if (option == QMailStore::NoRemovalRecord) {
@@ -2013,6 +2268,7 @@ void ServiceHandler::onlineDeleteMessages(quint64 action, const QMailMessageIdLi
 
 void ServiceHandler::discardMessages(quint64 action, QMailMessageIdList messageIds)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::discardMessages", action);
     uint progress = 0;
     uint total = messageIds.count();
 
@@ -2063,6 +2319,7 @@ bool ServiceHandler::dispatchOnlineDeleteMessages(quint64 action, const QByteArr
 
 void ServiceHandler::onlineCopyMessages(quint64 action, const QMailMessageIdList& messageIds, const QMailFolderId &destination)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::onlineCopyMessages", action);
     QSet<QMailAccountId> accountIds(folderAccount(destination));
 
     if (accountIds.isEmpty()) {
@@ -2154,6 +2411,7 @@ bool ServiceHandler::dispatchCopyToLocal(quint64 action, const QByteArray &data)
 
 void ServiceHandler::onlineMoveMessages(quint64 action, const QMailMessageIdList& messageIds, const QMailFolderId &destination)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::onlineMoveMessages", action);
     QSet<QMailMessageService*> sources;
 
     QMap<QMailAccountId, QMailMessageIdList> messageLists(accountMessages(messageIds));
@@ -2195,6 +2453,7 @@ bool ServiceHandler::dispatchOnlineMoveMessages(quint64 action, const QByteArray
 
 void ServiceHandler::onlineFlagMessagesAndMoveToStandardFolder(quint64 action, const QMailMessageIdList& messageIds, quint64 setMask, quint64 unsetMask)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::onlineFlagMessagesAndMoveToStandardFolder", action);
     QSet<QMailMessageService*> sources;
 
     QMap<QMailAccountId, QMailMessageIdList> messageLists(accountMessages(messageIds));
@@ -2208,6 +2467,7 @@ void ServiceHandler::onlineFlagMessagesAndMoveToStandardFolder(quint64 action, c
 
 void ServiceHandler::addOrUpdateMessages(quint64 action, const QString &filename, bool add)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::addOrUpdateMessages", action);
     QFile file(filename);
     QFileInfo fi(file);
     QMailMessageIdList ids;
@@ -2262,6 +2522,7 @@ void ServiceHandler::updateMessages(quint64 action, const QString &filename)
 
 void ServiceHandler::addMessages(quint64 action, const QMailMessageMetaDataList &messages)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::addMessages", action);
     bool failure = false;
     QList<QMailMessageMetaData*> list;
     QString scheme;
@@ -2314,6 +2575,7 @@ void ServiceHandler::addMessages(quint64 action, const QMailMessageMetaDataList
 
 void ServiceHandler::updateMessages(quint64 action, const QMailMessageMetaDataList &messages)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::updateMessages", action);
     bool failure = false;
     QList<QMailMessageMetaData*> list;
     QString scheme;
@@ -2404,6 +2666,7 @@ bool ServiceHandler::dispatchOnlineFlagMessagesAndMoveToStandardFolder(quint64 a
 
 void ServiceHandler::deleteMessages(quint64 action, const QMailMessageIdList& messageIds)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::deleteMessages", action);
     uint total = messageIds.count();
 
     // Just delete all these messages from device and mark for deletion on server when exportUpdates is called
@@ -2423,6 +2686,7 @@ void ServiceHandler::deleteMessages(quint64 action, const QMailMessageIdList& me
 
 void ServiceHandler::rollBackUpdates(quint64 action, const QMailAccountId &mailAccountId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::rollBackUpdates", action);
     QMailDisconnected::rollBackUpdates(mailAccountId);
     
     emit storageActionCompleted(action);
@@ -2433,6 +2697,7 @@ void ServiceHandler::rollBackUpdates(quint64 action, const QMailAccountId &mailA
 
 void ServiceHandler::moveToStandardFolder(quint64 action, const QMailMessageIdList& ids, quint64 standardFolder)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::moveToStandardFolder", action);
     QMailDisconnected::moveToStandardFolder(ids, static_cast<QMailFolder::StandardFolder>(standardFolder));
     messagesMoved(ids, action);
     messagesFlagged(ids, action);
@@ -2445,6 +2710,7 @@ void ServiceHandler::moveToStandardFolder(quint64 action, const QMailMessageIdLi
 
 void ServiceHandler::moveToFolder(quint64 action, const QMailMessageIdList& ids, const QMailFolderId& folderId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::moveToFolder", action);
     QMailDisconnected::moveToFolder(ids, folderId);
     messagesMoved(ids, action);
     
@@ -2456,6 +2722,7 @@ void ServiceHandler::moveToFolder(quint64 action, const QMailMessageIdList& ids,
 
 void ServiceHandler::flagMessages(quint64 action, const QMailMessageIdList& ids, quint64 setMask, quint64 unsetMask)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::flagMessages", action);
     QMailDisconnected::flagMessages(ids, setMask, unsetMask, "");
     messagesFlagged(ids, action);
     
@@ -2467,6 +2734,7 @@ void ServiceHandler::flagMessages(quint64 action, const QMailMessageIdList& ids,
 
 void ServiceHandler::restoreToPreviousFolder(quint64 action, const QMailMessageKey& key)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::restoreToPreviousFolder", action);
     QMailDisconnected::restoreToPreviousFolder(key);
     
     emit storageActionCompleted(action);
@@ -2477,6 +2745,7 @@ void ServiceHandler::restoreToPreviousFolder(quint64 action, const QMailMessageK
 
 void ServiceHandler::onlineCreateFolder(quint64 action, const QString &name, const QMailAccountId &accountId, const QMailFolderId &parentId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::onlineCreateFolder", action);
     if(accountId.isValid()) {
 
         QSet<QMailAccountId> accounts;
@@ -2521,6 +2790,7 @@ bool ServiceHandler::dispatchOnlineCreateFolder(quint64 action, const QByteArray
 
 void ServiceHandler::onlineRenameFolder(quint64 action, const QMailFolderId &folderId, const QString &name)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::onlineRenameFolder", action);
     if(folderId.isValid()) {
         QSet<QMailAccountId> accounts = folderAccount(folderId);
         QSet<QMailMessageService *> sources(sourceServiceSet(accounts));
@@ -2557,6 +2827,7 @@ bool ServiceHandler::dispatchOnlineRenameFolder(quint64 action, const QByteArray
 
 void ServiceHandler::onlineDeleteFolder(quint64 action, const QMailFolderId &folderId)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::onlineDeleteFolder", action);
     if(folderId.isValid()) {
         QSet<QMailAccountId> accounts = folderAccount(folderId);
         QSet<QMailMessageService *> sources(sourceServiceSet(accounts));
@@ -2603,6 +2874,7 @@ void ServiceHandler::countMessages(quint64 action, const QMailMessageKey& filter
 
 void ServiceHandler::searchMessages(quint64 action, const QMailMessageKey& filter, const QString& bodyText, QMailSearchAction::SearchSpecification spec, quint64 limit, const QMailMessageSortKey &sort, SearchType searchType)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::searchMessages", action);
     if (spec == QMailSearchAction::Remote) {
         // Find the accounts that we need to search within from the criteria
         QSet<QMailAccountId> searchAccountIds(accountsApplicableTo(filter, sourceMap.keys().toSet()));
@@ -2837,28 +3109,18 @@ void ServiceHandler::actionCompleted(bool success, QMailMessageService *service,
 
         if (data.services.isEmpty()) {
             // This action is finished
-            mActiveActions.erase(it);
+            eraseActiveAction(it, success ? ActionSucceeded : ActionFailed);
             emit activityChanged(action, success ? QMailServiceAction::Successful : QMailServiceAction::Failed);
         }
     }
 
-    if (_outstandingRequests.contains(action)) {
-        _outstandingRequests.remove(action);
-
-        // Ensure this request is no longer in the file
-        _requestsFile.resize(0);
-        foreach (quint64 req, _outstandingRequests) {
-            QByteArray requestNumber(QByteArray::number(req));
-            _requestsFile.write(requestNumber.append('\n'));
-        }
-        _requestsFile.flush();
-    }
+    _requestJournal.completed(action);
 
     mServiceAction.remove(service);
 
 
     // See if there are pending requests
-    QTimer::singleShot(0, this, SLOT(dispatchRequest()));
+    scheduleDispatch();
 }
 
 void ServiceHandler::messagesTransmitted(const QMailMessageIdList& ml, quint64 a)
@@ -2921,6 +3183,7 @@ void ServiceHandler::protocolResponse(const QString &response, const QVariant &d
 
 void ServiceHandler::protocolRequest(quint64 action, const QMailAccountId &accountId, const QString &request, const QVariant &data)
 {
+    TRACE_ACTION_SPAN("ServiceHandler::protocolRequest", action);
     QSet<QMailMessageService*> sources(sourceServiceSet(accountId));
     if (sources.isEmpty()) {
         reportFailure(action, QMailServiceAction::Status::ErrNoConnection, tr("Unable to forward protocol-specific request for unconfigured account"));
@@ -3033,7 +3296,7 @@ void ServiceHandler::availabilityChanged(bool available)
             mUnavailableServices.remove(service);
 
             // See if there are pending requests that can now be dispatched
-            QTimer::singleShot(0, this, SLOT(dispatchRequest()));
+            scheduleDispatch();
         } else {
             mUnavailableServices.insert(service);
         }
@@ -3096,7 +3359,7 @@ void ServiceHandler::actionCompleted(bool success)
 
     qWarning() << "Would not determine server/action completing";
     // See if there are pending requests
-    QTimer::singleShot(0, this, SLOT(dispatchRequest()));
+    scheduleDispatch();
 }
 
 void ServiceHandler::reportFailure(quint64 action, QMailServiceAction::Status::ErrorCode code, const QString &text, const QMailAccountId &accountId, const QMailFolderId &folderId, const QMailMessageId &messageId)
@@ -43,7 +43,9 @@
 #define SERVICEHANDLER_H
 
 #include <QByteArray>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QHash>
 #include <QLinkedList>
 #include <QList>
 #include <qmailmessageserver.h>
@@ -54,8 +56,11 @@
 #include <QString>
 #include <QStringList>
 #include <QPointer>
+#include "requestjournal.h"
 
 class QMailServiceConfiguration;
+class InitialSync;
+class ResyncFilter;
 
 class ServiceHandler : public QObject
 {
@@ -196,6 +201,9 @@ private slots:
 
     void continueSearch();
 
+    void resyncChecked(quint64 action, const QMailFolderIdList &changed);
+    void initialSyncFinished(quint64 action);
+
     void dispatchRequest();
 
     void expireAction();
@@ -247,7 +255,8 @@ private:
     typedef bool (ServiceHandler::*RequestServicer)(quint64, const QByteArray &);
     typedef void (ServiceHandler::*CompletionSignal)(quint64);
 
-    void enqueueRequest(quint64 action, const QByteArray &data, const QSet<QMailMessageService*> &services, RequestServicer servicer, CompletionSignal completion, QMailServerRequestType description, const QSet<QMailMessageService*> &preconditions = QSet<QMailMessageService*>());
+    void enqueueRequest(quint64 action, const QByteArray &data, const QSet<QMailMessageService*> &services, RequestServicer servicer, CompletionSignal completion, QMailServerRequestType description, const QSet<QMailMessageService*> &preconditions = QSet<QMailMessageService*>(), bool interactive = false);
+    void queueMessageLists(quint64 action, const QMailAccountId &accountId, const QMailFolderIdList &folderIds, uint minimum, const QMailMessageSortKey &sort);
 
     bool dispatchPrepareMessages(quint64 action, const QByteArray& data);
     bool dispatchTransmitMessages(quint64 action, const QByteArray& data);
@@ -306,10 +315,55 @@ private:
         uint progressTotal;
         uint progressCurrent;
         QMailServiceAction::Status status;
+        // Accounts whose concurrency slots this action occupies
+        QSet<QMailAccountId> accounts;
+        QElapsedTimer started;
+    };
+
+    enum ActionOutcome {
+        ActionSucceeded,
+        ActionFailed,
+        ActionCancelled
+    };
+
+    // Concurrency slots for one account, the limit adapts to how the account's server is coping
+    struct AccountSlots
+    {
+        AccountSlots() : active(0), queued(0), limit(InitialAccountActions) {}
+        int active;
+        // Requests waiting on this account, kept as they come and go so dispatch needn't scan them
+        int queued;
+        int limit;
     };
     
     QMap<quint64, ActionData> mActiveActions;
+    // Number of active actions per client process, keyed by the top 32 bits of the action id
+    QHash<quint64, int> mProcessActionCount;
     QLinkedList<quint64> mActionExpiry;
+    // Position of each action in mActionExpiry so updates don't need a linear search
+    QHash<quint64, QLinkedList<quint64>::iterator> mActionExpiryIndex;
+    bool mDispatchScheduled;
+    // Number of queued requests someone is waiting on
+    int mInteractiveQueued;
+
+    void insertActiveAction(quint64 action, const ActionData &data);
+    QMap<quint64, ActionData>::iterator eraseActiveAction(QMap<quint64, ActionData>::iterator it, ActionOutcome outcome);
+    QHash<QMailAccountId, AccountSlots> mAccountSlots;
+
+    static const int InitialAccountActions = 2;
+    // Interactive requests may go over the device limit by this much
+    static const int ReservedInteractiveActions = 1;
+    // Successful actions quicker than this grow the account's limit
+    static const int SlowActionMs = 30000;
+
+    QSet<QMailAccountId> requestAccounts(const QSet<QPointer<QMailMessageService> > &services) const;
+    bool accountSlotsAvailable(const QSet<QMailAccountId> &accounts, int fairShare) const;
+    void dispatchRequests(bool interactivePass, int fairShare);
+    void appendRequest(const Request &request);
+    static bool isInteractive(QMailServerRequestType description);
+    void appendActionExpiry(quint64 action);
+    QLinkedList<quint64>::iterator eraseActionExpiry(QLinkedList<quint64>::iterator it);
+    void scheduleDispatch();
 
     QMap<QPointer<QMailMessageService>, quint64> mServiceAction;
 
@@ -324,10 +378,15 @@ private:
         RequestServicer servicer;
         CompletionSignal completion;
         QMailServerRequestType description;
+        bool interactive;
+        QSet<QMailAccountId> accounts;
+        QElapsedTimer queued;
     };
 
     QList<Request> mRequests;
 
+    QList<Request>::iterator eraseRequest(QList<Request>::iterator it);
+
     class MessageSearch
     {
     public:
@@ -360,12 +419,17 @@ private:
     QMailMessageIdList mMatchingIds;
     QMailMessageIdList mSentIds;
 
-    QFile _requestsFile;
-    QSet<quint64> _outstandingRequests;
+    RequestJournal _requestJournal;
     QList<quint64> _failedRequests;
 
     QSet<QMailAccountId> _retrievalAccountIds;
     QSet<QMailAccountId> _transmissionAccountIds;
+
+    ResyncFilter *_resyncFilter;
+    InitialSync *_initialSync;
+    // Message list requests waiting on the filter or the initial sync
+    QMap<quint64, QByteArray> _awaitingResync;
+    QMap<quint64, QByteArray> _awaitingInitialSync;
 };
 
 #endif
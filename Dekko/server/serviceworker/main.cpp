@@ -5,6 +5,8 @@
 #include <service/AccountServiceWorker.h>
 #include <service/AccountServiceAdaptor.h>
 #include <qmailnamespace.h>
+#include <Metrics.h>
+#include <Trace.h>
 
 
 #define SERVICE "org.dekkoproject.Service"
@@ -17,6 +19,8 @@ Q_DECL_EXPORT int main(int argc, char** argv)
 {
 
     QCoreApplication app(argc, argv);
+    Trace::startFromEnvironment(QStringLiteral("dekko-worker"));
+    Metrics::startFromEnvironment(QStringLiteral("dekko-worker"));
 
     if(QMail::fileLock("dekko-worker.lock") == -1)
         qFatal("Could not get dekko worker lock. dekko-worker might already be running!");
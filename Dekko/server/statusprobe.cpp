@@ -0,0 +1,76 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "statusprobe.h"
+#include <QMap>
+
+StatusProbe::StatusProbe(const QMailAccountId &account, const Endpoint &endpoint, const QStringList &paths, QObject *parent)
+    : ImapConnection(account, endpoint, parent),
+      _paths(paths),
+      _condStore(false)
+{
+}
+
+void StatusProbe::authenticated()
+{
+    // QRESYNC implies CONDSTORE, RFC 7162
+    _condStore = hasCapability("CONDSTORE") || hasCapability("QRESYNC");
+    if (!_condStore) {
+        emit finished();
+        return;
+    }
+
+    foreach (const QString &path, _paths)
+        _outstanding.insert(send("STATUS " + quoted(path) + " (UIDVALIDITY UIDNEXT MESSAGES HIGHESTMODSEQ)"));
+}
+
+void StatusProbe::untagged(const QByteArray &line)
+{
+    if (!line.toUpper().startsWith("STATUS "))
+        return;
+
+    const int list = line.lastIndexOf(" (");
+    if (list == -1 || !line.endsWith(')'))
+        return;
+    QString path = unquoted(line.mid(7, list - 7).trimmed());
+    if (!_paths.contains(path) && path.compare(QLatin1String("INBOX"), Qt::CaseInsensitive) == 0) {
+        foreach (const QString &candidate, _paths) {
+            if (candidate.compare(path, Qt::CaseInsensitive) == 0)
+                path = candidate;
+        }
+    }
+
+    QMap<QByteArray, QByteArray> items;
+    const QList<QByteArray> parts = line.mid(list + 2, line.size() - list - 3).toUpper().split(' ');
+    for (int i = 0; i + 1 < parts.size(); i += 2)
+        items.insert(parts.at(i), parts.at(i + 1));
+
+    // 0 means the mailbox has no mod-sequences, RFC 7162
+    const QByteArray modSeq = items.value("HIGHESTMODSEQ");
+    if (modSeq.isEmpty() || modSeq == "0")
+        return;
+    _states.insert(path, items.value("UIDVALIDITY") + ' ' + items.value("UIDNEXT") + ' '
+                   + items.value("MESSAGES") + ' ' + modSeq);
+}
+
+void StatusProbe::tagged(const QByteArray &tag, const bool ok, const QByteArray &line)
+{
+    Q_UNUSED(ok);
+    Q_UNUSED(line);
+    if (_outstanding.remove(tag) && _outstanding.isEmpty())
+        emit finished();
+}
@@ -0,0 +1,61 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STATUSPROBE_H
+#define STATUSPROBE_H
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include "imapconnection.h"
+
+/*
+    Asks the server for the CONDSTORE state of some folders, the STATUS
+    commands for all of them are pipelined so it takes one round trip once
+    logged in.
+
+    A folder's state is its UIDVALIDITY, UIDNEXT, MESSAGES and HIGHESTMODSEQ,
+    any flag change, expunge or new message changes it. It's empty for
+    folders the server doesn't keep mod-sequences for.
+*/
+class StatusProbe : public ImapConnection
+{
+    Q_OBJECT
+
+public:
+    StatusProbe(const QMailAccountId &account, const Endpoint &endpoint, const QStringList &paths, QObject *parent = 0);
+
+    // Valid once finished
+    bool hasCondStore() const { return _condStore; }
+    QByteArray state(const QString &path) const { return _states.value(path); }
+
+signals:
+    void finished();
+
+protected:
+    void authenticated();
+    void untagged(const QByteArray &line);
+    void tagged(const QByteArray &tag, const bool ok, const QByteArray &line);
+
+private:
+    QStringList _paths;
+    QSet<QByteArray> _outstanding;
+    QHash<QString, QByteArray> _states;
+    bool _condStore;
+};
+
+#endif
@@ -0,0 +1,113 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "structureindexer.h"
+#include <QDebug>
+#include <QTimer>
+#include <qmailstore.h>
+#include <MessageStructure.h>
+
+// Messages read from the store per query
+#define INDEX_BATCH 500
+
+StructureIndexer::StructureIndexer(QObject *parent)
+    : QObject(parent),
+      _indexScheduled(false)
+{
+}
+
+void StructureIndexer::messagesChanged(const QMailMessageIdList &ids)
+{
+    foreach (const QMailMessageId &id, ids) {
+        if (!_written.remove(id))
+            _pending.insert(id);
+    }
+    schedule();
+}
+
+void StructureIndexer::contentsModified(const QMailMessageIdList &ids)
+{
+    foreach (const QMailMessageId &id, ids) {
+        _pending.insert(id);
+        _modified.insert(id);
+    }
+    schedule();
+}
+
+void StructureIndexer::schedule()
+{
+    if (!_pending.isEmpty() && !_indexScheduled) {
+        _indexScheduled = true;
+        QTimer::singleShot(0, this, SLOT(index()));
+    }
+}
+
+void StructureIndexer::index()
+{
+    _indexScheduled = false;
+    const QSet<QMailMessageId> pending(_pending);
+    const QSet<QMailMessageId> modified(_modified);
+    _pending.clear();
+    _modified.clear();
+
+    int failed = 0;
+    QMailMessageIdList batch;
+    batch.reserve(INDEX_BATCH);
+    foreach (const QMailMessageId &id, pending) {
+        batch.append(id);
+        if (batch.size() == INDEX_BATCH) {
+            failed += indexBatch(batch, modified);
+            batch.clear();
+        }
+    }
+    if (!batch.isEmpty())
+        failed += indexBatch(batch, modified);
+
+    if (failed)
+        qWarning() << "Unable to store structure summaries for" << failed << "messages";
+}
+
+int StructureIndexer::indexBatch(const QMailMessageIdList &ids, const QSet<QMailMessageId> &modified)
+{
+    QMailStore *store = QMailStore::instance();
+    const QMailMessageKey::Properties properties(QMailMessageKey::Id | QMailMessageKey::Status | QMailMessageKey::Custom);
+    int failed = 0;
+    foreach (const QMailMessageMetaData &existing, store->messagesMetaData(QMailMessageKey::id(ids), properties)) {
+        const quint64 status = existing.status();
+        if (status & QMailMessage::Removed)
+            continue;
+        // Nothing to summarise until some content arrives, which changes the status
+        if (!(status & (QMailMessage::ContentAvailable | QMailMessage::PartialContentAvailable)))
+            continue;
+        if (!modified.contains(existing.id()) && MessageStructure::fromMetaData(existing).isCurrent(existing))
+            continue;
+
+        const QString summary = MessageStructure::fromMessage(QMailMessage(existing.id())).toString();
+        if (summary.isEmpty() || summary == existing.customField(MessageStructure::fieldName()))
+            continue;
+
+        // The other custom fields go back as they were read, nothing else is touched
+        QMailMessageMetaData meta(existing);
+        meta.setCustomField(MessageStructure::fieldName(), summary);
+        _written.insert(meta.id());
+        if (!store->updateMessagesMetaData(QMailMessageKey::id(meta.id()), QMailMessageKey::Custom, meta)) {
+            _written.remove(meta.id());
+            ++failed;
+        }
+    }
+    return failed;
+}
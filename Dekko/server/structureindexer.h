@@ -0,0 +1,63 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STRUCTUREINDEXER_H
+#define STRUCTUREINDEXER_H
+
+#include <QObject>
+#include <QSet>
+#include <qmailmessage.h>
+
+/*
+    Keeps the MessageStructure summary of retrieved messages up to date so
+    the client can decide what to display from the metadata alone.
+
+    Messages added or updated by retrieval are collected and checked together
+    at the end of the current event loop pass, reading only their status and
+    custom fields. A message is only loaded when its content status no longer
+    matches the summary or its content was modified, which is how retrieving
+    a part shows up. Messages with no content at all, such as the headers the
+    initial sync stores, are left until some arrives. Only the custom fields
+    are written back, and only when the summary differs.
+*/
+class StructureIndexer : public QObject
+{
+    Q_OBJECT
+
+public:
+    StructureIndexer(QObject *parent = 0);
+
+    void messagesChanged(const QMailMessageIdList &ids);
+    void contentsModified(const QMailMessageIdList &ids);
+
+private slots:
+    void index();
+
+private:
+    void schedule();
+    /** Summarises what needs it among \a ids, returns how many couldn't be stored */
+    int indexBatch(const QMailMessageIdList &ids, const QSet<QMailMessageId> &modified);
+
+    QSet<QMailMessageId> _pending;
+    // Content was rewritten, the summary is remade whatever it says
+    QSet<QMailMessageId> _modified;
+    // Updates we made ourselves, the notification they cause needs no work
+    QSet<QMailMessageId> _written;
+    bool _indexScheduled;
+};
+
+#endif
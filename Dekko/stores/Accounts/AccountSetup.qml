@@ -104,6 +104,12 @@ AppListener {
             // for the popups etc.
             Client.handleFailure(account.id, status)
         }
+        onBackgroundTasksComplete: {
+            Log.logInfo("AccountSetup::backgroundTasksComplete", "Validation stage timings: " + JSON.stringify(stageTimings))
+            // The standard folders exist now so the sync can use them
+            Log.logInfo("AccountSetup::backgroundTasksComplete", "Starting initial sync for new account")
+            Client.synchronizeAccount(account.id)
+        }
     }
 
     Connections {
@@ -123,8 +129,9 @@ AppListener {
     Filter {
         type: WizardKeys.syncNewAccount
         onDispatched: {
-            Log.logInfo("AccountSetup::syncNewAccount", "Starting initial sync for new account")
-            Client.synchronizeAccount(account.id)
+            Log.logInfo("AccountSetup::syncNewAccount", "Retrieving folders for new account")
+            account.save()
+            validator.startBackgroundTasks()
         }
     }
 
@@ -137,6 +144,7 @@ AppListener {
         type: WizardKeys.removeNewAccount
         onDispatched: {
             Log.logInfo("AccountSetup::removeNewAccount", "Attempting account removal")
+            validator.cancelBackgroundTasks()
             // We don't need to confirm removal here
             if (account.isValid) {
                 AccountActions.deleteAccount(account.id, false)
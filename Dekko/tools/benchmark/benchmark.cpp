@@ -0,0 +1,151 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "benchmark.h"
+#include <algorithm>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+
+static qint64 statusField(const QByteArray &field)
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    Q_FOREACH(const QByteArray &line, status.readAll().split('\n')) {
+        if (line.startsWith(field)) {
+            return line.mid(field.size()).trimmed().split(' ').first().toLongLong();
+        }
+    }
+    return -1;
+}
+
+Benchmark::Benchmark(const QString &name) :
+    m_name(name), m_checks(0)
+{
+}
+
+void Benchmark::measure(const QString &op, const int &iterations, const std::function<void ()> &fn)
+{
+    for (int i = 0; i < iterations; ++i) {
+        time(op, fn);
+    }
+}
+
+void Benchmark::time(const QString &op, const std::function<void ()> &fn)
+{
+    const qint64 before = residentKb();
+    QElapsedTimer timer;
+    timer.start();
+    fn();
+    const qint64 elapsed = timer.nsecsElapsed() / 1000;
+    Operation &o = operation(op);
+    o.samples << elapsed;
+    o.memoryGrowthKb = qMax(o.memoryGrowthKb, residentKb() - before);
+}
+
+void Benchmark::addSample(const QString &op, const qint64 &usecs)
+{
+    operation(op).samples << usecs;
+}
+
+void Benchmark::addValue(const QString &op, const QString &name, const qint64 &amount)
+{
+    operation(op).values[name] += amount;
+}
+
+void Benchmark::addReport(const QString &name, const QJsonObject &report)
+{
+    m_reports.insert(name, report);
+    check(QStringLiteral("%1 passed").arg(name), report.value(QStringLiteral("failures")).toArray().isEmpty());
+}
+
+bool Benchmark::check(const QString &what, const bool &ok)
+{
+    ++m_checks;
+    if (!ok) {
+        qWarning() << "[Benchmark]" << m_name << "check failed:" << what;
+        m_failures << what;
+    }
+    return ok;
+}
+
+QJsonObject Benchmark::report() const
+{
+    QJsonObject operations;
+    Q_FOREACH(const QString &op, m_order) {
+        const Operation &o = m_operations[op];
+        QJsonObject result;
+        if (!o.samples.isEmpty()) {
+            qint64 total = 0;
+            Q_FOREACH(const qint64 &sample, o.samples) {
+                total += sample;
+            }
+            result.insert(QStringLiteral("count"), o.samples.size());
+            result.insert(QStringLiteral("p50_us"), percentile(o.samples, 0.5));
+            result.insert(QStringLiteral("p99_us"), percentile(o.samples, 0.99));
+            result.insert(QStringLiteral("max_us"), percentile(o.samples, 1.0));
+            result.insert(QStringLiteral("total_us"), total);
+            result.insert(QStringLiteral("memoryGrowth_kb"), o.memoryGrowthKb);
+        }
+        QHash<QString, qint64>::const_iterator it = o.values.constBegin();
+        for (; it != o.values.constEnd(); ++it) {
+            result.insert(it.key(), it.value());
+        }
+        operations.insert(op, result);
+    }
+    QJsonObject report;
+    report.insert(QStringLiteral("operations"), operations);
+    if (!m_reports.isEmpty()) {
+        report.insert(QStringLiteral("reports"), m_reports);
+    }
+    report.insert(QStringLiteral("checks"), m_checks);
+    report.insert(QStringLiteral("failures"), QJsonArray::fromStringList(m_failures));
+    report.insert(QStringLiteral("resident_kb"), residentKb());
+    report.insert(QStringLiteral("peakResident_kb"), peakResidentKb());
+    return report;
+}
+
+qint64 Benchmark::residentKb()
+{
+    return statusField("VmRSS:");
+}
+
+qint64 Benchmark::peakResidentKb()
+{
+    return statusField("VmHWM:");
+}
+
+qint64 Benchmark::percentile(QList<qint64> values, const double &p)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    const int index = qBound(0, int(p * (values.size() - 1) + 0.5), values.size() - 1);
+    return values.at(index);
+}
+
+Benchmark::Operation &Benchmark::operation(const QString &op)
+{
+    if (!m_operations.contains(op)) {
+        m_order << op;
+    }
+    return m_operations[op];
+}
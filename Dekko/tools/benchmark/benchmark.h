@@ -0,0 +1,84 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <functional>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/** @short Collects timings for one benchmark run
+ *
+ * Each named operation keeps all of its samples so the report can give
+ * p50/p99 rather than an average that hides the slow tail. Resident memory
+ * is sampled around every operation, the report carries the largest growth
+ * seen for it along with the process peak.
+ *
+ * Suites can also record plain values (bytes, round trips) and checks. A
+ * failed check marks the run as failed so the tools can gate on it.
+ */
+class Benchmark
+{
+public:
+    explicit Benchmark(const QString &name);
+
+    QString name() const { return m_name; }
+
+    /** @short Run \param fn \param iterations times, timing each call as \param op */
+    void measure(const QString &op, const int &iterations, const std::function<void ()> &fn);
+    /** @short Time a single call of \param fn as \param op */
+    void time(const QString &op, const std::function<void ()> &fn);
+    /** @short Add a sample taken by the caller */
+    void addSample(const QString &op, const qint64 &usecs);
+    /** @short Add \param amount to the counter \param name of \param op */
+    void addValue(const QString &op, const QString &name, const qint64 &amount);
+
+    /** @short Nest a report produced elsewhere, i.e by a child process, under \param name */
+    void addReport(const QString &name, const QJsonObject &report);
+
+    /** @short Record a check, returns \param ok */
+    bool check(const QString &what, const bool &ok);
+    bool passed() const { return m_failures.isEmpty(); }
+
+    QJsonObject report() const;
+
+    static qint64 residentKb();
+    static qint64 peakResidentKb();
+    static qint64 percentile(QList<qint64> values, const double &p);
+
+private:
+    struct Operation {
+        Operation() : memoryGrowthKb(0) {}
+        QList<qint64> samples;
+        qint64 memoryGrowthKb;
+        QHash<QString, qint64> values;
+    };
+    Operation &operation(const QString &op);
+
+    QString m_name;
+    QStringList m_order;
+    QHash<QString, Operation> m_operations;
+    QJsonObject m_reports;
+    int m_checks;
+    QStringList m_failures;
+};
+
+#endif // BENCHMARK_H
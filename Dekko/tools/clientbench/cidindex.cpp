@@ -0,0 +1,142 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <QCoreApplication>
+#include <qmailaccount.h>
+#include <qmailaccountconfiguration.h>
+#include <qmailstore.h>
+#include <MessageCache.h>
+
+#define PART_COUNT 200
+#define CID_INDEX_FIELD "dekko-cid-index"
+
+// How cid: urls used to be resolved, a full walk of a freshly loaded message
+struct CidWalker {
+    QString cid;
+    QString location;
+
+    bool operator()(const QMailMessagePart &part) {
+        if (part.contentID() == cid) {
+            location = part.location().toString(true);
+            return false;
+        }
+        return true;
+    }
+};
+
+static QString contentId(const int &index)
+{
+    return QStringLiteral("image%1@clientbench").arg(index);
+}
+
+// An html body referencing PART_COUNT inline images
+static QMailMessageId addSyntheticMessage(const QMailAccountId &accountId, const QMailFolderId &folderId)
+{
+    QMailMessage msg;
+    msg.setMessageType(QMailMessage::Email);
+    msg.setParentAccountId(accountId);
+    msg.setParentFolderId(folderId);
+    msg.setSubject(QStringLiteral("%1 inline images").arg(PART_COUNT));
+    msg.setFrom(QMailAddress(QStringLiteral("sender@clientbench.example")));
+    msg.setMultipartType(QMailMessagePartContainer::MultipartRelated);
+
+    QString html = QStringLiteral("<html><body>");
+    for (int i = 0; i < PART_COUNT; ++i) {
+        html += QStringLiteral("<img src=\"cid:%1\">").arg(contentId(i));
+    }
+    html += QStringLiteral("</body></html>");
+    msg.appendPart(QMailMessagePart::fromData(html.toUtf8(),
+                                              QMailMessageContentDisposition(QMailMessageContentDisposition::Inline),
+                                              QMailMessageContentType("text/html; charset=UTF-8"),
+                                              QMailMessageBody::QuotedPrintable));
+    for (int i = 0; i < PART_COUNT; ++i) {
+        QMailMessageContentDisposition disposition(QMailMessageContentDisposition::Inline);
+        disposition.setFilename(QStringLiteral("image%1.png").arg(i).toLatin1());
+        QMailMessagePart part = QMailMessagePart::fromData(QByteArray(2048, char('a' + i % 26)), disposition,
+                                                           QMailMessageContentType("image/png"),
+                                                           QMailMessageBody::Base64);
+        part.setContentID(contentId(i));
+        msg.appendPart(part);
+    }
+    msg.setStatus(QMailMessage::ContentAvailable, true);
+    if (!QMailStore::instance()->addMessage(&msg)) {
+        return QMailMessageId();
+    }
+    return msg.id();
+}
+
+bool cidIndexSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    Q_UNUSED(options);
+    QMailStore *store = QMailStore::instance();
+    QMailAccount account;
+    account.setName(QStringLiteral("Clientbench cid"));
+    account.setMessageType(QMailMessage::Email);
+    QMailAccountConfiguration config;
+    if (!bench.check(QStringLiteral("account added"), store->addAccount(&account, &config))) {
+        return true;
+    }
+    QMailFolder folder(QStringLiteral("INBOX"), QMailFolderId(), account.id());
+    const QMailMessageId id = store->addFolder(&folder) ? addSyntheticMessage(account.id(), folder.id()) : QMailMessageId();
+    if (!bench.check(QStringLiteral("message added"), id.isValid())) {
+        store->removeAccount(account.id());
+        return true;
+    }
+
+    QStringList expected;
+    for (int i = 0; i < PART_COUNT; ++i) {
+        CidWalker walker;
+        walker.cid = contentId(i);
+        bench.time(QStringLiteral("walk"), [&]() {
+            const QMailMessage msg(id);
+            msg.foreachPart<CidWalker &>(walker);
+        });
+        expected << walker.location;
+    }
+    bench.check(QStringLiteral("walk finds every part"), !expected.contains(QString()));
+
+    // First view parses the message and queues the index write
+    MessageCache *cache = MessageCache::instance();
+    cache->clear();
+    QString location;
+    bench.time(QStringLiteral("first"), [&]() {
+        location = cache->locationForContentId(id, QStringLiteral("cid:") + contentId(0));
+    });
+    bench.check(QStringLiteral("first resolves"), location == expected.first());
+    // Something else flags the message before the index lands, that must survive the write
+    store->updateMessagesMetaData(QMailMessageKey::id(id), QMailMessage::Important, true);
+    QCoreApplication::processEvents();
+    const QMailMessageMetaData meta(id);
+    bench.check(QStringLiteral("index persisted"), !meta.customField(QStringLiteral(CID_INDEX_FIELD)).isEmpty());
+    bench.check(QStringLiteral("concurrent flag kept"), meta.status() & QMailMessage::Important);
+
+    // Every later lookup is a metadata read, nothing gets parsed
+    for (int i = 0; i < PART_COUNT; ++i) {
+        cache->clear();
+        bench.time(QStringLiteral("indexed"), [&]() {
+            location = cache->locationForContentId(id, QStringLiteral("cid:") + contentId(i));
+        });
+        if (location != expected.at(i)) {
+            bench.check(QStringLiteral("indexed resolves %1").arg(contentId(i)), false);
+        }
+    }
+    bench.addValue(QStringLiteral("indexed"), QStringLiteral("parts"), PART_COUNT);
+
+    store->removeAccount(account.id());
+    return true;
+}
@@ -0,0 +1,154 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QThread>
+#include <QTimer>
+#include <qmailnamespace.h>
+#include <MailServiceClient.h>
+#include <LocalMailService.h>
+
+#define SERVICE "org.dekkoproject.Service"
+// Longest we wait on any single reply
+#define REPLY_TIMEOUT 10000
+
+// Runs \param call and waits until it reports back through the done callback
+static bool roundTrip(const std::function<void (QEventLoop *, const std::function<void ()> &)> &call)
+{
+    QEventLoop loop;
+    bool done = false;
+    call(&loop, [&]() { done = true; loop.quit(); });
+    if (!done) {
+        QTimer::singleShot(REPLY_TIMEOUT, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+    return done;
+}
+
+// The same calls the message list makes, timed from the call to the callback
+static void measureClient(Benchmark &bench, const SuiteOptions &options)
+{
+    Client *client = Client::instance();
+    const QMailMessageKey key = QMailMessageKey::messageType(QMailMessage::Email);
+    const QMailMessageSortKey sort = QMailMessageSortKey::receptionTimeStamp(Qt::DescendingOrder);
+    bool ok = true;
+    int count = 0;
+    for (int i = 0; i < options.iterations && ok; ++i) {
+        bench.time(QStringLiteral("countMessages"), [&]() {
+            ok = roundTrip([&](QEventLoop *loop, const std::function<void ()> &done) {
+                client->countMessages(key, loop, [&, done](const int &total) { count = total; done(); });
+            });
+        });
+    }
+    bench.check(QStringLiteral("countMessages replies"), ok);
+    bench.addValue(QStringLiteral("countMessages"), QStringLiteral("messages"), count);
+
+    Q_FOREACH(const int &limit, QList<int>() << 50 << 1000) {
+        const QString op = QStringLiteral("queryMessages.%1").arg(limit);
+        int returned = 0;
+        for (int i = 0; i < options.iterations && ok; ++i) {
+            bench.time(op, [&]() {
+                ok = roundTrip([&](QEventLoop *loop, const std::function<void ()> &done) {
+                    client->queryMessages(key, sort, limit, loop, [&, done](const QMailMessageIdList &ids) {
+                        returned = ids.size();
+                        done();
+                    });
+                });
+            });
+        }
+        bench.check(QStringLiteral("%1 replies").arg(op), ok);
+        bench.addValue(op, QStringLiteral("returned"), returned);
+    }
+
+    // Read by the undo bar on every change, a blocking call over the bus
+    bench.measure(QStringLiteral("undoDescription"), options.iterations, [&]() {
+        client->undoDescription();
+    });
+}
+
+bool ipcLocalSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    if (!bench.check(QStringLiteral("in process service started"), LocalMailService::start())) {
+        return true;
+    }
+    measureClient(bench, options);
+    return true;
+}
+
+bool ipcDBusSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    QDBusConnectionInterface *bus = QDBusConnection::sessionBus().interface();
+    QProcess worker;
+    if (!bus->isServiceRegistered(SERVICE)) {
+        // Picks up our QMF_DATA so it serves the same store
+        worker.start(QMail::messageServerPath() + QStringLiteral("/dekko-worker"));
+        QElapsedTimer timer;
+        timer.start();
+        while (worker.state() != QProcess::NotRunning && !bus->isServiceRegistered(SERVICE)
+               && timer.elapsed() < REPLY_TIMEOUT) {
+            QThread::msleep(50);
+        }
+    }
+    if (bench.check(QStringLiteral("dekko-worker on the bus"), bus->isServiceRegistered(SERVICE))) {
+        measureClient(bench, options);
+    }
+    if (worker.state() != QProcess::NotRunning) {
+        worker.terminate();
+        worker.waitForFinished();
+    }
+    return true;
+}
+
+// Client picks its transport once per process, so each mode runs in a child of its own
+bool ipcSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    QHash<QString, QJsonObject> operations;
+    Q_FOREACH(const QString &mode, QStringList() << QStringLiteral("ipc-dbus") << QStringLiteral("ipc-local")) {
+        QProcess child;
+        child.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        child.start(QCoreApplication::applicationFilePath(), QStringList()
+                    << QStringLiteral("--suite") << mode
+                    << QStringLiteral("--iterations") << QString::number(options.iterations)
+                    << QStringLiteral("--data-dir") << QString::fromLocal8Bit(qgetenv("QMF_DATA")));
+        child.waitForFinished(-1);
+        const QJsonObject report = QJsonDocument::fromJson(child.readAllStandardOutput()).object()
+                .value(QStringLiteral("suites")).toObject().value(mode).toObject();
+        if (!bench.check(QStringLiteral("%1 reported").arg(mode), !report.isEmpty())) {
+            continue;
+        }
+        bench.addReport(mode, report);
+        operations.insert(mode, report.value(QStringLiteral("operations")).toObject());
+    }
+    // How many times slower the bus is than a queued call, in percent
+    const QJsonObject dbus = operations.value(QStringLiteral("ipc-dbus"));
+    const QJsonObject local = operations.value(QStringLiteral("ipc-local"));
+    Q_FOREACH(const QString &op, dbus.keys()) {
+        const qint64 localP50 = local.value(op).toObject().value(QStringLiteral("p50_us")).toVariant().toLongLong();
+        const qint64 dbusP50 = dbus.value(op).toObject().value(QStringLiteral("p50_us")).toVariant().toLongLong();
+        if (localP50 > 0) {
+            bench.addValue(op, QStringLiteral("dbusOverLocal_p50_pct"), dbusP50 * 100 / localP50);
+        }
+    }
+    return true;
+}
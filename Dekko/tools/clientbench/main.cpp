@@ -0,0 +1,127 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include "suites.h"
+
+struct Suite {
+    const char *name;
+    SuiteFunc run;
+    // Only run when asked for by name
+    bool onRequest;
+};
+
+static const Suite SUITES[] = {
+    { "cid", cidIndexSuite, false },
+    { "ipc", ipcSuite, false },
+    { "ipc-local", ipcLocalSuite, true },
+    { "ipc-dbus", ipcDBusSuite, true },
+    // These start the worker in process, so they have to come after ipc
+    // which needs the bus name and worker lock free for its children
+    { "messagelist", messageListSuite, false },
+    { "folders", folderCountSuite, false },
+    { "worker", workerSuite, false },
+    { "formatting", formattingSuite, false },
+    { "msgpart", msgPartSuite, false }
+};
+static const int SUITE_COUNT = sizeof(SUITES) / sizeof(SUITES[0]);
+
+// dekko-storegen --data-dir /tmp/bigstore --messages 100000
+// dekko-clientbench --data-dir /tmp/bigstore --json bench.json
+//
+// Runs headless against the given store, without --data-dir a scratch store is
+// used and only the suites that bring their own data do anything. As with
+// storegen keep the messageserver for the real store stopped. The ipc suite
+// also needs a session bus and starts the installed dekko-worker if it isn't
+// running, the suites after it run the worker in process and need the bus too.
+int main(int argc, char **argv)
+{
+    // Formatting pulls in fonts & palettes so we need a gui app, just not a screen
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("dekko-clientbench"));
+
+    QStringList names;
+    for (int i = 0; i < SUITE_COUNT; ++i) {
+        names << QString::fromLatin1(SUITES[i].name);
+    }
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmarks Dekko's client side hot paths"));
+    parser.addHelpOption();
+    QCommandLineOption dataDir(QStringLiteral("data-dir"), QStringLiteral("Store generated by dekko-storegen, overrides QMF_DATA"), QStringLiteral("path"));
+    QCommandLineOption suites(QStringLiteral("suite"), QStringLiteral("Suite to run, may be repeated. One of: %1").arg(names.join(QStringLiteral(", "))), QStringLiteral("name"));
+    QCommandLineOption iterations(QStringLiteral("iterations"), QStringLiteral("Samples per operation"), QStringLiteral("n"), QStringLiteral("50"));
+    QCommandLineOption json(QStringLiteral("json"), QStringLiteral("Write the report to this file instead of stdout"), QStringLiteral("file"));
+    parser.addOptions({ dataDir, suites, iterations, json });
+    parser.process(app);
+
+    SuiteOptions options;
+    options.iterations = qMax(1, parser.value(iterations).toInt());
+    // Has to be set before anything touches the store
+    QTemporaryDir scratch;
+    if (parser.isSet(dataDir)) {
+        qputenv("QMF_DATA", QFile::encodeName(QDir(parser.value(dataDir)).absolutePath()));
+        options.generatedStore = true;
+    } else {
+        qputenv("QMF_DATA", QFile::encodeName(scratch.path()));
+    }
+
+    const QStringList wanted = parser.values(suites);
+    QJsonObject results;
+    bool ok = true;
+    for (int i = 0; i < SUITE_COUNT; ++i) {
+        const QString name = QString::fromLatin1(SUITES[i].name);
+        if (wanted.isEmpty() ? SUITES[i].onRequest : !wanted.contains(name)) {
+            continue;
+        }
+        Benchmark bench(name);
+        qDebug() << "[ClientBench] Running" << bench.name();
+        if (!SUITES[i].run(bench, options)) {
+            qDebug() << "[ClientBench] Skipped" << bench.name();
+            continue;
+        }
+        ok = ok && bench.passed();
+        results.insert(bench.name(), bench.report());
+    }
+
+    QJsonObject report;
+    report.insert(QStringLiteral("store"), QString::fromLocal8Bit(qgetenv("QMF_DATA")));
+    report.insert(QStringLiteral("iterations"), options.iterations);
+    report.insert(QStringLiteral("suites"), results);
+    report.insert(QStringLiteral("peakResident_kb"), Benchmark::peakResidentKb());
+    const QByteArray data = QJsonDocument(report).toJson();
+    if (parser.isSet(json)) {
+        QFile file(parser.value(json));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+            qWarning() << "Unable to write report to" << file.fileName();
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << data;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <algorithm>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <qmailstore.h>
+#include <Folder.h>
+#include <LocalMailService.h>
+#include <MessageList.h>
+
+// Longest we wait on any one update to land
+#define REPLY_TIMEOUT 10000
+// Messages flagged per update, about a screenful
+#define UPDATE_SIZE 10
+
+namespace {
+
+bool waitUntil(const std::function<bool ()> &done)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done() && timer.elapsed() < REPLY_TIMEOUT) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+    }
+    return done();
+}
+
+// Folders of the generated store, largest first
+QMailFolderIdList foldersBySize()
+{
+    QMailStore *store = QMailStore::instance();
+    QList<QPair<int, QMailFolderId> > sized;
+    Q_FOREACH(const QMailFolderId &id, store->queryFolders()) {
+        sized << qMakePair(store->countMessages(QMailMessageKey::parentFolderId(id)), id);
+    }
+    std::sort(sized.begin(), sized.end(), [](const QPair<int, QMailFolderId> &a, const QPair<int, QMailFolderId> &b) {
+        return a.first > b.first;
+    });
+    QMailFolderIdList ids;
+    for (int i = 0; i < sized.size(); ++i) {
+        ids << sized.at(i).second;
+    }
+    return ids;
+}
+
+}
+
+bool messageListSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    if (!options.generatedStore) {
+        return false;
+    }
+    // Through Client the same way the app goes with the worker on a thread
+    if (!bench.check(QStringLiteral("in process service started"), LocalMailService::start())) {
+        return true;
+    }
+    const QMailFolderIdList folders = foldersBySize();
+    if (!bench.check(QStringLiteral("store has two folders"), folders.size() >= 2)) {
+        return true;
+    }
+
+    MessageList list;
+    QQmlObjectListModel<MinimalMessage> *model = static_cast<QQmlObjectListModel<MinimalMessage> *>(list.model());
+    bool settled = false;
+    QObject::connect(&list, &MessageList::canPossiblyLoadMore, [&]() { settled = true; });
+    auto run = [&](const QString &op, const std::function<void ()> &fn) {
+        settled = false;
+        bool ok = false;
+        bench.time(op, [&]() {
+            fn();
+            ok = waitUntil([&]() { return settled; });
+        });
+        return ok;
+    };
+
+    // Switching between the two largest folders, every switch is a fresh list
+    bool ok = true;
+    for (int i = 0; i < options.iterations && ok; ++i) {
+        const QMailMessageKey key = QMailMessageKey::parentFolderId(folders.at(i % 2));
+        ok = run(QStringLiteral("init"), [&]() { list.setKey(QVariant::fromValue(key)); });
+    }
+    bench.check(QStringLiteral("init completes"), ok);
+    bench.addValue(QStringLiteral("init"), QStringLiteral("rows"), model->count());
+
+    // Scrolling to the bottom, INCREMENT_VALUE more rows each time
+    int loads = 0;
+    for (int i = 0; i < options.iterations && ok && list.canLoadMore(); ++i) {
+        ok = run(QStringLiteral("loadMore"), [&]() { list.loadMore(); });
+        ++loads;
+    }
+    bench.check(QStringLiteral("loadMore completes"), ok);
+    bench.addValue(QStringLiteral("loadMore"), QStringLiteral("loads"), loads);
+    bench.addValue(QStringLiteral("loadMore"), QStringLiteral("rows"), model->count());
+
+    // Flagging rows that are on screen, timed from the store write to the diff landing
+    QMailMessageIdList shown;
+    for (int row = 0; row < qMin(UPDATE_SIZE, model->count()); ++row) {
+        shown << QMailMessageId(model->at(row)->messageId());
+    }
+    QMailStore *store = QMailStore::instance();
+    for (int i = 0; i < options.iterations && ok; ++i) {
+        const bool flag = !(i % 2);
+        ok = run(QStringLiteral("update"), [&]() {
+            store->updateMessagesMetaData(QMailMessageKey::id(shown), QMailMessage::Important, flag);
+        });
+    }
+    // Leave the generated store as it was
+    store->updateMessagesMetaData(QMailMessageKey::id(shown), QMailMessage::Important, false);
+    bench.check(QStringLiteral("update completes"), ok);
+    bench.addValue(QStringLiteral("update"), QStringLiteral("messages"), shown.size());
+    return true;
+}
+
+bool folderCountSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    if (!options.generatedStore) {
+        return false;
+    }
+    // Through Client the same way the app goes with the worker on a thread
+    if (!bench.check(QStringLiteral("in process service started"), LocalMailService::start())) {
+        return true;
+    }
+    const QMailFolderIdList ids = QMailStore::instance()->queryFolders();
+    QList<Folder *> folders;
+    int pending = 0;
+    Q_FOREACH(const QMailFolderId &id, ids) {
+        // Each one asks for its unread count as soon as it's created
+        ++pending;
+        Folder *folder = new Folder(0, id, QMailMessageKey::parentFolderId(id), Folder::StandardFolder);
+        QObject::connect(folder, &Folder::unreadCountChanged, [&]() { --pending; });
+        folders << folder;
+    }
+    bool ok = waitUntil([&]() { return pending <= 0; });
+    bench.check(QStringLiteral("initial counts"), ok);
+
+    // New mail somewhere, every folder in the list refreshes
+    for (int i = 0; i < options.iterations && ok; ++i) {
+        bench.time(QStringLiteral("refresh"), [&]() {
+            pending = folders.size();
+            Q_FOREACH(Folder *folder, folders) {
+                folder->handleContentsModified(ids);
+            }
+            ok = waitUntil([&]() { return pending <= 0; });
+        });
+    }
+    bench.check(QStringLiteral("refresh completes"), ok);
+    bench.addValue(QStringLiteral("refresh"), QStringLiteral("folders"), folders.size());
+    qDeleteAll(folders);
+    return true;
+}
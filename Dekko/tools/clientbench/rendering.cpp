@@ -0,0 +1,197 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QUrlQuery>
+#include <qmailstore.h>
+#include <Formatting.h>
+#include <MessageCache.h>
+#include <MsgPartQNAM.h>
+
+// Longest we wait on any one part
+#define REPLY_TIMEOUT 10000
+// Recent messages whose text parts are rendered
+#define SAMPLE_SIZE 50
+
+namespace {
+
+// A long reply as it comes back from a mailing list: quoted levels, links,
+// addresses and a signature, most of what the formatter has to look for
+QString syntheticReply(const int &paragraphs)
+{
+    QStringList lines;
+    for (int i = 0; i < paragraphs; ++i) {
+        const QString quote = QString(i % 4, QLatin1Char('>')) + (i % 4 ? QStringLiteral(" ") : QString());
+        lines << quote + QStringLiteral("On the release plan, see https://example.org/issues/%1 and mail team%1@example.org").arg(i)
+              << quote + QStringLiteral("for the *details* before the next _review_, thanks.")
+              << quote;
+    }
+    lines << QStringLiteral("-- ") << QStringLiteral("Sent from the clientbench");
+    return lines.join(QLatin1Char('\n'));
+}
+
+struct TextPart {
+    QMailMessageId id;
+    QString location;
+    bool plain;
+};
+
+struct TextPartCollector {
+    QMailMessageId id;
+    QList<TextPart> parts;
+
+    bool operator()(const QMailMessagePart &part) {
+        const QMailMessageContentType type = part.contentType();
+        if (type.type().toLower() == "text" && part.multipartType() == QMailMessagePartContainer::MultipartNone) {
+            TextPart text;
+            text.id = id;
+            text.location = part.location().toString(true);
+            text.plain = type.subType().toLower() == "plain";
+            parts << text;
+        }
+        return true;
+    }
+};
+
+// Text parts of the most recent multipart messages, these are what the message view loads
+QList<TextPart> recentTextParts()
+{
+    QList<TextPart> parts;
+    const QMailMessageIdList ids = QMailStore::instance()->queryMessages(
+                QMailMessageKey::messageType(QMailMessage::Email)
+                & QMailMessageKey::status(QMailMessage::ContentAvailable, QMailDataComparator::Includes),
+                QMailMessageSortKey::timeStamp(Qt::DescendingOrder), SAMPLE_SIZE * 4);
+    Q_FOREACH(const QMailMessageId &id, ids) {
+        const QMailMessage msg(id);
+        TextPartCollector collector;
+        collector.id = id;
+        msg.foreachPart<TextPartCollector &>(collector);
+        parts << collector.parts;
+        if (parts.size() >= SAMPLE_SIZE) {
+            break;
+        }
+    }
+    return parts;
+}
+
+}
+
+bool formattingSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    // Synthetic text first so there's something to compare without a store
+    Q_FOREACH(const int &paragraphs, QList<int>() << 10 << 100 << 1000) {
+        const QString text = syntheticReply(paragraphs);
+        const QString op = QStringLiteral("synthetic.%1").arg(paragraphs);
+        QString html;
+        bench.measure(op, options.iterations, [&]() {
+            html = Formatting::markupPlainTextToHtml(text);
+        });
+        bench.addValue(op, QStringLiteral("inputBytes"), text.toUtf8().size());
+        bench.addValue(op, QStringLiteral("outputBytes"), html.toUtf8().size());
+    }
+    if (!options.generatedStore) {
+        return true;
+    }
+    // Then the plain text bodies of the generated mail
+    QStringList bodies;
+    Q_FOREACH(const TextPart &part, recentTextParts()) {
+        if (part.plain) {
+            const QMailMessage msg(part.id);
+            bodies << msg.partAt(QMailMessagePart::Location(part.location)).body().data();
+        }
+    }
+    if (!bench.check(QStringLiteral("store has plain text bodies"), !bodies.isEmpty())) {
+        return true;
+    }
+    for (int i = 0; i < options.iterations; ++i) {
+        Q_FOREACH(const QString &body, bodies) {
+            bench.time(QStringLiteral("stored"), [&]() {
+                Formatting::markupPlainTextToHtml(body);
+            });
+        }
+    }
+    bench.addValue(QStringLiteral("stored"), QStringLiteral("bodies"), bodies.size());
+    return true;
+}
+
+bool msgPartSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    if (!options.generatedStore) {
+        return false;
+    }
+    const QList<TextPart> parts = recentTextParts();
+    if (!bench.check(QStringLiteral("store has text parts"), !parts.isEmpty())) {
+        return true;
+    }
+
+    // Requested the way the message view does, from the url to the last byte read
+    MsgPartQNAM qnam;
+    auto fetch = [&](const QString &op, const TextPart &part) {
+        QUrl url;
+        url.setScheme(QStringLiteral("dekko-part"));
+        url.setHost(QStringLiteral("msg"));
+        QUrlQuery query;
+        query.addQueryItem(QStringLiteral("messageId"), QString::number(part.id.toULongLong()));
+        query.addQueryItem(QStringLiteral("location"), part.location);
+        if (part.plain) {
+            query.addQueryItem(QStringLiteral("requestFormatting"), QStringLiteral("true"));
+        }
+        url.setQuery(query);
+        qint64 bytes = -1;
+        bench.time(op, [&]() {
+            QNetworkReply *reply = qnam.get(QNetworkRequest(url));
+            QElapsedTimer timer;
+            timer.start();
+            while (!reply->isFinished() && timer.elapsed() < REPLY_TIMEOUT) {
+                QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+            }
+            if (reply->isFinished() && reply->error() == QNetworkReply::NoError) {
+                bytes = reply->readAll().size();
+            }
+            reply->deleteLater();
+        });
+        if (bytes >= 0) {
+            bench.addValue(op, QStringLiteral("bytes"), bytes);
+        }
+        return bytes >= 0;
+    };
+
+    MessageCache *cache = MessageCache::instance();
+    int plain = 0;
+    Q_FOREACH(const TextPart &part, parts) {
+        plain += part.plain ? 1 : 0;
+    }
+    bool ok = true;
+    for (int i = 0; i < options.iterations && ok; ++i) {
+        Q_FOREACH(const TextPart &part, parts) {
+            const QString kind = part.plain ? QStringLiteral("plain") : QStringLiteral("html");
+            // Opening a message, nothing parsed yet
+            cache->clear();
+            ok = ok && fetch(kind + QStringLiteral(".cold"), part);
+            // Another part or a reload of the same message, served from the cache
+            ok = ok && fetch(kind + QStringLiteral(".warm"), part);
+        }
+    }
+    bench.check(QStringLiteral("every part delivered"), ok);
+    bench.addValue(QStringLiteral("plain.cold"), QStringLiteral("parts"), plain);
+    bench.addValue(QStringLiteral("html.cold"), QStringLiteral("parts"), parts.size() - plain);
+    return true;
+}
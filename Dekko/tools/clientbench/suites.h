@@ -0,0 +1,52 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SUITES_H
+#define SUITES_H
+
+#include "benchmark.h"
+
+struct SuiteOptions {
+    SuiteOptions() : iterations(50), generatedStore(false) {}
+    // Samples taken per operation
+    int iterations;
+    // True when pointed at a store made by dekko-storegen, suites that
+    // only measure reads over it skip themselves otherwise.
+    bool generatedStore;
+};
+
+// Each suite fills in \param bench and returns false if it couldn't run
+typedef bool (*SuiteFunc)(Benchmark &bench, const SuiteOptions &options);
+
+// Content-ID resolution over a synthetic 200 part message
+bool cidIndexSuite(Benchmark &bench, const SuiteOptions &options);
+// Client round trips over D-Bus vs the in process worker, each mode runs as a child
+bool ipcSuite(Benchmark &bench, const SuiteOptions &options);
+bool ipcLocalSuite(Benchmark &bench, const SuiteOptions &options);
+bool ipcDBusSuite(Benchmark &bench, const SuiteOptions &options);
+// MessageList init, loadMore and update diffs over the two largest folders
+bool messageListSuite(Benchmark &bench, const SuiteOptions &options);
+// Unread count refresh of every folder
+bool folderCountSuite(Benchmark &bench, const SuiteOptions &options);
+// MailServiceWorker::queryMessages on the worker thread
+bool workerSuite(Benchmark &bench, const SuiteOptions &options);
+// Formatting::markupPlainTextToHtml over synthetic and stored bodies
+bool formattingSuite(Benchmark &bench, const SuiteOptions &options);
+// MsgPartReply delivering text parts, cold and from the message cache
+bool msgPartSuite(Benchmark &bench, const SuiteOptions &options);
+
+#endif // SUITES_H
@@ -0,0 +1,69 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <qmailaccount.h>
+#include <qmailstore.h>
+#include <LocalMailService.h>
+#include <serviceutils.h>
+
+// MailServiceWorker::queryMessages itself, keys arriving serialized as they do
+// over the bus, called on the worker's thread
+bool workerSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    if (!options.generatedStore) {
+        return false;
+    }
+    if (!bench.check(QStringLiteral("in process service started"), LocalMailService::start())) {
+        return true;
+    }
+    MailServiceWorker *worker = LocalMailService::instance()->worker();
+    QMailFolderId inbox;
+    Q_FOREACH(const QMailAccountId &id, QMailStore::instance()->queryAccounts()) {
+        inbox = QMailAccount(id).standardFolder(QMailFolder::InboxFolder);
+        if (inbox.isValid()) {
+            break;
+        }
+    }
+
+    struct Query { const char *name; QMailMessageKey key; };
+    const Query queries[] = {
+        { "all", QMailMessageKey::messageType(QMailMessage::Email) },
+        { "inbox", QMailMessageKey::parentFolderId(inbox) },
+        { "unread", QMailMessageKey::parentFolderId(inbox)
+                    & QMailMessageKey::status(QMailMessage::Read | QMailMessage::ReadElsewhere, QMailDataComparator::Excludes) }
+    };
+    const QByteArray sort = msg_sort_key_bytes(QMailMessageSortKey::timeStamp(Qt::DescendingOrder));
+    for (const Query &query : queries) {
+        const QByteArray key = msg_key_bytes(query.key);
+        Q_FOREACH(const int &limit, QList<int>() << 50 << 1000) {
+            const QString op = QStringLiteral("%1.%2").arg(QString::fromLatin1(query.name)).arg(limit);
+            QList<quint64> ids;
+            bool ok = true;
+            for (int i = 0; i < options.iterations && ok; ++i) {
+                bench.time(op, [&]() {
+                    ok = QMetaObject::invokeMethod(worker, "queryMessages", Qt::BlockingQueuedConnection,
+                                                   Q_RETURN_ARG(QList<quint64>, ids), Q_ARG(QByteArray, key),
+                                                   Q_ARG(QByteArray, sort), Q_ARG(int, limit));
+                });
+            }
+            bench.check(QStringLiteral("%1 returns").arg(op), ok);
+            bench.addValue(op, QStringLiteral("returned"), ids.size());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,910 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "imapsession.h"
+#include <algorithm>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QLocale>
+#include <QRegExp>
+#include <QSet>
+#include <QTcpSocket>
+
+#define CAPABILITIES "IMAP4rev1 LITERAL+ IDLE UIDPLUS MOVE UNSELECT CONDSTORE AUTH=PLAIN"
+
+// Splits IMAP arguments, keeping parenthesized lists and bracketed sections whole
+static QList<QByteArray> tokenize(const QByteArray &text)
+{
+    QList<QByteArray> tokens;
+    int i = 0;
+    const int n = text.size();
+    while (i < n) {
+        while (i < n && text.at(i) == ' ') {
+            ++i;
+        }
+        if (i >= n) {
+            break;
+        }
+        if (text.at(i) == '"') {
+            QByteArray token;
+            for (++i; i < n && text.at(i) != '"'; ++i) {
+                if (text.at(i) == '\\' && i + 1 < n) {
+                    ++i;
+                }
+                token += text.at(i);
+            }
+            ++i;
+            tokens << token;
+            continue;
+        }
+        const int start = i;
+        int depth = 0;
+        bool quoted = false;
+        for (; i < n; ++i) {
+            const char c = text.at(i);
+            if (quoted) {
+                if (c == '\\') {
+                    ++i;
+                } else if (c == '"') {
+                    quoted = false;
+                }
+                continue;
+            }
+            if (c == '"') {
+                quoted = true;
+            } else if (c == '(' || c == '[') {
+                ++depth;
+            } else if (c == ')' || c == ']') {
+                --depth;
+                if (depth == 0 && c == ')' && text.at(start) == '(') {
+                    ++i;
+                    break;
+                }
+            } else if (c == ' ' && depth <= 0) {
+                break;
+            }
+        }
+        tokens << text.mid(start, i - start);
+    }
+    return tokens;
+}
+
+static QByteArray unparenthesize(const QByteArray &list)
+{
+    if (list.startsWith('(') && list.endsWith(')')) {
+        return list.mid(1, list.size() - 2);
+    }
+    return list;
+}
+
+static QByteArray quote(const QByteArray &value)
+{
+    bool plain = true;
+    for (const char c : value) {
+        if (uchar(c) >= 0x80 || c == '\r' || c == '\n' || c == '"' || c == '\\') {
+            plain = false;
+            break;
+        }
+    }
+    if (plain) {
+        return '"' + value + '"';
+    }
+    return '{' + QByteArray::number(value.size()) + "}\r\n" + value;
+}
+
+static QByteArray nstring(const QByteArray &value)
+{
+    return value.isEmpty() ? QByteArrayLiteral("NIL") : quote(value);
+}
+
+static QByteArray flagList(const QStringList &flags)
+{
+    return '(' + flags.join(QLatin1Char(' ')).toLatin1() + ')';
+}
+
+static QByteArray encodingName(const QMailMessageBody::TransferEncoding &encoding)
+{
+    switch (encoding) {
+    case QMailMessageBody::EightBit: return "8BIT";
+    case QMailMessageBody::Base64: return "BASE64";
+    case QMailMessageBody::QuotedPrintable: return "QUOTED-PRINTABLE";
+    case QMailMessageBody::Binary: return "BINARY";
+    default: return "7BIT";
+    }
+}
+
+static QByteArray parameters(const QList<QMailMessageHeaderField::ParameterType> &params)
+{
+    if (params.isEmpty()) {
+        return "NIL";
+    }
+    QList<QByteArray> items;
+    Q_FOREACH(const QMailMessageHeaderField::ParameterType &param, params) {
+        items << quote(param.first.toUpper()) << quote(param.second);
+    }
+    return '(' + items.join(' ') + ')';
+}
+
+static QByteArray bodyStructure(const QMailMessagePartContainer &container, const QMailMessagePart *part)
+{
+    if (container.multipartType() != QMailMessagePartContainer::MultipartNone) {
+        QByteArray result("(");
+        for (uint i = 0; i < container.partCount(); ++i) {
+            const QMailMessagePart &child = container.partAt(i);
+            result += bodyStructure(child, &child);
+        }
+        const QByteArray type = QMailMessagePartContainer::nameForMultipartType(container.multipartType());
+        result += ' ' + quote(type.mid(type.indexOf('/') + 1).toUpper());
+        result += " (\"BOUNDARY\" " + quote(container.boundary()) + ") NIL NIL)";
+        return result;
+    }
+    const QMailMessageContentType type = container.contentType();
+    const QByteArray data = container.hasBody() ? container.body().data(QMailMessageBody::Encoded) : QByteArray();
+    QByteArray result("(");
+    result += quote(type.type().isEmpty() ? QByteArray("TEXT") : type.type().toUpper()) + ' ';
+    result += quote(type.subType().isEmpty() ? QByteArray("PLAIN") : type.subType().toUpper()) + ' ';
+    result += parameters(type.parameters()) + ' ';
+    result += nstring(part ? part->contentID().toLatin1() : QByteArray()) + ' ';
+    result += nstring(part ? part->contentDescription().toUtf8() : QByteArray()) + ' ';
+    result += '"' + encodingName(container.transferEncoding()) + "\" ";
+    result += QByteArray::number(data.size());
+    if (type.type().isEmpty() || type.type().toLower() == "text") {
+        result += ' ' + QByteArray::number(data.count('\n'));
+    }
+    // md5, disposition, language, location
+    result += " NIL ";
+    if (part && !part->contentDisposition().isNull()) {
+        const QMailMessageContentDisposition disposition = part->contentDisposition();
+        const QByteArray kind = disposition.type() == QMailMessageContentDisposition::Attachment ? "ATTACHMENT" : "INLINE";
+        result += "(\"" + kind + "\" " + parameters(disposition.parameters()) + ')';
+    } else {
+        result += "NIL";
+    }
+    result += " NIL NIL)";
+    return result;
+}
+
+static QByteArray addressList(const QMailAddressList &addresses)
+{
+    if (addresses.isEmpty()) {
+        return "NIL";
+    }
+    QByteArray result("(");
+    Q_FOREACH(const QMailAddress &address, addresses) {
+        const QString addr = address.address();
+        const int at = addr.indexOf(QLatin1Char('@'));
+        result += '(' + nstring(address.name().toUtf8()) + " NIL "
+                + nstring(addr.left(at).toUtf8()) + ' '
+                + nstring(at == -1 ? QByteArray() : addr.mid(at + 1).toUtf8()) + ')';
+    }
+    return result + ')';
+}
+
+static QByteArray envelope(const QMailMessage &msg)
+{
+    const QMailAddressList from = QMailAddressList() << msg.from();
+    const QMailAddressList replyTo = msg.replyTo().isNull() ? from : QMailAddressList() << msg.replyTo();
+    return '(' + nstring(msg.headerFieldText(QStringLiteral("Date")).toUtf8()) + ' '
+            + nstring(msg.subject().toUtf8()) + ' '
+            + addressList(from) + ' ' + addressList(from) + ' ' + addressList(replyTo) + ' '
+            + addressList(msg.to()) + ' ' + addressList(msg.cc()) + ' ' + addressList(msg.bcc()) + ' '
+            + nstring(msg.headerFieldText(QStringLiteral("In-Reply-To")).toUtf8()) + ' '
+            + nstring(msg.headerFieldText(QStringLiteral("Message-ID")).toUtf8()) + ')';
+}
+
+// The header block, including the blank line that ends it
+static QByteArray headerOf(const QByteArray &raw)
+{
+    const int end = raw.indexOf("\r\n\r\n");
+    return end == -1 ? raw : raw.left(end + 4);
+}
+
+static QByteArray headerFields(const QByteArray &header, const QList<QByteArray> &names, const bool &exclude)
+{
+    QSet<QByteArray> wanted;
+    Q_FOREACH(const QByteArray &name, names) {
+        wanted.insert(name.toLower());
+    }
+    QByteArray result;
+    bool keep = false;
+    Q_FOREACH(const QByteArray &line, header.split('\n')) {
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+        if (line.at(0) != ' ' && line.at(0) != '\t') {
+            const QByteArray name = line.left(line.indexOf(':')).trimmed().toLower();
+            keep = wanted.contains(name) != exclude;
+        }
+        if (keep) {
+            result += line + '\n';
+        }
+    }
+    return result + "\r\n";
+}
+
+// What a FETCH item reads, for the stats: the structure, the header, the
+// content or the item itself for the small ones like FLAGS
+static QString fetchedKind(const QByteArray &item)
+{
+    const QByteArray upper = item.toUpper();
+    if (upper == "BODY" || upper == "BODYSTRUCTURE") {
+        return QStringLiteral("BODYSTRUCTURE");
+    }
+    if (upper == "RFC822.HEADER") {
+        return QStringLiteral("HEADER");
+    }
+    if (upper == "RFC822" || upper == "RFC822.TEXT") {
+        return QStringLiteral("CONTENT");
+    }
+    if (upper.startsWith("BODY[") || upper.startsWith("BODY.PEEK[")) {
+        return upper.mid(upper.indexOf('[') + 1).startsWith("HEADER") ? QStringLiteral("HEADER") : QStringLiteral("CONTENT");
+    }
+    return QString::fromLatin1(upper);
+}
+
+// Section text for BODY[...], empty for anything we don't serve
+static QByteArray section(StandinMessage &msg, const QByteArray &spec)
+{
+    const QByteArray &raw = msg.rfc822();
+    if (spec.isEmpty()) {
+        return raw;
+    }
+    const QByteArray upper = spec.toUpper();
+    if (upper == "HEADER") {
+        return headerOf(raw);
+    }
+    if (upper == "TEXT") {
+        return raw.mid(headerOf(raw).size());
+    }
+    if (upper.startsWith("HEADER.FIELDS")) {
+        const int open = spec.indexOf('(');
+        const QList<QByteArray> names = open == -1 ? QList<QByteArray>()
+                                                   : unparenthesize(spec.mid(open).trimmed()).split(' ');
+        return headerFields(headerOf(raw), names, upper.startsWith("HEADER.FIELDS.NOT"));
+    }
+    // Part numbers, e.g 1.2
+    const QMailMessage parsed = QMailMessage::fromRfc2822(raw);
+    const QMailMessagePartContainer *container = &parsed;
+    Q_FOREACH(const QByteArray &number, spec.split('.')) {
+        bool ok = false;
+        const uint index = number.toUInt(&ok);
+        if (!ok || index == 0) {
+            // .MIME, .HEADER and .TEXT of parts aren't served
+            return QByteArray();
+        }
+        if (container->multipartType() == QMailMessagePartContainer::MultipartNone) {
+            if (index != 1) {
+                return QByteArray();
+            }
+            break;
+        }
+        if (index > container->partCount()) {
+            return QByteArray();
+        }
+        container = &container->partAt(index - 1);
+    }
+    return container->hasBody() ? container->body().data(QMailMessageBody::Encoded) : QByteArray();
+}
+
+ImapSession::ImapSession(QTcpSocket *socket, QObject *parent) : Session(socket, QStringLiteral("imap"), parent),
+    m_inLiteral(false), m_idling(false), m_authenticating(false), m_readOnly(false), m_knownCount(0)
+{
+    connect(Mailboxes::instance(), &Mailboxes::messagesAppended, this, &ImapSession::handleMessagesAppended);
+    reply("* OK [CAPABILITY " CAPABILITIES "] Dekko stand-in ready\r\n");
+    finish(QStringLiteral("GREETING"));
+}
+
+void ImapSession::handleLine(const QByteArray &line)
+{
+    if (m_idling) {
+        if (line.trimmed().toUpper() == "DONE") {
+            m_idling = false;
+            ok("IDLE terminated");
+        }
+        return;
+    }
+    if (m_authenticating) {
+        // Any credentials will do
+        m_authenticating = false;
+        ok("Authenticated");
+        return;
+    }
+    if (m_inLiteral) {
+        m_args << line;
+        m_inLiteral = false;
+        return;
+    }
+    QByteArray chunk = line;
+    // A literal follows this chunk, {n} waits for a go ahead and {n+} doesn't
+    int literal = -1;
+    bool synchronizing = true;
+    if (chunk.endsWith('}')) {
+        const int open = chunk.lastIndexOf('{');
+        QByteArray size = chunk.mid(open + 1, chunk.size() - open - 2);
+        if (size.endsWith('+')) {
+            synchronizing = false;
+            size.chop(1);
+        }
+        bool valid = false;
+        literal = open == -1 ? -1 : size.toInt(&valid);
+        if (!valid) {
+            literal = -1;
+        } else {
+            chunk.truncate(open);
+        }
+    }
+    QList<QByteArray> tokens = tokenize(chunk);
+    if (m_tag.isEmpty()) {
+        if (tokens.size() < 2) {
+            reply("* BAD Missing command\r\n");
+            finish(QStringLiteral("BAD"), true);
+            return;
+        }
+        m_tag = tokens.takeFirst();
+        m_command = tokens.takeFirst().toUpper();
+        if (m_command == "UID" && !tokens.isEmpty()) {
+            m_command += ' ' + tokens.takeFirst().toUpper();
+        }
+    }
+    m_args << tokens;
+    if (literal >= 0) {
+        m_inLiteral = true;
+        expectLiteral(literal);
+        if (synchronizing) {
+            reply("+ Ready for literal data\r\n");
+            finish(QString::fromLatin1(m_command) + QStringLiteral(" (continuation)"));
+        }
+        return;
+    }
+    execute();
+}
+
+void ImapSession::handleMessagesAppended(const QString &name)
+{
+    if (m_idling && m_selected && m_selected->name == name) {
+        notifyExists();
+        finish(QStringLiteral("IDLE (push)"));
+    }
+}
+
+void ImapSession::execute()
+{
+    const QByteArray command = m_command;
+    bool dropped = false;
+    if (command != "LOGOUT" && command != "XSTATS" && injectFailure(&dropped)) {
+        if (dropped) {
+            return;
+        }
+        no("[UNAVAILABLE] Injected failure");
+        return;
+    }
+    if (command == "CAPABILITY") {
+        reply("* CAPABILITY " CAPABILITIES "\r\n");
+        ok();
+    } else if (command == "NOOP" || command == "CHECK") {
+        notifyExists();
+        ok();
+    } else if (command == "LOGOUT") {
+        reply("* BYE Logging out\r\n");
+        ok();
+        close();
+    } else if (command == "LOGIN" || command == "ID" || command == "ENABLE") {
+        ok();
+    } else if (command == "AUTHENTICATE") {
+        if (m_args.size() > 1) {
+            ok("Authenticated");
+        } else {
+            m_authenticating = true;
+            reply("+ \r\n");
+            finish(QStringLiteral("AUTHENTICATE (continuation)"));
+        }
+    } else if (command == "LIST" || command == "LSUB") {
+        list(command == "LSUB");
+    } else if (command == "STATUS") {
+        status();
+    } else if (command == "SELECT" || command == "EXAMINE") {
+        select(command == "EXAMINE");
+    } else if (command == "CLOSE" || command == "UNSELECT") {
+        if (command == "CLOSE" && m_selected && !m_readOnly) {
+            // CLOSE expunges silently
+            QList<StandinMessagePtr> &messages = m_selected->messages;
+            messages.erase(std::remove_if(messages.begin(), messages.end(), [](const StandinMessagePtr &msg) {
+                return msg->flags.contains(QStringLiteral("\\Deleted"));
+            }), messages.end());
+        }
+        m_selected.clear();
+        ok();
+    } else if (command == "CREATE") {
+        Mailboxes::instance()->create(QString::fromUtf8(m_args.value(0))) ? ok() : no("Can't create mailbox");
+    } else if (command == "DELETE") {
+        Mailboxes::instance()->remove(QString::fromUtf8(m_args.value(0))) ? ok() : no("No such mailbox");
+    } else if (command == "RENAME") {
+        Mailboxes::instance()->rename(QString::fromUtf8(m_args.value(0)), QString::fromUtf8(m_args.value(1)))
+                ? ok() : no("Can't rename mailbox");
+    } else if (command == "SUBSCRIBE" || command == "UNSUBSCRIBE") {
+        ok();
+    } else if (command == "FETCH" || command == "UID FETCH") {
+        fetch(command.startsWith("UID"));
+    } else if (command == "SEARCH" || command == "UID SEARCH") {
+        search(command.startsWith("UID"));
+    } else if (command == "STORE" || command == "UID STORE") {
+        store(command.startsWith("UID"));
+    } else if (command == "COPY" || command == "UID COPY" || command == "MOVE" || command == "UID MOVE") {
+        copy(command.startsWith("UID"), command.endsWith("MOVE"));
+    } else if (command == "EXPUNGE") {
+        if (requireSelected()) {
+            expunge(QList<quint32>(), false);
+            ok();
+        }
+    } else if (command == "UID EXPUNGE") {
+        if (requireSelected()) {
+            QList<quint32> uids;
+            Q_FOREACH(const int index, resolve(m_args.value(0), true)) {
+                uids << m_selected->messages.at(index)->uid;
+            }
+            expunge(uids, true);
+            ok();
+        }
+    } else if (command == "APPEND") {
+        append();
+    } else if (command == "IDLE") {
+        m_idling = true;
+        reply("+ idling\r\n");
+        finish(QStringLiteral("IDLE (continuation)"));
+        return;
+    } else if (command == "XSTATS") {
+        // Not a real extension, lets a harness read the counters between
+        // operations. The answer covers everything up to this command.
+        const QByteArray stats = QJsonDocument(Stats::instance()->toJson()).toJson(QJsonDocument::Compact);
+        reply("* XSTATS {" + QByteArray::number(stats.size()) + "}\r\n" + stats + "\r\n");
+        ok();
+    } else {
+        bad("Unknown command");
+    }
+}
+
+void ImapSession::ok(const QByteArray &text)
+{
+    reply(m_tag + " OK " + (text.isEmpty() ? m_command + " completed" : text) + "\r\n");
+    finish(QString::fromLatin1(m_command));
+    m_tag.clear();
+    m_args.clear();
+}
+
+void ImapSession::no(const QByteArray &text)
+{
+    reply(m_tag + " NO " + text + "\r\n");
+    finish(QString::fromLatin1(m_command), true);
+    m_tag.clear();
+    m_args.clear();
+}
+
+void ImapSession::bad(const QByteArray &text)
+{
+    reply(m_tag + " BAD " + text + "\r\n");
+    finish(QString::fromLatin1(m_command), true);
+    m_tag.clear();
+    m_args.clear();
+}
+
+bool ImapSession::requireSelected()
+{
+    if (!m_selected) {
+        bad("No mailbox selected");
+        return false;
+    }
+    return true;
+}
+
+void ImapSession::notifyExists()
+{
+    if (m_selected && m_selected->messages.size() != m_knownCount) {
+        m_knownCount = m_selected->messages.size();
+        reply("* " + QByteArray::number(m_knownCount) + " EXISTS\r\n");
+    }
+}
+
+void ImapSession::list(const bool &lsub)
+{
+    const QByteArray pattern = m_args.value(1);
+    if (pattern.isEmpty()) {
+        // Just the hierarchy delimiter
+        reply("* LIST (\\Noselect) \"/\" \"\"\r\n");
+        ok();
+        return;
+    }
+    const QRegExp matcher(QString::fromUtf8(pattern).replace(QLatin1Char('*'), QLatin1String(".*"))
+                          .replace(QLatin1Char('%'), QLatin1String("[^/]*")));
+    Q_FOREACH(const QString &name, Mailboxes::instance()->names()) {
+        if (matcher.exactMatch(name)) {
+            reply(QByteArray(lsub ? "* LSUB" : "* LIST") + " () \"/\" " + quote(name.toUtf8()) + "\r\n");
+        }
+    }
+    ok();
+}
+
+void ImapSession::status()
+{
+    MailboxPtr box = Mailboxes::instance()->mailbox(QString::fromUtf8(m_args.value(0)));
+    if (!box) {
+        no("No such mailbox");
+        return;
+    }
+    int unseen = 0;
+    Q_FOREACH(const StandinMessagePtr &msg, box->messages) {
+        if (!msg->flags.contains(QStringLiteral("\\Seen"))) {
+            ++unseen;
+        }
+    }
+    QList<QByteArray> items;
+    Q_FOREACH(const QByteArray &item, unparenthesize(m_args.value(1)).toUpper().split(' ')) {
+        if (item == "MESSAGES") {
+            items << item << QByteArray::number(box->messages.size());
+        } else if (item == "RECENT") {
+            items << item << "0";
+        } else if (item == "UIDNEXT") {
+            items << item << QByteArray::number(box->uidNext);
+        } else if (item == "UIDVALIDITY") {
+            items << item << QByteArray::number(box->uidValidity);
+        } else if (item == "UNSEEN") {
+            items << item << QByteArray::number(unseen);
+        } else if (item == "HIGHESTMODSEQ") {
+            items << item << QByteArray::number(box->highestModSeq);
+        }
+    }
+    reply("* STATUS " + quote(box->name.toUtf8()) + " (" + items.join(' ') + ")\r\n");
+    ok();
+}
+
+void ImapSession::select(const bool &readOnly)
+{
+    m_selected = Mailboxes::instance()->mailbox(QString::fromUtf8(m_args.value(0)));
+    if (!m_selected) {
+        no("No such mailbox");
+        return;
+    }
+    m_readOnly = readOnly;
+    m_knownCount = m_selected->messages.size();
+    reply("* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n");
+    reply("* OK [PERMANENTFLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)] Flags permitted\r\n");
+    reply("* " + QByteArray::number(m_knownCount) + " EXISTS\r\n");
+    reply("* 0 RECENT\r\n");
+    reply("* OK [UIDVALIDITY " + QByteArray::number(m_selected->uidValidity) + "] UIDs valid\r\n");
+    reply("* OK [UIDNEXT " + QByteArray::number(m_selected->uidNext) + "] Predicted next UID\r\n");
+    reply("* OK [HIGHESTMODSEQ " + QByteArray::number(m_selected->highestModSeq) + "] Highest\r\n");
+    ok(readOnly ? "[READ-ONLY] EXAMINE completed" : "[READ-WRITE] SELECT completed");
+}
+
+QList<int> ImapSession::resolve(const QByteArray &set, const bool &byUid) const
+{
+    QList<int> indexes;
+    if (!m_selected) {
+        return indexes;
+    }
+    const QList<StandinMessagePtr> &messages = m_selected->messages;
+    const quint32 last = byUid ? (messages.isEmpty() ? 0 : messages.last()->uid) : quint32(messages.size());
+    Q_FOREACH(const QByteArray &range, set.split(',')) {
+        const QList<QByteArray> bounds = range.split(':');
+        quint32 low = bounds.at(0) == "*" ? last : bounds.at(0).toUInt();
+        quint32 high = bounds.size() > 1 ? (bounds.at(1) == "*" ? last : bounds.at(1).toUInt()) : low;
+        if (low > high) {
+            qSwap(low, high);
+        }
+        if (!byUid) {
+            for (quint32 seq = qMax(low, 1u); seq <= qMin(high, last); ++seq) {
+                indexes << int(seq - 1);
+            }
+            continue;
+        }
+        // Messages are in uid order
+        auto it = std::lower_bound(messages.begin(), messages.end(), low, [](const StandinMessagePtr &msg, const quint32 uid) {
+            return msg->uid < uid;
+        });
+        for (; it != messages.end() && (*it)->uid <= high; ++it) {
+            indexes << int(it - messages.begin());
+        }
+    }
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+    return indexes;
+}
+
+QByteArray ImapSession::fetchItem(StandinMessage &msg, const QByteArray &item, bool *seen)
+{
+    const QByteArray upper = item.toUpper();
+    if (upper == "UID") {
+        return "UID " + QByteArray::number(msg.uid);
+    }
+    if (upper == "FLAGS") {
+        return "FLAGS " + flagList(msg.flags);
+    }
+    if (upper == "INTERNALDATE") {
+        return "INTERNALDATE \"" + QLocale::c().toString(msg.internalDate, QStringLiteral("dd-MMM-yyyy hh:mm:ss +0000")).toLatin1() + '"';
+    }
+    if (upper == "RFC822.SIZE") {
+        return "RFC822.SIZE " + QByteArray::number(msg.rfc822().size());
+    }
+    if (upper == "BODYSTRUCTURE" || upper == "BODY") {
+        const QMailMessage parsed = QMailMessage::fromRfc2822(msg.rfc822());
+        return upper + ' ' + bodyStructure(parsed, 0);
+    }
+    if (upper == "ENVELOPE") {
+        return "ENVELOPE " + envelope(QMailMessage::fromRfc2822(msg.rfc822()));
+    }
+    if (upper == "RFC822" || upper == "RFC822.HEADER" || upper == "RFC822.TEXT") {
+        const QByteArray spec = upper == "RFC822" ? QByteArray() : upper.mid(7);
+        if (upper != "RFC822.HEADER") {
+            *seen = true;
+        }
+        return upper + ' ' + quote(section(msg, spec));
+    }
+    if (upper.startsWith("BODY[") || upper.startsWith("BODY.PEEK[")) {
+        const int open = item.indexOf('[');
+        const int close = item.lastIndexOf(']');
+        const QByteArray spec = item.mid(open + 1, close - open - 1);
+        QByteArray data = section(msg, spec);
+        QByteArray name = "BODY[" + spec + ']';
+        // <start.length> partial fetch
+        const QByteArray partial = item.mid(close + 1);
+        if (partial.startsWith('<')) {
+            const QList<QByteArray> range = partial.mid(1, partial.size() - 2).split('.');
+            const int start = range.value(0).toInt();
+            data = data.mid(start, range.size() > 1 ? range.at(1).toInt() : -1);
+            name += '<' + QByteArray::number(start) + '>';
+        }
+        if (!upper.startsWith("BODY.PEEK")) {
+            *seen = true;
+        }
+        return name + ' ' + '{' + QByteArray::number(data.size()) + "}\r\n" + data;
+    }
+    return QByteArray();
+}
+
+void ImapSession::fetch(const bool &byUid)
+{
+    if (!requireSelected()) {
+        return;
+    }
+    QList<QByteArray> items = tokenize(unparenthesize(m_args.value(1)));
+    if (items.size() == 1) {
+        const QByteArray macro = items.first().toUpper();
+        if (macro == "ALL" || macro == "FAST" || macro == "FULL") {
+            items = QList<QByteArray>() << "FLAGS" << "INTERNALDATE" << "RFC822.SIZE";
+            if (macro != "FAST") {
+                items << "ENVELOPE";
+            }
+            if (macro == "FULL") {
+                items << "BODY";
+            }
+        }
+    }
+    bool hasUid = false;
+    Q_FOREACH(const QByteArray &item, items) {
+        hasUid = hasUid || item.toUpper() == "UID";
+    }
+    if (byUid && !hasUid) {
+        items.prepend("UID");
+    }
+    const QList<int> indexes = resolve(m_args.value(0), byUid);
+    if (!indexes.isEmpty()) {
+        QSet<QString> kinds;
+        Q_FOREACH(const QByteArray &item, items) {
+            kinds.insert(fetchedKind(item));
+        }
+        Q_FOREACH(const QString &kind, kinds) {
+            Stats::instance()->recordFetched(kind, indexes.size());
+        }
+    }
+    Q_FOREACH(const int index, indexes) {
+        StandinMessage &msg = *m_selected->messages.at(index);
+        QList<QByteArray> parts;
+        bool seen = false;
+        Q_FOREACH(const QByteArray &item, items) {
+            const QByteArray part = fetchItem(msg, item, &seen);
+            if (!part.isEmpty()) {
+                parts << part;
+            }
+        }
+        if (seen && !m_readOnly && !msg.flags.contains(QStringLiteral("\\Seen"))) {
+            msg.flags << QStringLiteral("\\Seen");
+            ++m_selected->highestModSeq;
+            parts << "FLAGS " + flagList(msg.flags);
+        }
+        reply("* " + QByteArray::number(index + 1) + " FETCH (" + parts.join(' ') + ")\r\n");
+    }
+    ok();
+}
+
+void ImapSession::search(const bool &byUid)
+{
+    if (!requireSelected()) {
+        return;
+    }
+    const QList<StandinMessagePtr> &messages = m_selected->messages;
+    QVector<bool> matches(messages.size(), true);
+    QList<QByteArray> keys = m_args;
+    bool negate = false;
+    while (!keys.isEmpty()) {
+        const QByteArray key = keys.takeFirst().toUpper();
+        QVector<bool> hit(messages.size(), false);
+        auto flagged = [&](const QString &flag, const bool &set) {
+            for (int i = 0; i < messages.size(); ++i) {
+                hit[i] = messages.at(i)->flags.contains(flag) == set;
+            }
+        };
+        if (key == "NOT") {
+            negate = true;
+            continue;
+        } else if (key == "ALL") {
+            hit.fill(true);
+        } else if (key == "UID") {
+            Q_FOREACH(const int index, resolve(keys.isEmpty() ? QByteArray() : keys.takeFirst(), true)) {
+                hit[index] = true;
+            }
+        } else if (key == "SEEN" || key == "UNSEEN") {
+            flagged(QStringLiteral("\\Seen"), key == "SEEN");
+        } else if (key == "FLAGGED" || key == "UNFLAGGED") {
+            flagged(QStringLiteral("\\Flagged"), key == "FLAGGED");
+        } else if (key == "DELETED" || key == "UNDELETED") {
+            flagged(QStringLiteral("\\Deleted"), key == "DELETED");
+        } else if (key == "ANSWERED" || key == "UNANSWERED") {
+            flagged(QStringLiteral("\\Answered"), key == "ANSWERED");
+        } else if (key == "DRAFT" || key == "UNDRAFT") {
+            flagged(QStringLiteral("\\Draft"), key == "DRAFT");
+        } else if (!key.isEmpty() && (QByteArray("0123456789*").contains(key.at(0)))) {
+            Q_FOREACH(const int index, resolve(key, false)) {
+                hit[index] = true;
+            }
+        } else {
+            // Keys with an argument we don't evaluate, e.g SINCE, match everything
+            static const QSet<QByteArray> withArgument = { "SINCE", "BEFORE", "ON", "FROM", "TO", "CC", "SUBJECT",
+                                                            "BODY", "TEXT", "LARGER", "SMALLER", "KEYWORD", "UNKEYWORD" };
+            if (withArgument.contains(key) && !keys.isEmpty()) {
+                keys.removeFirst();
+            }
+            hit.fill(!negate);
+        }
+        for (int i = 0; i < messages.size(); ++i) {
+            matches[i] = matches.at(i) && (hit.at(i) != negate);
+        }
+        negate = false;
+    }
+    QList<QByteArray> result;
+    for (int i = 0; i < messages.size(); ++i) {
+        if (matches.at(i)) {
+            result << QByteArray::number(byUid ? messages.at(i)->uid : quint32(i + 1));
+        }
+    }
+    reply("* SEARCH" + (result.isEmpty() ? QByteArray() : ' ' + result.join(' ')) + "\r\n");
+    ok();
+}
+
+void ImapSession::store(const bool &byUid)
+{
+    if (!requireSelected()) {
+        return;
+    }
+    if (m_readOnly) {
+        no("Mailbox is read-only");
+        return;
+    }
+    const QByteArray action = m_args.value(1).toUpper();
+    const bool silent = action.endsWith(".SILENT");
+    QStringList flags;
+    for (int i = 2; i < m_args.size(); ++i) {
+        Q_FOREACH(const QByteArray &flag, unparenthesize(m_args.at(i)).split(' ')) {
+            if (!flag.isEmpty()) {
+                flags << QString::fromLatin1(flag);
+            }
+        }
+    }
+    Q_FOREACH(const int index, resolve(m_args.value(0), byUid)) {
+        StandinMessage &msg = *m_selected->messages.at(index);
+        if (action.startsWith('+')) {
+            Q_FOREACH(const QString &flag, flags) {
+                if (!msg.flags.contains(flag)) {
+                    msg.flags << flag;
+                }
+            }
+        } else if (action.startsWith('-')) {
+            Q_FOREACH(const QString &flag, flags) {
+                msg.flags.removeAll(flag);
+            }
+        } else {
+            msg.flags = flags;
+        }
+        ++m_selected->highestModSeq;
+        if (!silent) {
+            reply("* " + QByteArray::number(index + 1) + " FETCH (" + (byUid ? "UID " + QByteArray::number(msg.uid) + ' ' : QByteArray())
+                  + "FLAGS " + flagList(msg.flags) + ")\r\n");
+        }
+    }
+    ok();
+}
+
+void ImapSession::copy(const bool &byUid, const bool &move)
+{
+    if (!requireSelected()) {
+        return;
+    }
+    MailboxPtr target = Mailboxes::instance()->mailbox(QString::fromUtf8(m_args.value(1)));
+    if (!target) {
+        no("[TRYCREATE] No such mailbox");
+        return;
+    }
+    QList<QByteArray> sourceUids;
+    QList<QByteArray> targetUids;
+    QList<quint32> moved;
+    Q_FOREACH(const int index, resolve(m_args.value(0), byUid)) {
+        StandinMessage &msg = *m_selected->messages.at(index);
+        StandinMessagePtr copied = Mailboxes::instance()->append(target->name, msg.rfc822(), msg.flags);
+        sourceUids << QByteArray::number(msg.uid);
+        targetUids << QByteArray::number(copied->uid);
+        moved << msg.uid;
+    }
+    const QByteArray copyUid = "[COPYUID " + QByteArray::number(target->uidValidity) + ' '
+            + sourceUids.join(',') + ' ' + targetUids.join(',') + "] ";
+    if (move) {
+        reply("* OK " + copyUid + "Moved\r\n");
+        expunge(moved, true);
+        ok();
+    } else {
+        ok(copyUid + "COPY completed");
+    }
+}
+
+void ImapSession::expunge(const QList<quint32> &uids, const bool &onlyThese)
+{
+    QList<StandinMessagePtr> &messages = m_selected->messages;
+    const QSet<quint32> wanted = uids.toSet();
+    for (int i = messages.size() - 1; i >= 0; --i) {
+        const StandinMessagePtr &msg = messages.at(i);
+        const bool remove = onlyThese ? wanted.contains(msg->uid) : msg->flags.contains(QStringLiteral("\\Deleted"));
+        if (remove) {
+            messages.removeAt(i);
+            ++m_selected->highestModSeq;
+            reply("* " + QByteArray::number(i + 1) + " EXPUNGE\r\n");
+        }
+    }
+    m_knownCount = messages.size();
+}
+
+void ImapSession::append()
+{
+    // mailbox [(flags)] [date] literal
+    if (m_args.size() < 2) {
+        bad("Missing arguments");
+        return;
+    }
+    const QString name = QString::fromUtf8(m_args.first());
+    QStringList flags;
+    if (m_args.size() > 2 && m_args.at(1).startsWith('(')) {
+        Q_FOREACH(const QByteArray &flag, unparenthesize(m_args.at(1)).split(' ')) {
+            if (!flag.isEmpty()) {
+                flags << QString::fromLatin1(flag);
+            }
+        }
+    }
+    StandinMessagePtr msg = Mailboxes::instance()->append(name, m_args.last(), flags);
+    if (!msg) {
+        no("[TRYCREATE] No such mailbox");
+        return;
+    }
+    const MailboxPtr box = Mailboxes::instance()->mailbox(name);
+    notifyExists();
+    ok("[APPENDUID " + QByteArray::number(box->uidValidity) + ' ' + QByteArray::number(msg->uid) + "] APPEND completed");
+}
@@ -0,0 +1,75 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IMAPSESSION_H
+#define IMAPSESSION_H
+
+#include "mailboxes.h"
+#include "session.h"
+
+/** @short Enough of IMAP4rev1 for Dekko's IMAP service to sync against
+ *
+ * Covers login, LIST/LSUB/STATUS, SELECT/EXAMINE, FETCH with BODYSTRUCTURE,
+ * ENVELOPE and (partial) body sections, SEARCH by flags and uid, STORE,
+ * COPY/MOVE, EXPUNGE, APPEND and IDLE, plus the UID forms. Flag changes and
+ * new messages are visible to every session but never written to the store.
+ */
+class ImapSession : public Session
+{
+    Q_OBJECT
+public:
+    explicit ImapSession(QTcpSocket *socket, QObject *parent = 0);
+
+protected:
+    void handleLine(const QByteArray &line);
+
+private slots:
+    void handleMessagesAppended(const QString &name);
+
+private:
+    void execute();
+    void ok(const QByteArray &text = QByteArray());
+    void no(const QByteArray &text);
+    void bad(const QByteArray &text);
+    bool requireSelected();
+    void notifyExists();
+
+    void list(const bool &lsub);
+    void status();
+    void select(const bool &readOnly);
+    void fetch(const bool &byUid);
+    void search(const bool &byUid);
+    void store(const bool &byUid);
+    void copy(const bool &byUid, const bool &move);
+    void expunge(const QList<quint32> &uids, const bool &onlyThese);
+    void append();
+
+    QList<int> resolve(const QByteArray &set, const bool &byUid) const;
+    QByteArray fetchItem(StandinMessage &msg, const QByteArray &item, bool *seen);
+
+    QByteArray m_tag;
+    QByteArray m_command;
+    QList<QByteArray> m_args;
+    bool m_inLiteral;
+    bool m_idling;
+    bool m_authenticating;
+    MailboxPtr m_selected;
+    bool m_readOnly;
+    int m_knownCount;
+};
+
+#endif // IMAPSESSION_H
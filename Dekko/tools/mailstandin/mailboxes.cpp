@@ -0,0 +1,162 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "mailboxes.h"
+#include <algorithm>
+#include <QDebug>
+#include <qmailaccount.h>
+#include <qmailstore.h>
+
+static QStringList flagsOf(const quint64 &status)
+{
+    QStringList flags;
+    if (status & (QMailMessage::Read | QMailMessage::ReadElsewhere)) {
+        flags << QStringLiteral("\\Seen");
+    }
+    if (status & QMailMessage::Important) {
+        flags << QStringLiteral("\\Flagged");
+    }
+    if (status & QMailMessage::Replied) {
+        flags << QStringLiteral("\\Answered");
+    }
+    if (status & QMailMessage::Draft) {
+        flags << QStringLiteral("\\Draft");
+    }
+    return flags;
+}
+
+const QByteArray &StandinMessage::rfc822()
+{
+    if (raw.isEmpty() && id.isValid()) {
+        raw = QMailMessage(id).toRfc2822(QMailMessage::TransmissionFormat);
+    }
+    return raw;
+}
+
+Mailboxes *Mailboxes::instance()
+{
+    static Mailboxes mailboxes;
+    return &mailboxes;
+}
+
+bool Mailboxes::load(const QString &accountName)
+{
+    QMailStore *store = QMailStore::instance();
+    QMailAccountKey key = QMailAccountKey::messageType(QMailMessage::Email);
+    if (!accountName.isEmpty()) {
+        key &= QMailAccountKey::name(accountName);
+    }
+    const QMailAccountIdList accounts = store->queryAccounts(key, QMailAccountSortKey::id());
+    if (accounts.isEmpty()) {
+        qWarning() << "[Mailboxes] No account to serve" << accountName;
+        return false;
+    }
+    const QMailAccount account(accounts.first());
+    m_sent = QMailFolder(account.standardFolder(QMailFolder::SentFolder)).path();
+
+    const QMailFolderIdList folders = store->queryFolders(QMailFolderKey::parentAccountId(account.id()));
+    int total = 0;
+    Q_FOREACH(const QMailFolderId &folderId, folders) {
+        const QMailFolder folder(folderId);
+        MailboxPtr mailbox(new Mailbox);
+        mailbox->name = folder.path();
+        mailbox->uidValidity = quint32(folderId.toULongLong());
+        const QMailMessageKey::Properties props = QMailMessageKey::Id | QMailMessageKey::Status | QMailMessageKey::ReceptionTimeStamp;
+        const QMailMessageMetaDataList metaData = store->messagesMetaData(
+                    QMailMessageKey::parentFolderId(folderId), props);
+        QList<QMailMessageMetaData> sorted = metaData;
+        std::sort(sorted.begin(), sorted.end(), [](const QMailMessageMetaData &a, const QMailMessageMetaData &b) {
+            return a.receivedDate().toUTC() < b.receivedDate().toUTC();
+        });
+        Q_FOREACH(const QMailMessageMetaData &meta, sorted) {
+            StandinMessagePtr msg(new StandinMessage);
+            msg->uid = mailbox->uidNext++;
+            msg->id = meta.id();
+            msg->flags = flagsOf(meta.status());
+            msg->internalDate = meta.receivedDate().toUTC();
+            mailbox->messages << msg;
+        }
+        total += mailbox->messages.size();
+        m_mailboxes.insert(mailbox->name, mailbox);
+    }
+    if (!m_mailboxes.contains(QStringLiteral("INBOX"))) {
+        create(QStringLiteral("INBOX"));
+    }
+    if (m_sent.isEmpty()) {
+        m_sent = QStringLiteral("Sent");
+        create(m_sent);
+    }
+    qDebug() << "[Mailboxes] Serving" << account.name() << "with" << m_mailboxes.size() << "mailboxes and" << total << "messages";
+    return true;
+}
+
+MailboxPtr Mailboxes::mailbox(const QString &name) const
+{
+    // INBOX is case insensitive, everything else isn't
+    if (name.compare(QLatin1String("INBOX"), Qt::CaseInsensitive) == 0) {
+        return m_mailboxes.value(QStringLiteral("INBOX"));
+    }
+    return m_mailboxes.value(name);
+}
+
+bool Mailboxes::create(const QString &name)
+{
+    if (name.isEmpty() || m_mailboxes.contains(name)) {
+        return false;
+    }
+    MailboxPtr mailbox(new Mailbox);
+    mailbox->name = name;
+    mailbox->uidValidity = quint32(qHash(name)) | 1;
+    m_mailboxes.insert(name, mailbox);
+    return true;
+}
+
+bool Mailboxes::remove(const QString &name)
+{
+    if (name == QLatin1String("INBOX")) {
+        return false;
+    }
+    return m_mailboxes.remove(name) > 0;
+}
+
+bool Mailboxes::rename(const QString &from, const QString &to)
+{
+    if (!m_mailboxes.contains(from) || m_mailboxes.contains(to) || from == QLatin1String("INBOX")) {
+        return false;
+    }
+    MailboxPtr mailbox = m_mailboxes.take(from);
+    mailbox->name = to;
+    m_mailboxes.insert(to, mailbox);
+    return true;
+}
+
+StandinMessagePtr Mailboxes::append(const QString &name, const QByteArray &raw, const QStringList &flags)
+{
+    MailboxPtr box = mailbox(name);
+    if (!box) {
+        return StandinMessagePtr();
+    }
+    StandinMessagePtr msg(new StandinMessage);
+    msg->uid = box->uidNext++;
+    msg->raw = raw;
+    msg->flags = flags;
+    msg->internalDate = QDateTime::currentDateTimeUtc();
+    box->messages << msg;
+    ++box->highestModSeq;
+    emit messagesAppended(box->name);
+    return msg;
+}
@@ -0,0 +1,86 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MAILBOXES_H
+#define MAILBOXES_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+#include <qmailmessage.h>
+
+/** @short A message as the stand-in serves it */
+struct StandinMessage {
+    StandinMessage() : uid(0) {}
+    quint32 uid;
+    QStringList flags;
+    QDateTime internalDate;
+    // Either in the store or appended/sent during this run
+    QMailMessageId id;
+    QByteArray raw;
+
+    /** @short The full RFC 2822 text, loaded from the store on first use */
+    const QByteArray &rfc822();
+};
+typedef QSharedPointer<StandinMessage> StandinMessagePtr;
+
+struct Mailbox {
+    Mailbox() : uidValidity(1), uidNext(1), highestModSeq(1) {}
+    QString name;
+    quint32 uidValidity;
+    quint32 uidNext;
+    quint64 highestModSeq; // CONDSTORE, bumped by any change to the mailbox
+    QList<StandinMessagePtr> messages; // in uid order
+};
+typedef QSharedPointer<Mailbox> MailboxPtr;
+
+/** @short The folders and messages of one account, shared by all sessions
+ *
+ * Seeded from a mail store, e.g one made by dekko-storegen. Changes made by
+ * clients only live in memory, the store is never written to.
+ */
+class Mailboxes : public QObject
+{
+    Q_OBJECT
+public:
+    static Mailboxes *instance();
+
+    /** @short Load the folders of \param accountName, or the first account if empty */
+    bool load(const QString &accountName);
+
+    QStringList names() const { return m_mailboxes.keys(); }
+    MailboxPtr mailbox(const QString &name) const;
+    bool create(const QString &name);
+    bool remove(const QString &name);
+    bool rename(const QString &from, const QString &to);
+    StandinMessagePtr append(const QString &name, const QByteArray &raw, const QStringList &flags);
+    QString sentMailbox() const { return m_sent; }
+
+signals:
+    /** @short For sessions idling on \param name */
+    void messagesAppended(const QString &name);
+
+private:
+    QMap<QString, MailboxPtr> m_mailboxes;
+    QString m_sent;
+};
+
+#endif // MAILBOXES_H
@@ -0,0 +1,117 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <signal.h>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include "imapsession.h"
+#include "mailboxes.h"
+#include "smtpsession.h"
+
+// dekko-storegen --data-dir /tmp/bigstore --messages 20000
+// dekko-mailstandin --data-dir /tmp/bigstore --latency 40 --bandwidth 262144 --stats sync.json
+//
+// Then point an account at localhost:1143 (IMAP) and localhost:1025 (SMTP),
+// any user name and password work. The stats are written on SIGINT/SIGTERM,
+// a running total can be had over IMAP at any time with "a XSTATS", which is
+// how dekko-syncbench reads them per operation.
+
+static void shutdown(int n)
+{
+    Q_UNUSED(n);
+    QCoreApplication::quit();
+}
+
+template <typename SessionType>
+static bool listen(QTcpServer *server, const quint16 &port)
+{
+    QObject::connect(server, &QTcpServer::newConnection, [server]() {
+        while (QTcpSocket *socket = server->nextPendingConnection()) {
+            new SessionType(socket, server);
+        }
+    });
+    if (!server->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "Unable to listen on port" << port << server->errorString();
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("dekko-mailstandin"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Loopback IMAP and SMTP server for measuring Dekko's sync and send"));
+    parser.addHelpOption();
+    QCommandLineOption dataDir(QStringLiteral("data-dir"), QStringLiteral("Store to serve, e.g one made by dekko-storegen"), QStringLiteral("path"));
+    QCommandLineOption account(QStringLiteral("account"), QStringLiteral("Name of the account to serve, defaults to the first"), QStringLiteral("name"));
+    QCommandLineOption imapPort(QStringLiteral("imap-port"), QStringLiteral("IMAP port"), QStringLiteral("port"), QStringLiteral("1143"));
+    QCommandLineOption smtpPort(QStringLiteral("smtp-port"), QStringLiteral("SMTP port"), QStringLiteral("port"), QStringLiteral("1025"));
+    QCommandLineOption latency(QStringLiteral("latency"), QStringLiteral("Delay before each response"), QStringLiteral("ms"), QStringLiteral("0"));
+    QCommandLineOption bandwidth(QStringLiteral("bandwidth"), QStringLiteral("Bytes per second sent to each client, 0 is unlimited"), QStringLiteral("bytes"), QStringLiteral("0"));
+    QCommandLineOption failRate(QStringLiteral("fail-rate"), QStringLiteral("Fraction of commands that fail"), QStringLiteral("ratio"), QStringLiteral("0"));
+    QCommandLineOption dropRate(QStringLiteral("drop-rate"), QStringLiteral("Fraction of commands the connection drops on"), QStringLiteral("ratio"), QStringLiteral("0"));
+    QCommandLineOption stats(QStringLiteral("stats"), QStringLiteral("Write per command stats to this file instead of stdout"), QStringLiteral("file"));
+    parser.addOptions({ dataDir, account, imapPort, smtpPort, latency, bandwidth, failRate, dropRate, stats });
+    parser.process(app);
+
+    if (parser.isSet(dataDir)) {
+        qputenv("QMF_DATA", QFile::encodeName(QDir(parser.value(dataDir)).absolutePath()));
+    }
+    if (!Mailboxes::instance()->load(parser.value(account))) {
+        return 1;
+    }
+
+    LinkConditions &conditions = Session::conditions();
+    conditions.latency = qMax(0, parser.value(latency).toInt());
+    conditions.bandwidth = qMax(0, parser.value(bandwidth).toInt());
+    conditions.failRate = parser.value(failRate).toDouble();
+    conditions.dropRate = parser.value(dropRate).toDouble();
+
+    QTcpServer imap;
+    QTcpServer smtp;
+    if (!listen<ImapSession>(&imap, parser.value(imapPort).toUShort())
+            || !listen<SmtpSession>(&smtp, parser.value(smtpPort).toUShort())) {
+        return 1;
+    }
+    qDebug() << "Serving IMAP on" << imap.serverPort() << "and SMTP on" << smtp.serverPort();
+
+    signal(SIGINT, shutdown);
+    signal(SIGTERM, shutdown);
+    const int exitCode = app.exec();
+
+    const QByteArray report = QJsonDocument(Stats::instance()->toJson()).toJson();
+    if (parser.isSet(stats)) {
+        QFile file(parser.value(stats));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(report) != report.size()) {
+            qWarning() << "Unable to write stats to" << file.fileName();
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << report;
+    }
+    return exitCode;
+}
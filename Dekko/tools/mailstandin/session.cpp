@@ -0,0 +1,204 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "session.h"
+#include <random>
+#include <QDebug>
+#include <QJsonArray>
+#include <QTcpSocket>
+#include <QTimer>
+
+// Bandwidth is paced in slices this long
+#define SLICE_MS 50
+
+static std::mt19937 &dice()
+{
+    static std::mt19937 random(1);
+    return random;
+}
+
+Stats *Stats::instance()
+{
+    static Stats stats;
+    return &stats;
+}
+
+void Stats::record(const QString &protocol, const QString &command, const qint64 &bytesIn,
+                   const qint64 &bytesOut, const qint64 &usecs, const bool &failed)
+{
+    Counter &counter = m_counters[protocol][command];
+    ++counter.count;
+    if (failed) {
+        ++counter.failures;
+    }
+    counter.bytesIn += bytesIn;
+    counter.bytesOut += bytesOut;
+    counter.usecs += usecs;
+}
+
+void Stats::recordFetched(const QString &item, const qint64 &messages)
+{
+    m_fetched[item] += messages;
+}
+
+QJsonObject Stats::toJson() const
+{
+    QJsonObject result;
+    for (auto protocol = m_counters.constBegin(); protocol != m_counters.constEnd(); ++protocol) {
+        QJsonObject commands;
+        qint64 roundTrips = 0;
+        for (auto it = protocol.value().constBegin(); it != protocol.value().constEnd(); ++it) {
+            QJsonObject counter;
+            counter.insert(QStringLiteral("count"), it.value().count);
+            counter.insert(QStringLiteral("failures"), it.value().failures);
+            counter.insert(QStringLiteral("bytesIn"), it.value().bytesIn);
+            counter.insert(QStringLiteral("bytesOut"), it.value().bytesOut);
+            counter.insert(QStringLiteral("wall_ms"), it.value().usecs / 1000.0);
+            commands.insert(it.key(), counter);
+            roundTrips += it.value().count;
+        }
+        QJsonObject summary;
+        summary.insert(QStringLiteral("roundTrips"), roundTrips);
+        summary.insert(QStringLiteral("commands"), commands);
+        if (protocol.key() == QLatin1String("imap")) {
+            QJsonObject fetched;
+            for (auto it = m_fetched.constBegin(); it != m_fetched.constEnd(); ++it) {
+                fetched.insert(it.key(), it.value());
+            }
+            summary.insert(QStringLiteral("fetched"), fetched);
+        }
+        result.insert(protocol.key(), summary);
+    }
+    return result;
+}
+
+Session::Session(QTcpSocket *socket, const QString &protocol, QObject *parent) : QObject(parent),
+    m_socket(socket), m_protocol(protocol), m_literal(-1), m_bytesIn(0), m_sendTimer(0), m_closing(false)
+{
+    m_socket->setParent(this);
+    m_sendTimer = new QTimer(this);
+    m_sendTimer->setSingleShot(true);
+    connect(m_sendTimer, &QTimer::timeout, this, &Session::sendSome);
+    connect(m_socket, &QTcpSocket::readyRead, this, &Session::readData);
+    connect(m_socket, &QTcpSocket::disconnected, this, &QObject::deleteLater);
+    m_commandTimer.start();
+}
+
+LinkConditions &Session::conditions()
+{
+    static LinkConditions conditions;
+    return conditions;
+}
+
+void Session::reply(const QByteArray &data)
+{
+    m_reply += data;
+}
+
+void Session::finish(const QString &command, const bool &failed)
+{
+    Pending pending;
+    pending.command = command;
+    pending.failed = failed;
+    pending.bytesIn = m_bytesIn;
+    pending.data = m_reply;
+    pending.timer = m_commandTimer;
+    m_queue.enqueue(pending);
+    m_reply.clear();
+    m_bytesIn = 0;
+    m_commandTimer.start();
+    if (!m_sendTimer->isActive() && m_sending.isEmpty()) {
+        m_sendTimer->start(conditions().latency);
+    }
+}
+
+bool Session::injectFailure(bool *dropped)
+{
+    std::uniform_real_distribution<double> roll(0.0, 1.0);
+    *dropped = false;
+    if (conditions().dropRate > 0 && roll(dice()) < conditions().dropRate) {
+        *dropped = true;
+        qDebug() << "[" << m_protocol << "] Dropping connection";
+        m_socket->abort();
+        return true;
+    }
+    return conditions().failRate > 0 && roll(dice()) < conditions().failRate;
+}
+
+void Session::close()
+{
+    m_closing = true;
+    if (m_queue.isEmpty() && m_sending.isEmpty()) {
+        m_socket->disconnectFromHost();
+    }
+}
+
+void Session::readData()
+{
+    const QByteArray data = m_socket->readAll();
+    m_bytesIn += data.size();
+    m_buffer += data;
+    forever {
+        if (m_literal >= 0) {
+            if (m_buffer.size() < m_literal) {
+                return;
+            }
+            const QByteArray literal = m_buffer.left(m_literal);
+            m_buffer.remove(0, m_literal);
+            m_literal = -1;
+            handleLine(literal);
+            continue;
+        }
+        const int end = m_buffer.indexOf("\r\n");
+        if (end == -1) {
+            return;
+        }
+        const QByteArray line = m_buffer.left(end);
+        m_buffer.remove(0, end + 2);
+        handleLine(line);
+        if (m_socket->state() != QAbstractSocket::ConnectedState) {
+            return;
+        }
+    }
+}
+
+void Session::sendSome()
+{
+    if (m_queue.isEmpty()) {
+        return;
+    }
+    Pending &pending = m_queue.head();
+    if (m_sending.isEmpty()) {
+        m_sending = pending.data;
+    }
+    const int bandwidth = conditions().bandwidth;
+    const int slice = bandwidth > 0 ? qMax(1, bandwidth * SLICE_MS / 1000) : m_sending.size();
+    m_socket->write(m_sending.left(slice));
+    m_sending.remove(0, slice);
+    if (!m_sending.isEmpty()) {
+        m_sendTimer->start(SLICE_MS);
+        return;
+    }
+    Stats::instance()->record(m_protocol, pending.command, pending.bytesIn, pending.data.size(),
+                              pending.timer.nsecsElapsed() / 1000, pending.failed);
+    m_queue.dequeue();
+    if (!m_queue.isEmpty()) {
+        m_sendTimer->start(conditions().latency);
+    } else if (m_closing) {
+        m_socket->disconnectFromHost();
+    }
+}
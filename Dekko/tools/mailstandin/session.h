@@ -0,0 +1,118 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QQueue>
+
+class QTcpSocket;
+class QTimer;
+
+/** @short Knobs shared by every connection */
+struct LinkConditions {
+    LinkConditions() : latency(0), bandwidth(0), failRate(0.0), dropRate(0.0) {}
+    int latency;     // ms added before each response
+    int bandwidth;   // bytes per second sent, 0 for unlimited
+    double failRate; // fraction of commands answered with a failure
+    double dropRate; // fraction of commands the connection is dropped on instead
+};
+
+/** @short Per command counters for the whole run, written out as JSON on exit */
+class Stats
+{
+public:
+    static Stats *instance();
+    void record(const QString &protocol, const QString &command, const qint64 &bytesIn,
+                const qint64 &bytesOut, const qint64 &usecs, const bool &failed);
+    /** @short Count \param messages answered with FETCH data of kind \param item */
+    void recordFetched(const QString &item, const qint64 &messages);
+    QJsonObject toJson() const;
+
+private:
+    struct Counter {
+        Counter() : count(0), failures(0), bytesIn(0), bytesOut(0), usecs(0) {}
+        qint64 count;
+        qint64 failures;
+        qint64 bytesIn;
+        qint64 bytesOut;
+        qint64 usecs;
+    };
+    QHash<QString, QHash<QString, Counter> > m_counters;
+    QHash<QString, qint64> m_fetched; // IMAP only
+};
+
+/** @short A line based client connection with simulated link conditions
+ *
+ * Responses to a command are collected with reply() and go out together once
+ * the command is finished, after the configured latency and no faster than
+ * the bandwidth allows. Each command is one round trip in the stats, timed
+ * from when it arrived until the last byte of its response was written.
+ */
+class Session : public QObject
+{
+    Q_OBJECT
+public:
+    Session(QTcpSocket *socket, const QString &protocol, QObject *parent = 0);
+
+    static LinkConditions &conditions();
+
+protected:
+    /** @short A complete line without the CRLF, or literal data when expecting it */
+    virtual void handleLine(const QByteArray &line) = 0;
+
+    void reply(const QByteArray &data);
+    /** @short Send what was replied for \param command after the latency */
+    void finish(const QString &command, const bool &failed = false);
+    /** @short The next \param size bytes are handed to handleLine() in one piece */
+    void expectLiteral(const int &size) { m_literal = size; }
+    /** @short Roll the dice for failure injection, drops the connection itself */
+    bool injectFailure(bool *dropped);
+    void close();
+
+private slots:
+    void readData();
+    void sendSome();
+
+private:
+    struct Pending {
+        QString command;
+        bool failed;
+        qint64 bytesIn;
+        QByteArray data;
+        QElapsedTimer timer;
+    };
+
+    QTcpSocket *m_socket;
+    QString m_protocol;
+    QByteArray m_buffer;
+    int m_literal;
+    qint64 m_bytesIn;
+    QByteArray m_reply;
+    QElapsedTimer m_commandTimer;
+    QQueue<Pending> m_queue;
+    QByteArray m_sending;
+    QTimer *m_sendTimer;
+    bool m_closing;
+};
+
+#endif // SESSION_H
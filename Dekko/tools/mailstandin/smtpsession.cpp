@@ -0,0 +1,121 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "smtpsession.h"
+#include "mailboxes.h"
+#include <QDebug>
+
+SmtpSession::SmtpSession(QTcpSocket *socket, QObject *parent) : Session(socket, QStringLiteral("smtp"), parent),
+    m_state(Command), m_authStep(0), m_recipients(0)
+{
+    reply("220 localhost Dekko stand-in ESMTP\r\n");
+    finish(QStringLiteral("GREETING"));
+}
+
+void SmtpSession::handleLine(const QByteArray &line)
+{
+    switch (m_state) {
+    case Data:
+        if (line == ".") {
+            m_state = Command;
+            Mailboxes::instance()->append(Mailboxes::instance()->sentMailbox(), m_data, QStringList() << QStringLiteral("\\Seen"));
+            m_data.clear();
+            m_recipients = 0;
+            respond("DATA (message)", "250 OK queued");
+            return;
+        }
+        // Undo the dot stuffing
+        m_data += (line.startsWith("..") ? line.mid(1) : line) + "\r\n";
+        return;
+    case AuthLogin:
+        if (++m_authStep < 2) {
+            respond("AUTH (continuation)", "334 UGFzc3dvcmQ6");
+            return;
+        }
+        m_state = Command;
+        respond("AUTH", "235 Authentication succeeded");
+        return;
+    case AuthPlain:
+        m_state = Command;
+        respond("AUTH", "235 Authentication succeeded");
+        return;
+    case Command:
+        break;
+    }
+
+    const QByteArray verb = line.left(line.indexOf(' ')).toUpper();
+    bool dropped = false;
+    if (verb != "QUIT" && injectFailure(&dropped)) {
+        if (!dropped) {
+            respond(verb, "451 Injected failure", true);
+        }
+        return;
+    }
+    if (verb == "EHLO") {
+        reply("250-localhost\r\n250-SIZE 52428800\r\n250-8BITMIME\r\n250-PIPELINING\r\n");
+        respond(verb, "250 AUTH PLAIN LOGIN");
+    } else if (verb == "HELO") {
+        respond(verb, "250 localhost");
+    } else if (verb == "AUTH") {
+        const QList<QByteArray> args = line.split(' ');
+        const QByteArray mechanism = args.value(1).toUpper();
+        if (mechanism == "PLAIN") {
+            if (args.size() > 2) {
+                respond(verb, "235 Authentication succeeded");
+            } else {
+                m_state = AuthPlain;
+                respond("AUTH (continuation)", "334 ");
+            }
+        } else if (mechanism == "LOGIN") {
+            m_state = AuthLogin;
+            m_authStep = 0;
+            respond("AUTH (continuation)", "334 VXNlcm5hbWU6");
+        } else {
+            respond(verb, "504 Unrecognized authentication type", true);
+        }
+    } else if (verb == "MAIL") {
+        m_recipients = 0;
+        respond(verb, "250 OK");
+    } else if (verb == "RCPT") {
+        ++m_recipients;
+        respond(verb, "250 OK");
+    } else if (verb == "DATA") {
+        if (!m_recipients) {
+            respond(verb, "554 No valid recipients", true);
+            return;
+        }
+        m_state = Data;
+        respond(verb, "354 End data with <CR><LF>.<CR><LF>");
+    } else if (verb == "RSET") {
+        m_recipients = 0;
+        m_data.clear();
+        respond(verb, "250 OK");
+    } else if (verb == "NOOP") {
+        respond(verb, "250 OK");
+    } else if (verb == "QUIT") {
+        respond(verb, "221 Bye");
+        close();
+    } else {
+        respond(verb, "502 Command not implemented", true);
+    }
+}
+
+void SmtpSession::respond(const QByteArray &command, const QByteArray &response, const bool &failed)
+{
+    reply(response + "\r\n");
+    finish(QString::fromLatin1(command), failed);
+}
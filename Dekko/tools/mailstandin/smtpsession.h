@@ -0,0 +1,47 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SMTPSESSION_H
+#define SMTPSESSION_H
+
+#include "session.h"
+
+/** @short Accepts anything submitted and files it in the Sent mailbox
+ *
+ * EHLO/HELO, AUTH PLAIN and LOGIN with any credentials, MAIL, RCPT, DATA,
+ * RSET, NOOP and QUIT. STARTTLS isn't offered, it's loopback only.
+ */
+class SmtpSession : public Session
+{
+    Q_OBJECT
+public:
+    explicit SmtpSession(QTcpSocket *socket, QObject *parent = 0);
+
+protected:
+    void handleLine(const QByteArray &line);
+
+private:
+    void respond(const QByteArray &command, const QByteArray &response, const bool &failed = false);
+
+    enum State { Command, Data, AuthLogin, AuthPlain };
+    State m_state;
+    int m_authStep;
+    int m_recipients;
+    QByteArray m_data;
+};
+
+#endif // SMTPSESSION_H
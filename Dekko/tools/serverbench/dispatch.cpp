@@ -0,0 +1,168 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <QCoreApplication>
+#include <QSet>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <qmailaccount.h>
+#include <qmailaccountconfiguration.h>
+#include <qmailserviceaction.h>
+#include <qmailstore.h>
+#include "servicehandler.h"
+
+// Spread over enough accounts and client processes that the fair share and
+// per process limits both come into play
+#define ACCOUNTS 8
+#define PROCESSES 4
+
+namespace {
+
+// Accepts IMAP connections and never greets them, so whatever a service starts
+// stays in flight until we complete it by cancelling
+class SilentServer : public QTcpServer
+{
+public:
+    SilentServer() {
+        connect(this, &QTcpServer::newConnection, [this]() {
+            while (QTcpSocket *socket = nextPendingConnection()) {
+                socket->setParent(this);
+            }
+        });
+    }
+};
+
+bool addAccount(const int &index, const quint16 &port)
+{
+    QMailAccount account;
+    account.setName(QStringLiteral("Serverbench %1").arg(index));
+    account.setMessageType(QMailMessage::Email);
+    account.setStatus(QMailAccount::Enabled, true);
+    account.setStatus(QMailAccount::CanRetrieve, true);
+    account.setStatus(QMailAccount::MessageSource, true);
+
+    QMailAccountConfiguration config;
+    config.addServiceConfiguration(QStringLiteral("qmfstoragemanager"));
+    QMailServiceConfiguration storage(&config, QStringLiteral("qmfstoragemanager"));
+    storage.setType(QMailServiceConfiguration::Storage);
+    storage.setVersion(101);
+    storage.setValue(QStringLiteral("basePath"), QString());
+
+    config.addServiceConfiguration(QStringLiteral("imap4"));
+    QMailServiceConfiguration imap(&config, QStringLiteral("imap4"));
+    imap.setType(QMailServiceConfiguration::Source);
+    imap.setVersion(100);
+    imap.setValue(QStringLiteral("server"), QStringLiteral("127.0.0.1"));
+    imap.setValue(QStringLiteral("port"), QString::number(port));
+    imap.setValue(QStringLiteral("encryption"), QStringLiteral("0"));
+    imap.setValue(QStringLiteral("username"), QStringLiteral("user%1").arg(index));
+    imap.setValue(QStringLiteral("password"), QStringLiteral("password"));
+    imap.setValue(QStringLiteral("pushEnabled"), QStringLiteral("0"));
+    return QMailStore::instance()->addAccount(&account, &config);
+}
+
+void settle()
+{
+    // Twice so anything the first pass scheduled gets to run too
+    QCoreApplication::processEvents();
+    QCoreApplication::processEvents();
+}
+
+}
+
+bool dispatchSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    if (options.generatedStore) {
+        return false;
+    }
+    SilentServer server;
+    if (!bench.check(QStringLiteral("listening for the imap service"), server.listen(QHostAddress::LocalHost))) {
+        return true;
+    }
+    for (int i = 0; i < ACCOUNTS; ++i) {
+        if (!bench.check(QStringLiteral("account %1 added").arg(i + 1), addAccount(i + 1, server.serverPort()))) {
+            return true;
+        }
+    }
+    const QMailAccountIdList accounts = QMailStore::instance()->queryAccounts();
+
+    // Services for the accounts are created here, same as on server start
+    ServiceHandler handler(0);
+    QList<quint64> inFlight;
+    QSet<quint64> queued;
+    QObject::connect(&handler, &ServiceHandler::actionStarted, [&](const QMailActionData &data) {
+        queued.remove(data.id());
+        inFlight.append(data.id());
+    });
+    QObject::connect(&handler, static_cast<void (ServiceHandler::*)(quint64, QMailServiceAction::Activity)>(&ServiceHandler::activityChanged),
+                     [&](quint64 action, QMailServiceAction::Activity activity) {
+        if (activity == QMailServiceAction::Failed || activity == QMailServiceAction::Successful) {
+            inFlight.removeAll(action);
+        }
+    });
+
+    quint64 sequence = 0;
+    auto enqueue = [&]() {
+        ++sequence;
+        const quint64 action = (quint64(sequence % PROCESSES + 1) << 32) | sequence;
+        queued.insert(action);
+        handler.retrieveFolderList(action, accounts.at(sequence % accounts.count()), QMailFolderId(), true);
+    };
+    // Called directly, not scheduled, so only the pass itself is timed
+    auto dispatch = [&]() {
+        QMetaObject::invokeMethod(&handler, "dispatchRequest", Qt::DirectConnection);
+    };
+
+    Q_FOREACH(const int &depth, options.queued) {
+        while (queued.count() < depth) {
+            enqueue();
+        }
+        settle();
+        if (!bench.check(QStringLiteral("actions started with %1 queued").arg(depth), !inFlight.isEmpty())) {
+            break;
+        }
+
+        // Nothing finished, the scan every unrelated event pays
+        const QString rescan = QStringLiteral("rescan.%1").arg(depth);
+        bench.measure(rescan, options.iterations, dispatch);
+        bench.addValue(rescan, QStringLiteral("queued"), queued.count());
+        bench.addValue(rescan, QStringLiteral("active"), inFlight.count());
+
+        // One action completes, the queue is topped back up and a pass fills the slot
+        const QString complete = QStringLiteral("complete.%1").arg(depth);
+        int completions = 0;
+        for (int i = 0; i < options.iterations && !inFlight.isEmpty(); ++i) {
+            handler.cancelTransfer(inFlight.takeFirst());
+            enqueue();
+            bench.time(complete, dispatch);
+            ++completions;
+            settle();
+        }
+        bench.check(QStringLiteral("%1 completions with %2 queued").arg(options.iterations).arg(depth),
+                    completions == options.iterations);
+        bench.addValue(complete, QStringLiteral("completions"), completions);
+        bench.addValue(complete, QStringLiteral("queued"), queued.count());
+    }
+
+    // Leave nothing behind for the handler to report on the way out
+    Q_FOREACH(const quint64 &action, queued.toList() + inFlight) {
+        handler.cancelTransfer(action);
+    }
+    settle();
+    return true;
+}
@@ -0,0 +1,199 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QTemporaryDir>
+#include "requestjournal.h"
+
+// Requests left outstanding the whole run, as a long sync would, so
+// compaction has something to carry over
+#define STANDING 50
+
+namespace {
+
+qint64 fileSize(const QString &path)
+{
+    // Not cached, the journal changes underneath us
+    return QFileInfo(path).size();
+}
+
+// The requests file as ServiceHandler kept it before RequestJournal: each
+// request written and flushed as it is queued, and the whole file rewritten
+// with what is left on every completion
+class BaselineJournal
+{
+public:
+    explicit BaselineJournal(const QString &path) : m_file(path), m_written(0)
+    {
+        m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+
+    void enqueued(quint64 action)
+    {
+        if (m_outstanding.contains(action))
+            return;
+        m_outstanding.insert(action);
+        m_written += m_file.write(QByteArray::number(action).append('\n'));
+        m_file.flush();
+    }
+
+    void completed(quint64 action)
+    {
+        if (!m_outstanding.remove(action))
+            return;
+        m_file.resize(0);
+        foreach (quint64 req, m_outstanding)
+            m_written += m_file.write(QByteArray::number(req).append('\n'));
+        m_file.flush();
+    }
+
+    bool isOutstanding(quint64 action) const { return m_outstanding.contains(action); }
+    qint64 written() const { return m_written; }
+
+private:
+    QFile m_file;
+    QSet<quint64> m_outstanding;
+    qint64 m_written;
+};
+
+qint64 perSecond(const qint64 &count, const qint64 &nsecs)
+{
+    return nsecs > 0 ? count * 1000000000 / nsecs : 0;
+}
+
+}
+
+bool journalSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    QTemporaryDir dir;
+    const QString path = dir.path() + QStringLiteral("/requests");
+    RequestJournal journal(path);
+    journal.recover();
+    BaselineJournal baseline(dir.path() + QStringLiteral("/baseline"));
+
+    quint64 action = 0;
+    for (int i = 0; i < STANDING; ++i) {
+        journal.enqueued(++action);
+        baseline.enqueued(action);
+    }
+    journal.commit();
+
+    // Each pass the server makes queues a burst, and completes it later. A
+    // commit is one write and one sync however many records it carries, the
+    // baseline writes and flushes for every record instead
+    Q_FOREACH(const int &burst, QList<int>() << 1 << 10 << 100) {
+        const QString enqueue = QStringLiteral("enqueue.%1").arg(burst);
+        const QString complete = QStringLiteral("complete.%1").arg(burst);
+        const QString baselineEnqueue = QStringLiteral("baseline.enqueue.%1").arg(burst);
+        const QString baselineComplete = QStringLiteral("baseline.complete.%1").arg(burst);
+        qint64 written = 0;
+        qint64 minimal = 0;
+        int compactions = 0;
+        int commits = 0;
+        qint64 enqueueNsecs = 0;
+        qint64 baselineNsecs = 0;
+        const qint64 baselineWrittenBefore = baseline.written();
+        QElapsedTimer timer;
+        // Times \param fn, which ends in a commit, and counts the bytes that
+        // commit put on disk, all of it when it compacted
+        auto commit = [&](const QString &op, const std::function<void ()> &fn) -> qint64 {
+            const qint64 before = fileSize(path);
+            timer.start();
+            bench.time(op, fn);
+            const qint64 elapsed = timer.nsecsElapsed();
+            const qint64 after = fileSize(path);
+            if (after < before) {
+                ++compactions;
+                written += after;
+            } else {
+                written += after - before;
+            }
+            ++commits;
+            // Any commit scheduled by the records is now a no op, let it go
+            QCoreApplication::processEvents();
+            return elapsed;
+        };
+
+        for (int i = 0; i < options.iterations; ++i) {
+            const quint64 first = action + 1;
+            const quint64 last = action + burst;
+            action = last;
+            for (quint64 a = first; a <= last; ++a) {
+                // "+<action>\n" and "-<action>\n"
+                minimal += 2 * (QByteArray::number(a).size() + 2);
+            }
+
+            enqueueNsecs += commit(enqueue, [&]() {
+                for (quint64 a = first; a <= last; ++a)
+                    journal.enqueued(a);
+                journal.commit();
+            });
+            commit(complete, [&]() {
+                for (quint64 a = first; a <= last; ++a)
+                    journal.completed(a);
+                journal.commit();
+            });
+
+            timer.start();
+            bench.time(baselineEnqueue, [&]() {
+                for (quint64 a = first; a <= last; ++a)
+                    baseline.enqueued(a);
+            });
+            baselineNsecs += timer.nsecsElapsed();
+            bench.time(baselineComplete, [&]() {
+                for (quint64 a = first; a <= last; ++a)
+                    baseline.completed(a);
+            });
+        }
+
+        const qint64 requests = qint64(options.iterations) * burst;
+        bench.addValue(enqueue, QStringLiteral("requests"), requests);
+        bench.addValue(enqueue, QStringLiteral("requestsPerSecond"), perSecond(requests, enqueueNsecs));
+        bench.addValue(enqueue, QStringLiteral("bytesWritten"), written);
+        bench.addValue(enqueue, QStringLiteral("bytesPerRequest"), written / requests);
+        // Over 100 is more than was journaled, the cost of compacting
+        bench.addValue(enqueue, QStringLiteral("writeAmplification_pct"), minimal ? written * 100 / minimal : 0);
+        bench.addValue(enqueue, QStringLiteral("syncs"), commits);
+        bench.addValue(enqueue, QStringLiteral("compactions"), compactions);
+
+        const qint64 baselineWritten = baseline.written() - baselineWrittenBefore;
+        bench.addValue(baselineEnqueue, QStringLiteral("requests"), requests);
+        bench.addValue(baselineEnqueue, QStringLiteral("requestsPerSecond"), perSecond(requests, baselineNsecs));
+        bench.addValue(baselineEnqueue, QStringLiteral("bytesWritten"), baselineWritten);
+        bench.addValue(baselineEnqueue, QStringLiteral("bytesPerRequest"), baselineWritten / requests);
+        bench.addValue(baselineEnqueue, QStringLiteral("writeAmplification_pct"), minimal ? baselineWritten * 100 / minimal : 0);
+        // One flush per record, never synced
+        bench.addValue(baselineEnqueue, QStringLiteral("flushes"), 2 * requests);
+
+        bench.check(QStringLiteral("standing requests survive a burst of %1").arg(burst),
+                    journal.isOutstanding(1) && journal.isOutstanding(STANDING)
+                    && baseline.isOutstanding(1) && baseline.isOutstanding(STANDING));
+    }
+
+    // What a restart reads back, which is every standing request
+    RequestJournal recovered(path);
+    QList<quint64> outstanding;
+    bench.time(QStringLiteral("recover"), [&]() { outstanding = recovered.recover(); });
+    bench.addValue(QStringLiteral("recover"), QStringLiteral("outstanding"), outstanding.count());
+    bench.check(QStringLiteral("only the standing requests recovered"), outstanding.count() == STANDING);
+    return true;
+}
@@ -0,0 +1,126 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include "suites.h"
+
+struct Suite {
+    const char *name;
+    SuiteFunc run;
+};
+
+static const Suite SUITES[] = {
+    { "dispatch", dispatchSuite },
+    { "journal", journalSuite },
+    { "search", searchSuite }
+};
+static const int SUITE_COUNT = sizeof(SUITES) / sizeof(SUITES[0]);
+
+// dekko-serverbench --queued 100 --queued 1000 --json bench.json
+// dekko-serverbench --data-dir /tmp/bigstore --suite search
+//
+// Runs the server's own code in process against a scratch store, so it never
+// touches the real one and needs no messageserver running. The QMF protocol
+// plugins do need to be installed as the suites drive the real services.
+// With --data-dir the suites reading a store run against one generated by
+// dekko-storegen instead, and those adding accounts are skipped.
+int main(int argc, char **argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("dekko-serverbench"));
+
+    QStringList names;
+    for (int i = 0; i < SUITE_COUNT; ++i) {
+        names << QString::fromLatin1(SUITES[i].name);
+    }
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmarks Dekko's message server hot paths"));
+    parser.addHelpOption();
+    QCommandLineOption dataDir(QStringLiteral("data-dir"), QStringLiteral("Store generated by dekko-storegen, overrides QMF_DATA"), QStringLiteral("path"));
+    QCommandLineOption suites(QStringLiteral("suite"), QStringLiteral("Suite to run, may be repeated. One of: %1").arg(names.join(QStringLiteral(", "))), QStringLiteral("name"));
+    QCommandLineOption iterations(QStringLiteral("iterations"), QStringLiteral("Samples per operation"), QStringLiteral("n"), QStringLiteral("50"));
+    QCommandLineOption queued(QStringLiteral("queued"), QStringLiteral("Queue depth to measure at, may be repeated. Defaults to 10, 100 and 1000"), QStringLiteral("n"));
+    QCommandLineOption json(QStringLiteral("json"), QStringLiteral("Write the report to this file instead of stdout"), QStringLiteral("file"));
+    parser.addOptions({ dataDir, suites, iterations, queued, json });
+    parser.process(app);
+
+    SuiteOptions options;
+    options.iterations = qMax(1, parser.value(iterations).toInt());
+    Q_FOREACH(const QString &depth, parser.values(queued)) {
+        if (depth.toInt() > 0) {
+            options.queued << depth.toInt();
+        }
+    }
+    if (options.queued.isEmpty()) {
+        options.queued << 10 << 100 << 1000;
+    }
+
+    // Has to be set before anything touches the store
+    QTemporaryDir scratch;
+    if (parser.isSet(dataDir)) {
+        qputenv("QMF_DATA", QFile::encodeName(QDir(parser.value(dataDir)).absolutePath()));
+        options.generatedStore = true;
+    } else {
+        qputenv("QMF_DATA", QFile::encodeName(scratch.path()));
+    }
+
+    const QStringList wanted = parser.values(suites);
+    QJsonObject results;
+    bool ok = true;
+    for (int i = 0; i < SUITE_COUNT; ++i) {
+        const QString name = QString::fromLatin1(SUITES[i].name);
+        if (!wanted.isEmpty() && !wanted.contains(name)) {
+            continue;
+        }
+        Benchmark bench(name);
+        qDebug() << "[ServerBench] Running" << bench.name();
+        if (!SUITES[i].run(bench, options)) {
+            qDebug() << "[ServerBench] Skipped" << bench.name();
+            continue;
+        }
+        ok = ok && bench.passed();
+        results.insert(bench.name(), bench.report());
+    }
+
+    QJsonObject report;
+    report.insert(QStringLiteral("store"), QString::fromLocal8Bit(qgetenv("QMF_DATA")));
+    report.insert(QStringLiteral("iterations"), options.iterations);
+    report.insert(QStringLiteral("suites"), results);
+    report.insert(QStringLiteral("peakResident_kb"), Benchmark::peakResidentKb());
+    const QByteArray data = QJsonDocument(report).toJson();
+    if (parser.isSet(json)) {
+        QFile file(parser.value(json));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+            qWarning() << "Unable to write report to" << file.fileName();
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << data;
+    }
+    return ok ? 0 : 1;
+}
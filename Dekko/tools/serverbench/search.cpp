@@ -0,0 +1,92 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "suites.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <qmailserviceaction.h>
+#include <qmailstore.h>
+#include "servicehandler.h"
+
+// Longest we wait on any one search
+#define SEARCH_TIMEOUT 120000
+// Messages the body text search looks through, it loads every one of them
+#define BODY_SEARCH_SIZE 500
+
+// Local searches as the client's search page makes them, over a store made by dekko-storegen
+bool searchSuite(Benchmark &bench, const SuiteOptions &options)
+{
+    if (!options.generatedStore) {
+        return false;
+    }
+    QMailStore *store = QMailStore::instance();
+    const QMailMessageKey email = QMailMessageKey::messageType(QMailMessage::Email);
+    const QMailMessageSortKey sort = QMailMessageSortKey::timeStamp(Qt::DescendingOrder);
+    if (!bench.check(QStringLiteral("store has messages"), store->countMessages(email) > 0)) {
+        return true;
+    }
+
+    ServiceHandler handler(0);
+    quint64 action = 0;
+    int matches = 0;
+    QObject::connect(&handler, static_cast<void (ServiceHandler::*)(quint64, const QMailMessageIdList &)>(&ServiceHandler::matchingMessageIds),
+                     [&](quint64 id, const QMailMessageIdList &ids) {
+        if (id == action) {
+            matches = ids.size();
+        }
+    });
+    auto search = [&](const QString &op, const QMailMessageKey &filter, const QString &bodyText) {
+        ++action;
+        matches = -1;
+        bool done = false;
+        QEventLoop loop;
+        QMetaObject::Connection completed = QObject::connect(&handler, &ServiceHandler::searchCompleted, [&](quint64 id) {
+            if (id == action) {
+                done = true;
+                loop.quit();
+            }
+        });
+        bench.time(op, [&]() {
+            handler.searchMessages(action, filter, bodyText, QMailSearchAction::Local, sort);
+            if (!done) {
+                QTimer::singleShot(SEARCH_TIMEOUT, &loop, &QEventLoop::quit);
+                loop.exec();
+            }
+        });
+        QObject::disconnect(completed);
+        return done;
+    };
+
+    // Metadata only, what a search of subjects and addresses comes down to
+    const QMailMessageKey subject = email & QMailMessageKey::subject(QStringLiteral("review"), QMailDataComparator::Includes);
+    bool ok = true;
+    for (int i = 0; i < options.iterations && ok; ++i) {
+        ok = search(QStringLiteral("subject"), subject, QString());
+    }
+    bench.check(QStringLiteral("subject searches complete"), ok);
+    bench.addValue(QStringLiteral("subject"), QStringLiteral("matches"), matches);
+
+    // Body text has every candidate loaded and decoded, so keep the set bounded
+    const QMailMessageKey recent = QMailMessageKey::id(store->queryMessages(email, sort, BODY_SEARCH_SIZE));
+    const QString body = QStringLiteral("body.%1").arg(BODY_SEARCH_SIZE);
+    for (int i = 0; i < qMax(1, options.iterations / 5) && ok; ++i) {
+        ok = search(body, recent, QStringLiteral("deadline"));
+    }
+    bench.check(QStringLiteral("body searches complete"), ok);
+    bench.addValue(body, QStringLiteral("matches"), matches);
+    return true;
+}
@@ -0,0 +1,46 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SUITES_H
+#define SUITES_H
+
+#include "benchmark.h"
+
+struct SuiteOptions {
+    SuiteOptions() : iterations(50), generatedStore(false) {}
+    // Samples taken per operation
+    int iterations;
+    // True when pointed at a store made by dekko-storegen, suites that
+    // measure reads over it skip themselves otherwise and those that add
+    // accounts of their own skip themselves when it is.
+    bool generatedStore;
+    // Queue depths to measure at
+    QList<int> queued;
+};
+
+// Each suite fills in \param bench and returns false if it couldn't run
+typedef bool (*SuiteFunc)(Benchmark &bench, const SuiteOptions &options);
+
+// ServiceHandler::dispatchRequest with N requests queued as M actions complete
+bool dispatchSuite(Benchmark &bench, const SuiteOptions &options);
+// RequestJournal throughput, bytes and syncs per request for bursts of requests,
+// next to the flush per request journal it replaced
+bool journalSuite(Benchmark &bench, const SuiteOptions &options);
+// ServiceHandler local search by subject and by body text
+bool searchSuite(Benchmark &bench, const SuiteOptions &options);
+
+#endif // SUITES_H
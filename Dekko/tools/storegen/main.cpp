@@ -0,0 +1,81 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTextStream>
+#include "storegenerator.h"
+
+// dekko-storegen --data-dir /tmp/bigstore --messages 100000 --json report.json
+//
+// Then run dekko against it with QMF_DATA=/tmp/bigstore. Keep the messageserver
+// for the real store stopped while generating, QMF locks the database.
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("dekko-storegen"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Generates a reproducible mail store for profiling Dekko"));
+    parser.addHelpOption();
+    QCommandLineOption dataDir(QStringLiteral("data-dir"), QStringLiteral("Store location, overrides QMF_DATA"), QStringLiteral("path"));
+    QCommandLineOption accounts(QStringLiteral("accounts"), QStringLiteral("Number of accounts"), QStringLiteral("n"), QStringLiteral("2"));
+    QCommandLineOption folders(QStringLiteral("folders"), QStringLiteral("Folders per account, at least 5"), QStringLiteral("n"), QStringLiteral("8"));
+    QCommandLineOption messages(QStringLiteral("messages"), QStringLiteral("Total number of messages"), QStringLiteral("n"), QStringLiteral("10000"));
+    QCommandLineOption seed(QStringLiteral("seed"), QStringLiteral("Random seed"), QStringLiteral("n"), QStringLiteral("1"));
+    QCommandLineOption threads(QStringLiteral("threads"), QStringLiteral("Fraction of messages that are replies"), QStringLiteral("ratio"), QStringLiteral("0.4"));
+    QCommandLineOption attachments(QStringLiteral("attachments"), QStringLiteral("Fraction of messages with an attachment"), QStringLiteral("ratio"), QStringLiteral("0.1"));
+    QCommandLineOption batch(QStringLiteral("batch"), QStringLiteral("Messages added to the store at a time"), QStringLiteral("n"), QStringLiteral("500"));
+    QCommandLineOption json(QStringLiteral("json"), QStringLiteral("Write the report to this file instead of stdout"), QStringLiteral("file"));
+    parser.addOptions({ dataDir, accounts, folders, messages, seed, threads, attachments, batch, json });
+    parser.process(app);
+
+    if (parser.isSet(dataDir)) {
+        const QString path = QDir(parser.value(dataDir)).absolutePath();
+        QDir().mkpath(path);
+        // Has to be set before anything touches the store
+        qputenv("QMF_DATA", QFile::encodeName(path));
+    }
+
+    StoreGenerator::Options options;
+    options.accounts = qMax(1, parser.value(accounts).toInt());
+    options.foldersPerAccount = parser.value(folders).toInt();
+    options.messages = qMax(0, parser.value(messages).toInt());
+    options.seed = parser.value(seed).toUInt();
+    options.threadRatio = parser.value(threads).toDouble();
+    options.attachmentRatio = parser.value(attachments).toDouble();
+    options.batchSize = qMax(1, parser.value(batch).toInt());
+
+    StoreGenerator generator(options);
+    const bool ok = generator.run();
+
+    const QByteArray report = QJsonDocument(generator.report()).toJson();
+    if (parser.isSet(json)) {
+        QFile file(parser.value(json));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(report) != report.size()) {
+            qWarning() << "Unable to write report to" << file.fileName();
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << report;
+    }
+    return ok ? 0 : 1;
+}
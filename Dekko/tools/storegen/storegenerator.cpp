@@ -0,0 +1,397 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "storegenerator.h"
+#include <algorithm>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <qmailaccount.h>
+#include <qmailaccountconfiguration.h>
+#include <qmailnamespace.h>
+#include <qmailstore.h>
+
+static const char *const WORDS[] = {
+    "meeting", "project", "release", "build", "review", "update", "schedule", "budget", "design", "draft",
+    "server", "client", "issue", "patch", "branch", "merge", "test", "report", "invoice", "order",
+    "the", "a", "we", "you", "it", "is", "was", "will", "should", "could", "have", "been", "for", "with",
+    "about", "from", "this", "that", "next", "last", "week", "today", "tomorrow", "please", "thanks",
+    "question", "answer", "follow", "up", "notes", "attached", "see", "below", "regarding", "quick",
+    "summary", "plan", "team", "call", "agenda", "feedback", "deadline", "status", "change", "request",
+    "photos", "holiday", "dinner", "weekend", "party", "trip", "ticket", "booking", "confirmation", "delivery"
+};
+static const int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+static const char *const FIRST_NAMES[] = {
+    "Alice", "Bob", "Carol", "Dave", "Eve", "Frank", "Grace", "Heidi", "Ivan", "Judy",
+    "Mallory", "Niaj", "Olivia", "Peggy", "Rupert", "Sybil", "Trent", "Victor", "Walter", "Zoë"
+};
+static const char *const LAST_NAMES[] = {
+    "Smith", "Jones", "Müller", "García", "Rossi", "Dubois", "Novak", "Kowalski", "Andersen", "Nakamura",
+    "O'Brien", "Silva", "Ivanova", "Haddad", "Chen", "Okafor", "Larsen", "Moreau", "Fischer", "Costa",
+    "Patel", "Kim", "Nguyen", "Horvat", "Jensen"
+};
+
+static const char *const ATTACHMENTS[][2] = {
+    { "report-%1.pdf", "application/pdf" },
+    { "photo-%1.jpg", "image/jpeg" },
+    { "notes-%1.txt", "text/plain" },
+    { "budget-%1.ods", "application/vnd.oasis.opendocument.spreadsheet" },
+    { "archive-%1.zip", "application/zip" }
+};
+static const int ATTACHMENT_COUNT = sizeof(ATTACHMENTS) / sizeof(ATTACHMENTS[0]);
+
+// Messages go back a minute to ten from here, so runs don't depend on the clock
+static const QDateTime BASE_DATE(QDate(2017, 6, 1), QTime(12, 0), Qt::UTC);
+// Recent messages per folder that replies are picked from
+#define RECENT_SIZE 50
+
+static qint64 percentile(QList<qint64> values, const double &p)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    const int index = qBound(0, int(p * (values.size() - 1) + 0.5), values.size() - 1);
+    return values.at(index);
+}
+
+static qint64 peakResidentKb()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    Q_FOREACH(const QByteArray &line, status.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+        }
+    }
+    return -1;
+}
+
+StoreGenerator::StoreGenerator(const Options &options) :
+    m_options(options), m_random(options.seed), m_elapsed(0), m_generated(0),
+    m_threaded(0), m_withAttachments(0)
+{
+    for (int i = 0; i < 500; ++i) {
+        const QString first = QString::fromUtf8(FIRST_NAMES[i % 20]);
+        const QString last = QString::fromUtf8(LAST_NAMES[(i / 20) % 25]);
+        const QString address = QStringLiteral("%1.%2@example%3.org")
+                .arg(first.toLower(), last.toLower().remove(QLatin1Char('\'')), QString::number(i % 7));
+        m_people << QMailAddress(first + QLatin1Char(' ') + last, address);
+    }
+}
+
+bool StoreGenerator::run()
+{
+    QElapsedTimer total;
+    total.start();
+    if (!createAccounts()) {
+        return false;
+    }
+    const int totalWeight = m_folderWeights.isEmpty() ? 0 : m_folderWeights.last();
+    int index = 0;
+    while (index < m_options.messages) {
+        QList<QMailMessage *> batch;
+        const int end = qMin(index + m_options.batchSize, m_options.messages);
+        for (; index < end; ++index) {
+            const int pick = between(0, totalWeight - 1);
+            const int folder = std::upper_bound(m_folderWeights.begin(), m_folderWeights.end(), pick) - m_folderWeights.begin();
+            batch << createMessage(index, m_folders[folder]);
+        }
+        QElapsedTimer timer;
+        timer.start();
+        const bool added = QMailStore::instance()->addMessages(batch);
+        m_batchTimes << timer.nsecsElapsed() / 1000;
+        qDeleteAll(batch);
+        if (!added) {
+            qWarning() << "[StoreGenerator] Failed adding messages" << QMailStore::instance()->lastError();
+            return false;
+        }
+        m_generated = index;
+        if (m_batchTimes.size() % 20 == 0) {
+            qDebug() << "[StoreGenerator]" << m_generated << "of" << m_options.messages << "messages";
+        }
+    }
+    m_elapsed = total.elapsed();
+    return true;
+}
+
+QJsonObject StoreGenerator::report() const
+{
+    QJsonObject options;
+    options.insert(QStringLiteral("seed"), qint64(m_options.seed));
+    options.insert(QStringLiteral("accounts"), m_options.accounts);
+    options.insert(QStringLiteral("foldersPerAccount"), m_options.foldersPerAccount);
+    options.insert(QStringLiteral("messages"), m_options.messages);
+    options.insert(QStringLiteral("batchSize"), m_options.batchSize);
+
+    QJsonObject batches;
+    batches.insert(QStringLiteral("count"), m_batchTimes.size());
+    batches.insert(QStringLiteral("p50_us"), percentile(m_batchTimes, 0.5));
+    batches.insert(QStringLiteral("p99_us"), percentile(m_batchTimes, 0.99));
+    batches.insert(QStringLiteral("max_us"), percentile(m_batchTimes, 1.0));
+
+    QJsonObject result;
+    result.insert(QStringLiteral("options"), options);
+    result.insert(QStringLiteral("generated"), m_generated);
+    result.insert(QStringLiteral("threadedReplies"), m_threaded);
+    result.insert(QStringLiteral("withAttachments"), m_withAttachments);
+    result.insert(QStringLiteral("elapsed_ms"), m_elapsed);
+    result.insert(QStringLiteral("messagesPerSecond"), m_elapsed > 0 ? m_generated * 1000.0 / m_elapsed : 0.0);
+    result.insert(QStringLiteral("addBatches"), batches);
+    result.insert(QStringLiteral("peakResident_kb"), peakResidentKb());
+    result.insert(QStringLiteral("storeSize_bytes"), QFileInfo(QMail::dataPath() + QStringLiteral("qmailstore.db")).size());
+    return result;
+}
+
+bool StoreGenerator::createAccounts()
+{
+    QMailStore *store = QMailStore::instance();
+    int weight = 0;
+    for (int a = 0; a < m_options.accounts; ++a) {
+        QMailAccount account;
+        account.setName(QStringLiteral("Storegen %1").arg(a + 1));
+        account.setMessageType(QMailMessage::Email);
+        account.setFromAddress(QMailAddress(QStringLiteral("Storegen User %1").arg(a + 1),
+                                            QStringLiteral("user%1@storegen.example").arg(a + 1)));
+        account.setStatus(QMailAccount::Enabled, true);
+        account.setStatus(QMailAccount::UserEditable, true);
+        account.setStatus(QMailAccount::UserRemovable, true);
+        QMailAccountConfiguration config;
+        if (!store->addAccount(&account, &config)) {
+            qWarning() << "[StoreGenerator] Failed adding account" << store->lastError();
+            return false;
+        }
+
+        // Standard folders first then mailing lists to make up the rest
+        // Archive stands in for a plain user folder
+        struct Standard { const char *path; QMailFolder::StandardFolder type; int weight; bool sent; };
+        static const Standard standards[] = {
+            { "INBOX", QMailFolder::InboxFolder, 40, false },
+            { "Sent", QMailFolder::SentFolder, 10, true },
+            { "Archive", QMailFolder::StandardFolder(0), 10, false },
+            { "Drafts", QMailFolder::DraftsFolder, 1, true },
+            { "Trash", QMailFolder::TrashFolder, 4, false }
+        };
+        const int folderCount = qMax(m_options.foldersPerAccount, 5);
+        const int lists = folderCount - 5;
+        for (int f = 0; f < folderCount; ++f) {
+            FolderInfo info;
+            info.accountId = account.id();
+            info.owner = account.fromAddress();
+            QString path;
+            int folderWeight = 0;
+            if (f < 5) {
+                path = QString::fromLatin1(standards[f].path);
+                folderWeight = standards[f].weight;
+                info.sent = standards[f].sent;
+                info.list = false;
+            } else {
+                path = QStringLiteral("Lists/%1-%2").arg(QString::fromLatin1(WORDS[f % WORD_COUNT])).arg(f);
+                folderWeight = qMax(1, 35 / qMax(lists, 1));
+                info.sent = false;
+                info.list = true;
+            }
+            QMailFolder folder(path, QMailFolderId(), account.id());
+            folder.setDisplayName(path.section(QLatin1Char('/'), -1));
+            folder.setStatus(QMailFolder::SynchronizationEnabled, true);
+            if (!store->addFolder(&folder)) {
+                qWarning() << "[StoreGenerator] Failed adding folder" << path << store->lastError();
+                return false;
+            }
+            info.id = folder.id();
+            if (f < 5 && standards[f].type) {
+                account.setStandardFolder(standards[f].type, folder.id());
+            }
+            weight += folderWeight;
+            m_folders << info;
+            m_folderWeights << weight;
+        }
+        store->updateAccount(&account);
+    }
+    return !m_folders.isEmpty();
+}
+
+QMailMessage *StoreGenerator::createMessage(const int &index, FolderInfo &folder)
+{
+    QMailMessage *msg = new QMailMessage;
+    msg->setMessageType(QMailMessage::Email);
+    msg->setParentAccountId(folder.accountId);
+    msg->setParentFolderId(folder.id);
+    msg->setServerUid(QStringLiteral("storegen-%1").arg(index));
+
+    const QDateTime date = BASE_DATE.addSecs(-qint64(m_options.messages - index) * 600 + between(0, 599));
+    msg->setDate(QMailTimeStamp(date));
+    msg->setReceivedDate(QMailTimeStamp(date));
+
+    if (folder.sent) {
+        msg->setFrom(folder.owner);
+        QMailAddressList to;
+        const int count = between(1, 3);
+        for (int i = 0; i < count; ++i) {
+            to << person();
+        }
+        msg->setTo(to);
+    } else if (folder.list) {
+        const QString list = QStringLiteral("list%1@lists.storegen.example").arg(folder.id.toULongLong());
+        msg->setFrom(person());
+        msg->setTo(QMailAddress(list));
+        msg->setHeaderField(QStringLiteral("List-Id"), QStringLiteral("<%1>").arg(QString(list).replace(QLatin1Char('@'), QLatin1Char('.'))));
+        msg->setListId(list);
+    } else {
+        msg->setFrom(person());
+        msg->setTo(folder.owner);
+        if (chance(0.2)) {
+            msg->setCc(QMailAddressList() << person() << person());
+        }
+    }
+
+    const QString messageId = QStringLiteral("storegen.%1.%2@storegen.example").arg(m_options.seed).arg(index);
+    msg->setHeaderField(QStringLiteral("Message-ID"), QStringLiteral("<%1>").arg(messageId));
+    QString references;
+    QString subject;
+    if (!folder.recent.isEmpty() && chance(m_options.threadRatio)) {
+        const int parent = between(0, folder.recent.size() - 1);
+        const QPair<QString, QString> &replyTo = folder.recent.at(parent);
+        references = (replyTo.second + QStringLiteral(" <%1>").arg(replyTo.first)).trimmed();
+        subject = folder.recentSubjects.at(parent);
+        if (!subject.startsWith(QLatin1String("Re: "))) {
+            subject.prepend(QLatin1String("Re: "));
+        }
+        msg->setHeaderField(QStringLiteral("In-Reply-To"), QStringLiteral("<%1>").arg(replyTo.first));
+        msg->setHeaderField(QStringLiteral("References"), references);
+        ++m_threaded;
+    } else {
+        subject = words(between(2, 8));
+        subject[0] = subject.at(0).toUpper();
+    }
+    msg->setSubject(subject);
+
+    folder.recent << qMakePair(messageId, references);
+    folder.recentSubjects << subject;
+    if (folder.recent.size() > RECENT_SIZE) {
+        folder.recent.removeFirst();
+        folder.recentSubjects.removeFirst();
+    }
+
+    quint64 status = QMailMessage::ContentAvailable | QMailMessage::PartialContentAvailable;
+    if (folder.sent) {
+        status |= QMailMessage::Outgoing | QMailMessage::Sent | QMailMessage::Read;
+    } else {
+        status |= QMailMessage::Incoming;
+        if (chance(m_options.readRatio)) {
+            status |= QMailMessage::Read;
+        }
+    }
+    if (chance(m_options.flaggedRatio)) {
+        status |= QMailMessage::Important;
+    }
+    msg->setStatus(status, true);
+    setContent(msg);
+    msg->setSize(msg->toRfc2822(QMailMessage::TransmissionFormat).size());
+    return msg;
+}
+
+void StoreGenerator::setContent(QMailMessage *msg)
+{
+    QStringList paragraphs;
+    const int count = between(1, 6);
+    for (int i = 0; i < count; ++i) {
+        paragraphs << words(between(10, 80)) + QLatin1Char('.');
+    }
+    const QByteArray plain = paragraphs.join(QStringLiteral("\n\n")).toUtf8();
+    const QMailMessageContentType plainType(QByteArrayLiteral("text/plain; charset=UTF-8"));
+    const bool html = chance(m_options.htmlRatio);
+    const bool attachment = chance(m_options.attachmentRatio);
+
+    if (!html && !attachment) {
+        msg->setBody(QMailMessageBody::fromData(plain, plainType, QMailMessageBody::QuotedPrintable));
+        return;
+    }
+
+    QMailMessagePart text = QMailMessagePart::fromData(plain, QMailMessageContentDisposition(QMailMessageContentDisposition::Inline),
+                                                       plainType, QMailMessageBody::QuotedPrintable);
+    if (html) {
+        QByteArray markup("<html><body>");
+        Q_FOREACH(const QString &paragraph, paragraphs) {
+            markup += "<p>" + paragraph.toUtf8() + "</p>";
+        }
+        markup += "</body></html>";
+        QMailMessagePart htmlPart = QMailMessagePart::fromData(markup, QMailMessageContentDisposition(QMailMessageContentDisposition::Inline),
+                                                               QMailMessageContentType(QByteArrayLiteral("text/html; charset=UTF-8")),
+                                                               QMailMessageBody::QuotedPrintable);
+        if (attachment) {
+            QMailMessagePart alternative;
+            alternative.setMultipartType(QMailMessagePart::MultipartAlternative);
+            alternative.appendPart(text);
+            alternative.appendPart(htmlPart);
+            text = alternative;
+        } else {
+            msg->setMultipartType(QMailMessage::MultipartAlternative);
+            msg->appendPart(text);
+            msg->appendPart(htmlPart);
+            return;
+        }
+    }
+
+    // Random bytes, they're sized like real attachments without compressing like real ones
+    const int which = between(0, ATTACHMENT_COUNT - 1);
+    QByteArray data(between(1024, 256 * 1024), Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = char(m_random() & 0xff);
+    }
+    const QString fileName = QString::fromLatin1(ATTACHMENTS[which][0]).arg(m_withAttachments + 1);
+    QMailMessageContentDisposition disposition(QMailMessageContentDisposition::Attachment);
+    disposition.setFilename(fileName.toUtf8());
+    disposition.setSize(data.size());
+    QMailMessageContentType type(QByteArray(ATTACHMENTS[which][1]));
+    type.setName(fileName.toUtf8());
+    msg->setMultipartType(QMailMessage::MultipartMixed);
+    msg->appendPart(text);
+    msg->appendPart(QMailMessagePart::fromData(data, disposition, type, QMailMessageBody::Base64));
+    msg->setStatus(QMailMessage::HasAttachments, true);
+    ++m_withAttachments;
+}
+
+QString StoreGenerator::words(const int &count)
+{
+    QStringList result;
+    for (int i = 0; i < count; ++i) {
+        result << QString::fromLatin1(WORDS[between(0, WORD_COUNT - 1)]);
+    }
+    return result.join(QLatin1Char(' '));
+}
+
+QMailAddress StoreGenerator::person()
+{
+    // Skewed so a few people send most of the mail, like a real inbox
+    const int index = between(0, m_people.size() - 1);
+    return m_people.at((index * index) / m_people.size());
+}
+
+bool StoreGenerator::chance(const double &ratio)
+{
+    return std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < ratio;
+}
+
+int StoreGenerator::between(const int &low, const int &high)
+{
+    return std::uniform_int_distribution<int>(low, qMax(low, high))(m_random);
+}
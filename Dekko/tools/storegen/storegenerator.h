@@ -0,0 +1,97 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STOREGENERATOR_H
+#define STOREGENERATOR_H
+
+#include <random>
+#include <QJsonObject>
+#include <QList>
+#include <QStringList>
+#include <qmailaddress.h>
+#include <qmailfolder.h>
+#include <qmailmessage.h>
+
+/** @short Fills a mail store with reproducible fake mail
+ *
+ * Everything is derived from the seed, including the dates which count back
+ * from a fixed point, so two runs with the same options give the same store.
+ * That makes it usable for comparing timings between builds, the numbers
+ * aren't thrown off by a different mix of messages.
+ *
+ * Messages get a realistic spread of MIME layouts (plain, alternative with
+ * html, mixed with an attachment), reply threads with proper References
+ * headers, mailing list folders, sent mail and read/flagged states.
+ */
+class StoreGenerator
+{
+public:
+    struct Options {
+        Options() : accounts(2), foldersPerAccount(8), messages(10000), seed(1),
+            threadRatio(0.4), attachmentRatio(0.1), htmlRatio(0.3), readRatio(0.7),
+            flaggedRatio(0.05), batchSize(500) {}
+        int accounts;
+        int foldersPerAccount;
+        int messages;
+        quint32 seed;
+        double threadRatio;
+        double attachmentRatio;
+        double htmlRatio;
+        double readRatio;
+        double flaggedRatio;
+        int batchSize;
+    };
+
+    explicit StoreGenerator(const Options &options);
+
+    bool run();
+    /** @short What was generated and how long the store took to take it */
+    QJsonObject report() const;
+
+private:
+    struct FolderInfo {
+        QMailFolderId id;
+        QMailAccountId accountId;
+        QMailAddress owner;
+        bool sent;
+        bool list;
+        // Recent messages to reply to
+        QList<QPair<QString, QString> > recent; // Message-ID, References
+        QStringList recentSubjects;
+    };
+
+    bool createAccounts();
+    QMailMessage *createMessage(const int &index, FolderInfo &folder);
+    void setContent(QMailMessage *msg);
+    QString words(const int &count);
+    QMailAddress person();
+    bool chance(const double &ratio);
+    int between(const int &low, const int &high);
+
+    Options m_options;
+    std::mt19937 m_random;
+    QList<FolderInfo> m_folders;
+    QList<int> m_folderWeights;
+    QList<QMailAddress> m_people;
+    QList<qint64> m_batchTimes; // microseconds
+    qint64 m_elapsed;
+    int m_generated;
+    int m_threaded;
+    int m_withAttachments;
+};
+
+#endif // STOREGENERATOR_H
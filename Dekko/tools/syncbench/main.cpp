@@ -0,0 +1,223 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <qmailnamespace.h>
+#include "benchmark.h"
+#include "standinstats.h"
+#include "syncdriver.h"
+
+// Longest we wait on either child process to come up
+#define START_TIMEOUT 30000
+
+// dekko-storegen --data-dir /tmp/bigstore --messages 20000
+// dekko-syncbench --data-dir /tmp/bigstore --latency 40 --json sync.json
+//
+// Starts dekko-mailstandin serving the given store and a dekkod of its own on
+// a scratch store, then runs an account pointed at the stand-in through a
+// full sync, an incremental sync, a bulk flag export and a queued send. Each
+// iteration starts over with a new account. The stand-in is expected next to
+// this program, dekkod where the app looks for it.
+//
+// The full sync goes through dekkod's initial sync, --initial-sync-depth is
+// passed on to it as DEKKO_INITIAL_SYNC_DEPTH. The messages it stores have
+// only their headers, and the check that the service then only reads their
+// flags fails if either sync fetched a structure or content for any message.
+
+static quint16 freePort()
+{
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    return server.serverPort();
+}
+
+static bool waitFor(const std::function<bool ()> &ready, QProcess *process)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!ready()) {
+        if (process->state() == QProcess::NotRunning || timer.elapsed() > START_TIMEOUT) {
+            return false;
+        }
+        QThread::msleep(50);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("dekko-syncbench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Measures Dekko's sync, export and send against dekko-mailstandin"));
+    parser.addHelpOption();
+    QCommandLineOption dataDir(QStringLiteral("data-dir"), QStringLiteral("Store for the stand-in to serve, e.g one made by dekko-storegen"), QStringLiteral("path"));
+    QCommandLineOption account(QStringLiteral("account"), QStringLiteral("Account of that store to serve, defaults to the first"), QStringLiteral("name"));
+    QCommandLineOption iterations(QStringLiteral("iterations"), QStringLiteral("Times to run the whole sequence"), QStringLiteral("n"), QStringLiteral("3"));
+    QCommandLineOption depth(QStringLiteral("depth"), QStringLiteral("Messages per folder to sync"), QStringLiteral("n"), QStringLiteral("100"));
+    QCommandLineOption flagged(QStringLiteral("flagged"), QStringLiteral("Messages marked read for the export"), QStringLiteral("n"), QStringLiteral("500"));
+    QCommandLineOption sent(QStringLiteral("sent"), QStringLiteral("Messages queued for the send"), QStringLiteral("n"), QStringLiteral("20"));
+    QCommandLineOption latency(QStringLiteral("latency"), QStringLiteral("Passed on to the stand-in"), QStringLiteral("ms"), QStringLiteral("0"));
+    QCommandLineOption bandwidth(QStringLiteral("bandwidth"), QStringLiteral("Passed on to the stand-in"), QStringLiteral("bytes"), QStringLiteral("0"));
+    QCommandLineOption timeout(QStringLiteral("timeout"), QStringLiteral("Seconds before an operation is given up on"), QStringLiteral("s"), QStringLiteral("600"));
+    QCommandLineOption initialSyncDepth(QStringLiteral("initial-sync-depth"), QStringLiteral("Passed on to dekkod, a number, \"all\" or \"off\""), QStringLiteral("n"));
+    QCommandLineOption json(QStringLiteral("json"), QStringLiteral("Write the report to this file instead of stdout"), QStringLiteral("file"));
+    parser.addOptions({ dataDir, account, iterations, depth, flagged, sent, latency, bandwidth, timeout, initialSyncDepth, json });
+    parser.process(app);
+
+    if (!parser.isSet(dataDir)) {
+        qWarning() << "--data-dir is required, the stand-in needs a store to serve";
+        return 1;
+    }
+
+    SyncDriver::Options options;
+    options.imapPort = freePort();
+    options.smtpPort = freePort();
+    options.depth = qMax(1, parser.value(depth).toInt());
+    options.flagged = qMax(1, parser.value(flagged).toInt());
+    options.sent = qMax(1, parser.value(sent).toInt());
+    options.timeout = qMax(1, parser.value(timeout).toInt());
+
+    // Our store and dekkod's, has to be set before anything touches it
+    QTemporaryDir scratch;
+    qputenv("QMF_DATA", QFile::encodeName(scratch.path()));
+
+    const QString binDir = QCoreApplication::applicationDirPath();
+    QProcess standin;
+    standin.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    QStringList standinArgs;
+    standinArgs << QStringLiteral("--data-dir") << QDir(parser.value(dataDir)).absolutePath()
+                << QStringLiteral("--imap-port") << QString::number(options.imapPort)
+                << QStringLiteral("--smtp-port") << QString::number(options.smtpPort)
+                << QStringLiteral("--latency") << parser.value(latency)
+                << QStringLiteral("--bandwidth") << parser.value(bandwidth);
+    if (parser.isSet(account)) {
+        standinArgs << QStringLiteral("--account") << parser.value(account);
+    }
+    standin.start(binDir + QStringLiteral("/dekko-mailstandin"), standinArgs);
+    StandinStats stats;
+    if (!waitFor([&]() { return stats.connectTo(options.imapPort); }, &standin)) {
+        qWarning() << "dekko-mailstandin didn't start";
+        return 1;
+    }
+
+    QProcess server;
+    server.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    if (parser.isSet(initialSyncDepth)) {
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert(QStringLiteral("DEKKO_INITIAL_SYNC_DEPTH"), parser.value(initialSyncDepth));
+        server.setProcessEnvironment(env);
+    }
+    server.start(QMail::messageServerPath() + QStringLiteral("/dekkod"));
+    // Same check the app makes, dekkod holds the lock for as long as it runs
+    const bool started = waitFor([]() {
+        const int id = QMail::fileLock(QStringLiteral("dekkod-instance.lock"));
+        if (id == -1) {
+            return true;
+        }
+        QMail::fileUnlock(id);
+        return false;
+    }, &server);
+    if (!started) {
+        qWarning() << "dekkod didn't start";
+        standin.terminate();
+        standin.waitForFinished();
+        return 1;
+    }
+
+    Benchmark bench(QStringLiteral("sync"));
+    SyncDriver driver(options);
+    const int runs = qMax(1, parser.value(iterations).toInt());
+    for (int i = 0; i < runs; ++i) {
+        if (!bench.check(QStringLiteral("account created"), driver.createAccount())) {
+            break;
+        }
+        // Each operation is timed on our side, the stand-in counts the traffic
+        auto measure = [&](const QString &op, const std::function<bool ()> &fn) {
+            const QJsonObject before = stats.snapshot();
+            bool ok = false;
+            bench.time(op, [&]() { ok = fn(); });
+            StandinStats::record(bench, op, before, stats.snapshot());
+            if (!bench.check(QStringLiteral("%1 %2").arg(op).arg(i + 1), ok)) {
+                qWarning() << "[SyncBench]" << op << "failed:" << driver.lastError();
+            }
+            return ok;
+        };
+        int flaggedCount = 0;
+        int sentCount = 0;
+        const QJsonObject beforeSync = stats.snapshot();
+        const bool synced = measure(QStringLiteral("fullSync"), [&]() { return driver.fullSync(); })
+                && measure(QStringLiteral("incrementalSync"), [&]() { return driver.incrementalSync(); });
+        if (synced) {
+            const int headerOnly = driver.headerOnlyMessages();
+            bench.addValue(QStringLiteral("fullSync"), QStringLiteral("headerOnlyMessages"), headerOnly);
+            if (headerOnly > 0) {
+                const QJsonObject afterSync = stats.snapshot();
+                const qint64 read = StandinStats::fetched(beforeSync, afterSync, QStringLiteral("BODYSTRUCTURE"))
+                        + StandinStats::fetched(beforeSync, afterSync, QStringLiteral("CONTENT"));
+                if (!bench.check(QStringLiteral("header-only messages only had their flags read %1").arg(i + 1), read == 0)) {
+                    qWarning() << "[SyncBench] Structure or content fetched for" << read << "messages with"
+                               << headerOnly << "header-only ones stored";
+                }
+            }
+        }
+        synced && measure(QStringLiteral("flagExport"), [&]() { return (flaggedCount = driver.flagExport()) > 0; })
+                && measure(QStringLiteral("queuedSend"), [&]() { return (sentCount = driver.queuedSend()) > 0; });
+        bench.addValue(QStringLiteral("flagExport"), QStringLiteral("messages"), qMax(0, flaggedCount));
+        bench.addValue(QStringLiteral("queuedSend"), QStringLiteral("messages"), qMax(0, sentCount));
+        driver.removeAccount();
+    }
+
+    server.terminate();
+    server.waitForFinished();
+    standin.terminate();
+    standin.waitForFinished();
+
+    QJsonObject report;
+    report.insert(QStringLiteral("store"), QDir(parser.value(dataDir)).absolutePath());
+    report.insert(QStringLiteral("iterations"), runs);
+    report.insert(QStringLiteral("depth"), options.depth);
+    if (parser.isSet(initialSyncDepth)) {
+        report.insert(QStringLiteral("initialSyncDepth"), parser.value(initialSyncDepth));
+    }
+    report.insert(QStringLiteral("latency_ms"), parser.value(latency).toInt());
+    report.insert(QStringLiteral("bandwidth"), parser.value(bandwidth).toInt());
+    report.insert(QStringLiteral("sync"), bench.report());
+    const QByteArray data = QJsonDocument(report).toJson();
+    if (parser.isSet(json)) {
+        QFile file(parser.value(json));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+            qWarning() << "Unable to write report to" << file.fileName();
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << data;
+    }
+    return bench.passed() ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "standinstats.h"
+#include <QDebug>
+#include <QJsonDocument>
+#include "benchmark.h"
+
+// Longest we wait on the stand-in to answer
+#define STATS_TIMEOUT 10000
+
+bool StandinStats::connectTo(const quint16 &port)
+{
+    m_tag = 0;
+    m_socket.connectToHost(QHostAddress::LocalHost, port);
+    if (!m_socket.waitForConnected(STATS_TIMEOUT)) {
+        return false;
+    }
+    // The greeting
+    return readLine().startsWith("* OK");
+}
+
+QByteArray StandinStats::readLine()
+{
+    while (!m_socket.canReadLine()) {
+        if (!m_socket.waitForReadyRead(STATS_TIMEOUT)) {
+            return QByteArray();
+        }
+    }
+    return m_socket.readLine();
+}
+
+QJsonObject StandinStats::snapshot()
+{
+    const QByteArray tag = "s" + QByteArray::number(++m_tag);
+    m_socket.write(tag + " XSTATS\r\n");
+    QByteArray stats;
+    forever {
+        const QByteArray line = readLine();
+        if (line.isEmpty()) {
+            qWarning() << "[StandinStats] No answer from the stand-in";
+            return QJsonObject();
+        }
+        if (line.startsWith("* XSTATS {")) {
+            const int size = line.mid(10, line.indexOf('}') - 10).toInt();
+            while (m_socket.bytesAvailable() < size + 2 && m_socket.waitForReadyRead(STATS_TIMEOUT)) {
+            }
+            stats = m_socket.read(size);
+            m_socket.read(2);
+        } else if (line.startsWith(tag + ' ')) {
+            break;
+        }
+    }
+    return QJsonDocument::fromJson(stats).object();
+}
+
+void StandinStats::record(Benchmark &bench, const QString &op, const QJsonObject &before, const QJsonObject &after)
+{
+    Q_FOREACH(const QString &protocol, after.keys()) {
+        const QJsonObject now = after.value(protocol).toObject().value(QStringLiteral("commands")).toObject();
+        const QJsonObject then = before.value(protocol).toObject().value(QStringLiteral("commands")).toObject();
+        qint64 roundTrips = 0;
+        qint64 bytesIn = 0;
+        qint64 bytesOut = 0;
+        Q_FOREACH(const QString &command, now.keys()) {
+            if (command == QLatin1String("XSTATS")) {
+                continue;
+            }
+            const QJsonObject a = then.value(command).toObject();
+            const QJsonObject b = now.value(command).toObject();
+            const qint64 count = b.value(QStringLiteral("count")).toVariant().toLongLong()
+                    - a.value(QStringLiteral("count")).toVariant().toLongLong();
+            if (count <= 0) {
+                continue;
+            }
+            roundTrips += count;
+            bytesIn += b.value(QStringLiteral("bytesIn")).toVariant().toLongLong()
+                    - a.value(QStringLiteral("bytesIn")).toVariant().toLongLong();
+            bytesOut += b.value(QStringLiteral("bytesOut")).toVariant().toLongLong()
+                    - a.value(QStringLiteral("bytesOut")).toVariant().toLongLong();
+            bench.addValue(op, QStringLiteral("%1.%2").arg(protocol, command), count);
+        }
+        // Bytes as the client sees them, sent to the server and received from it
+        bench.addValue(op, protocol + QStringLiteral(".roundTrips"), roundTrips);
+        bench.addValue(op, protocol + QStringLiteral(".bytesSent"), bytesIn);
+        bench.addValue(op, protocol + QStringLiteral(".bytesReceived"), bytesOut);
+        // Messages per kind of FETCH data, so what was read of them shows
+        Q_FOREACH(const QString &kind, after.value(protocol).toObject().value(QStringLiteral("fetched")).toObject().keys()) {
+            const qint64 messages = fetched(before, after, kind);
+            if (messages > 0) {
+                bench.addValue(op, QStringLiteral("%1.fetched.%2").arg(protocol, kind), messages);
+            }
+        }
+    }
+}
+
+qint64 StandinStats::fetched(const QJsonObject &before, const QJsonObject &after, const QString &kind)
+{
+    const QString imap = QStringLiteral("imap");
+    const QString fetched = QStringLiteral("fetched");
+    return after.value(imap).toObject().value(fetched).toObject().value(kind).toVariant().toLongLong()
+            - before.value(imap).toObject().value(fetched).toObject().value(kind).toVariant().toLongLong();
+}
@@ -0,0 +1,50 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STANDINSTATS_H
+#define STANDINSTATS_H
+
+#include <QJsonObject>
+#include <QTcpSocket>
+
+class Benchmark;
+
+/** @short Reads dekko-mailstandin's per command counters over its IMAP port
+ *
+ * The stand-in keeps running totals, so an operation's round trips and bytes
+ * are the difference between a snapshot taken before and one after it. The
+ * snapshot commands themselves are left out of the difference.
+ */
+class StandinStats
+{
+public:
+    bool connectTo(const quint16 &port);
+    QJsonObject snapshot();
+
+    /** @short Add what happened between \param before and \param after to \param op */
+    static void record(Benchmark &bench, const QString &op, const QJsonObject &before, const QJsonObject &after);
+    /** @short Messages the stand-in sent \param kind of FETCH data for in between, e.g BODYSTRUCTURE */
+    static qint64 fetched(const QJsonObject &before, const QJsonObject &after, const QString &kind);
+
+private:
+    QByteArray readLine();
+
+    QTcpSocket m_socket;
+    int m_tag;
+};
+
+#endif // STANDINSTATS_H
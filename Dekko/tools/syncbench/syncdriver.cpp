@@ -0,0 +1,171 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "syncdriver.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <qmailaccountconfiguration.h>
+#include <qmailstore.h>
+
+SyncDriver::SyncDriver(const Options &options, QObject *parent) : QObject(parent),
+    m_options(options), m_retrieval(0), m_transmit(0)
+{
+    m_retrieval = new QMailRetrievalAction(this);
+    m_transmit = new QMailTransmitAction(this);
+}
+
+bool SyncDriver::createAccount()
+{
+    QMailAccount account;
+    account.setName(QStringLiteral("Syncbench"));
+    account.setMessageType(QMailMessage::Email);
+    account.setFromAddress(QMailAddress(QStringLiteral("Syncbench"), QStringLiteral("syncbench@standin.example")));
+    account.setStatus(QMailAccount::Enabled, true);
+    account.setStatus(QMailAccount::CanRetrieve, true);
+    account.setStatus(QMailAccount::CanTransmit, true);
+    account.setStatus(QMailAccount::MessageSource, true);
+    account.setStatus(QMailAccount::MessageSink, true);
+
+    QMailAccountConfiguration config;
+    config.addServiceConfiguration(QStringLiteral("qmfstoragemanager"));
+    QMailServiceConfiguration storage(&config, QStringLiteral("qmfstoragemanager"));
+    storage.setType(QMailServiceConfiguration::Storage);
+    storage.setVersion(101);
+    storage.setValue(QStringLiteral("basePath"), QString());
+
+    config.addServiceConfiguration(QStringLiteral("imap4"));
+    QMailServiceConfiguration imap(&config, QStringLiteral("imap4"));
+    imap.setType(QMailServiceConfiguration::Source);
+    imap.setVersion(100);
+    imap.setValue(QStringLiteral("server"), QStringLiteral("127.0.0.1"));
+    imap.setValue(QStringLiteral("port"), QString::number(m_options.imapPort));
+    imap.setValue(QStringLiteral("encryption"), QStringLiteral("0"));
+    imap.setValue(QStringLiteral("username"), QStringLiteral("syncbench"));
+    imap.setValue(QStringLiteral("password"), QStringLiteral("password"));
+    imap.setValue(QStringLiteral("pushEnabled"), QStringLiteral("0"));
+    imap.setValue(QStringLiteral("canDelete"), QStringLiteral("1"));
+
+    config.addServiceConfiguration(QStringLiteral("smtp"));
+    QMailServiceConfiguration smtp(&config, QStringLiteral("smtp"));
+    smtp.setType(QMailServiceConfiguration::Sink);
+    smtp.setVersion(100);
+    smtp.setValue(QStringLiteral("address"), QStringLiteral("syncbench@standin.example"));
+    smtp.setValue(QStringLiteral("server"), QStringLiteral("127.0.0.1"));
+    smtp.setValue(QStringLiteral("port"), QString::number(m_options.smtpPort));
+    smtp.setValue(QStringLiteral("encryption"), QStringLiteral("0"));
+    smtp.setValue(QStringLiteral("authentication"), QStringLiteral("0"));
+
+    if (!QMailStore::instance()->addAccount(&account, &config)) {
+        m_error = QStringLiteral("Unable to add the account");
+        return false;
+    }
+    m_account = account.id();
+    return true;
+}
+
+void SyncDriver::removeAccount()
+{
+    if (m_account.isValid()) {
+        QMailStore::instance()->removeAccount(m_account);
+        m_account = QMailAccountId();
+    }
+}
+
+bool SyncDriver::run(QMailServiceAction *action, const std::function<void ()> &start)
+{
+    QEventLoop loop;
+    QMetaObject::Connection done = connect(action, &QMailServiceAction::activityChanged, [&](QMailServiceAction::Activity activity) {
+        if (activity == QMailServiceAction::Successful || activity == QMailServiceAction::Failed) {
+            loop.quit();
+        }
+    });
+    QTimer::singleShot(m_options.timeout * 1000, &loop, &QEventLoop::quit);
+    start();
+    if (action->activity() != QMailServiceAction::Successful && action->activity() != QMailServiceAction::Failed) {
+        loop.exec();
+    }
+    disconnect(done);
+    if (action->activity() != QMailServiceAction::Successful) {
+        m_error = action->isRunning() ? QStringLiteral("Timed out") : action->status().text;
+        if (action->isRunning()) {
+            action->cancelOperation();
+        }
+        return false;
+    }
+    return true;
+}
+
+bool SyncDriver::fullSync()
+{
+    return run(m_retrieval, [this]() { m_retrieval->retrieveFolderList(m_account, QMailFolderId(), true); })
+            && run(m_retrieval, [this]() { m_retrieval->synchronize(m_account, m_options.depth); });
+}
+
+bool SyncDriver::incrementalSync()
+{
+    return run(m_retrieval, [this]() { m_retrieval->synchronize(m_account, m_options.depth); });
+}
+
+int SyncDriver::headerOnlyMessages() const
+{
+    // What dekkod's initial sync leaves, the structure field is MessageStructure's
+    const QMailMessageKey key = QMailMessageKey::parentAccountId(m_account)
+            & QMailMessageKey::status(QMailMessage::ContentAvailable | QMailMessage::PartialContentAvailable | QMailMessage::New,
+                                      QMailDataComparator::Excludes)
+            & QMailMessageKey::customField(QStringLiteral("dekko-structure"), QMailDataComparator::Absent);
+    return QMailStore::instance()->countMessages(key);
+}
+
+int SyncDriver::flagExport()
+{
+    // The same status change marking a selection read makes, ReadElsewhere
+    // stays clear so the export sees it as a local change to push
+    QMailStore *store = QMailStore::instance();
+    const QMailMessageIdList ids = store->queryMessages(
+                QMailMessageKey::parentAccountId(m_account)
+                & QMailMessageKey::status(QMailMessage::Read | QMailMessage::ReadElsewhere, QMailDataComparator::Excludes),
+                QMailMessageSortKey::timeStamp(Qt::DescendingOrder), m_options.flagged);
+    if (ids.isEmpty() || !store->updateMessagesMetaData(QMailMessageKey::id(ids), QMailMessage::Read, true)) {
+        m_error = QStringLiteral("No unread messages to flag");
+        return -1;
+    }
+    return run(m_retrieval, [this]() { m_retrieval->exportUpdates(m_account); }) ? ids.size() : -1;
+}
+
+int SyncDriver::queuedSend()
+{
+    QMailStore *store = QMailStore::instance();
+    const QMailAccount account(m_account);
+    for (int i = 0; i < m_options.sent; ++i) {
+        QMailMessage msg;
+        msg.setMessageType(QMailMessage::Email);
+        msg.setParentAccountId(m_account);
+        msg.setParentFolderId(QMailFolder::LocalStorageFolderId);
+        msg.setFrom(account.fromAddress());
+        msg.setTo(QMailAddress(QStringLiteral("recipient%1@standin.example").arg(i)));
+        msg.setSubject(QStringLiteral("Syncbench %1").arg(i));
+        msg.setDate(QMailTimeStamp::currentDateTime());
+        msg.setBody(QMailMessageBody::fromData(QString(4096, QLatin1Char('x')), QMailMessageContentType("text/plain; charset=UTF-8"),
+                                               QMailMessageBody::QuotedPrintable));
+        msg.setStatus(QMailMessage::Outbox | QMailMessage::Outgoing | QMailMessage::LocalOnly, true);
+        if (!store->addMessage(&msg)) {
+            m_error = QStringLiteral("Unable to queue message %1").arg(i);
+            return -1;
+        }
+    }
+    return run(m_transmit, [this]() { m_transmit->transmitMessages(m_account); }) ? m_options.sent : -1;
+}
@@ -0,0 +1,76 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SYNCDRIVER_H
+#define SYNCDRIVER_H
+
+#include <functional>
+#include <QObject>
+#include <qmailaccount.h>
+#include <qmailserviceaction.h>
+
+/** @short Drives a running dekkod through the operations syncbench measures
+ *
+ * Every operation is a real service action against an account pointed at
+ * the stand-in, run to completion the same way the client waits on them.
+ */
+class SyncDriver : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        Options() : imapPort(0), smtpPort(0), depth(100), flagged(500), sent(20), timeout(600) {}
+        quint16 imapPort;
+        quint16 smtpPort;
+        // Messages per folder a sync keeps, as in the account settings
+        int depth;
+        int flagged;
+        int sent;
+        // Seconds before an action is given up on
+        int timeout;
+    };
+
+    explicit SyncDriver(const Options &options, QObject *parent = 0);
+
+    bool createAccount();
+    void removeAccount();
+    QMailAccountId accountId() const { return m_account; }
+
+    /** @short Folder list and every folder synced, on an account with nothing local */
+    bool fullSync();
+    /** @short Sync again with nothing changed on the server */
+    bool incrementalSync();
+    /** @short Messages stored with only their headers, no content, structure or New status */
+    int headerOnlyMessages() const;
+    /** @short Mark messages read locally then export the changes, returns the number flagged */
+    int flagExport();
+    /** @short Queue messages in the outbox and transmit them, returns the number queued */
+    int queuedSend();
+
+    QString lastError() const { return m_error; }
+
+private:
+    bool run(QMailServiceAction *action, const std::function<void ()> &start);
+
+    Options m_options;
+    QMailAccountId m_account;
+    QMailRetrievalAction *m_retrieval;
+    QMailTransmitAction *m_transmit;
+    QString m_error;
+};
+
+#endif // SYNCDRIVER_H
@@ -0,0 +1,378 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "CacheManager.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QPair>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#ifdef Q_OS_UNIX
+#include <utime.h>
+#endif
+
+Q_LOGGING_CATEGORY(D_CACHE_MANAGER, "dekko.cache")
+
+// Evicting down to a bit under budget stops every insert from triggering another round
+#define EVICT_TO_PERCENT 90
+// Stats are published at most this often (ms)
+#define STATS_INTERVAL 1000
+
+CacheManager *CacheManager::instance()
+{
+    // Created on first use from whichever thread gets here first, torn down at exit
+    static CacheManager manager;
+    return &manager;
+}
+
+QObject *CacheManager::factory(QQmlEngine *engine, QJSEngine *scriptEngine)
+{
+    Q_UNUSED(engine)
+    Q_UNUSED(scriptEngine)
+    QObject *manager = CacheManager::instance();
+    QQmlEngine::setObjectOwnership(manager, QQmlEngine::CppOwnership);
+    return manager;
+}
+
+CacheManager::CacheManager(QObject *parent) : QObject(parent),
+    m_index(0)
+{
+    qRegisterMetaType<QList<quint64> >("QList<quint64>");
+    qRegisterMetaType<CacheManager::OwnerFunc>("CacheManager::OwnerFunc");
+    m_index = new CacheIndex();
+    m_index->moveToThread(&m_thread);
+    connect(m_index, &CacheIndex::statsChanged, this, &CacheManager::handleStats);
+    m_thread.setObjectName(QStringLiteral("CacheManager"));
+    m_thread.start(QThread::LowestPriority);
+}
+
+CacheManager::~CacheManager()
+{
+    m_thread.quit();
+    m_thread.wait();
+    // Nothing runs on the thread any more so the index can go from here
+    delete m_index;
+}
+
+void CacheManager::registerCache(const QString &name, const QString &directory, OwnerFunc owner)
+{
+    QMetaObject::invokeMethod(m_index, "registerCache", Qt::QueuedConnection,
+                              Q_ARG(QString, name), Q_ARG(QString, QDir::cleanPath(directory)),
+                              Q_ARG(CacheManager::OwnerFunc, owner));
+}
+
+void CacheManager::setBudget(const QString &name, const qint64 &bytes)
+{
+    QMetaObject::invokeMethod(m_index, "setBudget", Qt::QueuedConnection,
+                              Q_ARG(QString, name), Q_ARG(qint64, bytes));
+}
+
+void CacheManager::inserted(const QString &name, const QString &filePath, const quint64 &owner)
+{
+    QMetaObject::invokeMethod(m_index, "inserted", Qt::QueuedConnection,
+                              Q_ARG(QString, name), Q_ARG(QString, QDir::cleanPath(filePath)), Q_ARG(quint64, owner));
+}
+
+void CacheManager::accessed(const QString &filePath)
+{
+    QMetaObject::invokeMethod(m_index, "accessed", Qt::QueuedConnection,
+                              Q_ARG(QString, QDir::cleanPath(filePath)));
+}
+
+void CacheManager::missed(const QString &name)
+{
+    QMetaObject::invokeMethod(m_index, "missed", Qt::QueuedConnection, Q_ARG(QString, name));
+}
+
+void CacheManager::removeOwners(const QList<quint64> &owners)
+{
+    if (owners.isEmpty()) {
+        return;
+    }
+    QMetaObject::invokeMethod(m_index, "removeOwners", Qt::QueuedConnection, Q_ARG(QList<quint64>, owners));
+}
+
+void CacheManager::clear(const QString &name)
+{
+    QMetaObject::invokeMethod(m_index, "clear", Qt::QueuedConnection, Q_ARG(QString, name));
+}
+
+qint64 CacheManager::totalSize() const
+{
+    qint64 total = 0;
+    Q_FOREACH(const QVariant &cache, m_stats) {
+        total += cache.toMap().value(QStringLiteral("size")).toLongLong();
+    }
+    return total;
+}
+
+void CacheManager::handleStats(const QVariantList &stats)
+{
+    m_stats = stats;
+    emit statsChanged();
+}
+
+CacheIndex::CacheIndex(QObject *parent) : QObject(parent)
+{
+    m_statsTimer = new QTimer(this);
+    m_statsTimer->setSingleShot(true);
+    m_statsTimer->setInterval(STATS_INTERVAL);
+    connect(m_statsTimer, &QTimer::timeout, this, &CacheIndex::publishStats);
+}
+
+void CacheIndex::registerCache(const QString &name, const QString &directory, CacheManager::OwnerFunc owner)
+{
+    if (m_caches.contains(name)) {
+        return;
+    }
+    Cache &cache = m_caches[name];
+    cache.directory = directory;
+    cache.budget = m_budgets.value(name, 0);
+    cache.size = 0;
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.evictions = 0;
+    cache.hitsMetric = Metrics::counter("cache." + name.toUtf8() + ".hits");
+    cache.missesMetric = Metrics::counter("cache." + name.toUtf8() + ".misses");
+    scan(cache, owner);
+    evict(cache);
+    scheduleStats();
+}
+
+void CacheIndex::setBudget(const QString &name, const qint64 &bytes)
+{
+    m_budgets.insert(name, bytes);
+    if (m_caches.contains(name)) {
+        Cache &cache = m_caches[name];
+        cache.budget = bytes;
+        evict(cache);
+        scheduleStats();
+    }
+}
+
+void CacheIndex::inserted(const QString &name, const QString &filePath, const quint64 &owner)
+{
+    if (!m_caches.contains(name)) {
+        return;
+    }
+    const QFileInfo info(filePath);
+    if (!info.exists()) {
+        return;
+    }
+    Cache &cache = m_caches[name];
+    addEntry(cache, filePath, info.size(), QDateTime::currentMSecsSinceEpoch(), owner);
+    evict(cache);
+    scheduleStats();
+}
+
+void CacheIndex::accessed(const QString &filePath)
+{
+    Cache *cache = cacheForPath(filePath);
+    if (!cache) {
+        return;
+    }
+    ++cache->hits;
+    cache->hitsMetric->add();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QHash<QString, Entry>::iterator it = cache->entries.find(filePath);
+    if (it != cache->entries.end()) {
+        it.value().lastAccess = now;
+    } else {
+        // Written before we got to index it
+        const QFileInfo info(filePath);
+        if (!info.exists()) {
+            return;
+        }
+        addEntry(*cache, filePath, info.size(), now, 0);
+    }
+#ifdef Q_OS_UNIX
+    // Access times are unreliable with relatime/noatime mounts so the mtime
+    // carries the last access over to the next scan
+    ::utime(QFile::encodeName(filePath).constData(), 0);
+#endif
+    scheduleStats();
+}
+
+void CacheIndex::missed(const QString &name)
+{
+    if (m_caches.contains(name)) {
+        ++m_caches[name].misses;
+        m_caches[name].missesMetric->add();
+        scheduleStats();
+    }
+}
+
+void CacheIndex::removeOwners(const QList<quint64> &owners)
+{
+    bool changed = false;
+    QHash<QString, Cache>::iterator cache = m_caches.begin();
+    for (; cache != m_caches.end(); ++cache) {
+        Q_FOREACH(const quint64 &owner, owners) {
+            Q_FOREACH(const QString &filePath, cache.value().owned.values(owner)) {
+                if (removeEntry(cache.value(), filePath)) {
+                    changed = true;
+                }
+            }
+        }
+    }
+    if (changed) {
+        scheduleStats();
+    }
+}
+
+void CacheIndex::clear(const QString &name)
+{
+    if (!m_caches.contains(name)) {
+        return;
+    }
+    Cache &cache = m_caches[name];
+    Q_FOREACH(const QString &filePath, cache.entries.keys()) {
+        removeEntry(cache, filePath);
+    }
+    scheduleStats();
+}
+
+CacheIndex::Cache *CacheIndex::cacheForPath(const QString &filePath)
+{
+    QHash<QString, Cache>::iterator it = m_caches.begin();
+    for (; it != m_caches.end(); ++it) {
+        if (filePath.startsWith(it.value().directory + QLatin1Char('/'))) {
+            return &it.value();
+        }
+    }
+    return Q_NULLPTR;
+}
+
+void CacheIndex::scan(Cache &cache, CacheManager::OwnerFunc owner)
+{
+    const QDir root(cache.directory);
+    QDirIterator it(cache.directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        if (info.fileName().startsWith(QLatin1Char('.'))) {
+            continue;
+        }
+        const QString filePath = QDir::cleanPath(info.absoluteFilePath());
+        addEntry(cache, filePath, info.size(), info.lastModified().toMSecsSinceEpoch(),
+                 owner ? owner(root.relativeFilePath(filePath)) : 0);
+    }
+}
+
+void CacheIndex::addEntry(Cache &cache, const QString &filePath, const qint64 &size, const qint64 &lastAccess, const quint64 &owner)
+{
+    QHash<QString, Entry>::iterator it = cache.entries.find(filePath);
+    if (it != cache.entries.end()) {
+        // Rewritten in place
+        cache.size -= it.value().size;
+        cache.owned.remove(it.value().owner, filePath);
+    }
+    Entry entry;
+    entry.size = size;
+    entry.lastAccess = lastAccess;
+    entry.owner = owner;
+    cache.entries.insert(filePath, entry);
+    cache.size += size;
+    if (owner) {
+        cache.owned.insert(owner, filePath);
+    }
+}
+
+bool CacheIndex::removeEntry(Cache &cache, const QString &filePath)
+{
+    QHash<QString, Entry>::iterator it = cache.entries.find(filePath);
+    if (it == cache.entries.end()) {
+        return false;
+    }
+    if (QFile::exists(filePath) && !QFile::remove(filePath)) {
+        qWarning() << "[CacheManager] Unable to remove" << filePath;
+        return false;
+    }
+    cache.size -= it.value().size;
+    cache.owned.remove(it.value().owner, filePath);
+    cache.entries.erase(it);
+    // Tidy up per message directories, stopping at the first one that isn't empty
+    QString directory = QFileInfo(filePath).absolutePath();
+    while (directory.startsWith(cache.directory + QLatin1Char('/')) && QDir().rmdir(directory)) {
+        directory = QFileInfo(directory).absolutePath();
+    }
+    return true;
+}
+
+void CacheIndex::evict(Cache &cache)
+{
+    if (cache.budget <= 0 || cache.size <= cache.budget) {
+        return;
+    }
+    const qint64 target = cache.budget / 100 * EVICT_TO_PERCENT;
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    // Staleness weighted by size: age * sqrt(size). Big files that haven't been
+    // looked at in a while go first without small recent ones being starved out.
+    typedef QPair<double, QString> Candidate;
+    QVector<Candidate> candidates;
+    candidates.reserve(cache.entries.size());
+    QHash<QString, Entry>::const_iterator it = cache.entries.constBegin();
+    for (; it != cache.entries.constEnd(); ++it) {
+        const double age = qMax<qint64>(1000, now - it.value().lastAccess);
+        candidates << Candidate(age * std::sqrt(double(qMax<qint64>(1, it.value().size))), it.key());
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.first > b.first;
+    });
+    Q_FOREACH(const Candidate &candidate, candidates) {
+        if (cache.size <= target) {
+            break;
+        }
+        if (removeEntry(cache, candidate.second)) {
+            ++cache.evictions;
+        }
+    }
+    qCDebug(D_CACHE_MANAGER) << "[CacheManager] Evicted down to" << cache.size << "of" << cache.budget << "in" << cache.directory;
+}
+
+void CacheIndex::scheduleStats()
+{
+    if (!m_statsTimer->isActive()) {
+        m_statsTimer->start();
+    }
+}
+
+void CacheIndex::publishStats()
+{
+    QVariantList stats;
+    QHash<QString, Cache>::const_iterator it = m_caches.constBegin();
+    for (; it != m_caches.constEnd(); ++it) {
+        QVariantMap cache;
+        cache.insert(QStringLiteral("name"), it.key());
+        cache.insert(QStringLiteral("entries"), it.value().entries.size());
+        cache.insert(QStringLiteral("size"), it.value().size);
+        cache.insert(QStringLiteral("budget"), it.value().budget);
+        cache.insert(QStringLiteral("hits"), it.value().hits);
+        cache.insert(QStringLiteral("misses"), it.value().misses);
+        cache.insert(QStringLiteral("evictions"), it.value().evictions);
+        stats << cache;
+    }
+    emit statsChanged(stats);
+}
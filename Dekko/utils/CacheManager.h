@@ -0,0 +1,151 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CACHEMANAGER_H
+#define CACHEMANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMultiHash>
+#include <QThread>
+#include <QVariantList>
+#include <QQmlEngine>
+#include <QJSEngine>
+#include "Metrics.h"
+
+class CacheIndex;
+class QTimer;
+
+/** @short Keeps the on disk caches within their byte budgets
+ *
+ * Each cache is a directory registered under a name ("attachments", "images").
+ * The files in it are indexed with their size, last access and optionally the
+ * message that owns them. Once a cache grows past it's budget the entries that
+ * are the stalest for their size are removed, so a big attachment nobody has
+ * opened in a week goes before a small avatar that was shown yesterday.
+ *
+ * Scanning and deleting happen on a background thread. All methods only queue
+ * work for it so are safe to call from any thread. Files whose name starts with
+ * a '.' are treated as still being written and are never indexed.
+ */
+class CacheManager : public QObject
+{
+    Q_OBJECT
+    /** @short One map per cache with name, entries, size, budget, hits, misses and evictions */
+    Q_PROPERTY(QVariantList stats READ stats NOTIFY statsChanged)
+    /** @short Bytes used by all caches */
+    Q_PROPERTY(qint64 totalSize READ totalSize NOTIFY statsChanged)
+public:
+    // Given a path relative to the cache directory return the owning message id, or 0
+    typedef quint64 (*OwnerFunc)(const QString &relativePath);
+
+    static CacheManager *instance();
+    static QObject *factory(QQmlEngine *engine, QJSEngine *scriptEngine);
+
+    /** @short Start managing \param directory, it's contents are indexed in the background */
+    void registerCache(const QString &name, const QString &directory, OwnerFunc owner = 0);
+    /** @short Limit cache \param name to \param bytes, 0 means unbounded
+     *
+     * May be set before the cache is registered.
+     */
+    void setBudget(const QString &name, const qint64 &bytes);
+
+    /** @short \param filePath was just written to cache \param name */
+    void inserted(const QString &name, const QString &filePath, const quint64 &owner = 0);
+    /** @short \param filePath was served from the cache */
+    void accessed(const QString &filePath);
+    /** @short Cache \param name didn't have what was asked for */
+    void missed(const QString &name);
+    /** @short Remove everything owned by \param owners, i.e the messages were deleted */
+    void removeOwners(const QList<quint64> &owners);
+
+    Q_INVOKABLE void clear(const QString &name);
+
+    QVariantList stats() const { return m_stats; }
+    qint64 totalSize() const;
+
+signals:
+    void statsChanged();
+
+private slots:
+    void handleStats(const QVariantList &stats);
+
+private:
+    explicit CacheManager(QObject *parent = 0);
+    ~CacheManager();
+
+    QThread m_thread;
+    CacheIndex *m_index;
+    QVariantList m_stats;
+};
+
+/** @short CacheManager's index, lives on the background thread */
+class CacheIndex : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CacheIndex(QObject *parent = 0);
+
+public slots:
+    void registerCache(const QString &name, const QString &directory, CacheManager::OwnerFunc owner);
+    void setBudget(const QString &name, const qint64 &bytes);
+    void inserted(const QString &name, const QString &filePath, const quint64 &owner);
+    void accessed(const QString &filePath);
+    void missed(const QString &name);
+    void removeOwners(const QList<quint64> &owners);
+    void clear(const QString &name);
+
+signals:
+    void statsChanged(const QVariantList &stats);
+
+private:
+    struct Entry {
+        qint64 size;
+        qint64 lastAccess; // msecs since epoch
+        quint64 owner;
+    };
+    struct Cache {
+        QString directory;
+        qint64 budget;
+        qint64 size;
+        int hits;
+        int misses;
+        int evictions;
+        // Same as hits and misses but for the process wide metrics
+        Metrics::Counter *hitsMetric;
+        Metrics::Counter *missesMetric;
+        QHash<QString, Entry> entries;
+        QMultiHash<quint64, QString> owned;
+    };
+
+    Cache *cacheForPath(const QString &filePath);
+    void scan(Cache &cache, CacheManager::OwnerFunc owner);
+    void addEntry(Cache &cache, const QString &filePath, const qint64 &size, const qint64 &lastAccess, const quint64 &owner);
+    bool removeEntry(Cache &cache, const QString &filePath);
+    void evict(Cache &cache);
+    void scheduleStats();
+    void publishStats();
+
+    QHash<QString, Cache> m_caches;
+    // Budgets set before their cache was registered
+    QHash<QString, qint64> m_budgets;
+    QTimer *m_statsTimer;
+};
+
+Q_DECLARE_METATYPE(CacheManager::OwnerFunc)
+
+#endif // CACHEMANAGER_H
@@ -16,6 +16,7 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "Formatting.h"
+#include "Trace.h"
 #include <QDebug>
 #include <QStack>
 #include <QPair>
@@ -468,6 +469,7 @@ QString Formatting::singleLinePlainTextToHtml(QString line)
 
 QString Formatting::plainTextToHtml(const QString &text)
 {
+    TRACE_SPAN("Formatting::plainTextToHtml");
     auto lines = text.split('\n');
     std::vector<TextInfo> lineBuffer;
     lineBuffer.reserve(lines.size());
@@ -479,6 +481,7 @@ QString Formatting::plainTextToHtml(const QString &text)
 #include "Paths.h"
 QString Formatting::markupPlainTextToHtml(const QString &text)
 {
+    TRACE_SPAN("Formatting::markupPlainTextToHtml");
     static const QString defaultStyle = QString::fromUtf8(
                 "pre{word-wrap: break-word; white-space: pre-wrap;}"
                 // The following line, sadly, produces a warning "QFont::setPixelSize: Pixel size <= 0 (0)".
@@ -548,6 +551,7 @@ QString Formatting::markupPlainTextToHtml(const QString &text)
 // pinched from trojita/Composer/PlainTextFormatter.cpp and modified to use QRegularExpression
 QStringList Formatting::quoteBody(QStringList bodyLines)
 {
+    TRACE_SPAN("Formatting::quoteBody");
     QStringList quote;
     for (QStringList::iterator line = bodyLines.begin(); line != bodyLines.end(); ++line) {
         if (Formatting::Regex::sigSeperator().exactMatch(*line)) {
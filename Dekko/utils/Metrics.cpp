@@ -0,0 +1,219 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Metrics.h"
+#include <limits>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QMap>
+#include <QMutex>
+#include <QSaveFile>
+#include <QTimer>
+
+// How often a snapshot is written, the numbers are cumulative so
+// this only bounds what's lost if the process gets killed
+#define FLUSH_INTERVAL 300000
+// Set to the metrics directory by the app for the processes it starts
+#define METRICS_ENV "DEKKO_METRICS"
+
+namespace {
+QMutex s_lock;
+// Sorted so snapshots diff nicely. Never freed, callers keep the pointers
+QMap<QByteArray, Metrics::Counter *> s_counters;
+QMap<QByteArray, Metrics::Gauge *> s_gauges;
+QMap<QByteArray, Metrics::Histogram *> s_histograms;
+QString s_processName;
+QString s_directory;
+
+template <typename T>
+T *lookup(QMap<QByteArray, T *> &map, const QByteArray &name)
+{
+    QMutexLocker lock(&s_lock);
+    T *&metric = map[name];
+    if (!metric) {
+        metric = new T;
+    }
+    return metric;
+}
+}
+
+Metrics::Histogram::Histogram() : m_count(0), m_sum(0), m_max(0)
+{
+    for (int i = 0; i < Buckets; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+int Metrics::Histogram::bucketOf(const quint64 value)
+{
+    if (value < SubBuckets) {
+        return int(value);
+    }
+    int exponent = 63;
+    while (!(value & (Q_UINT64_C(1) << exponent))) {
+        --exponent;
+    }
+    // exponent >= 3, the top 3 bits below the leading one pick the sub bucket
+    const int shift = exponent - 3;
+    return SubBuckets + shift * SubBuckets + int((value >> shift) & (SubBuckets - 1));
+}
+
+qint64 Metrics::Histogram::highestIn(const int bucket)
+{
+    if (bucket < SubBuckets) {
+        return bucket;
+    }
+    const int shift = (bucket - SubBuckets) / SubBuckets;
+    const quint64 lowest = quint64(SubBuckets + (bucket % SubBuckets)) << shift;
+    const quint64 highest = lowest + (Q_UINT64_C(1) << shift) - 1;
+    return qint64(qMin(highest, quint64(std::numeric_limits<qint64>::max())));
+}
+
+void Metrics::Histogram::record(const qint64 value)
+{
+    const qint64 v = qMax(Q_INT64_C(0), value);
+    m_buckets[bucketOf(quint64(v))].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(v, std::memory_order_relaxed);
+    qint64 max = m_max.load(std::memory_order_relaxed);
+    while (v > max && !m_max.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+    }
+}
+
+qint64 Metrics::Histogram::percentile(const double percentile) const
+{
+    const qint64 total = count();
+    if (total == 0) {
+        return 0;
+    }
+    const qint64 wanted = qMax(Q_INT64_C(1), qint64(total * percentile / 100.0 + 0.5));
+    qint64 seen = 0;
+    for (int i = 0; i < Buckets; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= wanted) {
+            // Never report more than was actually recorded
+            return qMin(highestIn(i), m_max.load(std::memory_order_relaxed));
+        }
+    }
+    return m_max.load(std::memory_order_relaxed);
+}
+
+QByteArray Metrics::Histogram::toJson() const
+{
+    const qint64 total = count();
+    const qint64 mean = total ? m_sum.load(std::memory_order_relaxed) / total : 0;
+    return "{\"count\":" + QByteArray::number(total)
+            + ",\"mean\":" + QByteArray::number(mean)
+            + ",\"p50\":" + QByteArray::number(percentile(50))
+            + ",\"p90\":" + QByteArray::number(percentile(90))
+            + ",\"p99\":" + QByteArray::number(percentile(99))
+            + ",\"p999\":" + QByteArray::number(percentile(99.9))
+            + ",\"max\":" + QByteArray::number(m_max.load(std::memory_order_relaxed)) + "}";
+}
+
+Metrics::Counter *Metrics::counter(const QByteArray &name)
+{
+    return lookup(s_counters, name);
+}
+
+Metrics::Gauge *Metrics::gauge(const QByteArray &name)
+{
+    return lookup(s_gauges, name);
+}
+
+Metrics::Histogram *Metrics::histogram(const QByteArray &name)
+{
+    return lookup(s_histograms, name);
+}
+
+QByteArray Metrics::toJson()
+{
+    QMutexLocker lock(&s_lock);
+    QByteArray json("{\"process\":\"" + s_processName.toUtf8()
+                    + "\",\"pid\":" + QByteArray::number(QCoreApplication::applicationPid())
+                    + ",\"time\":\"" + QDateTime::currentDateTimeUtc().toString(Qt::ISODate).toLatin1() + "\"");
+    json += ",\n\"counters\":{";
+    for (QMap<QByteArray, Counter *>::const_iterator it = s_counters.constBegin(); it != s_counters.constEnd(); ++it) {
+        json += (it == s_counters.constBegin() ? "\n\"" : ",\n\"") + it.key() + "\":" + QByteArray::number(it.value()->value());
+    }
+    json += "},\n\"gauges\":{";
+    for (QMap<QByteArray, Gauge *>::const_iterator it = s_gauges.constBegin(); it != s_gauges.constEnd(); ++it) {
+        json += (it == s_gauges.constBegin() ? "\n\"" : ",\n\"") + it.key() + "\":" + QByteArray::number(it.value()->value());
+    }
+    json += "},\n\"histograms\":{";
+    for (QMap<QByteArray, Histogram *>::const_iterator it = s_histograms.constBegin(); it != s_histograms.constEnd(); ++it) {
+        json += (it == s_histograms.constBegin() ? "\n\"" : ",\n\"") + it.key() + "\":" + it.value()->toJson();
+    }
+    json += "}\n}\n";
+    return json;
+}
+
+void Metrics::start(const QString &processName, const QString &directory)
+{
+    if (!QDir().mkpath(directory)) {
+        qWarning() << "[Metrics] Unable to create" << directory;
+        return;
+    }
+    {
+        QMutexLocker lock(&s_lock);
+        const bool started = !s_directory.isEmpty();
+        s_processName = processName;
+        s_directory = directory;
+        if (started) {
+            return;
+        }
+    }
+    qputenv(METRICS_ENV, directory.toLocal8Bit());
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app) {
+        QTimer *timer = new QTimer(app);
+        timer->setInterval(FLUSH_INTERVAL);
+        QObject::connect(timer, &QTimer::timeout, [](){ Metrics::flush(); });
+        QObject::connect(app, &QCoreApplication::aboutToQuit, [](){ Metrics::flush(); });
+        timer->start();
+    }
+}
+
+void Metrics::startFromEnvironment(const QString &processName)
+{
+    const QByteArray directory = qgetenv(METRICS_ENV);
+    if (!directory.isEmpty()) {
+        start(processName, QString::fromLocal8Bit(directory));
+    }
+}
+
+bool Metrics::flush()
+{
+    QString filePath;
+    {
+        QMutexLocker lock(&s_lock);
+        if (s_directory.isEmpty()) {
+            return false;
+        }
+        // One file per process name, the latest snapshot is what matters
+        filePath = QStringLiteral("%1/%2.json").arg(s_directory, s_processName);
+    }
+    const QByteArray json = toJson();
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+        qWarning() << "[Metrics] Unable to write" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
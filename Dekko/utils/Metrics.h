@@ -0,0 +1,119 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+
+/** @short Process wide counters, gauges and latency histograms
+ *
+ * Metrics are created on first use and live for the rest of the process, so a
+ * pointer can be kept in a static and updated without any lookup. Updates are
+ * plain atomics and safe from any thread.
+ *
+ * Histograms are HDR style, each power of two is split into 8 linear buckets
+ * so any percentile is within 12.5% of the real value whatever the range.
+ * Latencies are recorded in microseconds.
+ *
+ * A snapshot is written as JSON to the metrics directory every few minutes and
+ * on exit. The worker and dekkod also return theirs over D-Bus, from
+ * org.dekkoproject.Service /mail and org.dekkoproject.Server /server.
+ */
+class Metrics
+{
+public:
+    class Counter
+    {
+    public:
+        Counter() : m_value(0) {}
+        void add(const qint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+        qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<qint64> m_value;
+    };
+
+    class Gauge
+    {
+    public:
+        Gauge() : m_value(0) {}
+        void set(const qint64 value) { m_value.store(value, std::memory_order_relaxed); }
+        void add(const qint64 n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+        qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<qint64> m_value;
+    };
+
+    class Histogram
+    {
+    public:
+        enum { SubBuckets = 8, Buckets = SubBuckets + 61 * SubBuckets };
+        Histogram();
+        void record(const qint64 value);
+        qint64 count() const { return m_count.load(std::memory_order_relaxed); }
+        /** @short Highest value that's in the same bucket as the \param percentile */
+        qint64 percentile(const double percentile) const;
+        QByteArray toJson() const;
+    private:
+        static int bucketOf(const quint64 value);
+        static qint64 highestIn(const int bucket);
+        std::atomic<quint64> m_buckets[Buckets];
+        std::atomic<qint64> m_count;
+        std::atomic<qint64> m_sum;
+        std::atomic<qint64> m_max;
+    };
+
+    static Counter *counter(const QByteArray &name);
+    static Gauge *gauge(const QByteArray &name);
+    static Histogram *histogram(const QByteArray &name);
+
+    /** @short Everything recorded so far, as a JSON object */
+    static QByteArray toJson();
+
+    /** @short Write a snapshot to \param directory every so often and on exit
+     *
+     * Child processes pick the directory up from the environment.
+     */
+    static void start(const QString &processName, const QString &directory);
+    static void startFromEnvironment(const QString &processName);
+    static bool flush();
+};
+
+/** @short Records the time from construction to destruction in a histogram */
+class MetricTimer
+{
+public:
+    explicit MetricTimer(Metrics::Histogram *histogram) : m_histogram(histogram) { m_timer.start(); }
+    ~MetricTimer() { m_histogram->record(m_timer.nsecsElapsed() / 1000); }
+private:
+    Q_DISABLE_COPY(MetricTimer)
+    Metrics::Histogram *m_histogram;
+    QElapsedTimer m_timer;
+};
+
+#define METRIC_CONCAT_(a, b) a##b
+#define METRIC_CONCAT(a, b) METRIC_CONCAT_(a, b)
+// name has to be constant, the lookup only happens the first time through
+#define METRIC_COUNT(name) do { static Metrics::Counter *c = Metrics::counter(name); c->add(); } while (0)
+#define METRIC_LATENCY(name) \
+    static Metrics::Histogram *METRIC_CONCAT(_metricHistogram, __LINE__) = Metrics::histogram(name); \
+    MetricTimer METRIC_CONCAT(_metricTimer, __LINE__)(METRIC_CONCAT(_metricHistogram, __LINE__))
+
+#endif // METRICS_H
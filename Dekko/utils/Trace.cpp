@@ -0,0 +1,275 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Events kept per thread, each is 40 bytes
+#define BUFFER_SIZE 8192
+// How often the trace is written out while running, so there's something
+// to look at even if the process gets killed
+#define FLUSH_INTERVAL 30000
+// Set to the trace directory by the app for the processes it starts
+#define TRACE_ENV "DEKKO_TRACE"
+// Trace files kept in the directory, each process writes one per run
+#define MAX_TRACE_FILES 20
+
+namespace {
+struct Event {
+    const char *name;
+    quint64 id;
+    qint64 timestamp;
+    qint64 duration;
+    char phase;
+};
+
+struct Buffer {
+    Buffer() : head(0), tid(0) {}
+    Event events[BUFFER_SIZE];
+    // Events ever recorded, the next one goes in head % BUFFER_SIZE.
+    // Only the owning thread writes it
+    std::atomic<quint64> head;
+    qint64 tid;
+    QString threadName;
+};
+
+std::atomic<bool> s_enabled(false);
+QMutex s_lock;
+// Never freed, the events should outlive the thread that recorded them
+QList<Buffer *> s_buffers;
+QString s_processName;
+QString s_directory;
+thread_local Buffer *t_buffer = 0;
+
+Buffer *threadBuffer()
+{
+    if (t_buffer) {
+        return t_buffer;
+    }
+    Buffer *buffer = new Buffer;
+    QThread *thread = QThread::currentThread();
+    buffer->threadName = thread->objectName();
+    if (buffer->threadName.isEmpty() && QCoreApplication::instance() && QCoreApplication::instance()->thread() == thread) {
+        buffer->threadName = QStringLiteral("main");
+    }
+    QMutexLocker lock(&s_lock);
+#ifdef Q_OS_LINUX
+    buffer->tid = syscall(SYS_gettid);
+#else
+    buffer->tid = s_buffers.size() + 1;
+#endif
+    s_buffers.append(buffer);
+    t_buffer = buffer;
+    return buffer;
+}
+
+void record(const char *name, const char phase, const qint64 &timestamp, const qint64 &duration, const quint64 &id)
+{
+    Buffer *buffer = threadBuffer();
+    const quint64 head = buffer->head.load(std::memory_order_relaxed);
+    Event &e = buffer->events[head % BUFFER_SIZE];
+    e.name = name;
+    e.id = id;
+    e.timestamp = timestamp;
+    e.duration = duration;
+    e.phase = phase;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+QByteArray jsonString(const QString &text)
+{
+    QByteArray result("\"");
+    Q_FOREACH(const char c, text.toUtf8()) {
+        if (c == '"' || c == '\\') {
+            result.append('\\').append(c);
+        } else if (static_cast<uchar>(c) < 0x20) {
+            result.append(' ');
+        } else {
+            result.append(c);
+        }
+    }
+    return result.append('"');
+}
+
+// QDir::Time lists newest first, everything past the newest MAX_TRACE_FILES goes,
+// so the run that is starting up always survives
+void pruneTraces(const QString &directory)
+{
+    QDir dir(directory);
+    const QFileInfoList files = dir.entryInfoList(QStringList() << QStringLiteral("*.json"), QDir::Files, QDir::Time);
+    for (int i = MAX_TRACE_FILES; i < files.size(); ++i) {
+        if (!QFile::remove(files.at(i).absoluteFilePath())) {
+            qWarning() << "[Trace] Unable to remove" << files.at(i).absoluteFilePath();
+        }
+    }
+}
+
+QByteArray hexId(const quint64 &id)
+{
+    return QByteArrayLiteral("\"0x") + QByteArray::number(id, 16) + '"';
+}
+}
+
+bool Trace::enabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::setEnabled(const bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Trace::start(const QString &processName, const QString &directory)
+{
+    if (!QDir().mkpath(directory)) {
+        qWarning() << "[Trace] Unable to create" << directory;
+        return;
+    }
+    {
+        QMutexLocker lock(&s_lock);
+        const bool started = !s_directory.isEmpty();
+        s_processName = processName;
+        s_directory = directory;
+        if (started) {
+            return;
+        }
+    }
+    pruneTraces(directory);
+    qputenv(TRACE_ENV, directory.toLocal8Bit());
+    setEnabled(true);
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app) {
+        QTimer *timer = new QTimer(app);
+        timer->setInterval(FLUSH_INTERVAL);
+        QObject::connect(timer, &QTimer::timeout, [](){ Trace::flush(); });
+        QObject::connect(app, &QCoreApplication::aboutToQuit, [](){ Trace::flush(); });
+        timer->start();
+    }
+    qDebug() << "[Trace] Tracing" << processName << "to" << directory;
+}
+
+void Trace::startFromEnvironment(const QString &processName)
+{
+    const QByteArray directory = qgetenv(TRACE_ENV);
+    if (!directory.isEmpty()) {
+        start(processName, QString::fromLocal8Bit(directory));
+    }
+}
+
+bool Trace::flush()
+{
+    QString directory;
+    QString processName;
+    {
+        QMutexLocker lock(&s_lock);
+        directory = s_directory;
+        processName = s_processName;
+    }
+    if (directory.isEmpty()) {
+        return false;
+    }
+    return write(QStringLiteral("%1/%2-%3.json").arg(directory, processName).arg(QCoreApplication::applicationPid()));
+}
+
+bool Trace::write(const QString &filePath)
+{
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    QMutexLocker lock(&s_lock);
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":0,\"args\":{\"name\":"
+            + jsonString(s_processName) + "}}";
+    QVector<Event> events;
+    Q_FOREACH(Buffer *buffer, s_buffers) {
+        const QByteArray tid = QByteArray::number(buffer->tid);
+        if (!buffer->threadName.isEmpty()) {
+            json += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":"
+                    + jsonString(buffer->threadName) + "}}";
+        }
+        // The owner keeps recording while we copy, anything it may have
+        // overwritten in the meantime is dropped afterwards
+        const quint64 end = buffer->head.load(std::memory_order_acquire);
+        const quint64 begin = end > BUFFER_SIZE ? end - BUFFER_SIZE : 0;
+        events.resize(0);
+        for (quint64 i = begin; i < end; ++i) {
+            events.append(buffer->events[i % BUFFER_SIZE]);
+        }
+        const quint64 head = buffer->head.load(std::memory_order_acquire);
+        if (head + 1 > begin + BUFFER_SIZE) {
+            const quint64 stale = qMin(head + 1 - BUFFER_SIZE - begin, quint64(events.size()));
+            events.remove(0, int(stale));
+        }
+        Q_FOREACH(const Event &e, events) {
+            json += ",\n{\"name\":\"" + QByteArray(e.name) + "\",\"ph\":\"" + e.phase + "\",\"pid\":" + pid
+                    + ",\"tid\":" + tid + ",\"ts\":" + QByteArray::number(e.timestamp);
+            if (e.phase == 'X') {
+                json += ",\"dur\":" + QByteArray::number(e.duration);
+                if (e.id) {
+                    json += ",\"args\":{\"id\":" + hexId(e.id) + "}";
+                }
+            } else {
+                json += ",\"cat\":\"action\",\"id\":" + hexId(e.id);
+            }
+            json += '}';
+        }
+    }
+    lock.unlock();
+    json += "\n]}\n";
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+        qWarning() << "[Trace] Unable to write" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+qint64 Trace::now()
+{
+    // CLOCK_MONOTONIC with libstdc++, shared by every process on the machine
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::complete(const char *name, const qint64 &start, const qint64 &end, const quint64 &id)
+{
+    record(name, 'X', start, end - start, id);
+}
+
+void Trace::asyncBegin(const char *name, const quint64 &id)
+{
+    record(name, 'b', now(), 0, id);
+}
+
+void Trace::asyncEnd(const char *name, const quint64 &id)
+{
+    record(name, 'e', now(), 0, id);
+}
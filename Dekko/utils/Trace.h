@@ -0,0 +1,106 @@
+/* Copyright (C) 2017 Dan Chapman <dpniel@ubuntu.com>
+
+   This file is part of Dekko email client for Ubuntu devices
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QtGlobal>
+
+/** @short Lightweight spans for finding where the time goes
+ *
+ * Events go into a fixed size ring buffer owned by the recording thread, so
+ * recording never takes a lock or allocates once a thread has its buffer.
+ * When a buffer fills the oldest events are overwritten. Names must be string
+ * literals, only the pointer is stored.
+ *
+ * Each process writes its own file in the Chrome trace event format, which
+ * chrome://tracing and ui.perfetto.dev both open. Timestamps come from the
+ * system wide monotonic clock so the files from the app, the worker and dekkod
+ * line up with each other.
+ *
+ * Spans can carry an id. Service actions use the QMF action id, whose high 32
+ * bits are the pid of the process that requested it, so an action in dekkod can
+ * be matched to the worker calls that started it.
+ *
+ * Tracing is off unless the app was started with -v or -d, which turns it on
+ * for the child processes too. Build with DEKKO_NO_TRACING to remove the macros
+ * altogether.
+ */
+class Trace
+{
+public:
+    static bool enabled();
+    static void setEnabled(const bool enabled);
+
+    /** @short Turn tracing on and have child processes do the same
+     *
+     * Traces are written to \param directory every so often and on exit.
+     * Only the newest few files are kept there, older runs are removed.
+     */
+    static void start(const QString &processName, const QString &directory);
+    /** @short Start tracing if the parent process asked for it */
+    static void startFromEnvironment(const QString &processName);
+
+    /** @short Write everything still in the buffers to \param filePath */
+    static bool write(const QString &filePath);
+    /** @short Write to the file for this process in the trace directory */
+    static bool flush();
+
+    // Microseconds on the monotonic clock
+    static qint64 now();
+    static void complete(const char *name, const qint64 &start, const qint64 &end, const quint64 &id);
+    static void asyncBegin(const char *name, const quint64 &id);
+    static void asyncEnd(const char *name, const quint64 &id);
+};
+
+/** @short Records a span from construction to destruction */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const quint64 &id = 0) :
+        m_name(Trace::enabled() ? name : 0), m_id(id), m_start(m_name ? Trace::now() : 0) {}
+    ~TraceSpan() {
+        if (m_name) {
+            Trace::complete(m_name, m_start, Trace::now(), m_id);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+    const char *m_name;
+    const quint64 m_id;
+    const qint64 m_start;
+};
+
+#ifndef DEKKO_NO_TRACING
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Span for the rest of the enclosing scope
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(_traceSpan, __LINE__)(name)
+#define TRACE_ACTION_SPAN(name, id) TraceSpan TRACE_CONCAT(_traceSpan, __LINE__)(name, id)
+// Span that starts and finishes in different places, i.e a service action
+#define TRACE_ACTION_BEGIN(name, id) do { if (Trace::enabled()) Trace::asyncBegin(name, id); } while (0)
+#define TRACE_ACTION_END(name, id) do { if (Trace::enabled()) Trace::asyncEnd(name, id); } while (0)
+#else
+#define TRACE_SPAN(name) do {} while (0)
+#define TRACE_ACTION_SPAN(name, id) do { Q_UNUSED(id); } while (0)
+#define TRACE_ACTION_BEGIN(name, id) do { Q_UNUSED(id); } while (0)
+#define TRACE_ACTION_END(name, id) do { Q_UNUSED(id); } while (0)
+#endif
+
+#endif // TRACE_H
@@ -118,6 +118,11 @@ AppListener {
         }
     }
 
+    Filter {
+        type: MessageKeys.setMessageListVisibleRange
+        onDispatched: MailStore.msgList.setVisibleRange(message.first, message.last)
+    }
+
     Filter {
         type: MessageKeys.setMessageCheck
         onDispatched: {
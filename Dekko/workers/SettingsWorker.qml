@@ -123,6 +123,14 @@ AppListener {
         }
     }
 
+    Filter {
+        type: SettingsKeys.clearCache
+        onDispatched: {
+            Log.logInfo("SettingsWorker::clearCache", "Clearing cache: %1".arg(message.name))
+            CacheManager.clear(message.name)
+        }
+    }
+
     AppScript {
         property string pickerId: "settings-mbox-picker"
         property string fieldId: ""